@@ -0,0 +1,416 @@
+//-------------------------------------------------------------------
+//
+// analysis.cpp
+//
+// C++ module for analyzing an audio waveform in short frames.  The
+// statistics from each frame are kept in a table that the
+// segmentation and normalization code can share, so the audio
+// samples only need to be examined once.
+//
+//-------------------------------------------------------------------
+//
+// (C) Copyright 2024 Ammon R. Campbell.
+//
+// I wrote this code for use in my own educational and experimental
+// programs, but you may also freely use it in yours as long as you
+// abide by the following terms and conditions:
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following
+//     disclaimer in the documentation and/or other materials
+//     provided with the distribution.
+//   * The name(s) of the author(s) and contributors (if any) may not
+//     be used to endorse or promote products derived from this
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+// CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+// OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.  IN OTHER WORDS, USE AT YOUR OWN RISK, NOT OURS.  
+//--------------------------------------------------------------------
+
+#include "analysis.h"
+#include "loudness.h"
+
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define USE_SSE2
+#endif
+
+// Calculates the statistics for a frame of samples.
+template <typename Count>
+static FrameStats analyze_frame(const float *data, Count count)
+{
+    FrameAccumulator acc;
+    for (size_t isample = 0; isample < count; isample++)
+        acc.Add(data[isample]);
+
+    return acc.Stats();
+}
+
+FrameStats FrameAccumulator::Stats() const
+{
+    FrameStats stats;
+    if (m_min > m_max)
+        return stats; // No samples.
+
+    stats.m_sum = m_sum;
+    stats.m_sum_squares = m_sum_squares;
+    stats.m_min = m_min;
+    stats.m_max = m_max;
+    stats.m_peak = (-m_min > m_max) ? -m_min : m_max;
+    return stats;
+}
+
+void FrameStats::Combine(const FrameStats &other)
+{
+    m_sum += other.m_sum;
+    m_sum_squares += other.m_sum_squares;
+    if (other.m_min < m_min)
+        m_min = other.m_min;
+    if (other.m_max > m_max)
+        m_max = other.m_max;
+    if (other.m_peak > m_peak)
+        m_peak = other.m_peak;
+}
+
+unsigned SamplesPerFrame(unsigned frequency)
+{
+    return (frequency >= 100) ? frequency / 100 : 1;
+}
+
+void AnalysisTable::Reset(unsigned frequency, size_t sample_count)
+{
+    *this = AnalysisTable();
+    m_frequency = frequency;
+    m_samples_per_frame = SamplesPerFrame(frequency);
+    m_frames.resize(sample_count / m_samples_per_frame);
+    m_remainder_count = static_cast<unsigned>(sample_count % m_samples_per_frame);
+}
+
+FrameStats AnalysisTable::CombineFrames(size_t first_frame, size_t num_frames) const
+{
+    if (first_frame >= m_frames.size() || !num_frames)
+        return FrameStats();
+    if (first_frame + num_frames > m_frames.size())
+        num_frames = m_frames.size() - first_frame;
+
+    FrameStats stats = m_frames[first_frame];
+    for (size_t iframe = first_frame + 1; iframe < first_frame + num_frames; iframe++)
+        stats.Combine(m_frames[iframe]);
+
+    return stats;
+}
+
+void AnalysisTable::FindMinMaxSamples(float &smin, float &smax) const
+{
+    if (m_frames.empty() && !m_remainder_count)
+    {
+        smin = smax = 0.f;
+        return;
+    }
+
+    FrameStats stats = m_frames.empty() ? m_remainder : CombineFrames(0, m_frames.size());
+    if (m_remainder_count)
+        stats.Combine(m_remainder);
+
+    smin = stats.m_min;
+    smax = stats.m_max;
+}
+
+// Calculates the exact integer sum, sum of squares, minimum and
+// maximum of a frame of 16-bit samples.
+template <typename Count>
+static void analyze_frame_pcm16(const int16_t *data, Count count,
+    int64_t &sum, int64_t &sum_squares, int16_t &smin, int16_t &smax)
+{
+    size_t isample = 0;
+    sum = 0;
+    sum_squares = 0;
+    smin = INT16_MAX;
+    smax = INT16_MIN;
+
+#ifdef USE_SSE2
+    //
+    // Process eight samples at a time.  The multiply-add
+    // instruction multiplies pairs of samples and adds each pair's
+    // products together, giving 32-bit results.  Multiplying by
+    // ones gives the sums of pairs of samples, which can be added
+    // up in 32 bits for a whole frame.  Multiplying the samples by
+    // themselves gives the sums of pairs of squares, which can be
+    // as big as 2^31, so those are treated as unsigned and widened
+    // to 64 bits before being added up.
+    //
+    const __m128i ones = _mm_set1_epi16(1);
+    const __m128i zero = _mm_setzero_si128();
+    __m128i vsum = zero;
+    __m128i vsquares_lo = zero;
+    __m128i vsquares_hi = zero;
+    __m128i vmin = _mm_set1_epi16(INT16_MAX);
+    __m128i vmax = _mm_set1_epi16(INT16_MIN);
+    for (; isample + 8 <= count; isample += 8)
+    {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + isample));
+        vsum = _mm_add_epi32(vsum, _mm_madd_epi16(x, ones));
+        __m128i squares = _mm_madd_epi16(x, x);
+        vsquares_lo = _mm_add_epi64(vsquares_lo, _mm_unpacklo_epi32(squares, zero));
+        vsquares_hi = _mm_add_epi64(vsquares_hi, _mm_unpackhi_epi32(squares, zero));
+        vmin = _mm_min_epi16(vmin, x);
+        vmax = _mm_max_epi16(vmax, x);
+    }
+
+    alignas(16) int32_t sums[4];
+    alignas(16) int64_t squares[4];
+    alignas(16) int16_t mins[8], maxs[8];
+    _mm_store_si128(reinterpret_cast<__m128i *>(sums), vsum);
+    _mm_store_si128(reinterpret_cast<__m128i *>(&squares[0]), vsquares_lo);
+    _mm_store_si128(reinterpret_cast<__m128i *>(&squares[2]), vsquares_hi);
+    _mm_store_si128(reinterpret_cast<__m128i *>(mins), vmin);
+    _mm_store_si128(reinterpret_cast<__m128i *>(maxs), vmax);
+    for (int i = 0; i < 4; i++)
+    {
+        sum += sums[i];
+        sum_squares += squares[i];
+    }
+    for (int i = 0; i < 8; i++)
+    {
+        if (mins[i] < smin)
+            smin = mins[i];
+        if (maxs[i] > smax)
+            smax = maxs[i];
+    }
+#endif
+
+    // Process any remaining samples one at a time.
+    for (; isample < count; isample++)
+    {
+        const int32_t sample = data[isample];
+        sum += sample;
+        sum_squares += sample * sample;
+        if (sample < smin)
+            smin = static_cast<int16_t>(sample);
+        if (sample > smax)
+            smax = static_cast<int16_t>(sample);
+    }
+}
+
+// Converts the integer statistics for a frame of 16-bit samples to
+// the same statistics the samples would have as floating-point
+// values between -1.0 and +1.0.  All of these values can be
+// represented exactly, so there is no rounding.
+static FrameStats pcm16_frame_stats(int64_t sum, int64_t sum_squares, int16_t smin, int16_t smax)
+{
+    FrameStats stats;
+    stats.m_sum = sum / 32768.0;
+    stats.m_sum_squares = sum_squares / 1073741824.0;
+    stats.m_min = smin / 32768.f;
+    stats.m_max = smax / 32768.f;
+    stats.m_peak = (-stats.m_min > stats.m_max) ? -stats.m_min : stats.m_max;
+    return stats;
+}
+
+// Calculates the statistics for a frame of samples, and feeds the
+// frame to the loudness meter (if any) while its samples are still
+// in the cache.  Samples that aren't floating-point are converted
+// into the given buffer first.
+template <typename SampleT, typename Count>
+static FrameStats analyze_frame(const SampleT *frame, Count count, std::vector<float> &buffer, LoudnessMeter *meter)
+{
+    const float *data = SamplesAsFloat(frame, count, buffer);
+    if (meter)
+        meter->Process(data, count);
+    return analyze_frame(data, count);
+}
+
+// 16-bit integer samples are analyzed as integers.  Only the
+// loudness meter needs them converted to floating-point.
+template <typename Count>
+static FrameStats analyze_frame(const int16_t *frame, Count count, std::vector<float> &buffer, LoudnessMeter *meter)
+{
+    if (meter)
+        meter->Process(SamplesAsFloat(frame, count, buffer), count);
+
+    int64_t sum = 0, sum_squares = 0;
+    int16_t smin = 0, smax = 0;
+    analyze_frame_pcm16(frame, count, sum, sum_squares, smin, smax);
+    return pcm16_frame_stats(sum, sum_squares, smin, smax);
+}
+
+// Fills in the table of statistics for each frame of a buffer of
+// samples, which has already been sized for the samples.
+template <typename SampleT, typename FrameSize>
+static void analyze_frames(const SampleT *samples, FrameSize samples_per_frame,
+    AnalysisTable &table, LoudnessMeter *meter)
+{
+    const size_t num_frames = table.m_frames.size();
+    std::vector<float> buffer;
+
+    // Analyze each full frame.
+    for (size_t iframe = 0; iframe < num_frames; iframe++)
+        table.m_frames[iframe] = analyze_frame(&samples[iframe * samples_per_frame], samples_per_frame, buffer, meter);
+
+    // Analyze the partial frame at the end of the waveform, if any.
+    if (table.m_remainder_count)
+    {
+        const size_t count = table.m_remainder_count;
+        table.m_remainder = analyze_frame(&samples[num_frames * samples_per_frame], count, buffer, meter);
+    }
+}
+
+// Fills in the table of statistics for each frame of a buffer of
+// samples.  If a loudness meter is given, the samples are also fed
+// through it at the same time.
+template <typename SampleT>
+static void analyze_samples(const SampleT *samples, size_t num_samples, unsigned frequency,
+    AnalysisTable &table, LoudnessMeter *meter)
+{
+    table.Reset(frequency, num_samples);
+    WithFrameSize(table.m_samples_per_frame, [&](auto samples_per_frame)
+    {
+        analyze_frames(samples, samples_per_frame, table, meter);
+    });
+}
+
+// Examines a buffer of 16-bit mono PCM samples and fills in the
+// table of statistics for each of its frames, working directly on
+// the integer samples.
+void AnalyzePCM16(const int16_t *samples, size_t num_samples, unsigned frequency,
+    AnalysisTable &table, LoudnessMeter *meter)
+{
+    if (meter)
+        meter->Reset(frequency);
+    analyze_samples(samples, num_samples, frequency, table, meter);
+}
+
+// Examines an audio waveform and fills in the table of statistics
+// for each of its frames.  If a loudness meter is given, the
+// waveform is also fed through it at the same time.
+template <typename SampleT>
+void AnalyzeAudioWaveform(const BasicWaveform<SampleT> &wav, AnalysisTable &table, LoudnessMeter *meter)
+{
+    analyze_samples(wav.m_data.data(), wav.m_data.size(), wav.m_frequency, table, meter);
+}
+
+template void AnalyzeAudioWaveform(const Waveform &wav, AnalysisTable &table, LoudnessMeter *meter);
+template void AnalyzeAudioWaveform(const Waveform16 &wav, AnalysisTable &table, LoudnessMeter *meter);
+template void AnalyzeAudioWaveform(const WaveformHalf &wav, AnalysisTable &table, LoudnessMeter *meter);
+
+// Examines a range of mono samples and fills in the table of
+// statistics for each of its frames.
+template <typename SampleT>
+void AnalyzeSamples(const SampleT *samples, size_t num_samples, unsigned frequency,
+    AnalysisTable &table, LoudnessMeter *meter)
+{
+    analyze_samples(samples, num_samples, frequency, table, meter);
+}
+
+template void AnalyzeSamples(const float *samples, size_t num_samples, unsigned frequency,
+    AnalysisTable &table, LoudnessMeter *meter);
+template void AnalyzeSamples(const int16_t *samples, size_t num_samples, unsigned frequency,
+    AnalysisTable &table, LoudnessMeter *meter);
+template void AnalyzeSamples(const Half *samples, size_t num_samples, unsigned frequency,
+    AnalysisTable &table, LoudnessMeter *meter);
+
+// Reads a WAV file and fills in the table of statistics for each of
+// its frames, without keeping the audio in memory as a floating-
+// point waveform.
+bool AnalyzeWAVFile(const wchar_t *filename, AnalysisTable &table, WAVInfo &header, LoudnessMeter *meter)
+{
+    if (!WAVFileReadHeader(filename, header))
+        return false;
+
+    // Anything other than 16-bit mono gets converted the usual way.
+    if (header.m_bits != 16 || header.m_is_float || header.m_channels != 1)
+    {
+        Waveform wav;
+        return wav.LoadFromWAVFile(filename, &table, meter);
+    }
+
+    std::vector<int16_t> samples(header.m_sample_count);
+    if (!samples.empty() && !WAVFileReadSamples(filename, samples.data(), samples.size() * sizeof(int16_t)))
+        return false;
+
+    AnalyzePCM16(samples.data(), samples.size(), header.m_rate, table, meter);
+    return true;
+}
+
+// Fills in the table of statistics for the samples of a WAV file
+// that have already been read into memory.
+void AnalyzeWAVData(const void *samples, const WAVInfo &header, AnalysisTable &table, LoudnessMeter *meter)
+{
+    if (header.m_bits != 16 || header.m_is_float || header.m_channels != 1)
+    {
+        Waveform wav;
+        wav.LoadFromWAVData(samples, header, &table, meter);
+        return;
+    }
+
+    AnalyzePCM16(static_cast<const int16_t *>(samples), header.m_sample_count, header.m_rate, table, meter);
+}
+
+// Returns the energy of a frame, not counting any DC offset.
+static double frame_energy(const FrameStats &stats, size_t count)
+{
+    return count ? stats.m_sum_squares - stats.m_sum * stats.m_sum / count : 0.0;
+}
+
+bool CombineTrackAnalysis(const std::vector<AnalysisTable> &tracks, AnalysisTable &combined)
+{
+    if (tracks.empty())
+        return false;
+
+    size_t sample_count = tracks[0].SampleCount();
+    for (const AnalysisTable &track : tracks)
+    {
+        if (track.m_frequency != tracks[0].m_frequency)
+            return false;
+        if (track.SampleCount() < sample_count)
+            sample_count = track.SampleCount();
+    }
+
+    combined.Reset(tracks[0].m_frequency, sample_count);
+    for (size_t iframe = 0; iframe < combined.m_frames.size(); iframe++)
+    {
+        double loudest = -1.0;
+        for (const AnalysisTable &track : tracks)
+        {
+            double energy = frame_energy(track.m_frames[iframe], combined.m_samples_per_frame);
+            if (energy > loudest)
+            {
+                loudest = energy;
+                combined.m_frames[iframe] = track.m_frames[iframe];
+            }
+        }
+    }
+
+    // The partial frame at the end can only come from the tracks
+    // that end there.
+    double loudest = -1.0;
+    for (const AnalysisTable &track : tracks)
+    {
+        if (track.SampleCount() != sample_count || !track.m_remainder_count)
+            continue;
+        double energy = frame_energy(track.m_remainder, track.m_remainder_count);
+        if (energy > loudest)
+        {
+            loudest = energy;
+            combined.m_remainder = track.m_remainder;
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,207 @@
+//-------------------------------------------------------------------
+//
+// analysis.h
+//
+// Header of C++ module for analyzing an audio waveform in short
+// frames.  The statistics from each frame are kept in a table that
+// the segmentation and normalization code can share, so the audio
+// samples only need to be examined once.
+//
+//-------------------------------------------------------------------
+//
+// (C) Copyright 2024 Ammon R. Campbell.
+//
+// I wrote this code for use in my own educational and experimental
+// programs, but you may also freely use it in yours as long as you
+// abide by the following terms and conditions:
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following
+//     disclaimer in the documentation and/or other materials
+//     provided with the distribution.
+//   * The name(s) of the author(s) and contributors (if any) may not
+//     be used to endorse or promote products derived from this
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+// CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+// OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.  IN OTHER WORDS, USE AT YOUR OWN RISK, NOT OURS.  
+//--------------------------------------------------------------------
+
+#pragma once
+#include "waveform.h"
+#include <float.h>
+#include <stdint.h>
+#include <type_traits>
+
+class LoudnessMeter;
+
+// Statistics about the samples in one frame of an audio waveform
+// (or in several consecutive frames combined).
+struct FrameStats
+{
+    double m_sum = 0;           // Sum of the sample values.
+    double m_sum_squares = 0;   // Sum of the squares of the sample values.
+    float m_min = 0;            // Lowest sample value.
+    float m_max = 0;            // Highest sample value.
+    float m_peak = 0;           // Highest absolute sample value.
+
+    // Adds the statistics from another frame to this one.
+    void Combine(const FrameStats &other);
+};
+
+// Accumulates the statistics for a frame one sample at a time, for
+// code that is producing the samples itself (such as the code that
+// converts samples while loading a WAV file).  This is kept inline
+// so the running totals can stay in registers.
+struct FrameAccumulator
+{
+    void Add(float sample)
+    {
+        m_sum += sample;
+        m_sum_squares += static_cast<double>(sample) * sample;
+        if (sample < m_min)
+            m_min = sample;
+        if (sample > m_max)
+            m_max = sample;
+    }
+
+    // Returns the statistics for the samples added so far.
+    FrameStats Stats() const;
+
+    double m_sum = 0;
+    double m_sum_squares = 0;
+    float m_min = FLT_MAX;
+    float m_max = -FLT_MAX;
+};
+
+// The number of samples in a frame.  The common frame sizes are
+// given to the analysis code as compile-time constants, so the
+// compiler can build a version of the inner loops for each one
+// with a fixed trip count (and no guessing about the tail end of
+// the SIMD loops).  Other frame sizes are given as a plain size_t.
+template <size_t N>
+using FixedFrameSize = std::integral_constant<size_t, N>;
+
+// Calls 'func(samples_per_frame)' with the frame size as a
+// FixedFrameSize if it's one of the common sizes, or as a plain
+// size_t if it isn't.
+template <typename Func>
+void WithFrameSize(size_t samples_per_frame, Func func)
+{
+    switch (samples_per_frame)
+    {
+    case 80:    // 8 KHz
+        func(FixedFrameSize<80>());
+        break;
+    case 160:   // 16 KHz
+        func(FixedFrameSize<160>());
+        break;
+    case 220:   // 22.05 KHz
+        func(FixedFrameSize<220>());
+        break;
+    case 441:   // 44.1 KHz
+        func(FixedFrameSize<441>());
+        break;
+    case 480:   // 48 KHz
+        func(FixedFrameSize<480>());
+        break;
+    default:
+        func(samples_per_frame);
+        break;
+    }
+}
+
+// Returns the number of samples in each 10 millisecond analysis
+// frame (see AnalysisTable) at the given sample frequency.
+unsigned SamplesPerFrame(unsigned frequency);
+
+// Table of statistics for each 10 millisecond frame of an audio
+// waveform.
+struct AnalysisTable
+{
+    // Clears the table and sizes it for a waveform with the given
+    // sample frequency and number of samples.
+    void Reset(unsigned frequency, size_t sample_count);
+
+    // Combines the statistics from several consecutive frames.
+    FrameStats CombineFrames(size_t first_frame, size_t num_frames) const;
+
+    // Finds the lowest and highest sample values in the waveform.
+    void FindMinMaxSamples(float &smin, float &smax) const;
+
+    // Returns the number of samples in the waveform.
+    size_t SampleCount() const { return m_frames.size() * m_samples_per_frame + m_remainder_count; }
+
+    unsigned m_frequency = 48000;       // Sample frequency in Hertz.
+    unsigned m_samples_per_frame = 480; // Number of samples in each frame.
+    std::vector<FrameStats> m_frames;   // Statistics for each full frame.
+    FrameStats m_remainder;             // Statistics for the partial frame at the end.
+    unsigned m_remainder_count = 0;     // Number of samples in the partial frame.
+};
+
+// Examines an audio waveform and fills in the table of statistics
+// for each of its frames.  If a loudness meter is given, the
+// waveform is also fed through it at the same time.  Waveforms of
+// 16-bit integer samples are analyzed with AnalyzePCM16.
+template <typename SampleT>
+void AnalyzeAudioWaveform(const BasicWaveform<SampleT> &wav, AnalysisTable &table, LoudnessMeter *meter = nullptr);
+
+// The same as AnalyzeAudioWaveform, for a range of mono samples that
+// isn't held in a waveform of its own, such as part of a larger
+// waveform.
+template <typename SampleT>
+void AnalyzeSamples(const SampleT *samples, size_t num_samples, unsigned frequency,
+    AnalysisTable &table, LoudnessMeter *meter = nullptr);
+
+// Examines a buffer of 16-bit mono PCM samples and fills in the
+// table of statistics for each of its frames, working directly on
+// the integer samples.  The sums are calculated exactly, so the
+// table is identical to the one AnalyzeAudioWaveform would make
+// after converting the samples to floating-point.  If a loudness
+// meter is given, the samples are also fed through it.
+void AnalyzePCM16(const int16_t *samples, size_t num_samples, unsigned frequency,
+    AnalysisTable &table, LoudnessMeter *meter = nullptr);
+
+// Reads a WAV file and fills in the table of statistics for each of
+// its frames, without keeping the audio in memory as a floating-
+// point waveform.  16-bit mono files are analyzed directly from the
+// file's samples, which uses half the memory of converting them.
+// Other formats are converted and analyzed the usual way.  The
+// file's header is also returned.  If a loudness meter is given,
+// it is reset and the samples are also fed through it.
+// Returns true if successful.
+bool AnalyzeWAVFile(const wchar_t *filename, AnalysisTable &table, WAVInfo &header,
+    LoudnessMeter *meter = nullptr);
+
+// Fills in the table of statistics for the samples of a WAV file
+// that have already been read into memory (with WAVFileReadHeader
+// and WAVFileReadSamples), the same way as AnalyzeWAVFile.
+void AnalyzeWAVData(const void *samples, const WAVInfo &header, AnalysisTable &table,
+    LoudnessMeter *meter = nullptr);
+
+// Combines the tables for several sample-aligned tracks of the same
+// recording (such as one track per microphone), so the tracks can be
+// segmented together.  Each frame of the combined table gets the
+// statistics of whichever track has the most energy in that frame,
+// so a part of the recording counts as loud if it's loud in any of
+// the tracks.  The tracks must have the same sample frequency.  If
+// their lengths differ, the combined table is as long as the
+// shortest track.
+// Returns false if the tables can't be combined.
+bool CombineTrackAnalysis(const std::vector<AnalysisTable> &tracks, AnalysisTable &combined);
@@ -0,0 +1,241 @@
+//-------------------------------------------------------------------
+//
+// analysis_test.cpp
+//
+// Simple test of the analysis.cpp module.  Generates a waveform of
+// random noise, analyzes it, then confirms that the statistics in
+// the analysis table match statistics calculated directly from the
+// samples.  Also checks that analyzing a WAV file while loading it
+// gives the same table as analyzing it afterward.
+//
+//-------------------------------------------------------------------
+//
+// (C) Copyright 2024 Ammon R. Campbell.
+//
+// I wrote this code for use in my own educational and experimental
+// programs, but you may also freely use it in yours as long as you
+// abide by the following terms and conditions:
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following
+//     disclaimer in the documentation and/or other materials
+//     provided with the distribution.
+//   * The name(s) of the author(s) and contributors (if any) may not
+//     be used to endorse or promote products derived from this
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+// CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+// OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.  IN OTHER WORDS, USE AT YOUR OWN RISK, NOT OURS.  
+//--------------------------------------------------------------------
+
+#include "waveform.h"
+#include "analysis.h"
+#include "segment.h"
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <math.h>
+#include <vector>
+
+// Checks that a statistic from the analysis table is close to the
+// value calculated directly from the samples.
+static bool check_stat(const char *what, size_t iframe, double table_value, double expected)
+{
+    if (fabs(table_value - expected) > 1e-6 * (1.0 + fabs(expected)))
+    {
+        printf("Frame %zu %s doesn't match!\n", iframe, what);
+        printf("  Expected:  %f\n", expected);
+        printf("  Table:     %f\n", table_value);
+        return false;
+    }
+
+    return true;
+}
+
+bool test_analysis()
+{
+    printf("Starting audio analysis test\n");
+
+    // Generate a few seconds of random noise, with a partial frame
+    // at the end.
+    Waveform wav;
+    wav.m_frequency = 44100;
+    wav.m_data.resize(wav.m_frequency * 3 + 123);
+    for (float &sample : wav.m_data)
+        sample = (rand() % 20001 - 10000) / 10000.0f;
+
+    AnalysisTable table;
+    AnalyzeAudioWaveform(wav, table);
+    if (table.m_samples_per_frame != 441 ||
+        table.m_frames.size() != 300 ||
+        table.m_remainder_count != 123)
+    {
+        printf("Analysis table has the wrong size!\n");
+        return false;
+    }
+
+    // Compare each frame's statistics to the samples.
+    for (size_t iframe = 0; iframe < table.m_frames.size(); iframe++)
+    {
+        const FrameStats &stats = table.m_frames[iframe];
+        double sum = 0.0, sum_squares = 0.0;
+        float smin = 1.0f, smax = -1.0f;
+        for (unsigned i = 0; i < table.m_samples_per_frame; i++)
+        {
+            float sample = wav.m_data[iframe * table.m_samples_per_frame + i];
+            sum += sample;
+            sum_squares += sample * sample;
+            smin = (sample < smin) ? sample : smin;
+            smax = (sample > smax) ? sample : smax;
+        }
+
+        if (!check_stat("sum", iframe, stats.m_sum, sum) ||
+            !check_stat("sum of squares", iframe, stats.m_sum_squares, sum_squares) ||
+            !check_stat("min", iframe, stats.m_min, smin) ||
+            !check_stat("max", iframe, stats.m_max, smax) ||
+            !check_stat("peak", iframe, stats.m_peak, (-smin > smax) ? -smin : smax))
+            return false;
+    }
+
+    // The minimum and maximum of the whole table should match the
+    // minimum and maximum of the waveform.
+    float smin = 0, smax = 0, table_min = 0, table_max = 0;
+    wav.FindMinMaxSamples(smin, smax);
+    table.FindMinMaxSamples(table_min, table_max);
+    if (smin != table_min || smax != table_max)
+    {
+        printf("Analysis table min/max doesn't match the waveform!\n");
+        return false;
+    }
+
+    printf("Analysis test OK.\n");
+    return true;
+}
+
+bool test_analysis_during_load(wchar_t *filename)
+{
+    printf("Starting analysis during load test with '%S'\n", filename);
+
+    // Load the WAV file, analyzing it as it's loaded.
+    Waveform wav;
+    AnalysisTable fused;
+    if (!wav.LoadFromWAVFile(filename, &fused))
+    {
+        printf("LoadFromWAVFile failed reading '%S'\n", filename);
+        return false;
+    }
+
+    // Analyze it again the usual way.
+    AnalysisTable separate;
+    AnalyzeAudioWaveform(wav, separate);
+
+    if (fused.m_samples_per_frame != separate.m_samples_per_frame ||
+        fused.m_frames.size() != separate.m_frames.size() ||
+        fused.m_remainder_count != separate.m_remainder_count)
+    {
+        printf("Analysis tables have different sizes!\n");
+        return false;
+    }
+
+    for (size_t iframe = 0; iframe <= fused.m_frames.size(); iframe++)
+    {
+        bool remainder = (iframe == fused.m_frames.size());
+        const FrameStats &a = remainder ? fused.m_remainder : fused.m_frames[iframe];
+        const FrameStats &b = remainder ? separate.m_remainder : separate.m_frames[iframe];
+        if (a.m_sum != b.m_sum || a.m_sum_squares != b.m_sum_squares ||
+            a.m_min != b.m_min || a.m_max != b.m_max || a.m_peak != b.m_peak)
+        {
+            printf("Analysis tables don't match at frame %zu!\n", iframe);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Makes a track of quiet noise with a loud burst of noise starting
+// at 'burst_start' seconds.
+static Waveform make_track(unsigned frequency, float burst_start)
+{
+    Waveform wav;
+    wav.m_frequency = frequency;
+    wav.m_data.resize(frequency * 4);
+    for (size_t isample = 0; isample < wav.m_data.size(); isample++)
+    {
+        float seconds = static_cast<float>(isample) / frequency;
+        float level = (seconds >= burst_start && seconds < burst_start + 0.6f) ? 0.5f : 0.001f;
+        wav.m_data[isample] = level * (rand() % 20001 - 10000) / 10000.0f;
+    }
+    return wav;
+}
+
+bool test_track_analysis()
+{
+    printf("Starting multitrack analysis test\n");
+
+    // Two tracks, each with speech (noise) at a different time.
+    std::vector<AnalysisTable> tables(2);
+    Waveform track1 = make_track(16000, 0.5f);
+    Waveform track2 = make_track(16000, 2.5f);
+    AnalyzeAudioWaveform(track1, tables[0]);
+    AnalyzeAudioWaveform(track2, tables[1]);
+
+    AnalysisTable combined;
+    if (!CombineTrackAnalysis(tables, combined) || combined.SampleCount() != track1.m_data.size())
+    {
+        printf("CombineTrackAnalysis failed!\n");
+        return false;
+    }
+
+    // Each frame should come from the louder track.
+    for (size_t iframe = 0; iframe < combined.m_frames.size(); iframe++)
+    {
+        const FrameStats &a = tables[0].m_frames[iframe];
+        const FrameStats &b = tables[1].m_frames[iframe];
+        const double n = combined.m_samples_per_frame;
+        const FrameStats &expected =
+            (a.m_sum_squares - a.m_sum * a.m_sum / n >= b.m_sum_squares - b.m_sum * b.m_sum / n) ? a : b;
+        if (combined.m_frames[iframe].m_sum_squares != expected.m_sum_squares)
+        {
+            printf("Combined frame %zu isn't from the louder track!\n", iframe);
+            return false;
+        }
+    }
+
+    // Segmenting the combined table should find both bursts.
+    auto segments = FindSegmentsInAudioWaveform(combined);
+    if (segments.size() != 2 ||
+        segments[0].m_start > 8000 || segments[0].m_start + segments[0].m_count < 17600 ||
+        segments[1].m_start > 40000 || segments[1].m_start + segments[1].m_count < 49600)
+    {
+        printf("Combined tracks have the wrong segments!\n");
+        return false;
+    }
+
+    // Tracks with different sample rates can't be combined.
+    AnalyzeAudioWaveform(make_track(8000, 1.0f), tables[1]);
+    if (CombineTrackAnalysis(tables, combined))
+    {
+        printf("CombineTrackAnalysis combined different sample rates!\n");
+        return false;
+    }
+
+    printf("Multitrack analysis test OK.\n");
+    return true;
+}
@@ -0,0 +1,417 @@
+//-------------------------------------------------------------------
+//
+// cache.cpp
+//
+// C++ module for a cache of the segments found in WAV files, so a
+// file that's the same as one processed before can have its segment
+// files linked instead of being processed again.  See cache.h for
+// more about it.
+//
+// Each entry is a text file named with a hash of its key, holding a
+// heading line, the key, a line with the sample rate, number of
+// samples and number of segments, and then a line for each segment
+// with its start, length, channel and loudness.  The entry's
+// segment files are named the same way, with "_seg" and the segment
+// number added.
+//
+//-------------------------------------------------------------------
+//
+// (C) Copyright 2024 Ammon R. Campbell.
+//
+// I wrote this code for use in my own educational and experimental
+// programs, but you may also freely use it in yours as long as you
+// abide by the following terms and conditions:
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following
+//     disclaimer in the documentation and/or other materials
+//     provided with the distribution.
+//   * The name(s) of the author(s) and contributors (if any) may not
+//     be used to endorse or promote products derived from this
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+// CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+// OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.  IN OTHER WORDS, USE AT YOUR OWN RISK, NOT OURS.  
+//--------------------------------------------------------------------
+
+#include "cache.h"
+#include "inputs.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <errno.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// The first line of every entry.
+static const char *k_entry_heading = "# splitspeech cache entry 1";
+
+// Largest line of an entry that's believed when it's read back.
+static const size_t k_max_entry_line = 64 * 1024;
+
+// The constants of the xxHash64 algorithm.
+static const uint64_t k_prime1 = 0x9E3779B185EBCA87ULL;
+static const uint64_t k_prime2 = 0xC2B2AE3D27D4EB4FULL;
+static const uint64_t k_prime3 = 0x165667B19E3779F9ULL;
+static const uint64_t k_prime4 = 0x85EBCA77C2B2AE63ULL;
+static const uint64_t k_prime5 = 0x27D4EB2F165667C5ULL;
+
+// Rotates a 64-bit value left by 'bits' bits.
+static inline uint64_t rotate_left(uint64_t value, unsigned bits)
+{
+    return (value << bits) | (value >> (64 - bits));
+}
+
+// Reads 8 bytes (in little-endian order) from an unaligned address.
+static inline uint64_t read64(const unsigned char *p)
+{
+    uint64_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+// Reads 4 bytes (in little-endian order) from an unaligned address.
+static inline uint32_t read32(const unsigned char *p)
+{
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+// Mixes 8 bytes of input into one of the hash's lanes.
+static inline uint64_t hash_round(uint64_t lane, uint64_t input)
+{
+    lane += input * k_prime2;
+    lane = rotate_left(lane, 31);
+    return lane * k_prime1;
+}
+
+// Folds one of the lanes into the hash.
+static inline uint64_t merge_lane(uint64_t hash, uint64_t lane)
+{
+    hash ^= hash_round(0, lane);
+    return hash * k_prime1 + k_prime4;
+}
+
+uint64_t HashContent(const void *data, size_t size)
+{
+    const unsigned char *p = static_cast<const unsigned char *>(data);
+    const unsigned char *end = p + size;
+    uint64_t hash = 0;
+
+    // The four lanes don't depend on each other, so the processor
+    // can work on all of them at once.
+    if (size >= 32)
+    {
+        uint64_t lane1 = k_prime1 + k_prime2;
+        uint64_t lane2 = k_prime2;
+        uint64_t lane3 = 0;
+        uint64_t lane4 = 0 - k_prime1;
+        for (const unsigned char *limit = end - 32; p <= limit; p += 32)
+        {
+            lane1 = hash_round(lane1, read64(p));
+            lane2 = hash_round(lane2, read64(p + 8));
+            lane3 = hash_round(lane3, read64(p + 16));
+            lane4 = hash_round(lane4, read64(p + 24));
+        }
+        hash = rotate_left(lane1, 1) + rotate_left(lane2, 7) + rotate_left(lane3, 12) + rotate_left(lane4, 18);
+        hash = merge_lane(hash, lane1);
+        hash = merge_lane(hash, lane2);
+        hash = merge_lane(hash, lane3);
+        hash = merge_lane(hash, lane4);
+    }
+    else
+    {
+        hash = k_prime5;
+    }
+    hash += static_cast<uint64_t>(size);
+
+    // Mix in the bytes that are left over.
+    for (; p + 8 <= end; p += 8)
+    {
+        hash ^= hash_round(0, read64(p));
+        hash = rotate_left(hash, 27) * k_prime1 + k_prime4;
+    }
+    if (p + 4 <= end)
+    {
+        hash ^= static_cast<uint64_t>(read32(p)) * k_prime1;
+        hash = rotate_left(hash, 23) * k_prime2 + k_prime3;
+        p += 4;
+    }
+    for (; p < end; p++)
+    {
+        hash ^= *p * k_prime5;
+        hash = rotate_left(hash, 11) * k_prime1;
+    }
+
+    // Spread every bit of the input across the whole hash.
+    hash ^= hash >> 33;
+    hash *= k_prime2;
+    hash ^= hash >> 29;
+    hash *= k_prime3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+#ifdef _WIN32
+
+// Creates a directory, unless it's already there.
+// Returns true if successful.
+static bool make_directory(const std::wstring &path)
+{
+    return CreateDirectoryW(path.c_str(), nullptr) || GetLastError() == ERROR_ALREADY_EXISTS;
+}
+
+// Makes a hard link named 'to' to the file 'from'.
+// Returns true if successful.
+static bool link_file(const std::wstring &from, const std::wstring &to)
+{
+    return CreateHardLinkW(to.c_str(), from.c_str(), nullptr) != 0;
+}
+
+// Renames a file, replacing any file that already has the new name.
+// Returns true if successful.
+static bool replace_file(const std::wstring &from, const std::wstring &to)
+{
+    return MoveFileExW(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+}
+
+#else
+
+// Creates a directory, unless it's already there.
+// Returns true if successful.
+static bool make_directory(const std::wstring &path)
+{
+    return mkdir(ToUTF8(path).c_str(), 0777) == 0 || errno == EEXIST;
+}
+
+// Makes a hard link named 'to' to the file 'from'.
+// Returns true if successful.
+static bool link_file(const std::wstring &from, const std::wstring &to)
+{
+    return link(ToUTF8(from).c_str(), ToUTF8(to).c_str()) == 0;
+}
+
+// Renames a file, replacing any file that already has the new name.
+// Returns true if successful.
+static bool replace_file(const std::wstring &from, const std::wstring &to)
+{
+    return rename(ToUTF8(from).c_str(), ToUTF8(to).c_str()) == 0;
+}
+
+#endif
+
+// Copies the file 'from' to a new file named 'to'.
+// Returns true if successful.
+static bool copy_file(const std::wstring &from, const std::wstring &to)
+{
+    FILE *in = nullptr;
+    if (_wfopen_s(&in, from.c_str(), L"rb") || !in)
+        return false;
+    FILE *out = nullptr;
+    if (_wfopen_s(&out, to.c_str(), L"wb") || !out)
+    {
+        fclose(in);
+        return false;
+    }
+
+    bool ok = true;
+    char buffer[64 * 1024];
+    size_t count = 0;
+    while (ok && (count = fread(buffer, 1, sizeof(buffer), in)) > 0)
+        ok = fwrite(buffer, 1, count, out) == count;
+    ok = ok && !ferror(in);
+    fclose(in);
+    if (fclose(out) != 0)
+        ok = false;
+    if (!ok)
+        _wunlink(to.c_str());
+    return ok;
+}
+
+// Gives the file 'from' a second name, 'to', replacing any file that
+// already has that name.  The file is hard linked if it can be, so
+// none of its data is copied, or copied if it can't (for example,
+// when the names are on different drives).
+// Returns true if successful.
+static bool link_or_copy_file(const std::wstring &from, const std::wstring &to)
+{
+    _wunlink(to.c_str());
+    return link_file(from, to) || copy_file(from, to);
+}
+
+// Reads a line of an entry, without the newline.
+// Returns false if there isn't a whole line.
+static bool read_line(FILE *fp, std::string &line)
+{
+    line.clear();
+    char buffer[1024];
+    while (fgets(buffer, sizeof(buffer), fp))
+    {
+        line += buffer;
+        if (line.back() == '\n')
+        {
+            line.pop_back();
+            if (!line.empty() && line.back() == '\r')
+                line.pop_back();
+            return true;
+        }
+        if (line.size() > k_max_entry_line)
+            return false;
+    }
+    return false;
+}
+
+bool ResultCache::Open(const wchar_t *directory)
+{
+    m_directory.clear();
+    if (!directory || !*directory || !make_directory(directory))
+        return false;
+
+#ifdef _WIN32
+    const wchar_t separator = L'\\';
+#else
+    const wchar_t separator = L'/';
+#endif
+    m_directory = directory;
+    if (m_directory.back() != L'/' && m_directory.back() != separator)
+        m_directory += separator;
+    return true;
+}
+
+std::wstring ResultCache::entry_filename(const std::string &key, const char *suffix) const
+{
+    char text[64];
+    snprintf(text, sizeof(text), "%016llx", static_cast<unsigned long long>(HashContent(key.data(), key.size())));
+    return m_directory + FromUTF8(text) + FromUTF8(suffix);
+}
+
+bool ResultCache::Find(const std::string &key, CacheEntry &entry) const
+{
+    if (!IsOpen() || key.find_first_of("\r\n") != std::string::npos)
+        return false;
+
+    FILE *fp = nullptr;
+    if (_wfopen_s(&fp, entry_filename(key, ".entry").c_str(), L"rb") || !fp)
+        return false;
+
+    std::string line;
+    unsigned long long sample_count = 0, num_segments = 0;
+    bool ok = read_line(fp, line) && line == k_entry_heading && read_line(fp, line) && line == key &&
+        read_line(fp, line) &&
+        sscanf(line.c_str(), "%u %llu %llu", &entry.m_frequency, &sample_count, &num_segments) == 3;
+    entry.m_sample_count = static_cast<size_t>(sample_count);
+    entry.m_segments.clear();
+    for (unsigned long long iseg = 0; ok && iseg < num_segments; iseg++)
+    {
+        unsigned long long start = 0, count = 0;
+        Segment segment;
+        ok = read_line(fp, line) &&
+            sscanf(line.c_str(), "%llu %llu %u %f", &start, &count, &segment.m_channel, &segment.m_loudness) == 4;
+        segment.m_start = static_cast<size_t>(start);
+        segment.m_count = static_cast<size_t>(count);
+        if (ok)
+            entry.m_segments.push_back(segment);
+    }
+    fclose(fp);
+
+    return ok && entry.m_frequency;
+}
+
+bool ResultCache::Restore(const std::string &key, const std::vector<std::wstring> &filenames) const
+{
+    if (!IsOpen())
+        return false;
+
+    for (size_t ifile = 0; ifile < filenames.size(); ifile++)
+    {
+        char suffix[64];
+        snprintf(suffix, sizeof(suffix), "_seg%zu.wav", ifile + 1);
+        if (!link_or_copy_file(entry_filename(key, suffix), filenames[ifile]))
+            return false;
+    }
+    return true;
+}
+
+bool ResultCache::Store(const std::string &key, const CacheEntry &entry, const std::vector<std::wstring> &filenames)
+{
+    if (!IsOpen() || key.find_first_of("\r\n") != std::string::npos)
+        return false;
+
+    // Claim the key, so no other thread stores it at the same time.
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_storing.insert(key).second)
+            return true;
+    }
+    const bool ok = store_entry(key, entry, filenames);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_storing.erase(key);
+    return ok;
+}
+
+bool ResultCache::store_entry(const std::string &key, const CacheEntry &entry,
+    const std::vector<std::wstring> &filenames) const
+{
+    // A whole entry is never changed, so a restore that's linking its
+    // files can't see them replaced.
+    CacheEntry existing;
+    if (Find(key, existing))
+        return true;
+
+    // An entry whose key has the same hash is removed before its
+    // segment files are replaced.
+    _wunlink(entry_filename(key, ".entry").c_str());
+    for (size_t ifile = 0; ifile < filenames.size(); ifile++)
+    {
+        char suffix[64];
+        snprintf(suffix, sizeof(suffix), "_seg%zu.wav", ifile + 1);
+        if (!link_or_copy_file(filenames[ifile], entry_filename(key, suffix)))
+            return false;
+    }
+
+    // Write the text file under another name, and rename it once
+    // it's all there.
+    const std::wstring temp_name = entry_filename(key, ".tmp");
+    FILE *fp = nullptr;
+    if (_wfopen_s(&fp, temp_name.c_str(), L"wb") || !fp)
+        return false;
+    fprintf(fp, "%s\n%s\n%u %llu %zu\n", k_entry_heading, key.c_str(), entry.m_frequency,
+        static_cast<unsigned long long>(entry.m_sample_count), entry.m_segments.size());
+    for (const Segment &segment : entry.m_segments)
+    {
+        fprintf(fp, "%llu %llu %u %.9g\n", static_cast<unsigned long long>(segment.m_start),
+            static_cast<unsigned long long>(segment.m_count), segment.m_channel, segment.m_loudness);
+    }
+    const bool written = !ferror(fp);
+    if (fclose(fp) != 0 || !written || !replace_file(temp_name, entry_filename(key, ".entry")))
+    {
+        _wunlink(temp_name.c_str());
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,132 @@
+//-------------------------------------------------------------------
+//
+// cache.h
+//
+// Header of C++ module for a cache of the segments found in WAV
+// files, keyed by a hash of each file's audio and the options it
+// was processed with, so a file that's the same as one that was
+// processed before doesn't have to be processed again.
+//
+//-------------------------------------------------------------------
+//
+// (C) Copyright 2024 Ammon R. Campbell.
+//
+// I wrote this code for use in my own educational and experimental
+// programs, but you may also freely use it in yours as long as you
+// abide by the following terms and conditions:
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following
+//     disclaimer in the documentation and/or other materials
+//     provided with the distribution.
+//   * The name(s) of the author(s) and contributors (if any) may not
+//     be used to endorse or promote products derived from this
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+// CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+// OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.  IN OTHER WORDS, USE AT YOUR OWN RISK, NOT OURS.  
+//--------------------------------------------------------------------
+
+#pragma once
+#include "segment.h"
+#include <stdint.h>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+// Returns a 64-bit hash of some bytes, for telling whether two WAV
+// files (or segments) have the same audio.  It works like xxHash64,
+// going through the bytes 32 at a time in four independent lanes,
+// so it's several times faster than HashBytes on big buffers, and
+// it's the same on every machine.
+uint64_t HashContent(const void *data, size_t size);
+
+// What the cache records about a WAV file's audio.
+struct CacheEntry
+{
+    unsigned m_frequency = 0;           // Sample rate of the audio.
+    size_t m_sample_count = 0;          // Number of samples in the audio.
+    std::vector<Segment> m_segments;    // Segments that were found.
+};
+
+// A cache of the segments found in WAV files, kept in a directory.
+// Each entry is looked up by a key, which should have a hash of a
+// file's audio (see HashContent), its format, and the options that
+// change its segments.  An entry has a text file with the segments
+// that were found, and a hard link to each of the segment files that
+// were written (or a copy, if they can't be linked), so when the
+// same audio turns up again with the same options, its segment files
+// can be linked to their new names without reading, analyzing or
+// converting any audio.
+//
+// The entry's text file is written last, after all of its segment
+// files are in place, so an entry that was only partly stored is
+// never found.  The key is kept in the text file too, so two keys
+// with the same hash can't be mixed up.
+class ResultCache
+{
+public:
+    ResultCache() = default;
+
+    ResultCache(const ResultCache &) = delete;
+    ResultCache &operator=(const ResultCache &) = delete;
+
+    // Opens the cache in the given directory, creating the directory
+    // if it doesn't exist.
+    // Returns true if successful.
+    bool Open(const wchar_t *directory);
+
+    // Returns true if the cache is open.
+    bool IsOpen() const { return !m_directory.empty(); }
+
+    // Looks up the entry with the given key.
+    // Returns true if it was found.
+    bool Find(const std::string &key, CacheEntry &entry) const;
+
+    // Links the segment files of the entry with the given key to the
+    // given names (one for each of its segments, in order), replacing
+    // any files that are already there.
+    // Returns true if successful.
+    bool Restore(const std::string &key, const std::vector<std::wstring> &filenames) const;
+
+    // Stores an entry with the given key, linking the segment files
+    // with the given names (one for each of its segments, in order)
+    // into the cache.  This can be called from any thread.  Nothing
+    // is locked while the files are linked, so storing one entry
+    // doesn't hold up storing or restoring others.  An entry that's
+    // already in the cache, or that another thread is storing, is
+    // left as it is.
+    // Returns true if successful.
+    bool Store(const std::string &key, const CacheEntry &entry, const std::vector<std::wstring> &filenames);
+
+private:
+    // Does the work of Store, once this thread has claimed the key.
+    // Returns true if successful.
+    bool store_entry(const std::string &key, const CacheEntry &entry,
+        const std::vector<std::wstring> &filenames) const;
+
+    // Returns the name of one of the files of the entry with the given
+    // key, which is the hash of the key followed by 'suffix'.
+    std::wstring entry_filename(const std::string &key, const char *suffix) const;
+
+    std::wstring m_directory;   // Directory the cache is kept in (with a separator at the end).
+    std::mutex m_mutex;             // Guards m_storing.
+    std::set<std::string> m_storing; // Keys of the entries being stored.
+};
@@ -0,0 +1,200 @@
+//-------------------------------------------------------------------
+//
+// cache_test.cpp
+//
+// Simple test of the cache.cpp module.  Checks the content hash
+// against known values, stores an entry with a couple of segment
+// files in a cache, and confirms that it's found again with the
+// same segments, that its files are linked back with the same
+// contents, that writing over a linked file doesn't change the
+// cached copy, and that a different key isn't found.
+//
+//-------------------------------------------------------------------
+//
+// (C) Copyright 2024 Ammon R. Campbell.
+//
+// I wrote this code for use in my own educational and experimental
+// programs, but you may also freely use it in yours as long as you
+// abide by the following terms and conditions:
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following
+//     disclaimer in the documentation and/or other materials
+//     provided with the distribution.
+//   * The name(s) of the author(s) and contributors (if any) may not
+//     be used to endorse or promote products derived from this
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+// CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+// OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.  IN OTHER WORDS, USE AT YOUR OWN RISK, NOT OURS.  
+//--------------------------------------------------------------------
+
+#include "cache.h"
+#include "wavfile.h"
+#include <stdio.h>
+#include <string.h>
+#include <wchar.h>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#define SEPARATOR L"\\"
+#else
+#define SEPARATOR L"/"
+#endif
+
+// Writes a short WAV file whose samples all have the given value.
+// Returns true if successful.
+static bool write_test_file(const std::wstring &filename, int16_t value)
+{
+    WAVInfo header;
+    header.m_rate = 8000;
+    header.m_sample_count = 100;
+    std::vector<int16_t> samples(header.m_sample_count, value);
+    return WAVFileWrite(filename.c_str(), header, samples.data());
+}
+
+// Returns the first sample of a WAV file, or 0 if it can't be read.
+static int16_t read_test_file(const std::wstring &filename)
+{
+    WAVInfo header;
+    if (!WAVFileReadHeader(filename.c_str(), header) || header.m_bits != 16 || !header.m_sample_count)
+        return 0;
+    std::vector<int16_t> samples(header.m_sample_count * header.m_channels);
+    if (!WAVFileReadSamples(filename.c_str(), samples.data(), samples.size() * sizeof(int16_t)))
+        return 0;
+    return samples[0];
+}
+
+// Checks HashContent against values from the reference xxHash64,
+// with lengths that go through each of its paths.
+static bool test_hash_content()
+{
+    const char *text = "Nobody inspects the spammish repetition, but the quick brown fox does.";
+    struct
+    {
+        size_t m_size;
+        uint64_t m_hash;
+    } const expected[] =
+    {
+        { 0, 0xEF46DB3751D8E999ULL },
+        { 3, 0xC9836C0B0560CCBAULL },
+        { 31, 0xC1A0E0AE86E1D78CULL },
+        { 32, 0x96F5BFCBFE7F0D1AULL },
+        { 70, 0xD0CA5789E0581E71ULL },
+    };
+
+    bool ok = true;
+    for (const auto &check : expected)
+    {
+        const uint64_t hash = HashContent(text, check.m_size);
+        if (hash != check.m_hash)
+        {
+            printf("HashContent of %zu bytes gave %016llx instead of %016llx!\n", check.m_size,
+                static_cast<unsigned long long>(hash), static_cast<unsigned long long>(check.m_hash));
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+// Stores an entry in a cache, and confirms that it's found and
+// restored correctly, and that a different key isn't found.
+static bool test_result_cache()
+{
+    const std::wstring directory = L"temp_cache";
+    const std::wstring seg1 = L"temp_cache_seg1.wav";
+    const std::wstring seg2 = L"temp_cache_seg2.wav";
+    const std::wstring restored1 = L"temp_restored_seg1.wav";
+    const std::wstring restored2 = L"temp_restored_seg2.wav";
+    const std::string key = "audio=0123456789abcdef level=-1";
+    bool ok = true;
+
+    CacheEntry entry;
+    entry.m_frequency = 8000;
+    entry.m_sample_count = 4000000;
+    Segment segment;
+    segment.m_start = 100;
+    segment.m_count = 200;
+    segment.m_loudness = -23.25f;
+    entry.m_segments.push_back(segment);
+    segment.m_start = 400;
+    segment.m_count = 1000;
+    segment.m_channel = 2;
+    segment.m_loudness = -30.5f;
+    entry.m_segments.push_back(segment);
+
+    ResultCache cache;
+    CacheEntry found;
+    if (!cache.Open(directory.c_str()) || !write_test_file(seg1, 1111) || !write_test_file(seg2, 2222) ||
+        cache.Find(key, found) || !cache.Store(key, entry, std::vector<std::wstring>{seg1, seg2}))
+    {
+        printf("Couldn't store an entry in cache '%S'\n", directory.c_str());
+        ok = false;
+    }
+
+    // It's found by the same key, even after the cache is reopened.
+    ResultCache reopened;
+    if (ok && (!reopened.Open(directory.c_str()) || !reopened.Find(key, found) ||
+               found.m_frequency != entry.m_frequency || found.m_sample_count != entry.m_sample_count ||
+               found.m_segments.size() != 2 || found.m_segments[1].m_start != 400 ||
+               found.m_segments[1].m_count != 1000 || found.m_segments[1].m_channel != 2 ||
+               found.m_segments[0].m_loudness != -23.25f || found.m_segments[1].m_loudness != -30.5f))
+    {
+        printf("Cache didn't find the entry that was stored!\n");
+        ok = false;
+    }
+
+    // Its files come back with the same contents, and writing over
+    // the files they came from doesn't change them.
+    if (ok && (!write_test_file(seg1, 3333) ||
+               !reopened.Restore(key, std::vector<std::wstring>{restored1, restored2}) ||
+               read_test_file(restored1) != 1111 || read_test_file(restored2) != 2222))
+    {
+        printf("Cache didn't restore the segment files that were stored!\n");
+        ok = false;
+    }
+
+    if (ok && (reopened.Find("audio=0123456789abcdef level=-2", found) || reopened.Find(key + "\n", found)))
+    {
+        printf("Cache found an entry for a key that wasn't stored!\n");
+        ok = false;
+    }
+
+    char hash[32];
+    snprintf(hash, sizeof(hash), "%016llx", static_cast<unsigned long long>(HashContent(key.data(), key.size())));
+    std::wstring base = directory + SEPARATOR;
+    for (const char *p = hash; *p; p++)
+        base += static_cast<wchar_t>(*p);
+    const std::wstring files[] = { seg1, seg2, restored1, restored2, base + L".entry", base + L"_seg1.wav",
+        base + L"_seg2.wav" };
+    for (const std::wstring &file : files)
+        _wunlink(file.c_str());
+    _wrmdir(directory.c_str());
+
+    return ok;
+}
+
+bool test_cache()
+{
+    printf("Starting cache test\n");
+
+    const bool hash_ok = test_hash_content();
+    return test_result_cache() && hash_ok;
+}
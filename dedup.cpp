@@ -0,0 +1,247 @@
+//-------------------------------------------------------------------
+//
+// dedup.cpp
+//
+// C++ module for finding segments whose audio is exactly the same
+// as a segment that was already written.  See dedup.h for more
+// about it.
+//
+//-------------------------------------------------------------------
+//
+// (C) Copyright 2024 Ammon R. Campbell.
+//
+// I wrote this code for use in my own educational and experimental
+// programs, but you may also freely use it in yours as long as you
+// abide by the following terms and conditions:
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following
+//     disclaimer in the documentation and/or other materials
+//     provided with the distribution.
+//   * The name(s) of the author(s) and contributors (if any) may not
+//     be used to endorse or promote products derived from this
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+// CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+// OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.  IN OTHER WORDS, USE AT YOUR OWN RISK, NOT OURS.  
+//--------------------------------------------------------------------
+
+#include "dedup.h"
+#include "cache.h"
+#include "inputs.h"
+#include <stdlib.h>
+#include <string.h>
+#include <functional>
+
+// The first line of a new index file.
+static const char *k_index_heading = "# splitspeech segment index: hash, size, segment file\n";
+
+// The first line of a new manifest.
+static const char *k_manifest_heading = "# splitspeech duplicate segments: hash, segment file, same as\n";
+
+uint64_t HashSegment(const WAVInfo &header, const int16_t *samples)
+{
+    const uint64_t fields[] =
+    {
+        header.m_rate,
+        header.m_channels,
+        header.m_bits,
+        header.m_is_float ? 1u : 0u,
+        header.m_sample_count,
+        HashContent(samples, header.CalculateBufferSize()),
+    };
+    return HashContent(fields, sizeof(fields));
+}
+
+// Opens a text file to add lines to, calling 'read_line' with each
+// whole line that's already in it (other than comments).  A line
+// without a newline at the end was cut off while it was being
+// written, so it's skipped, and the next line goes after it.  A new
+// file gets 'heading' as its first line.
+// Returns true if successful.
+static bool open_for_append(const wchar_t *filename, const char *heading, FILE *&fp,
+    const std::function<void(const std::string &)> &read_line)
+{
+    bool ends_in_newline = true;
+    bool empty = true;
+    FILE *in = nullptr;
+    if (!_wfopen_s(&in, filename, L"rb") && in)
+    {
+        std::string line;
+        char buffer[1024];
+        while (fgets(buffer, sizeof(buffer), in))
+        {
+            empty = false;
+            line += buffer;
+            ends_in_newline = line.back() == '\n';
+            if (!ends_in_newline)
+                continue;
+            line.pop_back();
+            if (!line.empty() && line.back() == '\r')
+                line.pop_back();
+            if (!line.empty() && line[0] != '#')
+                read_line(line);
+            line.clear();
+        }
+        fclose(in);
+    }
+
+    if (_wfopen_s(&fp, filename, L"ab") || !fp)
+    {
+        fp = nullptr;
+        return false;
+    }
+    if (empty)
+        fputs(heading, fp);
+    else if (!ends_in_newline)
+        fputc('\n', fp);
+    return fflush(fp) == 0;
+}
+
+bool SegmentIndex::OpenIndex(const wchar_t *filename)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_index_fp)
+        return false;
+
+    return open_for_append(filename, k_index_heading, m_index_fp, [this](const std::string &line)
+    {
+        const char *p = line.c_str();
+        char *end = nullptr;
+        const uint64_t hash = strtoull(p, &end, 16);
+        if (end == p || *end != '\t')
+            return;
+        p = end + 1;
+        const uint64_t size = strtoull(p, &end, 10);
+        if (end == p || *end != '\t' || !end[1])
+            return;
+
+        // The first file with each hash stays the canonical copy.
+        Entry &entry = m_entries[hash];
+        if (entry.m_filename.empty())
+        {
+            entry.m_size = size;
+            entry.m_filename = FromUTF8(end + 1);
+            entry.m_indexed = true;
+        }
+    });
+}
+
+bool SegmentIndex::OpenManifest(const wchar_t *filename)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_manifest_fp)
+        return false;
+
+    return open_for_append(filename, k_manifest_heading, m_manifest_fp, [](const std::string &) {});
+}
+
+void SegmentIndex::Close()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (FILE **fp : { &m_index_fp, &m_manifest_fp })
+    {
+        if (*fp)
+        {
+            if (fclose(*fp) != 0)
+                m_error = true;
+            *fp = nullptr;
+        }
+    }
+}
+
+void SegmentIndex::add_line(FILE *fp, const std::string &line)
+{
+    if (!fp)
+        return;
+
+    // A name with a newline in it can't be recorded.
+    if (line.find_first_of("\r\n") != std::string::npos)
+        return;
+
+    if (fputs(line.c_str(), fp) < 0 || fputc('\n', fp) == EOF || fflush(fp) != 0)
+        m_error = true;
+}
+
+// Returns true if the file can be opened for reading.
+static bool file_exists(const std::wstring &filename)
+{
+    FILE *fp = nullptr;
+    if (_wfopen_s(&fp, filename.c_str(), L"rb") || !fp)
+        return false;
+    fclose(fp);
+    return true;
+}
+
+bool SegmentIndex::Claim(uint64_t hash, uint64_t size, const std::wstring &filename, std::wstring &canonical)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto found = m_entries.find(hash);
+    if (found == m_entries.end())
+    {
+        Entry &entry = m_entries[hash];
+        entry.m_size = size;
+        entry.m_filename = filename;
+        return false;
+    }
+
+    // A segment that's written to the same file as its canonical copy
+    // (as when a batch is run again) is written again, and one with
+    // a different size isn't really the same.
+    Entry &entry = found->second;
+    if (entry.m_filename == filename || entry.m_size != size)
+        return false;
+
+    // The file of a segment that's in the index file might have been
+    // deleted since.  If so, this segment becomes the canonical copy.
+    if (entry.m_indexed && !file_exists(entry.m_filename))
+    {
+        entry.m_filename = filename;
+        entry.m_indexed = false;
+        return false;
+    }
+
+    canonical = entry.m_filename;
+    char text[32];
+    snprintf(text, sizeof(text), "%016llx\t", static_cast<unsigned long long>(hash));
+    add_line(m_manifest_fp, text + ToUTF8(filename) + "\t" + ToUTF8(canonical));
+    return true;
+}
+
+void SegmentIndex::Commit(uint64_t hash, uint64_t size, const std::wstring &filename)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto found = m_entries.find(hash);
+    if (found == m_entries.end() || found->second.m_filename != filename || found->second.m_indexed)
+        return;
+
+    found->second.m_indexed = true;
+    char text[64];
+    snprintf(text, sizeof(text), "%016llx\t%llu\t", static_cast<unsigned long long>(hash),
+        static_cast<unsigned long long>(size));
+    add_line(m_index_fp, text + ToUTF8(filename));
+}
+
+void SegmentIndex::Release(uint64_t hash, const std::wstring &filename)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto found = m_entries.find(hash);
+    if (found != m_entries.end() && found->second.m_filename == filename && !found->second.m_indexed)
+        m_entries.erase(found);
+}
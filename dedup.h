@@ -0,0 +1,138 @@
+//-------------------------------------------------------------------
+//
+// dedup.h
+//
+// Header of C++ module for finding segments whose audio is exactly
+// the same as a segment that was already written, so they don't
+// have to be written (and stored) again.
+//
+//-------------------------------------------------------------------
+//
+// (C) Copyright 2024 Ammon R. Campbell.
+//
+// I wrote this code for use in my own educational and experimental
+// programs, but you may also freely use it in yours as long as you
+// abide by the following terms and conditions:
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following
+//     disclaimer in the documentation and/or other materials
+//     provided with the distribution.
+//   * The name(s) of the author(s) and contributors (if any) may not
+//     be used to endorse or promote products derived from this
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+// CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+// OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.  IN OTHER WORDS, USE AT YOUR OWN RISK, NOT OURS.  
+//--------------------------------------------------------------------
+
+#pragma once
+#include "wavfile.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+// Returns a hash of the WAV file that WAVFileWrite would write from
+// the given header and 16-bit samples, without making the file.
+// The file's header is made from the fields of 'header', so those
+// are hashed along with the samples (see HashContent).
+uint64_t HashSegment(const WAVInfo &header, const int16_t *samples);
+
+// Keeps track of the segment files that have been written, by the
+// hash and size of their contents, so a segment that's the same as
+// one that was already written can be left out, and pointed at the
+// first one (its canonical copy) instead.  Segments with the same
+// hash and size are taken to be the same; with a 64-bit hash, the
+// odds of two different segments being mixed up are negligible.
+//
+// The index can be kept in a file, so the segments written by
+// earlier runs count too.  The file is a text file with a line for
+// each segment file, with its hash, its size and its name (in UTF-8),
+// separated by tabs.  A segment is added to it once its file has
+// been written.  The segments that are left out can be listed in a
+// manifest, which is a text file with a line for each one, with
+// its hash, the name its file would have had, and the name of its
+// canonical copy, separated by tabs.  Both files are only ever
+// added to, and a line that was cut off part way is ignored.
+class SegmentIndex
+{
+public:
+    SegmentIndex() = default;
+    ~SegmentIndex() { Close(); }
+
+    SegmentIndex(const SegmentIndex &) = delete;
+    SegmentIndex &operator=(const SegmentIndex &) = delete;
+
+    // Opens the file the index is kept in, reading the segments that
+    // are already in it, and creating it if it doesn't exist.
+    // Returns true if successful.
+    bool OpenIndex(const wchar_t *filename);
+
+    // Opens the manifest of the segments that are left out, creating
+    // it if it doesn't exist.  New lines are added to the end.
+    // Returns true if successful.
+    bool OpenManifest(const wchar_t *filename);
+
+    // Flushes the files to the disk and closes them.
+    void Close();
+
+    // Checks a segment that's about to be written to 'filename'.  If
+    // a segment with the same hash and size has already been written
+    // (or claimed) under another name, this returns true, with that
+    // name in 'canonical', and adds the segment to the manifest.
+    // Otherwise the segment is claimed as the canonical copy, so
+    // that any others that are the same are left out, and this
+    // returns false.  A segment from the index file whose file is
+    // gone isn't a canonical copy any more, so this one takes its
+    // place.  This can be called from any thread.
+    bool Claim(uint64_t hash, uint64_t size, const std::wstring &filename, std::wstring &canonical);
+
+    // Adds a segment that was claimed to the index file, once its
+    // file has been written.  This can be called from any thread.
+    void Commit(uint64_t hash, uint64_t size, const std::wstring &filename);
+
+    // Gives up the claim on a segment whose file couldn't be written,
+    // so the next segment that's the same is written instead of
+    // being left out.  This can be called from any thread.
+    void Release(uint64_t hash, const std::wstring &filename);
+
+    // Returns true if a line couldn't be added to the index or the
+    // manifest.
+    bool HadError() const { return m_error; }
+
+private:
+    // A segment file that's in the index.
+    struct Entry
+    {
+        uint64_t m_size = 0;        // Size of the samples in bytes.
+        std::wstring m_filename;    // Name of the file.
+        bool m_indexed = false;     // Is it in the index file yet?
+    };
+
+    // Adds a line to one of the files.
+    void add_line(FILE *fp, const std::string &line);
+
+    FILE *m_index_fp = nullptr;                         // The open index file.
+    FILE *m_manifest_fp = nullptr;                      // The open manifest.
+    std::unordered_map<uint64_t, Entry> m_entries;      // The segments, by hash.
+    std::mutex m_mutex;                                 // Guards the entries and the files.
+    bool m_error = false;                               // Couldn't a line be added?
+};
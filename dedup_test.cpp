@@ -0,0 +1,183 @@
+//-------------------------------------------------------------------
+//
+// dedup_test.cpp
+//
+// Simple test of the dedup.cpp module.  Checks that segments with
+// the same samples and format hash the same, and others don't, and
+// that a segment index finds duplicates within a run and, from its
+// file, across runs (as long as the canonical copy is still there),
+// lists them in its manifest, and lets go of a released claim.
+//
+//-------------------------------------------------------------------
+//
+// (C) Copyright 2024 Ammon R. Campbell.
+//
+// I wrote this code for use in my own educational and experimental
+// programs, but you may also freely use it in yours as long as you
+// abide by the following terms and conditions:
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following
+//     disclaimer in the documentation and/or other materials
+//     provided with the distribution.
+//   * The name(s) of the author(s) and contributors (if any) may not
+//     be used to endorse or promote products derived from this
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+// CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+// OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.  IN OTHER WORDS, USE AT YOUR OWN RISK, NOT OURS.  
+//--------------------------------------------------------------------
+
+#include "dedup.h"
+#include <stdio.h>
+#include <wchar.h>
+#include <string>
+#include <vector>
+
+// Returns the number of lines in a text file that aren't comments.
+static size_t count_lines(const wchar_t *filename)
+{
+    FILE *fp = nullptr;
+    if (_wfopen_s(&fp, filename, L"rb") || !fp)
+        return 0;
+    size_t count = 0;
+    char buffer[1024];
+    while (fgets(buffer, sizeof(buffer), fp))
+    {
+        if (buffer[0] != '#')
+            count++;
+    }
+    fclose(fp);
+    return count;
+}
+
+bool test_dedup()
+{
+    printf("Starting dedup test\n");
+
+    const wchar_t *index_name = L"temp_segment_index.txt";
+    const wchar_t *manifest_name = L"temp_duplicates.txt";
+    const wchar_t *canonical_name = L"temp_canonical_seg1.wav";
+    _wunlink(index_name);
+    _wunlink(manifest_name);
+    _wunlink(canonical_name);
+    bool ok = true;
+
+    // The hash changes with the samples and with the format.
+    WAVInfo header;
+    header.m_rate = 16000;
+    header.m_sample_count = 1000;
+    std::vector<int16_t> samples(header.m_sample_count);
+    for (size_t isample = 0; isample < samples.size(); isample++)
+        samples[isample] = static_cast<int16_t>((isample * 37) % 2000 - 1000);
+    std::vector<int16_t> other = samples;
+    other[999]++;
+    WAVInfo other_rate = header;
+    other_rate.m_rate = 8000;
+    const uint64_t hash = HashSegment(header, samples.data());
+    const uint64_t size = header.CalculateBufferSize();
+    if (HashSegment(header, samples.data()) != hash || HashSegment(header, other.data()) == hash ||
+        HashSegment(other_rate, samples.data()) == hash)
+    {
+        printf("HashSegment didn't tell the segments apart!\n");
+        ok = false;
+    }
+
+    // Within a run, the first file with a hash is the canonical copy.
+    std::wstring canonical;
+    {
+        SegmentIndex index;
+        if (!index.OpenIndex(index_name) || !index.OpenManifest(manifest_name))
+        {
+            printf("Couldn't open segment index '%S'\n", index_name);
+            ok = false;
+        }
+        if (ok && (index.Claim(hash, size, canonical_name, canonical) ||
+                   !index.Claim(hash, size, L"b_seg1.wav", canonical) || canonical != canonical_name ||
+                   index.Claim(hash, size + 2, L"c_seg1.wav", canonical) ||
+                   index.Claim(hash ^ 1, size, L"d_seg1.wav", canonical)))
+        {
+            printf("Segment index didn't find the right duplicates!\n");
+            ok = false;
+        }
+
+        // A claim that's released (because its file couldn't be
+        // written) doesn't make the next one a duplicate.
+        const bool claimed = !index.Claim(hash ^ 2, size, L"f_seg1.wav", canonical);
+        index.Release(hash ^ 2, L"f_seg1.wav");
+        if (ok && (!claimed || index.Claim(hash ^ 2, size, L"g_seg1.wav", canonical)))
+        {
+            printf("Segment index didn't release the claim!\n");
+            ok = false;
+        }
+        index.Commit(hash, size, canonical_name);
+        index.Commit(hash, size, L"b_seg1.wav");
+        index.Close();
+        if (ok && (index.HadError() || count_lines(index_name) != 1 || count_lines(manifest_name) != 1))
+        {
+            printf("Segment index didn't write the right lines!\n");
+            ok = false;
+        }
+    }
+
+    // A later run picks up the segments in the index file, but a
+    // segment written to the same file again isn't a duplicate.
+    {
+        FILE *fp = nullptr;
+        if (ok && !_wfopen_s(&fp, index_name, L"ab") && fp)
+        {
+            fputs("0123", fp);
+            fclose(fp);
+        }
+        if (ok && !_wfopen_s(&fp, canonical_name, L"wb") && fp)
+            fclose(fp);
+
+        SegmentIndex index;
+        if (ok && (!index.OpenIndex(index_name) || index.Claim(hash, size, canonical_name, canonical) ||
+                   !index.Claim(hash, size, L"e_seg1.wav", canonical) || canonical != canonical_name))
+        {
+            printf("Segment index didn't find the duplicates from its file!\n");
+            ok = false;
+        }
+        index.Commit(hash, size, canonical_name);
+        index.Close();
+        if (ok && count_lines(index_name) != 2)
+        {
+            printf("Segment index didn't skip the line that was cut off!\n");
+            ok = false;
+        }
+    }
+
+    // Once the canonical copy's file is gone, the next segment that's
+    // the same takes its place.
+    _wunlink(canonical_name);
+    {
+        SegmentIndex index;
+        if (ok && (!index.OpenIndex(index_name) || index.Claim(hash, size, L"e_seg1.wav", canonical) ||
+                   !index.Claim(hash, size, L"f_seg1.wav", canonical) || canonical != L"e_seg1.wav"))
+        {
+            printf("Segment index kept a canonical copy that was deleted!\n");
+            ok = false;
+        }
+    }
+
+    _wunlink(index_name);
+    _wunlink(manifest_name);
+    return ok;
+}
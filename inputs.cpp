@@ -0,0 +1,654 @@
+//-------------------------------------------------------------------
+//
+// inputs.cpp
+//
+// C++ module for finding the WAV files to process when there are
+// too many to list on the command line:  reading them from a
+// manifest file, or finding them in a tree of directories.
+//
+//-------------------------------------------------------------------
+//
+// (C) Copyright 2024 Ammon R. Campbell.
+//
+// I wrote this code for use in my own educational and experimental
+// programs, but you may also freely use it in yours as long as you
+// abide by the following terms and conditions:
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following
+//     disclaimer in the documentation and/or other materials
+//     provided with the distribution.
+//   * The name(s) of the author(s) and contributors (if any) may not
+//     be used to endorse or promote products derived from this
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+// CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+// OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.  IN OTHER WORDS, USE AT YOUR OWN RISK, NOT OURS.  
+//--------------------------------------------------------------------
+
+#include "inputs.h"
+#include <stdint.h>
+#include <string.h>
+#include <wchar.h>
+#include <wctype.h>
+#include <algorithm>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+// Number of directories that DirectoryWalker lists ahead of the
+// one it's returning files from.
+static const size_t k_directories_listed_ahead = 8;
+
+// Adds a Unicode character to a wide string, as a UTF-16 surrogate
+// pair if wchar_t is 16 bits and the character needs one.
+static void append_code_point(std::wstring &text, uint32_t code)
+{
+#if WCHAR_MAX <= 0xFFFF
+    if (code > 0xFFFF)
+    {
+        code -= 0x10000;
+        text += static_cast<wchar_t>(0xD800 + (code >> 10));
+        text += static_cast<wchar_t>(0xDC00 + (code & 0x3FF));
+        return;
+    }
+#endif
+    text += static_cast<wchar_t>(code);
+}
+
+// Adds a Unicode character to a string in UTF-8.
+static void append_utf8(std::string &text, uint32_t code)
+{
+    if (code < 0x80)
+    {
+        text += static_cast<char>(code);
+    }
+    else if (code < 0x800)
+    {
+        text += static_cast<char>(0xC0 | (code >> 6));
+        text += static_cast<char>(0x80 | (code & 0x3F));
+    }
+    else if (code < 0x10000)
+    {
+        text += static_cast<char>(0xE0 | (code >> 12));
+        text += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+        text += static_cast<char>(0x80 | (code & 0x3F));
+    }
+    else
+    {
+        text += static_cast<char>(0xF0 | (code >> 18));
+        text += static_cast<char>(0x80 | ((code >> 12) & 0x3F));
+        text += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+        text += static_cast<char>(0x80 | (code & 0x3F));
+    }
+}
+
+std::wstring FromUTF8(const std::string &text)
+{
+    std::wstring result;
+    const unsigned char *p = reinterpret_cast<const unsigned char *>(text.c_str());
+    const unsigned char *end = p + text.size();
+    while (p < end)
+    {
+        uint32_t code = *p++;
+        unsigned extra = 0;
+        if (code >= 0xF0 && code < 0xF8)
+        {
+            code &= 0x07;
+            extra = 3;
+        }
+        else if (code >= 0xE0)
+        {
+            code &= 0x0F;
+            extra = 2;
+        }
+        else if (code >= 0xC0)
+        {
+            code &= 0x1F;
+            extra = 1;
+        }
+        else if (code >= 0x80)
+        {
+            code = 0xFFFD;
+        }
+        for (; extra && p < end && (*p & 0xC0) == 0x80; extra--)
+            code = (code << 6) | (*p++ & 0x3F);
+        if (extra || code > 0x10FFFF)
+            code = 0xFFFD;
+        append_code_point(result, code);
+    }
+    return result;
+}
+
+std::string ToUTF8(const std::wstring &text)
+{
+    std::string result;
+    for (size_t ichar = 0; ichar < text.size(); ichar++)
+    {
+        uint32_t code = static_cast<uint32_t>(text[ichar]);
+        if (code >= 0xD800 && code < 0xDC00 && ichar + 1 < text.size() &&
+            text[ichar + 1] >= 0xDC00 && text[ichar + 1] < 0xE000)
+        {
+            // A UTF-16 surrogate pair.
+            code = 0x10000 + ((code - 0xD800) << 10) + (static_cast<uint32_t>(text[ichar + 1]) - 0xDC00);
+            ichar++;
+        }
+        append_utf8(result, code);
+    }
+    return result;
+}
+
+uint64_t HashBytes(const void *data, size_t size)
+{
+    const unsigned char *bytes = static_cast<const unsigned char *>(data);
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t ibyte = 0; ibyte < size; ibyte++)
+    {
+        hash ^= bytes[ibyte];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+uint64_t PathHash(const std::wstring &path)
+{
+    std::string text = ToUTF8(path);
+    std::replace(text.begin(), text.end(), '\\', '/');
+    return HashBytes(text.data(), text.size());
+}
+
+std::wstring SegmentBaseName(const std::wstring &filename)
+{
+#ifdef _WIN32
+    const size_t slash = filename.find_last_of(L"\\/:");
+#else
+    const size_t slash = filename.find_last_of(L'/');
+#endif
+    const size_t start = (slash == std::wstring::npos) ? 0 : slash + 1;
+    const size_t dot = filename.find_last_of(L'.');
+    const size_t end = (dot == std::wstring::npos || dot < start) ? filename.size() : dot;
+    return filename.substr(start, end - start);
+}
+
+bool OutputNames::Add(const std::wstring &filename, std::wstring &earlier)
+{
+    // Windows doesn't tell upper and lower case apart in filenames.
+    std::wstring key = SegmentBaseName(filename);
+#ifdef _WIN32
+    for (wchar_t &ch : key)
+        ch = static_cast<wchar_t>(towlower(ch));
+#endif
+    auto added = m_files.emplace(key, filename);
+    if (!added.second)
+    {
+        earlier = added.first->second;
+        return false;
+    }
+    return true;
+}
+
+// Returns true if the filename ends in ".wav" (in any case).
+static bool has_wav_extension(const std::wstring &name)
+{
+    const wchar_t *extension = L".wav";
+    const size_t length = wcslen(extension);
+    if (name.size() < length)
+        return false;
+    for (size_t ichar = 0; ichar < length; ichar++)
+    {
+        if (towlower(name[name.size() - length + ichar]) != static_cast<wint_t>(extension[ichar]))
+            return false;
+    }
+    return true;
+}
+
+// Returns the path of a file or directory in a directory.
+static std::wstring join_path(const std::wstring &directory, const std::wstring &name)
+{
+#ifdef _WIN32
+    const wchar_t separator = L'\\';
+#else
+    const wchar_t separator = L'/';
+#endif
+    if (directory.empty() || directory.back() == L'/' || directory.back() == separator)
+        return directory + name;
+    return directory + separator + name;
+}
+
+#ifdef _WIN32
+
+bool IsDirectory(const wchar_t *path)
+{
+    DWORD attributes = GetFileAttributesW(path);
+    return attributes != INVALID_FILE_ATTRIBUTES && (attributes & FILE_ATTRIBUTE_DIRECTORY);
+}
+
+// Lists the WAV files and the directories in a directory.  Links
+// to other directories aren't followed, so a link can't make the
+// walk go around in circles.
+// Returns true if successful.
+static bool list_directory(const std::wstring &path, std::vector<std::wstring> &files,
+    std::vector<std::wstring> &subdirs)
+{
+    WIN32_FIND_DATAW data;
+    HANDLE find = FindFirstFileW(join_path(path, L"*").c_str(), &data);
+    if (find == INVALID_HANDLE_VALUE)
+        return false;
+
+    do
+    {
+        const std::wstring name = data.cFileName;
+        if (name == L"." || name == L"..")
+            continue;
+        if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+        {
+            if (!(data.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT))
+                subdirs.push_back(join_path(path, name));
+        }
+        else if (has_wav_extension(name))
+        {
+            files.push_back(join_path(path, name));
+        }
+    } while (FindNextFileW(find, &data));
+    FindClose(find);
+
+    std::sort(files.begin(), files.end());
+    std::sort(subdirs.begin(), subdirs.end());
+    return true;
+}
+
+#else
+
+bool IsDirectory(const wchar_t *path)
+{
+    struct stat info;
+    return stat(ToUTF8(path).c_str(), &info) == 0 && S_ISDIR(info.st_mode);
+}
+
+// Lists the WAV files and the directories in a directory.  Links
+// to other directories aren't followed, so a link can't make the
+// walk go around in circles.
+// Returns true if successful.
+static bool list_directory(const std::wstring &path, std::vector<std::wstring> &files,
+    std::vector<std::wstring> &subdirs)
+{
+    const std::string narrow_path = ToUTF8(path);
+    DIR *dir = opendir(narrow_path.c_str());
+    if (!dir)
+        return false;
+
+    for (struct dirent *entry = readdir(dir); entry; entry = readdir(dir))
+    {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+            continue;
+        const std::wstring name = FromUTF8(entry->d_name);
+        struct stat info;
+        if (lstat((narrow_path + "/" + entry->d_name).c_str(), &info) != 0)
+            continue;
+        if (S_ISDIR(info.st_mode))
+            subdirs.push_back(join_path(path, name));
+        else if (has_wav_extension(name))
+            files.push_back(join_path(path, name));
+    }
+    closedir(dir);
+
+    std::sort(files.begin(), files.end());
+    std::sort(subdirs.begin(), subdirs.end());
+    return true;
+}
+
+#endif
+
+// Returns true if a path is relative to the current directory.
+static bool is_relative_path(const std::wstring &path)
+{
+#ifdef _WIN32
+    // "\\server\share", "\\dir" and "C:..." aren't relative to
+    // the current directory.
+    if (path.size() >= 2 && path[1] == L':')
+        return false;
+    return path.empty() || (path[0] != L'\\' && path[0] != L'/');
+#else
+    return path.empty() || path[0] != L'/';
+#endif
+}
+
+// Returns the directory part of a path, or an empty string if it's
+// just the name of a file in the current directory.
+static std::wstring directory_of(const std::wstring &path)
+{
+#ifdef _WIN32
+    const size_t end = path.find_last_of(L"\\/:");
+#else
+    const size_t end = path.find_last_of(L'/');
+#endif
+    return (end == std::wstring::npos) ? std::wstring() : path.substr(0, end + 1);
+}
+
+bool ManifestReader::Open(const wchar_t *filename)
+{
+    Close();
+    m_line = 0;
+    m_directory = directory_of(filename);
+    return !_wfopen_s(&m_fp, filename, L"rb") && m_fp;
+}
+
+void ManifestReader::Close()
+{
+    if (m_fp)
+        fclose(m_fp);
+    m_fp = nullptr;
+}
+
+// The kinds of values that a manifest's JSON objects can have.
+enum class JSONValue
+{
+    Text,       // A string or a number.
+    True,       // true.
+    Nothing,    // false or null.
+};
+
+// Skips spaces and tabs.
+static void skip_spaces(const char *&p)
+{
+    while (*p == ' ' || *p == '\t')
+        p++;
+}
+
+// Reads four hexadecimal digits.
+// Returns false if they aren't there.
+static bool parse_hex4(const char *&p, uint32_t &value)
+{
+    value = 0;
+    for (unsigned idigit = 0; idigit < 4; idigit++, p++)
+    {
+        char c = *p;
+        uint32_t digit = 0;
+        if (c >= '0' && c <= '9')
+            digit = static_cast<uint32_t>(c - '0');
+        else if (c >= 'a' && c <= 'f')
+            digit = static_cast<uint32_t>(c - 'a' + 10);
+        else if (c >= 'A' && c <= 'F')
+            digit = static_cast<uint32_t>(c - 'A' + 10);
+        else
+            return false;
+        value = value * 16 + digit;
+    }
+    return true;
+}
+
+// Reads a JSON string, starting at its opening quote.
+// Returns false if it isn't a valid string.
+static bool parse_json_string(const char *&p, std::wstring &value)
+{
+    if (*p++ != '"')
+        return false;
+
+    std::string text;
+    for (;;)
+    {
+        char c = *p++;
+        if (c == '"')
+            break;
+        if (c == '\0' || c == '\r' || c == '\n')
+            return false;
+        if (c != '\\')
+        {
+            text += c;
+            continue;
+        }
+
+        switch (*p++)
+        {
+        case '"':  text += '"';  break;
+        case '\\': text += '\\'; break;
+        case '/':  text += '/';  break;
+        case 'b':  text += '\b'; break;
+        case 'f':  text += '\f'; break;
+        case 'n':  text += '\n'; break;
+        case 'r':  text += '\r'; break;
+        case 't':  text += '\t'; break;
+        case 'u':
+        {
+            uint32_t code = 0;
+            if (!parse_hex4(p, code))
+                return false;
+
+            // A character outside the first 64K comes as a pair of
+            // UTF-16 surrogates.
+            uint32_t low = 0;
+            if (code >= 0xD800 && code < 0xDC00 && p[0] == '\\' && p[1] == 'u')
+            {
+                const char *q = p + 2;
+                if (parse_hex4(q, low) && low >= 0xDC00 && low < 0xE000)
+                {
+                    code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                    p = q;
+                }
+            }
+            append_utf8(text, code);
+            break;
+        }
+        default:
+            return false;
+        }
+    }
+
+    value = FromUTF8(text);
+    return true;
+}
+
+// Reads a JSON value that's a string, a number, true, false or
+// null.
+// Returns false if it isn't one of those.
+static bool parse_json_value(const char *&p, std::wstring &value, JSONValue &kind)
+{
+    kind = JSONValue::Text;
+    if (*p == '"')
+        return parse_json_string(p, value);
+
+    const char *literals[3] = { "true", "false", "null" };
+    for (const char *literal : literals)
+    {
+        const size_t length = strlen(literal);
+        if (strncmp(p, literal, length) == 0)
+        {
+            kind = (literal == literals[0]) ? JSONValue::True : JSONValue::Nothing;
+            p += length;
+            return true;
+        }
+    }
+
+    std::string number;
+    while ((*p >= '0' && *p <= '9') || *p == '-' || *p == '+' || *p == '.' || *p == 'e' || *p == 'E')
+        number += *p++;
+    value = FromUTF8(number);
+    return !number.empty();
+}
+
+// Reads a manifest line that's a JSON object, with the name of the
+// WAV file and any options.
+// Returns false if the line isn't a valid object.
+static bool parse_json_entry(const char *p, ManifestEntry &entry)
+{
+    if (*p++ != '{')
+        return false;
+
+    skip_spaces(p);
+    if (*p == '}')
+    {
+        p++;
+    }
+    else
+    {
+        for (;;)
+        {
+            std::wstring key, value;
+            JSONValue kind = JSONValue::Text;
+            skip_spaces(p);
+            if (!parse_json_string(p, key))
+                return false;
+            skip_spaces(p);
+            if (*p++ != ':')
+                return false;
+            skip_spaces(p);
+            if (!parse_json_value(p, value, kind))
+                return false;
+
+            if (key == L"path")
+            {
+                if (kind != JSONValue::Text)
+                    return false;
+                entry.m_filename = value;
+            }
+            else if (kind == JSONValue::True)
+            {
+                entry.m_options.push_back(L"--" + key);
+            }
+            else if (kind == JSONValue::Text)
+            {
+                entry.m_options.push_back(L"--" + key + L"=" + value);
+            }
+
+            skip_spaces(p);
+            char c = *p++;
+            if (c == '}')
+                break;
+            if (c != ',')
+                return false;
+        }
+    }
+
+    skip_spaces(p);
+    return *p == '\0';
+}
+
+bool ManifestReader::Next(ManifestEntry &entry)
+{
+    if (!m_fp)
+        return false;
+
+    for (;;)
+    {
+        // Read a whole line, however long it is.
+        std::string line;
+        char buffer[1024];
+        bool got_line = false;
+        while (fgets(buffer, sizeof(buffer), m_fp))
+        {
+            got_line = true;
+            line += buffer;
+            if (!line.empty() && line.back() == '\n')
+                break;
+        }
+        if (!got_line)
+            return false;
+        m_line++;
+
+        // Trim the line, and the byte order mark that some editors
+        // put at the start of a UTF-8 file.
+        if (m_line == 1 && line.compare(0, 3, "\xEF\xBB\xBF") == 0)
+            line.erase(0, 3);
+        const char *spaces = " \t\r\n";
+        line.erase(0, std::min(line.find_first_not_of(spaces), line.size()));
+        line.erase(line.find_last_not_of(spaces) + 1);
+        if (line.empty() || line[0] == '#')
+            continue;
+
+        entry = ManifestEntry();
+        entry.m_line = m_line;
+        if (line[0] != '{')
+        {
+            entry.m_filename = FromUTF8(line);
+        }
+        else if (!parse_json_entry(line.c_str(), entry))
+        {
+            entry = ManifestEntry();
+            entry.m_line = m_line;
+            entry.m_error = "not a valid JSON object";
+        }
+        else if (entry.m_filename.empty())
+        {
+            entry.m_options.clear();
+            entry.m_error = "no \"path\" given";
+        }
+        if (!entry.m_filename.empty() && is_relative_path(entry.m_filename))
+            entry.m_filename = join_path(m_directory, entry.m_filename);
+        return true;
+    }
+}
+
+DirectoryWalker::DirectoryWalker(const std::wstring &root)
+{
+    std::shared_ptr<Directory> dir(new Directory);
+    dir->m_path = root;
+    m_pending.push_back(dir);
+    list_ahead();
+}
+
+void DirectoryWalker::list_ahead()
+{
+    for (size_t idir = 0; idir < m_pending.size() && idir < k_directories_listed_ahead; idir++)
+    {
+        std::shared_ptr<Directory> dir = m_pending[idir];
+        if (dir->m_started)
+            continue;
+
+        dir->m_started = true;
+        dir->m_listing = std::async(std::launch::async, [dir]()
+        {
+            return list_directory(dir->m_path, dir->m_files, dir->m_subdirs);
+        });
+    }
+}
+
+bool DirectoryWalker::Next(std::wstring &filename)
+{
+    while (m_files.empty())
+    {
+        if (m_pending.empty())
+            return false;
+
+        std::shared_ptr<Directory> dir = m_pending.front();
+        m_pending.pop_front();
+        if (!dir->m_listing.get())
+            m_unreadable.push_back(dir->m_path);
+        m_files.assign(dir->m_files.begin(), dir->m_files.end());
+
+        // The directories in this one come next, before the ones
+        // after it.
+        for (auto subdir = dir->m_subdirs.rbegin(); subdir != dir->m_subdirs.rend(); ++subdir)
+        {
+            std::shared_ptr<Directory> next(new Directory);
+            next->m_path = *subdir;
+            m_pending.push_front(next);
+        }
+        list_ahead();
+    }
+
+    filename = m_files.front();
+    m_files.pop_front();
+    return true;
+}
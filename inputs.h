@@ -0,0 +1,196 @@
+//-------------------------------------------------------------------
+//
+// inputs.h
+//
+// Header of C++ module for finding the WAV files to process when
+// there are too many to list on the command line:  reading them
+// from a manifest file, or finding them in a tree of directories.
+//
+//-------------------------------------------------------------------
+//
+// (C) Copyright 2024 Ammon R. Campbell.
+//
+// I wrote this code for use in my own educational and experimental
+// programs, but you may also freely use it in yours as long as you
+// abide by the following terms and conditions:
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following
+//     disclaimer in the documentation and/or other materials
+//     provided with the distribution.
+//   * The name(s) of the author(s) and contributors (if any) may not
+//     be used to endorse or promote products derived from this
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+// CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+// OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.  IN OTHER WORDS, USE AT YOUR OWN RISK, NOT OURS.  
+//--------------------------------------------------------------------
+
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+#include <deque>
+#include <future>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Returns true if the path names a directory.
+bool IsDirectory(const wchar_t *path);
+
+// Converts UTF-8 text to a wide string.  Bytes that aren't valid
+// UTF-8 become U+FFFD.
+std::wstring FromUTF8(const std::string &text);
+
+// Converts a wide string to UTF-8.
+std::string ToUTF8(const std::wstring &text);
+
+// Returns the 64-bit FNV-1a hash of some bytes.  It's quick, and
+// the same on every machine.
+uint64_t HashBytes(const void *data, size_t size);
+
+// Returns a hash of a path that's the same on every machine (the
+// hash of the path in UTF-8, with backslashes counted as forward
+// slashes), for splitting a list of files between machines by
+// name.
+uint64_t PathHash(const std::wstring &path);
+
+// Returns the name that a WAV file's segment files are named after,
+// which is the file's name without its directory or extension, so
+// "recordings\day1.wav" gives "day1".  The segment files all go in
+// the current directory, whichever directory the WAV file is in.
+std::wstring SegmentBaseName(const std::wstring &filename);
+
+// Keeps track of the WAV files whose segment files are going to be
+// written, so two WAV files with the same name in different
+// directories (which would write the same segment files, one over
+// the other) are caught before either one is processed.
+class OutputNames
+{
+public:
+    // Adds a WAV file.  If a file that was added before it has the
+    // same segment files, this returns false with that file's name
+    // in 'earlier', and the file isn't added.
+    bool Add(const std::wstring &filename, std::wstring &earlier);
+
+private:
+    std::unordered_map<std::wstring, std::wstring> m_files; // Files by their segment files' base name.
+};
+
+// One WAV file from a manifest, with any options given for it.
+struct ManifestEntry
+{
+    std::wstring m_filename;                // Name of the WAV file.
+    std::vector<std::wstring> m_options;    // Options for the file, like "--level=-3".
+    unsigned m_line = 0;                    // Line number in the manifest (1=first).
+    std::string m_error;                    // Why the line couldn't be read (if it couldn't).
+};
+
+// Reads a manifest, which is a text file (in UTF-8) that lists the
+// WAV files to process, one per line.  Each line is either just the
+// name of a file, or a JSON object with the name of the file as
+// "path" and any options for it, named like the command line
+// options, for example:
+//
+//   recordings/day1.wav
+//   {"path": "recordings/day2.wav", "level": -3, "truepeak": true}
+//
+// Options with a value of true become switches like "--truepeak",
+// options with a value of false or null are left out, and others
+// become options like "--level=-3".  Blank lines, and lines that
+// start with '#', are skipped.  A relative path is taken to be
+// relative to the directory the manifest is in, so a manifest can
+// be used from any working directory.
+//
+// The manifest is read one line at a time as the entries are
+// needed, so it can list any number of files.
+class ManifestReader
+{
+public:
+    ManifestReader() = default;
+    ~ManifestReader() { Close(); }
+
+    ManifestReader(const ManifestReader &) = delete;
+    ManifestReader &operator=(const ManifestReader &) = delete;
+
+    // Opens the manifest.
+    // Returns true if successful.
+    bool Open(const wchar_t *filename);
+
+    // Closes the manifest.
+    void Close();
+
+    // Reads the next entry from the manifest.  If a line can't be
+    // understood, the entry's m_error says why, and its filename is
+    // empty.
+    // Returns false if there are no more entries.
+    bool Next(ManifestEntry &entry);
+
+private:
+    FILE *m_fp = nullptr;       // The open manifest.
+    unsigned m_line = 0;        // Number of lines read so far.
+    std::wstring m_directory;   // Directory the manifest is in (empty=the current directory).
+};
+
+// Finds the WAV files in a directory and all of the directories
+// under it.  The files are returned in a fixed order (each
+// directory's files sorted by name, then the directories under it,
+// also sorted by name), so the same tree always gives the same
+// list.
+//
+// The files are found as they're needed, so a huge tree doesn't
+// have to be listed before the first file is processed.  The next
+// several directories are listed in parallel while the files from
+// the earlier ones are being returned, so waiting on the file
+// system for each directory in turn doesn't hold things up.
+class DirectoryWalker
+{
+public:
+    // Starts walking the tree under 'root'.
+    explicit DirectoryWalker(const std::wstring &root);
+
+    DirectoryWalker(const DirectoryWalker &) = delete;
+    DirectoryWalker &operator=(const DirectoryWalker &) = delete;
+
+    // Gets the name of the next WAV file.
+    // Returns false if there are no more.
+    bool Next(std::wstring &filename);
+
+    // Returns the directories that couldn't be listed.
+    const std::vector<std::wstring> &UnreadableDirectories() const { return m_unreadable; }
+
+private:
+    // One directory and what's in it, once it's been listed.
+    struct Directory
+    {
+        std::wstring m_path;                    // Name of the directory.
+        std::vector<std::wstring> m_files;      // WAV files in it.
+        std::vector<std::wstring> m_subdirs;    // Directories in it.
+        std::future<bool> m_listing;            // Finishes when it's been listed.
+        bool m_started = false;                 // Has the listing been started?
+    };
+
+    // Starts listing the next few directories that will be needed.
+    void list_ahead();
+
+    std::deque<std::shared_ptr<Directory>> m_pending;   // Directories to return files from, in order.
+    std::deque<std::wstring> m_files;                   // Files to return before the next directory.
+    std::vector<std::wstring> m_unreadable;             // Directories that couldn't be listed.
+};
@@ -0,0 +1,242 @@
+//-------------------------------------------------------------------
+//
+// inputs_test.cpp
+//
+// Simple test of the inputs.cpp module.  Writes a manifest with
+// plain lines, JSON lines (with options, escapes and non-English
+// names) and bad lines, and confirms that ManifestReader reads
+// them correctly, and checks some path hashes, and that two WAV
+// files with the same name in different directories are caught by
+// OutputNames, since their segment files would clash.  Then makes
+// a small tree of directories and confirms that DirectoryWalker
+// finds the WAV files in it, in order, and that a manifest in it
+// gives paths relative to its directory.
+//
+//-------------------------------------------------------------------
+//
+// (C) Copyright 2024 Ammon R. Campbell.
+//
+// I wrote this code for use in my own educational and experimental
+// programs, but you may also freely use it in yours as long as you
+// abide by the following terms and conditions:
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following
+//     disclaimer in the documentation and/or other materials
+//     provided with the distribution.
+//   * The name(s) of the author(s) and contributors (if any) may not
+//     be used to endorse or promote products derived from this
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+// CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+// OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.  IN OTHER WORDS, USE AT YOUR OWN RISK, NOT OURS.  
+//--------------------------------------------------------------------
+
+#include "inputs.h"
+#include <stdio.h>
+#include <wchar.h>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#define SEPARATOR L"\\"
+#define ABSOLUTE_PATH L"C:\\abs.wav"
+#else
+#define SEPARATOR L"/"
+#define ABSOLUTE_PATH L"/abs.wav"
+#endif
+
+// Makes an empty file.
+// Returns true if successful.
+static bool touch(const std::wstring &filename)
+{
+    FILE *fp = nullptr;
+    if (_wfopen_s(&fp, filename.c_str(), L"wb") || !fp)
+        return false;
+    fclose(fp);
+    return true;
+}
+
+bool test_inputs()
+{
+    printf("Starting inputs test\n");
+
+    // A manifest with one of each kind of line.
+    const wchar_t *manifest_name = L"temp_manifest.txt";
+    FILE *fp = nullptr;
+    if (_wfopen_s(&fp, manifest_name, L"wb") || !fp)
+    {
+        printf("Couldn't write '%S'\n", manifest_name);
+        return false;
+    }
+    fputs("\xEF\xBB\xBF" "first.wav\r\n", fp);
+    fputs("\n# A comment\n", fp);
+    fputs("  {\"path\": \"dir/second.wav\", \"level\": -3.5, \"truepeak\": true, \"analyze\": false}\n", fp);
+    fputs("{\"storage\":\"int16\",\"path\":\"caf\xC3\xA9 \\\"\\u00e9\\\".wav\"}\n", fp);
+    fputs("{\"path\": \"broken.wav\"\n", fp);
+    fputs("{\"level\": -3}\n", fp);
+    fputs("last.wav", fp);
+    fclose(fp);
+
+    struct Expected
+    {
+        const wchar_t *m_filename;
+        std::vector<std::wstring> m_options;
+        unsigned m_line;
+        bool m_error;
+    };
+    const Expected expected[] = {
+        { L"first.wav", {}, 1, false },
+        { L"dir/second.wav", { L"--level=-3.5", L"--truepeak" }, 4, false },
+        { L"caf\u00e9 \"\u00e9\".wav", { L"--storage=int16" }, 5, false },
+        { L"", {}, 6, true },
+        { L"", {}, 7, true },
+        { L"last.wav", {}, 8, false },
+    };
+
+    bool ok = true;
+    ManifestReader reader;
+    if (!reader.Open(manifest_name))
+    {
+        printf("ManifestReader couldn't open '%S'\n", manifest_name);
+        ok = false;
+    }
+    ManifestEntry entry;
+    for (const Expected &expect : expected)
+    {
+        if (!ok)
+            break;
+        if (!reader.Next(entry) || entry.m_filename != expect.m_filename || entry.m_options != expect.m_options ||
+            entry.m_line != expect.m_line || entry.m_error.empty() == expect.m_error)
+        {
+            printf("Manifest line %u wasn't read correctly!\n", expect.m_line);
+            ok = false;
+        }
+    }
+    if (ok && reader.Next(entry))
+    {
+        printf("ManifestReader read past the end of the manifest!\n");
+        ok = false;
+    }
+    reader.Close();
+    _wunlink(manifest_name);
+
+    // Path hashes are the same for either kind of slash, and for
+    // characters that take a surrogate pair on Windows.
+    if (ok && (PathHash(L"a") != 0xaf63dc4c8601ec8cULL ||
+               PathHash(L"dir\\caf\u00e9.wav") != 0x702954266560836dULL ||
+               PathHash(L"dir/\U0001F600.wav") != 0x1e6e28aa01cf7470ULL))
+    {
+        printf("PathHash gave the wrong hash!\n");
+        ok = false;
+    }
+
+    // Segment files are named after just the WAV file's base name,
+    // so two files with the same name in different directories
+    // clash, and the second one is caught.
+    const std::wstring take1 = L"sub0" SEPARATOR L"take1.wav";
+    const std::wstring other_take1 = L"sub.1" SEPARATOR L"take1.wav";
+    std::wstring earlier;
+    OutputNames names;
+    if (ok && (SegmentBaseName(take1) != L"take1" || SegmentBaseName(L"sub.1" SEPARATOR L"take1") != L"take1" ||
+               !names.Add(take1, earlier) || !names.Add(L"take2.wav", earlier) ||
+               names.Add(other_take1, earlier) || earlier != take1))
+    {
+        printf("OutputNames didn't catch two files with the same segment files!\n");
+        ok = false;
+    }
+
+    // A tree of directories with WAV files and other files in it.
+    const std::wstring root = L"temp_walk";
+    const std::wstring dirs[] = { root, root + SEPARATOR L"sub1", root + SEPARATOR L"sub0",
+        root + SEPARATOR L"sub0" SEPARATOR L"deeper" };
+    const std::wstring files[] = {
+        root + SEPARATOR L"b.wav",
+        root + SEPARATOR L"a.WAV",
+        root + SEPARATOR L"notes.txt",
+        root + SEPARATOR L"sub1" SEPARATOR L"c.wav",
+        root + SEPARATOR L"sub0" SEPARATOR L"deeper" SEPARATOR L"e.wav",
+        root + SEPARATOR L"sub0" SEPARATOR L"d.wav",
+    };
+    for (const std::wstring &dir : dirs)
+        _wmkdir(dir.c_str());
+    for (const std::wstring &file : files)
+    {
+        if (ok && !touch(file))
+        {
+            printf("Couldn't write '%S'\n", file.c_str());
+            ok = false;
+        }
+    }
+
+    const std::wstring walk_order[] = { files[1], files[0], files[5], files[4], files[3] };
+    if (ok && (!IsDirectory(root.c_str()) || IsDirectory(files[0].c_str())))
+    {
+        printf("IsDirectory got a file or directory wrong!\n");
+        ok = false;
+    }
+    if (ok)
+    {
+        DirectoryWalker walker(root);
+        std::wstring filename;
+        for (const std::wstring &expect : walk_order)
+        {
+            if (!walker.Next(filename) || filename != expect)
+            {
+                printf("DirectoryWalker found '%S' instead of '%S'!\n", filename.c_str(), expect.c_str());
+                ok = false;
+                break;
+            }
+        }
+        if (ok && (walker.Next(filename) || !walker.UnreadableDirectories().empty()))
+        {
+            printf("DirectoryWalker found too many files or couldn't list a directory!\n");
+            ok = false;
+        }
+    }
+
+    // The relative paths in a manifest in another directory are
+    // relative to that directory.
+    const std::wstring nested_manifest = root + SEPARATOR L"sub1" SEPARATOR L"list.txt";
+    if (ok && (_wfopen_s(&fp, nested_manifest.c_str(), L"wb") || !fp))
+    {
+        printf("Couldn't write '%S'\n", nested_manifest.c_str());
+        ok = false;
+    }
+    if (ok)
+    {
+        fprintf(fp, "c.wav\n%s\n", ToUTF8(ABSOLUTE_PATH).c_str());
+        fclose(fp);
+        if (!reader.Open(nested_manifest.c_str()) || !reader.Next(entry) || entry.m_filename != files[3] ||
+            !reader.Next(entry) || entry.m_filename != ABSOLUTE_PATH)
+        {
+            printf("Manifest paths weren't taken relative to the manifest!\n");
+            ok = false;
+        }
+        reader.Close();
+        _wunlink(nested_manifest.c_str());
+    }
+
+    for (const std::wstring &file : files)
+        _wunlink(file.c_str());
+    for (size_t idir = sizeof(dirs) / sizeof(dirs[0]); idir > 0; idir--)
+        _wrmdir(dirs[idir - 1].c_str());
+
+    return ok;
+}
@@ -0,0 +1,576 @@
+//-------------------------------------------------------------------
+//
+// jobs.cpp
+//
+// C++ module for running a batch of independent jobs (such as
+// processing many WAV files) on a pool of threads.
+//
+//-------------------------------------------------------------------
+//
+// (C) Copyright 2024 Ammon R. Campbell.
+//
+// I wrote this code for use in my own educational and experimental
+// programs, but you may also freely use it in yours as long as you
+// abide by the following terms and conditions:
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following
+//     disclaimer in the documentation and/or other materials
+//     provided with the distribution.
+//   * The name(s) of the author(s) and contributors (if any) may not
+//     be used to endorse or promote products derived from this
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+// CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+// OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.  IN OTHER WORDS, USE AT YOUR OWN RISK, NOT OURS.  
+//--------------------------------------------------------------------
+
+#include "jobs.h"
+#include <stdio.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sched.h>
+#endif
+
+#ifdef _WIN32
+
+// Counts the CPUs in the process's affinity mask, and limits that
+// to the CPU rate of the job object the process is in (if any).
+static unsigned allowed_cpu_count()
+{
+    DWORD_PTR process_mask = 0, system_mask = 0;
+    if (!GetProcessAffinityMask(GetCurrentProcess(), &process_mask, &system_mask))
+        return 0;
+
+    unsigned count = 0;
+    for (; process_mask; process_mask &= process_mask - 1)
+        count++;
+
+    // A hard cap on the job's CPU rate is given in hundredths of a
+    // percent of all of the system's CPUs.
+    JOBOBJECT_CPU_RATE_CONTROL_INFORMATION rate = {};
+    if (QueryInformationJobObject(nullptr, JobObjectCpuRateControlInformation, &rate, sizeof(rate), nullptr) &&
+        (rate.ControlFlags & JOB_OBJECT_CPU_RATE_CONTROL_ENABLE) &&
+        (rate.ControlFlags & JOB_OBJECT_CPU_RATE_CONTROL_HARD_CAP))
+    {
+        SYSTEM_INFO info = {};
+        GetSystemInfo(&info);
+        unsigned limit = static_cast<unsigned>((static_cast<unsigned long long>(rate.CpuRate) *
+            info.dwNumberOfProcessors + 9999) / 10000);
+        if (limit < count)
+            count = limit;
+    }
+
+    return count;
+}
+
+#else
+
+// Reads a cgroup's CPU quota, and returns the number of CPUs worth
+// of time it allows (rounded up), or 0 if there's no limit.
+static unsigned cgroup_cpu_limit()
+{
+    long long quota = 0, period = 0;
+
+    // cgroup version 2 has the quota and period in one file.
+    FILE *fp = fopen("/sys/fs/cgroup/cpu.max", "r");
+    if (fp)
+    {
+        if (fscanf(fp, "%lld %lld", &quota, &period) != 2)
+            quota = 0; // "max" means no limit.
+        fclose(fp);
+    }
+    else
+    {
+        // cgroup version 1 has them in separate files.
+        fp = fopen("/sys/fs/cgroup/cpu/cpu.cfs_quota_us", "r");
+        if (fp)
+        {
+            if (fscanf(fp, "%lld", &quota) != 1)
+                quota = 0;
+            fclose(fp);
+        }
+        fp = fopen("/sys/fs/cgroup/cpu/cpu.cfs_period_us", "r");
+        if (fp)
+        {
+            if (fscanf(fp, "%lld", &period) != 1)
+                period = 0;
+            fclose(fp);
+        }
+    }
+
+    if (quota <= 0 || period <= 0)
+        return 0;
+
+    return static_cast<unsigned>((quota + period - 1) / period);
+}
+
+// Counts the CPUs in the process's affinity mask, and limits that
+// to the cgroup's CPU quota (if any).
+static unsigned allowed_cpu_count()
+{
+    unsigned count = 0;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0)
+        count = static_cast<unsigned>(CPU_COUNT(&set));
+
+    unsigned limit = cgroup_cpu_limit();
+    if (limit && (!count || limit < count))
+        count = limit;
+
+    return count;
+}
+
+#endif
+
+unsigned AvailableCPUCount()
+{
+    unsigned count = allowed_cpu_count();
+    if (!count)
+        count = std::thread::hardware_concurrency();
+
+    return count ? count : 1;
+}
+
+// One task waiting to run, and the group it belongs to.
+struct Task
+{
+    std::function<void()> m_run;    // The work to do.
+    TaskGroup *m_group = nullptr;   // Group to tell when it's done.
+};
+
+// A queue of tasks, which is shared between threads.
+struct TaskQueue
+{
+    std::mutex m_mutex;             // Guards m_tasks.
+    std::deque<Task> m_tasks;       // Tasks waiting to run.
+};
+
+// Runs tasks on a pool of threads, with work stealing.  Each thread
+// takes tasks from the back of its own queue, so it keeps working
+// on the most recent (and most related) work it created.  When its
+// queue is empty, it steals from the front of another thread's
+// queue, where the oldest (and usually biggest) tasks are, and
+// after that it starts the next of the jobs given to RunJobs.
+//
+// A thread that's waiting for a group of tasks runs other tasks
+// while it waits, but doesn't start new jobs.  A new job could
+// take much longer than the group, and could even wait for
+// something (like memory) that the waiting job is holding.
+class TaskScheduler
+{
+public:
+    explicit TaskScheduler(unsigned num_threads);
+
+    // Adds a task to the current thread's queue.
+    void Push(Task task);
+
+    // Adds a job to the queue of jobs that haven't been started,
+    // as a task of the given group.  This can be called from any
+    // thread.
+    void PushJob(std::function<void()> run, TaskGroup &group);
+
+    // Runs one task, if there are any waiting.  If 'start_jobs' is
+    // true, it can start a new job if there are no tasks.
+    // Returns false if there was nothing to run.
+    bool RunOne(bool start_jobs);
+
+    // Runs tasks until the group's tasks are finished.  If
+    // 'start_jobs' is true, it can start new jobs too.
+    void WaitFor(TaskGroup &group, bool start_jobs);
+
+    // Sleeps until the group's tasks are finished, on a thread
+    // that isn't one of the pool's.
+    void WaitOutside(TaskGroup &group);
+
+    // Runs tasks until Stop is called.
+    void WorkerLoop();
+
+    // Tells the threads in WorkerLoop to return.
+    void Stop();
+
+private:
+    // Takes a task from the back of the queue if 'back' is true, or
+    // from the front otherwise.
+    bool take(TaskQueue &queue, bool back, Task &task);
+
+    // Wakes up the threads that are waiting for something to do.
+    void wake_all();
+
+    std::vector<std::unique_ptr<TaskQueue>> m_queues;   // One queue for each thread.
+    TaskQueue m_jobs;                       // Jobs that haven't been started.
+    std::atomic<size_t> m_queued_tasks{0};  // Number of tasks in the threads' queues.
+    std::atomic<size_t> m_queued_jobs{0};   // Number of jobs that haven't been started.
+    std::mutex m_sleep_mutex;               // Guards m_stop, and goes with m_wake.
+    std::condition_variable m_wake;         // Signalled when there's something to do.
+    bool m_stop = false;                    // Should WorkerLoop return?
+};
+
+// The scheduler that the current thread belongs to (if any), and
+// which of the scheduler's queues is the thread's own.
+static thread_local TaskScheduler *t_scheduler = nullptr;
+static thread_local size_t t_queue = 0;
+
+TaskScheduler::TaskScheduler(unsigned num_threads)
+{
+    for (unsigned ithread = 0; ithread < num_threads; ithread++)
+        m_queues.emplace_back(new TaskQueue);
+}
+
+void TaskScheduler::Push(Task task)
+{
+    {
+        TaskQueue &queue = *m_queues[t_queue];
+        std::lock_guard<std::mutex> lock(queue.m_mutex);
+        queue.m_tasks.push_back(std::move(task));
+    }
+    m_queued_tasks++;
+
+    // Locking the mutex makes sure a thread that's about to wait
+    // either sees the new task or gets the notification.
+    {
+        std::lock_guard<std::mutex> lock(m_sleep_mutex);
+    }
+    m_wake.notify_one();
+}
+
+void TaskScheduler::PushJob(std::function<void()> run, TaskGroup &group)
+{
+    Task task;
+    task.m_run = std::move(run);
+    task.m_group = &group;
+    group.m_pending++;
+    {
+        std::lock_guard<std::mutex> lock(m_jobs.m_mutex);
+        m_jobs.m_tasks.push_back(std::move(task));
+    }
+    m_queued_jobs++;
+
+    // Only the threads that are looking for work start jobs, so all
+    // of the sleeping threads are woken, to be sure one of them is.
+    wake_all();
+}
+
+bool TaskScheduler::take(TaskQueue &queue, bool back, Task &task)
+{
+    std::lock_guard<std::mutex> lock(queue.m_mutex);
+    if (queue.m_tasks.empty())
+        return false;
+
+    if (back)
+    {
+        task = std::move(queue.m_tasks.back());
+        queue.m_tasks.pop_back();
+    }
+    else
+    {
+        task = std::move(queue.m_tasks.front());
+        queue.m_tasks.pop_front();
+    }
+    return true;
+}
+
+bool TaskScheduler::RunOne(bool start_jobs)
+{
+    // Try our own queue, then steal from the other threads, going
+    // around from the one after us, then start a new job.
+    Task task;
+    bool found = false;
+    if (m_queued_tasks)
+    {
+        const size_t num_queues = m_queues.size();
+        found = take(*m_queues[t_queue], true, task);
+        for (size_t ivictim = 1; !found && ivictim < num_queues; ivictim++)
+            found = take(*m_queues[(t_queue + ivictim) % num_queues], false, task);
+        if (found)
+            m_queued_tasks--;
+    }
+    if (!found && start_jobs && m_queued_jobs)
+    {
+        found = take(m_jobs, false, task);
+        if (found)
+            m_queued_jobs--;
+    }
+    if (!found)
+        return false;
+
+    task.m_group->run_task(task.m_run);
+    if (--task.m_group->m_pending == 0)
+        wake_all();
+    return true;
+}
+
+void TaskScheduler::wake_all()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_sleep_mutex);
+    }
+    m_wake.notify_all();
+}
+
+void TaskScheduler::WaitFor(TaskGroup &group, bool start_jobs)
+{
+    while (group.m_pending)
+    {
+        if (RunOne(start_jobs))
+            continue;
+
+        // Nothing to run, so sleep until some of the group's tasks
+        // (which are running on other threads) finish, or there's
+        // something new to run.
+        std::unique_lock<std::mutex> lock(m_sleep_mutex);
+        m_wake.wait(lock, [this, &group, start_jobs]()
+        {
+            return !group.m_pending || m_queued_tasks || (start_jobs && m_queued_jobs);
+        });
+    }
+}
+
+void TaskScheduler::WaitOutside(TaskGroup &group)
+{
+    std::unique_lock<std::mutex> lock(m_sleep_mutex);
+    m_wake.wait(lock, [&group]() { return !group.m_pending; });
+}
+
+void TaskScheduler::WorkerLoop()
+{
+    for (;;)
+    {
+        if (RunOne(true))
+            continue;
+
+        std::unique_lock<std::mutex> lock(m_sleep_mutex);
+        m_wake.wait(lock, [this]() { return m_stop || m_queued_tasks || m_queued_jobs; });
+        if (m_stop)
+            return;
+    }
+}
+
+void TaskScheduler::Stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_sleep_mutex);
+        m_stop = true;
+    }
+    m_wake.notify_all();
+}
+
+size_t MemoryBudget::Acquire(size_t bytes)
+{
+    if (!m_total)
+        return 0;
+    if (bytes > m_total)
+        bytes = m_total;
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_freed.wait(lock, [this, bytes]() { return m_used + bytes <= m_total; });
+    m_used += bytes;
+    return bytes;
+}
+
+void MemoryBudget::Release(size_t bytes)
+{
+    if (!bytes)
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_used -= bytes;
+    }
+    m_freed.notify_all();
+}
+
+void TaskGroup::Run(std::function<void()> task)
+{
+    if (!t_scheduler)
+    {
+        run_task(task);
+        return;
+    }
+
+    m_pending++;
+    Task queued;
+    queued.m_run = std::move(task);
+    queued.m_group = this;
+    t_scheduler->Push(std::move(queued));
+}
+
+void TaskGroup::Wait()
+{
+    wait();
+    rethrow();
+}
+
+void TaskGroup::wait()
+{
+    if (m_pending)
+        t_scheduler->WaitFor(*this, false);
+}
+
+void TaskGroup::run_task(const std::function<void()> &task)
+{
+    try
+    {
+        task();
+    }
+    catch(...)
+    {
+        std::lock_guard<std::mutex> lock(m_error_mutex);
+        if (!m_error)
+            m_error = std::current_exception();
+    }
+}
+
+void TaskGroup::rethrow()
+{
+    std::exception_ptr error;
+    {
+        std::lock_guard<std::mutex> lock(m_error_mutex);
+        error.swap(m_error);
+    }
+    if (error)
+        std::rethrow_exception(error);
+}
+
+void RunJobs(size_t num_jobs, unsigned num_threads, const std::function<void(size_t)> &job)
+{
+    if (!num_threads)
+        num_threads = 1;
+
+    TaskScheduler scheduler(num_threads);
+    TaskGroup jobs;
+    for (size_t ijob = 0; ijob < num_jobs; ijob++)
+        scheduler.PushJob([&job, ijob]() { job(ijob); }, jobs);
+
+    // The calling thread is one of the pool, using the first queue.
+    auto start = [&scheduler](size_t iqueue)
+    {
+        t_scheduler = &scheduler;
+        t_queue = iqueue;
+    };
+    std::vector<std::thread> threads;
+    for (unsigned ithread = 1; ithread < num_threads; ithread++)
+    {
+        threads.emplace_back([&scheduler, &start, ithread]()
+        {
+            start(ithread);
+            scheduler.WorkerLoop();
+        });
+    }
+
+    TaskScheduler *previous_scheduler = t_scheduler;
+    size_t previous_queue = t_queue;
+    start(0);
+    scheduler.WaitFor(jobs, true);
+    t_scheduler = previous_scheduler;
+    t_queue = previous_queue;
+
+    scheduler.Stop();
+    for (std::thread &thread : threads)
+        thread.join();
+    jobs.rethrow();
+}
+
+std::vector<size_t> OrderJobs(const std::vector<double> &costs, JobOrder order)
+{
+    std::vector<size_t> jobs(costs.size());
+    for (size_t ijob = 0; ijob < jobs.size(); ijob++)
+        jobs[ijob] = ijob;
+
+    if (order == JobOrder::LongestFirst)
+        std::stable_sort(jobs.begin(), jobs.end(), [&costs](size_t a, size_t b) { return costs[a] > costs[b]; });
+    else if (order == JobOrder::ShortestFirst)
+        std::stable_sort(jobs.begin(), jobs.end(), [&costs](size_t a, size_t b) { return costs[a] < costs[b]; });
+
+    return jobs;
+}
+
+std::vector<unsigned> BalanceShards(const std::vector<double> &costs, std::vector<double> &loads)
+{
+    std::vector<unsigned> shards(costs.size(), 0);
+    if (loads.empty())
+        return shards;
+
+    for (size_t ijob : OrderJobs(costs, JobOrder::LongestFirst))
+    {
+        const unsigned shard = static_cast<unsigned>(std::min_element(loads.begin(), loads.end()) - loads.begin());
+        shards[ijob] = shard;
+        loads[shard] += costs[ijob];
+    }
+
+    return shards;
+}
+
+JobPool::JobPool(unsigned num_threads)
+{
+    if (!num_threads)
+        num_threads = 1;
+
+    m_scheduler.reset(new TaskScheduler(num_threads));
+    for (unsigned ithread = 0; ithread < num_threads; ithread++)
+    {
+        m_threads.emplace_back([this, ithread]()
+        {
+            t_scheduler = m_scheduler.get();
+            t_queue = ithread;
+            m_scheduler->WorkerLoop();
+        });
+    }
+}
+
+JobPool::~JobPool()
+{
+    stop();
+}
+
+void JobPool::Add(std::function<void()> job)
+{
+    m_scheduler->PushJob(std::move(job), m_jobs);
+}
+
+void JobPool::Finish()
+{
+    stop();
+    m_jobs.rethrow();
+}
+
+void JobPool::stop()
+{
+    if (m_threads.empty())
+        return;
+
+    m_scheduler->WaitOutside(m_jobs);
+    m_scheduler->Stop();
+    for (std::thread &thread : m_threads)
+        thread.join();
+    m_threads.clear();
+}
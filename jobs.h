@@ -0,0 +1,228 @@
+//-------------------------------------------------------------------
+//
+// jobs.h
+//
+// Header of C++ module for running a batch of independent jobs
+// (such as processing many WAV files) on a pool of threads.
+//
+//-------------------------------------------------------------------
+//
+// (C) Copyright 2024 Ammon R. Campbell.
+//
+// I wrote this code for use in my own educational and experimental
+// programs, but you may also freely use it in yours as long as you
+// abide by the following terms and conditions:
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following
+//     disclaimer in the documentation and/or other materials
+//     provided with the distribution.
+//   * The name(s) of the author(s) and contributors (if any) may not
+//     be used to endorse or promote products derived from this
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+// CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+// OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.  IN OTHER WORDS, USE AT YOUR OWN RISK, NOT OURS.  
+//--------------------------------------------------------------------
+
+#pragma once
+#include <stddef.h>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Returns the number of CPUs that this process is allowed to use.
+// This is the number of CPUs in the process's affinity mask, or
+// less if the process is limited to a share of the CPU time (by a
+// cgroup on Linux, or a job object on Windows).  Always returns at
+// least 1.
+unsigned AvailableCPUCount();
+
+// Runs 'job(0)' through 'job(num_jobs - 1)' on a pool of
+// 'num_threads' threads, and returns when all of them are done.
+// The jobs are started in order, but can finish in any order.
+//
+// Each thread in the pool has its own queue of tasks, which the
+// jobs can add smaller pieces of work to with a TaskGroup.  A
+// thread that runs out of tasks (and jobs) steals tasks from the
+// other threads' queues, so near the end of a batch, when only one
+// or two long jobs are left, their tasks get spread across all of
+// the threads.  If a job throws an exception, the other jobs still
+// run, and the first exception is thrown again once they're done.
+void RunJobs(size_t num_jobs, unsigned num_threads, const std::function<void(size_t)> &job);
+
+// Orders that a batch of jobs can be started in.
+enum class JobOrder
+{
+    Input,          // The order they were given in.
+    LongestFirst,   // Longest first, so the batch finishes soonest.
+    ShortestFirst,  // Shortest first, so the most jobs finish soonest.
+};
+
+// Returns the order to start a batch of jobs in, as a list of the
+// jobs' indexes, given an estimate of how long each job will take.
+// Longest first is the classic LPT (longest processing time)
+// schedule:  starting the big jobs early keeps one of them from
+// running by itself at the end while the other threads sit idle.
+// Jobs with the same estimate stay in their original order.
+std::vector<size_t> OrderJobs(const std::vector<double> &costs, JobOrder order);
+
+// Splits a batch of jobs between several shards (such as separate
+// machines that each run their own share of the batch), so each
+// shard gets about the same total cost.  The jobs are given out
+// longest first, each to the shard with the least cost so far (the
+// lowest numbered one if there's a tie).  'loads' holds each
+// shard's total cost so far, and is updated, so several batches can
+// be balanced one after another.  The result only depends on the
+// costs and the loads, so every machine that runs it on the same
+// batch gets the same shards.
+// Returns the shard for each job.
+std::vector<unsigned> BalanceShards(const std::vector<double> &costs, std::vector<double> &loads);
+
+// Keeps track of how much of a fixed amount of memory is in use,
+// like a semaphore that counts bytes.  A job acquires its estimated
+// memory use before it starts, and waits if that much isn't free,
+// so the jobs running at once never use more than the budget.
+class MemoryBudget
+{
+public:
+    // Makes a budget of 'total' bytes (0 for no limit).
+    explicit MemoryBudget(size_t total) : m_total(total) {}
+
+    MemoryBudget(const MemoryBudget &) = delete;
+    MemoryBudget &operator=(const MemoryBudget &) = delete;
+
+    // Returns the total size of the budget, or 0 if it has no limit.
+    size_t Total() const { return m_total; }
+
+    // Returns true if 'bytes' would fit in the budget if nothing
+    // else were using it.
+    bool Fits(size_t bytes) const { return !m_total || bytes <= m_total; }
+
+    // Waits until 'bytes' of the budget are free, and takes them.
+    // Returns the number of bytes taken, which must be passed to
+    // Release later.  A request bigger than the whole budget waits
+    // until nothing else is using it, then takes all of it.
+    size_t Acquire(size_t bytes);
+
+    // Gives back bytes that were taken by Acquire.
+    void Release(size_t bytes);
+
+private:
+    const size_t m_total;               // Size of the budget, or 0 for no limit.
+    size_t m_used = 0;                  // Number of bytes taken.
+    std::mutex m_mutex;                 // Guards m_used.
+    std::condition_variable m_freed;    // Signalled when bytes are released.
+};
+
+// A group of tasks that can run in parallel, such as writing each
+// of the segments of one WAV file.  When used from one of the
+// threads of RunJobs's pool, each task goes on the thread's queue,
+// where any idle thread in the pool can steal it.  When used from
+// any other thread, each task runs right away on that thread.
+//
+// If a task throws an exception (such as std::bad_alloc), the
+// group's other tasks still run, and Wait throws the first one
+// again, so the job that made the group can fail by itself instead
+// of ending the program.  Anything the tasks print should be held
+// until Wait returns (see OutputCapture in splitspeech.cpp), since
+// they can run on any of the threads.
+class TaskGroup
+{
+public:
+    TaskGroup() = default;
+    ~TaskGroup() { wait(); }
+
+    TaskGroup(const TaskGroup &) = delete;
+    TaskGroup &operator=(const TaskGroup &) = delete;
+
+    // Adds a task to the group.
+    void Run(std::function<void()> task);
+
+    // Waits for all of the group's tasks to finish.  While it
+    // waits, the thread runs other tasks from the pool (including
+    // the group's own), but doesn't start new jobs.  Then throws the
+    // first exception that any of the tasks threw, if there was one.
+    void Wait();
+
+private:
+    friend class TaskScheduler;
+    friend class JobPool;
+    friend void RunJobs(size_t num_jobs, unsigned num_threads, const std::function<void(size_t)> &job);
+
+    // Waits for all of the group's tasks to finish, without throwing.
+    void wait();
+
+    // Runs one of the group's tasks, keeping the exception if it
+    // throws one (and it's the first).
+    void run_task(const std::function<void()> &task);
+
+    // Throws the exception that a task threw, if there was one.
+    void rethrow();
+
+    std::atomic<size_t> m_pending{0};   // Number of the group's tasks that haven't finished.
+    std::mutex m_error_mutex;           // Guards m_error.
+    std::exception_ptr m_error;         // First exception a task threw (null=none).
+};
+
+class TaskScheduler;
+
+// A pool of threads that runs jobs as they're added, for when the
+// jobs aren't all known up front (such as WAV files that are read
+// one after another).  Like RunJobs, each thread has its own queue
+// of tasks for the jobs' TaskGroups, and a thread that has nothing
+// to do steals tasks from the others, or starts the next job.  A
+// thread with no tasks and no jobs to start sleeps until there are
+// some, so it doesn't hold up the threads that are busy.
+//
+// Jobs can be added from any thread, and are started in the order
+// they're added.  If a job throws an exception, the other jobs
+// still run, and Finish throws the first one again.
+class JobPool
+{
+public:
+    // Starts 'num_threads' threads (at least 1).
+    explicit JobPool(unsigned num_threads);
+
+    // Waits for the jobs (see Finish), without throwing.
+    ~JobPool();
+
+    JobPool(const JobPool &) = delete;
+    JobPool &operator=(const JobPool &) = delete;
+
+    // Adds a job to be started once a thread is free.
+    void Add(std::function<void()> job);
+
+    // Waits for all of the jobs that were added to finish, and stops
+    // the threads.  No more jobs can be added after this.
+    void Finish();
+
+private:
+    // Waits for the jobs and stops the threads, without throwing.
+    void stop();
+
+    std::unique_ptr<TaskScheduler> m_scheduler; // Runs the jobs and their tasks.
+    std::vector<std::thread> m_threads;         // The pool's threads.
+    TaskGroup m_jobs;                           // The jobs that were added.
+};
@@ -0,0 +1,271 @@
+//-------------------------------------------------------------------
+//
+// jobs_test.cpp
+//
+// Simple test of the jobs.cpp module.  Runs a batch of jobs, each
+// of which runs a group of tasks (some with tasks of their own), on
+// different numbers of threads and confirms that every job and
+// task ran exactly once, and was finished when Wait returned, and
+// that a task's exception is passed on by Wait and RunJobs, and
+// that a JobPool runs jobs that are added as it goes.  Also
+// checks the orders that OrderJobs puts jobs in, the shards that
+// BalanceShards splits them into, and that jobs sharing a
+// MemoryBudget stay within it.
+//
+//-------------------------------------------------------------------
+//
+// (C) Copyright 2024 Ammon R. Campbell.
+//
+// I wrote this code for use in my own educational and experimental
+// programs, but you may also freely use it in yours as long as you
+// abide by the following terms and conditions:
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following
+//     disclaimer in the documentation and/or other materials
+//     provided with the distribution.
+//   * The name(s) of the author(s) and contributors (if any) may not
+//     be used to endorse or promote products derived from this
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+// CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+// OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.  IN OTHER WORDS, USE AT YOUR OWN RISK, NOT OURS.  
+//--------------------------------------------------------------------
+
+#include "jobs.h"
+#include <stdio.h>
+#include <atomic>
+#include <new>
+#include <thread>
+#include <vector>
+
+// Number of tasks that each job runs (a multiple of 3).
+static const size_t k_tasks_per_job = 30;
+
+bool test_jobs()
+{
+    printf("Starting jobs test\n");
+
+    unsigned cpus = AvailableCPUCount();
+    if (cpus < 1)
+    {
+        printf("AvailableCPUCount returned %u!\n", cpus);
+        return false;
+    }
+
+    const unsigned thread_counts[] = { 1, 2, 8, cpus };
+    const size_t job_counts[] = { 0, 1, 5, 1000 };
+    for (unsigned num_threads : thread_counts)
+    {
+        for (size_t num_jobs : job_counts)
+        {
+            std::vector<std::atomic<unsigned>> runs(num_jobs);
+            std::vector<std::atomic<unsigned>> task_runs(num_jobs * k_tasks_per_job);
+            for (auto &count : runs)
+                count = 0;
+            for (auto &count : task_runs)
+                count = 0;
+            std::atomic<unsigned> failures(0);
+            RunJobs(num_jobs, num_threads, [&](size_t ijob)
+            {
+                runs[ijob]++;
+
+                // Every other task has two tasks of its own.
+                std::atomic<unsigned> *tasks = &task_runs[ijob * k_tasks_per_job];
+                TaskGroup group;
+                for (size_t itask = 0; itask < k_tasks_per_job; itask += 3)
+                {
+                    group.Run([tasks, itask]()
+                    {
+                        tasks[itask]++;
+                        TaskGroup subgroup;
+                        subgroup.Run([tasks, itask]() { tasks[itask + 1]++; });
+                        subgroup.Run([tasks, itask]() { tasks[itask + 2]++; });
+                        subgroup.Wait();
+                    });
+                }
+                group.Wait();
+
+                for (size_t itask = 0; itask < k_tasks_per_job; itask++)
+                {
+                    if (tasks[itask] != 1)
+                        failures++;
+                }
+            });
+
+            for (size_t ijob = 0; ijob < num_jobs; ijob++)
+            {
+                if (runs[ijob] != 1)
+                {
+                    printf("Job %zu of %zu ran %u times on %u threads!\n",
+                        ijob, num_jobs, runs[ijob].load(), num_threads);
+                    return false;
+                }
+            }
+            if (failures)
+            {
+                printf("%u task(s) weren't run exactly once before Wait returned on %u threads!\n",
+                    failures.load(), num_threads);
+                return false;
+            }
+        }
+    }
+
+    // Outside of RunJobs, the tasks run right away.
+    unsigned count = 0;
+    TaskGroup group;
+    group.Run([&count]() { count++; });
+    if (count != 1)
+    {
+        printf("Task didn't run right away outside of RunJobs!\n");
+        return false;
+    }
+
+    // A task that throws doesn't stop the group's other tasks, and
+    // its exception comes out of Wait (and then out of RunJobs).
+    std::atomic<unsigned> ran(0);
+    bool caught = false;
+    try
+    {
+        RunJobs(3, 4, [&](size_t ijob)
+        {
+            TaskGroup throwing;
+            for (unsigned itask = 0; itask < 10; itask++)
+            {
+                throwing.Run([&ran, itask]()
+                {
+                    ran++;
+                    if (itask == 5)
+                        throw std::bad_alloc();
+                });
+            }
+            try
+            {
+                throwing.Wait();
+            }
+            catch(const std::bad_alloc &)
+            {
+                if (ijob == 1)
+                    throw;
+            }
+        });
+    }
+    catch(const std::bad_alloc &)
+    {
+        caught = true;
+    }
+    if (!caught || ran != 30)
+    {
+        printf("A task's exception wasn't passed on by Wait and RunJobs!\n");
+        return false;
+    }
+
+    // Jobs added to a JobPool as they come along all run once, with
+    // their tasks, by the time Finish returns.
+    {
+        std::vector<std::atomic<unsigned>> pool_runs(100 * 2);
+        for (auto &pool_count : pool_runs)
+            pool_count = 0;
+        JobPool pool(4);
+        for (size_t ijob = 0; ijob < 100; ijob++)
+        {
+            pool.Add([&pool_runs, ijob]()
+            {
+                TaskGroup tasks;
+                tasks.Run([&pool_runs, ijob]() { pool_runs[ijob * 2]++; });
+                tasks.Run([&pool_runs, ijob]() { pool_runs[ijob * 2 + 1]++; });
+                tasks.Wait();
+            });
+            if (ijob % 10 == 0)
+                std::this_thread::yield();
+        }
+        pool.Finish();
+        for (const auto &pool_count : pool_runs)
+        {
+            if (pool_count != 1)
+            {
+                printf("JobPool didn't run every job's tasks exactly once!\n");
+                return false;
+            }
+        }
+    }
+
+    // Orders for jobs of these lengths (with a tie).
+    const std::vector<double> costs = { 10, 3600, 0.5, 3600, 60 };
+    const std::vector<size_t> expected[3] = {
+        { 0, 1, 2, 3, 4 },      // Input
+        { 1, 3, 4, 0, 2 },      // LongestFirst
+        { 2, 0, 4, 1, 3 },      // ShortestFirst
+    };
+    const JobOrder orders[3] = { JobOrder::Input, JobOrder::LongestFirst, JobOrder::ShortestFirst };
+    for (unsigned iorder = 0; iorder < 3; iorder++)
+    {
+        if (OrderJobs(costs, orders[iorder]) != expected[iorder])
+        {
+            printf("OrderJobs gave the wrong order for order %u!\n", iorder);
+            return false;
+        }
+    }
+
+    // The same jobs split between two shards, then another batch
+    // that all goes to the shard that got less of the first.
+    std::vector<double> loads(2, 0.0);
+    const std::vector<unsigned> expected_shards = { 1, 0, 1, 1, 0 };
+    if (BalanceShards(costs, loads) != expected_shards || loads[0] != 3660 || loads[1] != 3610.5 ||
+        BalanceShards({ 20, 20, 20 }, loads) != std::vector<unsigned>({ 1, 1, 1 }))
+    {
+        printf("BalanceShards gave the wrong shards!\n");
+        return false;
+    }
+
+    // Jobs that share a memory budget never use more than all of it.
+    const size_t budget_bytes = 1000;
+    MemoryBudget budget(budget_bytes);
+    if (budget.Acquire(5000) != budget_bytes || budget.Fits(budget_bytes + 1))
+    {
+        printf("MemoryBudget didn't limit a request to the budget!\n");
+        return false;
+    }
+    budget.Release(budget_bytes);
+    std::atomic<size_t> in_use(0), peak(0);
+    RunJobs(200, 8, [&](size_t ijob)
+    {
+        size_t bytes = budget.Acquire(100 + (ijob * 37) % 900);
+        size_t now = in_use += bytes;
+        for (size_t seen = peak; now > seen && !peak.compare_exchange_weak(seen, now); )
+            continue;
+        std::this_thread::yield();
+        in_use -= bytes;
+        budget.Release(bytes);
+    });
+    if (peak > budget_bytes || budget.Acquire(budget_bytes) != budget_bytes)
+    {
+        printf("Jobs used %zu bytes of a budget of %zu!\n", peak.load(), budget_bytes);
+        return false;
+    }
+    budget.Release(budget_bytes);
+    if (MemoryBudget(0).Acquire(5000) != 0)
+    {
+        printf("MemoryBudget with no limit took bytes!\n");
+        return false;
+    }
+
+    printf("Jobs test OK.\n");
+    return true;
+}
@@ -0,0 +1,609 @@
+//-------------------------------------------------------------------
+//
+// journal.cpp
+//
+// C++ module for keeping a journal of the WAV files that have been
+// processed, and checkpoints of long recordings part way through,
+// so a long batch that gets interrupted can pick up where it left
+// off instead of starting over.  See journal.h for more about them.
+//
+// Each line of the journal has the size of a WAV file, its time,
+// the hash of its segments, the options it was processed with, and
+// its name (in UTF-8), separated by tabs.  The name is last, so it
+// can have tabs in it.
+//
+// A checkpoint file is a series of binary records, each with its
+// type (32 bits), the size of its contents (64 bits), the contents,
+// and the hash of the contents (64 bits).  The first record has the
+// checkpoint's key.  The numbers are in the machine's own format,
+// since a checkpoint is only picked up on the machine that left it.
+//
+//-------------------------------------------------------------------
+//
+// (C) Copyright 2024 Ammon R. Campbell.
+//
+// I wrote this code for use in my own educational and experimental
+// programs, but you may also freely use it in yours as long as you
+// abide by the following terms and conditions:
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following
+//     disclaimer in the documentation and/or other materials
+//     provided with the distribution.
+//   * The name(s) of the author(s) and contributors (if any) may not
+//     be used to endorse or promote products derived from this
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+// CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+// OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.  IN OTHER WORDS, USE AT YOUR OWN RISK, NOT OURS.  
+//--------------------------------------------------------------------
+
+#include "journal.h"
+#include "inputs.h"
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+// Types of records in a checkpoint file.
+enum CheckpointRecord : uint32_t
+{
+    k_checkpoint_key = 1,       // The key, which must match to pick it up.
+    k_checkpoint_analyzed = 2,  // A range of frames that was analyzed.
+    k_checkpoint_written = 3,   // A segment that was written.
+};
+
+// Largest checkpoint record that's believed when it's read back.
+static const uint64_t k_max_checkpoint_record = 1ULL << 30;
+
+// Number of records that can be added before the journal is synced
+// to the disk.
+static const unsigned k_records_per_sync = 32;
+
+// Number of seconds that can go by before the journal is synced.
+static const int k_seconds_per_sync = 5;
+
+// The first line of a new journal.
+static const char *k_journal_heading = "# splitspeech journal: size, time, segment files hash, options, segment files count, segment files, WAV file\n";
+
+// Flushes a file all the way to the disk.
+// Returns true if successful.
+static bool sync_file(FILE *fp)
+{
+    if (fflush(fp) != 0)
+        return false;
+#ifdef _WIN32
+    return _commit(_fileno(fp)) == 0;
+#else
+    return fsync(fileno(fp)) == 0;
+#endif
+}
+
+// Flushes a file after a record has been added to it, and syncs it
+// to the disk if enough records or time have gone by since it was
+// last synced.
+// Returns true if successful.
+static bool flush_record(FILE *fp, unsigned &unsynced, std::chrono::steady_clock::time_point &last_sync)
+{
+    const auto now = std::chrono::steady_clock::now();
+    if (++unsynced < k_records_per_sync && now - last_sync < std::chrono::seconds(k_seconds_per_sync))
+    {
+        // Flushing hands the record to the operating system, so it's
+        // kept if the program is killed; syncing it to the disk, so
+        // it's kept if the machine goes down, is slower.
+        return fflush(fp) == 0;
+    }
+
+    unsynced = 0;
+    last_sync = now;
+    return sync_file(fp);
+}
+
+#ifdef _WIN32
+
+bool GetFileStamp(const wchar_t *filename, uint64_t &size, int64_t &mtime)
+{
+    struct _stat64 info;
+    if (_wstat64(filename, &info) != 0)
+        return false;
+    size = static_cast<uint64_t>(info.st_size);
+    mtime = static_cast<int64_t>(info.st_mtime);
+    return true;
+}
+
+#else
+
+bool GetFileStamp(const wchar_t *filename, uint64_t &size, int64_t &mtime)
+{
+    struct stat info;
+    if (stat(ToUTF8(filename).c_str(), &info) != 0)
+        return false;
+    size = static_cast<uint64_t>(info.st_size);
+    mtime = static_cast<int64_t>(info.st_mtime);
+    return true;
+}
+
+#endif
+
+uint64_t HashOutputs(const std::vector<std::wstring> &outputs, bool &complete)
+{
+    complete = true;
+    std::string text;
+    for (const std::wstring &output : outputs)
+    {
+        uint64_t size = 0;
+        int64_t mtime = 0;
+        if (!GetFileStamp(output.c_str(), size, mtime))
+            complete = false;
+        text += ToUTF8(output);
+        text += '\t';
+        text += std::to_string(size);
+        text += '\n';
+    }
+    return HashBytes(text.data(), text.size());
+}
+
+// Reads a line of the journal into a record.
+// Returns false if the line isn't a record.
+static bool parse_record(const std::string &line, JournalRecord &record)
+{
+    const char *p = line.c_str();
+    char *end = nullptr;
+    record.m_size = strtoull(p, &end, 10);
+    if (end == p || *end != '\t')
+        return false;
+    p = end + 1;
+    record.m_mtime = strtoll(p, &end, 10);
+    if (end == p || *end != '\t')
+        return false;
+    p = end + 1;
+    record.m_outputs_hash = strtoull(p, &end, 16);
+    if (end == p || *end != '\t')
+        return false;
+    p = end + 1;
+    const char *tab = strchr(p, '\t');
+    if (!tab)
+        return false;
+    record.m_options.assign(p, tab);
+    p = tab + 1;
+    const unsigned long long count = strtoull(p, &end, 10);
+    if (end == p || *end != '\t')
+        return false;
+    p = end + 1;
+    record.m_outputs.clear();
+    for (unsigned long long ioutput = 0; ioutput < count; ioutput++)
+    {
+        tab = strchr(p, '\t');
+        if (!tab || tab == p)
+            return false;
+        record.m_outputs.push_back(FromUTF8(std::string(p, tab)));
+        p = tab + 1;
+    }
+    record.m_filename = FromUTF8(p);
+    return !record.m_filename.empty();
+}
+
+bool Journal::Open(const wchar_t *filename)
+{
+    Close();
+    m_done.clear();
+
+    // Read the records that are already there.  A line without a
+    // newline at the end was cut off while it was being written.
+    bool ends_in_newline = true;
+    bool empty = true;
+    FILE *fp = nullptr;
+    if (!_wfopen_s(&fp, filename, L"rb") && fp)
+    {
+        std::string line;
+        char buffer[1024];
+        while (fgets(buffer, sizeof(buffer), fp))
+        {
+            empty = false;
+            line += buffer;
+            ends_in_newline = line.back() == '\n';
+            if (!ends_in_newline)
+                continue;
+            line.pop_back();
+            if (!line.empty() && line.back() == '\r')
+                line.pop_back();
+            JournalRecord record;
+            if (!line.empty() && line[0] != '#' && parse_record(line, record))
+                m_done[record.m_filename] = record;
+            line.clear();
+        }
+        fclose(fp);
+    }
+
+    if (_wfopen_s(&m_fp, filename, L"ab") || !m_fp)
+    {
+        m_fp = nullptr;
+        return false;
+    }
+    if (empty)
+        fputs(k_journal_heading, m_fp);
+    else if (!ends_in_newline)
+        fputc('\n', m_fp);
+    m_unsynced = 0;
+    m_last_sync = std::chrono::steady_clock::now();
+    return sync_file(m_fp);
+}
+
+void Journal::Close()
+{
+    if (!m_fp)
+        return;
+    sync_file(m_fp);
+    fclose(m_fp);
+    m_fp = nullptr;
+}
+
+bool Journal::IsDone(const JournalRecord &record) const
+{
+    auto found = m_done.find(record.m_filename);
+    if (found == m_done.end() || found->second.m_size != record.m_size ||
+        found->second.m_mtime != record.m_mtime || found->second.m_options != record.m_options)
+        return false;
+
+    // If any of its segment files have been changed or removed since,
+    // it has to be done again.
+    bool complete = false;
+    const uint64_t hash = HashOutputs(found->second.m_outputs, complete);
+    return complete && hash == found->second.m_outputs_hash;
+}
+
+bool Journal::Find(const std::wstring &filename, JournalRecord &record) const
+{
+    auto found = m_done.find(filename);
+    if (found == m_done.end())
+        return false;
+    record = found->second;
+    return true;
+}
+
+bool Journal::Add(const JournalRecord &record)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_fp)
+        return false;
+
+    // A name with a newline in it can't be recorded, and nor can a
+    // segment file with a tab in its name, so the file just gets
+    // processed again next time.
+    std::string names;
+    for (const std::wstring &output : record.m_outputs)
+    {
+        const std::string name = ToUTF8(output);
+        if (name.find('\t') != std::string::npos)
+            return true;
+        names += name + '\t';
+    }
+    names += ToUTF8(record.m_filename);
+    if (names.find_first_of("\r\n") != std::string::npos)
+        return true;
+
+    bool complete = false;
+    const uint64_t hash = HashOutputs(record.m_outputs, complete);
+    fprintf(m_fp, "%llu\t%lld\t%016llx\t%s\t%zu\t%s\n", static_cast<unsigned long long>(record.m_size),
+        static_cast<long long>(record.m_mtime), static_cast<unsigned long long>(hash), record.m_options.c_str(),
+        record.m_outputs.size(), names.c_str());
+    return flush_record(m_fp, m_unsynced, m_last_sync);
+}
+
+// Adds a value to a checkpoint record's contents.
+template <typename T>
+static void put(std::string &payload, const T &value)
+{
+    payload.append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+// Adds a frame's statistics to a checkpoint record's contents.
+static void put(std::string &payload, const FrameStats &stats)
+{
+    put(payload, stats.m_sum);
+    put(payload, stats.m_sum_squares);
+    put(payload, stats.m_min);
+    put(payload, stats.m_max);
+    put(payload, stats.m_peak);
+}
+
+// Gets a value from a checkpoint record's contents.
+// Returns false if the contents run out first.
+template <typename T>
+static bool get(const char *&p, const char *end, T &value)
+{
+    if (static_cast<size_t>(end - p) < sizeof(value))
+        return false;
+    memcpy(&value, p, sizeof(value));
+    p += sizeof(value);
+    return true;
+}
+
+// Gets a frame's statistics from a checkpoint record's contents.
+// Returns false if the contents run out first.
+static bool get(const char *&p, const char *end, FrameStats &stats)
+{
+    return get(p, end, stats.m_sum) && get(p, end, stats.m_sum_squares) && get(p, end, stats.m_min) &&
+        get(p, end, stats.m_max) && get(p, end, stats.m_peak);
+}
+
+// Reads the next record from a checkpoint file.
+// Returns false if there isn't a whole record with the right hash.
+static bool read_record(FILE *fp, uint32_t &type, std::string &payload)
+{
+    uint64_t size = 0, hash = 0;
+    if (fread(&type, sizeof(type), 1, fp) != 1 || fread(&size, sizeof(size), 1, fp) != 1 ||
+        size > k_max_checkpoint_record)
+    {
+        return false;
+    }
+    payload.resize(static_cast<size_t>(size));
+    if ((size && fread(&payload[0], 1, payload.size(), fp) != payload.size()) ||
+        fread(&hash, sizeof(hash), 1, fp) != 1)
+    {
+        return false;
+    }
+    return hash == HashBytes(payload.data(), payload.size());
+}
+
+bool Checkpoint::restore_analyzed(const std::string &payload, AnalysisTable &table, LoudnessMeter *meter)
+{
+    const char *p = payload.data();
+    const char *end = p + payload.size();
+    uint64_t first_sample = 0, num_samples = 0;
+    if (!get(p, end, first_sample) || !get(p, end, num_samples))
+        return false;
+
+    // Each frame in the range, and the partial frame at the end of
+    // the table if the range reaches it.
+    const size_t samples_per_frame = table.m_samples_per_frame;
+    const uint64_t end_sample = first_sample + num_samples;
+    if (first_sample % samples_per_frame || end_sample > table.SampleCount() || end_sample < first_sample)
+        return false;
+    const size_t first_frame = static_cast<size_t>(first_sample / samples_per_frame);
+    const size_t end_frame = static_cast<size_t>((end_sample + samples_per_frame - 1) / samples_per_frame);
+
+    // With a meter, the ranges have to follow on from each other.
+    if (meter && first_sample != m_analyzed_count)
+        return false;
+
+    std::vector<FrameStats> frames(end_frame - first_frame);
+    for (FrameStats &stats : frames)
+    {
+        if (!get(p, end, stats))
+            return false;
+    }
+    uint8_t has_meter = 0;
+    if (!get(p, end, has_meter))
+        return false;
+    if (meter)
+    {
+        LoudnessMeter::State state;
+        uint64_t first_step = 0, num_steps = 0;
+        if (!has_meter || !get(p, end, state.m_filter) || !get(p, end, state.m_step_sum) ||
+            !get(p, end, state.m_step_count) || !get(p, end, first_step) || !get(p, end, num_steps) ||
+            num_steps > static_cast<size_t>(end - p) / sizeof(double))
+        {
+            return false;
+        }
+        state.m_first_step = static_cast<size_t>(first_step);
+        state.m_step_power.resize(static_cast<size_t>(num_steps));
+        for (double &power : state.m_step_power)
+            get(p, end, power);
+        if (!meter->SetState(state))
+            return false;
+        m_meter_steps = state.m_first_step + state.m_step_power.size();
+    }
+
+    for (size_t iframe = first_frame; iframe < end_frame; iframe++)
+    {
+        if (iframe < table.m_frames.size())
+            table.m_frames[iframe] = frames[iframe - first_frame];
+        else
+            table.m_remainder = frames[iframe - first_frame];
+        if (!m_analyzed[iframe])
+        {
+            m_analyzed[iframe] = 1;
+            m_analyzed_count += iframe < table.m_frames.size() ? samples_per_frame : table.m_remainder_count;
+        }
+    }
+    return true;
+}
+
+bool Checkpoint::Open(const wchar_t *filename, const std::string &key, AnalysisTable &table, LoudnessMeter *meter)
+{
+    Close();
+    m_filename = filename;
+    m_samples_per_frame = table.m_samples_per_frame ? table.m_samples_per_frame : 1;
+    m_analyzed.assign(table.m_frames.size() + (table.m_remainder_count ? 1 : 0), 0);
+    m_written.clear();
+    m_analyzed_count = 0;
+    m_written_count = 0;
+    m_meter_steps = 0;
+
+    // Read back the records that were left by an earlier run, up to
+    // the first one that was cut off (or doesn't fit).
+    int64_t good_size = 0;
+    if (!_wfopen_s(&m_fp, filename, L"rb") && m_fp)
+    {
+        uint32_t type = 0;
+        std::string payload;
+        if (read_record(m_fp, type, payload) && type == k_checkpoint_key && payload == key)
+        {
+            good_size = _ftelli64(m_fp);
+            while (read_record(m_fp, type, payload))
+            {
+                if (type == k_checkpoint_analyzed)
+                {
+                    if (!restore_analyzed(payload, table, meter))
+                        break;
+                }
+                else if (type == k_checkpoint_written && payload.size() == sizeof(uint32_t))
+                {
+                    uint32_t seg_num = 0;
+                    memcpy(&seg_num, payload.data(), sizeof(seg_num));
+                    if (!seg_num)
+                        break;
+                    if (m_written.size() < seg_num)
+                        m_written.resize(seg_num, 0);
+                    if (!m_written[seg_num - 1])
+                        m_written_count++;
+                    m_written[seg_num - 1] = 1;
+                }
+                else
+                {
+                    break;
+                }
+                good_size = _ftelli64(m_fp);
+            }
+        }
+        fclose(m_fp);
+        m_fp = nullptr;
+    }
+
+    // Carry on after the last good record, or start over.
+    m_unsynced = 0;
+    m_last_sync = std::chrono::steady_clock::now();
+    if (good_size > 0)
+    {
+        if (_wfopen_s(&m_fp, filename, L"r+b") || !m_fp)
+        {
+            m_fp = nullptr;
+            return false;
+        }
+#ifdef _WIN32
+        const bool truncated = _chsize_s(_fileno(m_fp), good_size) == 0;
+#else
+        const bool truncated = ftruncate(fileno(m_fp), static_cast<off_t>(good_size)) == 0;
+#endif
+        if (!truncated || _fseeki64(m_fp, 0, SEEK_END) != 0)
+        {
+            Close();
+            return false;
+        }
+        return true;
+    }
+
+    if (_wfopen_s(&m_fp, filename, L"wb") || !m_fp)
+    {
+        m_fp = nullptr;
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return add_record(k_checkpoint_key, key);
+}
+
+void Checkpoint::Close()
+{
+    if (!m_fp)
+        return;
+    sync_file(m_fp);
+    fclose(m_fp);
+    m_fp = nullptr;
+}
+
+void Checkpoint::Remove()
+{
+    if (m_fp)
+        fclose(m_fp);
+    m_fp = nullptr;
+    if (!m_filename.empty())
+        _wunlink(m_filename.c_str());
+}
+
+bool Checkpoint::IsAnalyzed(size_t first_sample, size_t num_samples) const
+{
+    const size_t first_frame = first_sample / m_samples_per_frame;
+    const size_t end_frame = (first_sample + num_samples + m_samples_per_frame - 1) / m_samples_per_frame;
+    if (end_frame > m_analyzed.size())
+        return false;
+    for (size_t iframe = first_frame; iframe < end_frame; iframe++)
+    {
+        if (!m_analyzed[iframe])
+            return false;
+    }
+    return true;
+}
+
+bool Checkpoint::IsWritten(unsigned seg_num) const
+{
+    return seg_num && seg_num <= m_written.size() && m_written[seg_num - 1];
+}
+
+bool Checkpoint::AddAnalyzed(const AnalysisTable &table, size_t first_sample, size_t num_samples,
+    const LoudnessMeter *meter)
+{
+    const size_t samples_per_frame = table.m_samples_per_frame;
+    const size_t first_frame = first_sample / samples_per_frame;
+    const size_t end_frame = (first_sample + num_samples + samples_per_frame - 1) / samples_per_frame;
+    std::string payload;
+    put(payload, static_cast<uint64_t>(first_sample));
+    put(payload, static_cast<uint64_t>(num_samples));
+    for (size_t iframe = first_frame; iframe < end_frame; iframe++)
+        put(payload, iframe < table.m_frames.size() ? table.m_frames[iframe] : table.m_remainder);
+    put(payload, static_cast<uint8_t>(meter ? 1 : 0));
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (meter)
+    {
+        // Only the steps since the last record are added.
+        LoudnessMeter::State state;
+        meter->GetState(state, m_meter_steps);
+        put(payload, state.m_filter);
+        put(payload, state.m_step_sum);
+        put(payload, state.m_step_count);
+        put(payload, static_cast<uint64_t>(state.m_first_step));
+        put(payload, static_cast<uint64_t>(state.m_step_power.size()));
+        for (double power : state.m_step_power)
+            put(payload, power);
+        m_meter_steps = state.m_first_step + state.m_step_power.size();
+    }
+    return add_record(k_checkpoint_analyzed, payload);
+}
+
+bool Checkpoint::AddWritten(unsigned seg_num)
+{
+    std::string payload;
+    put(payload, static_cast<uint32_t>(seg_num));
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return add_record(k_checkpoint_written, payload);
+}
+
+bool Checkpoint::add_record(uint32_t type, const std::string &payload)
+{
+    if (!m_fp)
+        return false;
+
+    const uint64_t size = payload.size();
+    const uint64_t hash = HashBytes(payload.data(), payload.size());
+    if (fwrite(&type, sizeof(type), 1, m_fp) != 1 || fwrite(&size, sizeof(size), 1, m_fp) != 1 ||
+        (size && fwrite(payload.data(), 1, payload.size(), m_fp) != payload.size()) ||
+        fwrite(&hash, sizeof(hash), 1, m_fp) != 1)
+    {
+        return false;
+    }
+    return flush_record(m_fp, m_unsynced, m_last_sync);
+}
@@ -0,0 +1,233 @@
+//-------------------------------------------------------------------
+//
+// journal.h
+//
+// Header of C++ module for keeping a journal of the WAV files that
+// have been processed, and checkpoints of long recordings part way
+// through, so a long batch that gets interrupted can pick up where
+// it left off instead of starting over.
+//
+//-------------------------------------------------------------------
+//
+// (C) Copyright 2024 Ammon R. Campbell.
+//
+// I wrote this code for use in my own educational and experimental
+// programs, but you may also freely use it in yours as long as you
+// abide by the following terms and conditions:
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following
+//     disclaimer in the documentation and/or other materials
+//     provided with the distribution.
+//   * The name(s) of the author(s) and contributors (if any) may not
+//     be used to endorse or promote products derived from this
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+// CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+// OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.  IN OTHER WORDS, USE AT YOUR OWN RISK, NOT OURS.  
+//--------------------------------------------------------------------
+
+#pragma once
+#include "analysis.h"
+#include "loudness.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// What the journal records about a WAV file that was processed.
+struct JournalRecord
+{
+    std::wstring m_filename;        // Name of the WAV file.
+    uint64_t m_size = 0;            // Size of the file in bytes.
+    int64_t m_mtime = 0;            // When the file was last changed (seconds since 1970).
+    std::string m_options;          // The options it was processed with.
+    std::vector<std::wstring> m_outputs; // The segment files that were written for it.
+    uint64_t m_outputs_hash = 0;    // Hash of the segment files (see HashOutputs).
+};
+
+// Gets the size of a file and when it was last changed, so a
+// journal record can tell if it's been changed since.
+// Returns true if successful.
+bool GetFileStamp(const wchar_t *filename, uint64_t &size, int64_t &mtime);
+
+// Returns a hash of the names and sizes of some segment files, so a
+// journal record can tell if any of them have been changed or
+// removed since.  'complete' is set to false if any of them aren't
+// there.
+uint64_t HashOutputs(const std::vector<std::wstring> &outputs, bool &complete);
+
+// A journal of the WAV files that have been processed, which is a
+// text file with one line for each file, added after all of the
+// file's segments have been written.  The journal is only ever
+// appended to.  Each record is flushed as soon as it's added, and
+// synced to the disk every few records (and every few seconds), so
+// if the program is killed, nothing is lost, and if the machine
+// goes down, at most the last few files are missing from it.  A
+// line that was cut off part way is ignored.
+//
+// Each record lists the segment files that were written for the
+// WAV file, with a hash of their names and sizes.  When a batch is
+// run again with the same journal, a file that's in the journal
+// with the same size, time and options, and whose segment files are
+// all still there unchanged, is skipped.  Any other file is
+// processed from the start, so segments left behind by a file that
+// was only partly done are written over, and the segment files
+// listed in its last record that it doesn't write this time (if it
+// has fewer segments now) can be removed.
+class Journal
+{
+public:
+    Journal() = default;
+    ~Journal() { Close(); }
+
+    Journal(const Journal &) = delete;
+    Journal &operator=(const Journal &) = delete;
+
+    // Opens the journal, reading the records that are already in it,
+    // and creating it if it doesn't exist.  New records are added
+    // to the end.
+    // Returns true if successful.
+    bool Open(const wchar_t *filename);
+
+    // Flushes the journal to the disk and closes it.
+    void Close();
+
+    // Returns true if the journal is open.
+    bool IsOpen() const { return m_fp != nullptr; }
+
+    // Returns true if the journal has a record of the same file with
+    // the same size, time and options, and the segment files that it
+    // lists are all there, unchanged.  If the file is in the journal
+    // more than once, the last record counts.
+    bool IsDone(const JournalRecord &record) const;
+
+    // Gets the last record of the file with the given name.
+    // Returns false if the file isn't in the journal.
+    bool Find(const std::wstring &filename, JournalRecord &record) const;
+
+    // Adds a record to the journal, with the hash of its segment
+    // files (so m_outputs_hash needn't be set).  This can be called
+    // from any thread.
+    // Returns true if successful.
+    bool Add(const JournalRecord &record);
+
+private:
+    FILE *m_fp = nullptr;                                   // The open journal.
+    std::unordered_map<std::wstring, JournalRecord> m_done; // Records read when it was opened.
+    std::mutex m_mutex;                                     // Guards the writing.
+    unsigned m_unsynced = 0;                                // Records written since the last sync.
+    std::chrono::steady_clock::time_point m_last_sync;      // When it was last synced.
+};
+
+// Keeps track of how far the processing of one long recording has
+// got, in a file of its own, so if the program is killed part way
+// through, the recording can be picked up where it left off instead
+// of being started over.  The file records each range of the
+// recording that's been analyzed (with the statistics for its
+// frames, and the loudness meter's state at the end of it, if
+// there's a meter), and each segment that's been written.  The
+// segments, and the gains to normalize them, don't need to be
+// recorded, since they're found again from the table of statistics,
+// which comes out the same as before.
+//
+// Like the journal, the file is only ever added to, each record is
+// flushed as soon as it's added, and it's synced to the disk every
+// few records.  Each record has a hash, so one that was cut off
+// part way is ignored.
+class Checkpoint
+{
+public:
+    Checkpoint() = default;
+    ~Checkpoint() { Close(); }
+
+    Checkpoint(const Checkpoint &) = delete;
+    Checkpoint &operator=(const Checkpoint &) = delete;
+
+    // Opens the checkpoint file.  If it was left by an earlier run
+    // with the same 'key' (which should say which recording it is,
+    // and the options it's processed with), what it recorded is
+    // restored:  the analyzed frames go into 'table', which must
+    // already be Reset for the whole recording, and if a loudness
+    // meter is given (already Reset), its state at the end of the
+    // analyzed audio is restored.  With a meter, only the ranges
+    // from the start of the recording up to the first gap are
+    // restored, since the meter has to be fed the audio in order.
+    // Otherwise the file is started over.
+    // Returns true if successful.
+    bool Open(const wchar_t *filename, const std::string &key, AnalysisTable &table, LoudnessMeter *meter);
+
+    // Flushes the file to the disk and closes it.
+    void Close();
+
+    // Closes and deletes the file, once the recording is done.
+    void Remove();
+
+    // Returns true if the 'num_samples' samples starting at
+    // 'first_sample' were all restored as analyzed by Open.
+    bool IsAnalyzed(size_t first_sample, size_t num_samples) const;
+
+    // Returns the number of samples restored as analyzed.
+    size_t AnalyzedCount() const { return m_analyzed_count; }
+
+    // Returns true if segment 'seg_num' (1=first) was restored as
+    // written by Open.
+    bool IsWritten(unsigned seg_num) const;
+
+    // Returns the number of segments restored as written.
+    size_t WrittenCount() const { return m_written_count; }
+
+    // Records that the 'num_samples' samples starting at
+    // 'first_sample' (at the start of a frame) have been analyzed
+    // into the table.  If a meter is given, its state is recorded
+    // too, so it must have been fed the audio up to the end of the
+    // range, and no further.  This can be called from any thread.
+    // Returns true if successful.
+    bool AddAnalyzed(const AnalysisTable &table, size_t first_sample, size_t num_samples,
+        const LoudnessMeter *meter = nullptr);
+
+    // Records that segment 'seg_num' (1=first) has been written.
+    // This can be called from any thread.
+    // Returns true if successful.
+    bool AddWritten(unsigned seg_num);
+
+private:
+    // Adds a record of the given type to the file.
+    bool add_record(uint32_t type, const std::string &payload);
+
+    // Restores a record of analyzed frames into the table (and the
+    // meter, if it's given).
+    // Returns false if the record doesn't fit.
+    bool restore_analyzed(const std::string &payload, AnalysisTable &table, LoudnessMeter *meter);
+
+    FILE *m_fp = nullptr;                               // The open file.
+    std::wstring m_filename;                            // Name of the file.
+    size_t m_samples_per_frame = 1;                     // Number of samples in each frame of the table.
+    std::vector<char> m_analyzed;                       // Was each frame restored? (The last is the partial frame.)
+    std::vector<char> m_written;                        // Was each segment restored?
+    size_t m_analyzed_count = 0;                        // Number of samples restored.
+    size_t m_written_count = 0;                         // Number of segments restored.
+    size_t m_meter_steps = 0;                           // Number of the meter's steps recorded so far.
+    std::mutex m_mutex;                                 // Guards the writing.
+    unsigned m_unsynced = 0;                            // Records written since the last sync.
+    std::chrono::steady_clock::time_point m_last_sync;  // When it was last synced.
+};
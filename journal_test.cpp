@@ -0,0 +1,334 @@
+//-------------------------------------------------------------------
+//
+// journal_test.cpp
+//
+// Simple test of the journal.cpp module.  Adds some records to a
+// journal, cuts the last one off part way (as if the program were
+// killed while writing it), and confirms that reopening the journal
+// finds the complete records, ignores the cut off one, and keeps
+// the records added after it.  Then does the same with a
+// checkpoint, with and without a loudness meter.
+//
+//-------------------------------------------------------------------
+//
+// (C) Copyright 2024 Ammon R. Campbell.
+//
+// I wrote this code for use in my own educational and experimental
+// programs, but you may also freely use it in yours as long as you
+// abide by the following terms and conditions:
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following
+//     disclaimer in the documentation and/or other materials
+//     provided with the distribution.
+//   * The name(s) of the author(s) and contributors (if any) may not
+//     be used to endorse or promote products derived from this
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+// CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+// OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.  IN OTHER WORDS, USE AT YOUR OWN RISK, NOT OURS.  
+//--------------------------------------------------------------------
+
+#include "journal.h"
+#include <stdio.h>
+#include <wchar.h>
+#include <string>
+#include <vector>
+
+// Fills in a table (and feeds a meter) with made up statistics for
+// the given range of samples, like analyzing it would.
+static void fake_analysis(AnalysisTable &table, size_t first_sample, size_t num_samples, LoudnessMeter *meter)
+{
+    const size_t end_sample = first_sample + num_samples;
+    for (size_t sample = first_sample; sample < end_sample; sample += table.m_samples_per_frame)
+    {
+        FrameStats stats;
+        stats.m_sum = static_cast<double>(sample);
+        stats.m_sum_squares = static_cast<double>(sample) * 0.5;
+        stats.m_peak = static_cast<float>(sample % 7);
+        const size_t iframe = sample / table.m_samples_per_frame;
+        if (iframe < table.m_frames.size())
+            table.m_frames[iframe] = stats;
+        else
+            table.m_remainder = stats;
+    }
+    if (meter)
+    {
+        std::vector<float> samples(num_samples);
+        for (size_t isample = 0; isample < num_samples; isample++)
+            samples[isample] = static_cast<float>(((first_sample + isample) * 37) % 101) / 101.0f - 0.5f;
+        meter->Process(samples.data(), samples.size());
+    }
+}
+
+// Returns true if two tables have the same statistics in the given
+// range of samples.
+static bool same_frames(const AnalysisTable &a, const AnalysisTable &b, size_t first_sample, size_t num_samples)
+{
+    const size_t end_frame = (first_sample + num_samples + a.m_samples_per_frame - 1) / a.m_samples_per_frame;
+    for (size_t iframe = first_sample / a.m_samples_per_frame; iframe < end_frame; iframe++)
+    {
+        const FrameStats &x = iframe < a.m_frames.size() ? a.m_frames[iframe] : a.m_remainder;
+        const FrameStats &y = iframe < b.m_frames.size() ? b.m_frames[iframe] : b.m_remainder;
+        if (x.m_sum != y.m_sum || x.m_sum_squares != y.m_sum_squares || x.m_peak != y.m_peak)
+            return false;
+    }
+    return true;
+}
+
+// Records some analyzed ranges and written segments in a
+// checkpoint, cuts the last record off part way, and confirms that
+// reopening it restores what was recorded, with and without a
+// loudness meter.
+static bool test_checkpoint()
+{
+    printf("Starting checkpoint test\n");
+
+    const wchar_t *checkpoint_name = L"temp_checkpoint.dat";
+    const unsigned frequency = 1000;
+    const size_t total = 10005;     // 1000 frames and a partial one.
+    const std::string key = "test key";
+    bool ok = true;
+
+    // Without a meter, ranges can be recorded in any order.
+    {
+        _wunlink(checkpoint_name);
+        AnalysisTable table;
+        table.Reset(frequency, total);
+        Checkpoint checkpoint;
+        fake_analysis(table, 5000, 5005, nullptr);
+        fake_analysis(table, 0, 3000, nullptr);
+        if (!checkpoint.Open(checkpoint_name, key, table, nullptr) || checkpoint.AnalyzedCount() ||
+            !checkpoint.AddAnalyzed(table, 5000, 5005) || !checkpoint.AddAnalyzed(table, 0, 3000) ||
+            !checkpoint.AddWritten(2) || !checkpoint.AddWritten(5))
+        {
+            printf("Couldn't write checkpoint '%S'\n", checkpoint_name);
+            ok = false;
+        }
+        checkpoint.Close();
+
+        FILE *fp = nullptr;
+        if (ok && !_wfopen_s(&fp, checkpoint_name, L"ab") && fp)
+        {
+            fputs("\x02\x00\x00\x00\xff", fp);
+            fclose(fp);
+        }
+
+        AnalysisTable restored;
+        restored.Reset(frequency, total);
+        if (ok && (!checkpoint.Open(checkpoint_name, key, restored, nullptr) || checkpoint.AnalyzedCount() != 8005 ||
+                   !checkpoint.IsAnalyzed(0, 3000) || checkpoint.IsAnalyzed(0, 3010) || !checkpoint.IsAnalyzed(5000, 5005) ||
+                   !same_frames(table, restored, 0, 3000) || !same_frames(table, restored, 5000, 5005) ||
+                   checkpoint.WrittenCount() != 2 || !checkpoint.IsWritten(2) || !checkpoint.IsWritten(5) ||
+                   checkpoint.IsWritten(1) || checkpoint.IsWritten(6)))
+        {
+            printf("Checkpoint didn't restore the right ranges and segments!\n");
+            ok = false;
+        }
+
+        // It can be added to after being picked up, even though the
+        // last record was cut off.
+        if (ok && !checkpoint.AddWritten(1))
+            ok = false;
+        checkpoint.Close();
+        if (ok && (!checkpoint.Open(checkpoint_name, key, restored, nullptr) || !checkpoint.IsWritten(1) ||
+                   checkpoint.WrittenCount() != 3))
+        {
+            printf("Checkpoint didn't keep a record added after picking it up!\n");
+            ok = false;
+        }
+        checkpoint.Close();
+
+        // A different key starts over.
+        AnalysisTable other;
+        other.Reset(frequency, total);
+        if (ok && (!checkpoint.Open(checkpoint_name, "other key", other, nullptr) || checkpoint.AnalyzedCount() ||
+                   checkpoint.WrittenCount()))
+        {
+            printf("Checkpoint with a different key wasn't started over!\n");
+            ok = false;
+        }
+        checkpoint.Remove();
+    }
+
+    // With a meter, only the ranges from the start up to the first
+    // gap are restored, and the meter carries on from the end of
+    // them.  The meter needs a higher sample rate than the table
+    // above.
+    if (ok)
+    {
+        const unsigned meter_frequency = 8000;
+        _wunlink(checkpoint_name);
+        AnalysisTable table;
+        table.Reset(meter_frequency, total);
+        LoudnessMeter meter(meter_frequency);
+        LoudnessMeter::State expected;
+        Checkpoint checkpoint;
+        ok = checkpoint.Open(checkpoint_name, key, table, &meter);
+        for (size_t first = 0; ok && first < 8000; first += 2000)
+        {
+            fake_analysis(table, first, 2000, &meter);
+            if (first == 2000)
+                meter.GetState(expected);
+            if (first != 4000)
+                ok = checkpoint.AddAnalyzed(table, first, 2000, &meter);
+        }
+        checkpoint.Close();
+
+        AnalysisTable restored;
+        restored.Reset(meter_frequency, total);
+        LoudnessMeter restored_meter(meter_frequency);
+        LoudnessMeter::State state;
+        ok = ok && checkpoint.Open(checkpoint_name, key, restored, &restored_meter);
+        restored_meter.GetState(state);
+        if (!ok || checkpoint.AnalyzedCount() != 4000 || !same_frames(table, restored, 0, 4000) ||
+            checkpoint.IsAnalyzed(6000, 2000) || state.m_step_power != expected.m_step_power ||
+            state.m_step_sum != expected.m_step_sum || state.m_step_count != expected.m_step_count ||
+            state.m_filter[0] != expected.m_filter[0] || state.m_filter[3] != expected.m_filter[3])
+        {
+            printf("Checkpoint with a meter didn't restore the right ranges!\n");
+            ok = false;
+        }
+        checkpoint.Remove();
+    }
+
+    return ok;
+}
+
+bool test_journal()
+{
+    printf("Starting journal test\n");
+
+    const wchar_t *journal_name = L"temp_journal.txt";
+    _wunlink(journal_name);
+
+    JournalRecord first;
+    first.m_filename = L"first.wav";
+    first.m_size = 1000;
+    first.m_mtime = 1700000000;
+    first.m_options = "level=-1";
+    JournalRecord second = first;
+    second.m_filename = L"dir\\caf\u00e9\tsecond.wav";
+    second.m_size = 5000000000ULL;
+    JournalRecord third = first;
+    third.m_filename = L"third.wav";
+
+    bool ok = true;
+    Journal journal;
+    if (!journal.Open(journal_name) || !journal.Add(first) || !journal.Add(second))
+    {
+        printf("Couldn't write journal '%S'\n", journal_name);
+        ok = false;
+    }
+    journal.Close();
+
+    // Cut off a record, as if it were being written when the program
+    // was killed.
+    FILE *fp = nullptr;
+    if (ok && (_wfopen_s(&fp, journal_name, L"ab") || !fp))
+    {
+        printf("Couldn't append to journal '%S'\n", journal_name);
+        ok = false;
+    }
+    if (fp)
+    {
+        fputs("1000\t1700000000\tlev", fp);
+        fclose(fp);
+    }
+
+    if (ok && (!journal.Open(journal_name) || !journal.IsDone(first) || !journal.IsDone(second) ||
+               journal.IsDone(third) || !journal.Add(third)))
+    {
+        printf("Journal didn't have the right records after being cut off!\n");
+        ok = false;
+    }
+    journal.Close();
+
+    // The file has to be the same, with the same options.
+    JournalRecord changed = first;
+    changed.m_mtime++;
+    JournalRecord other_options = first;
+    other_options.m_options = "level=-3";
+    if (ok && (!journal.Open(journal_name) || !journal.IsDone(first) || !journal.IsDone(third) ||
+               journal.IsDone(changed) || journal.IsDone(other_options)))
+    {
+        printf("Journal didn't have the right records after being reopened!\n");
+        ok = false;
+    }
+    journal.Close();
+
+    // A file's segment files have to be there, unchanged.
+    const wchar_t *output_names[] = { L"temp_journal_seg1.wav", L"temp_journal_seg2.wav" };
+    JournalRecord with_outputs = first;
+    with_outputs.m_filename = L"with_outputs.wav";
+    for (const wchar_t *output_name : output_names)
+    {
+        if (_wfopen_s(&fp, output_name, L"wb") || !fp)
+        {
+            printf("Couldn't write '%S'\n", output_name);
+            ok = false;
+            continue;
+        }
+        fputs("segment", fp);
+        fclose(fp);
+        with_outputs.m_outputs.push_back(output_name);
+    }
+    JournalRecord found;
+    if (ok && (!journal.Open(journal_name) || !journal.Add(with_outputs)))
+    {
+        printf("Couldn't add a record with segment files to journal '%S'\n", journal_name);
+        ok = false;
+    }
+    journal.Close();
+    if (ok && (!journal.Open(journal_name) || !journal.IsDone(with_outputs) ||
+               !journal.Find(with_outputs.m_filename, found) || found.m_outputs != with_outputs.m_outputs))
+    {
+        printf("Journal didn't have the record's segment files!\n");
+        ok = false;
+    }
+    if (ok && !_wfopen_s(&fp, output_names[1], L"ab") && fp)
+    {
+        fputs(" changed", fp);
+        fclose(fp);
+        if (journal.IsDone(with_outputs))
+        {
+            printf("Journal says a file is done when one of its segment files was changed!\n");
+            ok = false;
+        }
+    }
+    _wunlink(output_names[1]);
+    if (ok && (journal.IsDone(with_outputs) || journal.Find(L"missing.wav", found)))
+    {
+        printf("Journal says a file is done when one of its segment files was removed!\n");
+        ok = false;
+    }
+    journal.Close();
+    _wunlink(output_names[0]);
+
+    uint64_t size = 0;
+    int64_t mtime = 0;
+    if (ok && (!GetFileStamp(journal_name, size, mtime) || size == 0 || mtime == 0))
+    {
+        printf("GetFileStamp didn't get the journal's size and time!\n");
+        ok = false;
+    }
+
+    _wunlink(journal_name);
+    return ok && test_checkpoint();
+}
@@ -0,0 +1,378 @@
+//-------------------------------------------------------------------
+//
+// loudness.cpp
+//
+// C++ module for measuring the perceived loudness of an audio
+// waveform, as described by ITU-R BS.1770 and EBU R128, and for
+// normalizing audio to a target loudness in LUFS.
+//
+//-------------------------------------------------------------------
+//
+// (C) Copyright 2024 Ammon R. Campbell.
+//
+// I wrote this code for use in my own educational and experimental
+// programs, but you may also freely use it in yours as long as you
+// abide by the following terms and conditions:
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following
+//     disclaimer in the documentation and/or other materials
+//     provided with the distribution.
+//   * The name(s) of the author(s) and contributors (if any) may not
+//     be used to endorse or promote products derived from this
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+// CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+// OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.  IN OTHER WORDS, USE AT YOUR OWN RISK, NOT OURS.  
+//--------------------------------------------------------------------
+
+#include "loudness.h"
+#include <math.h>
+#include <algorithm>
+
+// Constants from ITU-R BS.1770.
+static const double k_pi = 3.14159265358979323846;
+static const double k_loudness_offset = -0.691;  // Offset applied to all loudness values.
+static const double k_absolute_gate = -70.0;     // Blocks quieter than this are ignored (LUFS).
+static const double k_relative_gate = -10.0;     // Relative gate below ungated loudness (LU).
+static const unsigned k_steps_per_block = 4;     // 400 millisecond gating blocks.
+static const unsigned k_steps_per_short_term = 30; // 3 second short-term window.
+
+// Converts a mean square power to a loudness value in LUFS.
+static double power_to_lufs(double power)
+{
+    if (power <= 0.0)
+        return -HUGE_VAL;
+    return k_loudness_offset + 10.0 * log10(power);
+}
+
+// Converts a loudness value in LUFS to a mean square power.
+static double lufs_to_power(double lufs)
+{
+    return pow(10.0, (lufs - k_loudness_offset) / 10.0);
+}
+
+LoudnessMeter::LoudnessMeter(unsigned frequency)
+{
+    Reset(frequency);
+}
+
+void LoudnessMeter::Reset(unsigned frequency)
+{
+    m_shelf = Biquad();
+    m_highpass = Biquad();
+    m_step_sum = 0.0;
+    m_step_count = 0;
+    m_step_power.clear();
+
+    if (!frequency)
+        frequency = 48000;
+    m_samples_per_step = frequency / 10;
+    if (!m_samples_per_step)
+        m_samples_per_step = 1;
+
+    // The K-weighting filter coefficients in BS.1770 are only given
+    // for a 48 KHz sample rate, so we derive them from the analog
+    // prototype filters for whatever sample rate we have.
+
+    // Stage 1:  High shelf of about +4 dB above 1.5 KHz.
+    {
+        const double f0 = 1681.974450955533;
+        const double gain_db = 3.999843853973347;
+        const double q = 0.7071752369554196;
+        const double k = tan(k_pi * f0 / frequency);
+        const double vh = pow(10.0, gain_db / 20.0);
+        const double vb = pow(vh, 0.4996667741545416);
+        const double a0 = 1.0 + k / q + k * k;
+        m_shelf.b0 = (vh + vb * k / q + k * k) / a0;
+        m_shelf.b1 = 2.0 * (k * k - vh) / a0;
+        m_shelf.b2 = (vh - vb * k / q + k * k) / a0;
+        m_shelf.a1 = 2.0 * (k * k - 1.0) / a0;
+        m_shelf.a2 = (1.0 - k / q + k * k) / a0;
+    }
+
+    // Stage 2:  High pass (RLB weighting) below about 40 Hz.
+    {
+        const double f0 = 38.13547087602444;
+        const double q = 0.5003270373238773;
+        const double k = tan(k_pi * f0 / frequency);
+        const double a0 = 1.0 + k / q + k * k;
+        m_highpass.b0 = 1.0;
+        m_highpass.b1 = -2.0;
+        m_highpass.b2 = 1.0;
+        m_highpass.a1 = 2.0 * (k * k - 1.0) / a0;
+        m_highpass.a2 = (1.0 - k / q + k * k) / a0;
+    }
+}
+
+void LoudnessMeter::Process(const float *samples, size_t count)
+{
+    //
+    // The samples are processed in small blocks that never cross
+    // a step boundary.  Each filter stage runs over the whole block
+    // with its state held in local variables, and the squares are
+    // then summed in a separate loop with no dependency between
+    // samples, which the compiler is free to vectorize.
+    //
+
+    const size_t block_size = 256;
+    double filtered[block_size];
+
+    while (count)
+    {
+        size_t n = m_samples_per_step - m_step_count;
+        if (n > block_size)
+            n = block_size;
+        if (n > count)
+            n = count;
+
+        // Stage 1.
+        {
+            const Biquad f = m_shelf;
+            double z1 = f.z1, z2 = f.z2;
+            for (size_t i = 0; i < n; i++)
+            {
+                double in = samples[i];
+                double out = f.b0 * in + z1;
+                z1 = f.b1 * in - f.a1 * out + z2;
+                z2 = f.b2 * in - f.a2 * out;
+                filtered[i] = out;
+            }
+            m_shelf.z1 = z1;
+            m_shelf.z2 = z2;
+        }
+
+        // Stage 2.
+        {
+            const Biquad f = m_highpass;
+            double z1 = f.z1, z2 = f.z2;
+            for (size_t i = 0; i < n; i++)
+            {
+                double in = filtered[i];
+                double out = f.b0 * in + z1;
+                z1 = f.b1 * in - f.a1 * out + z2;
+                z2 = f.b2 * in - f.a2 * out;
+                filtered[i] = out;
+            }
+            m_highpass.z1 = z1;
+            m_highpass.z2 = z2;
+        }
+
+        // Accumulate the power of the filtered signal.
+        double sum = 0.0;
+        for (size_t i = 0; i < n; i++)
+            sum += filtered[i] * filtered[i];
+        m_step_sum += sum;
+        m_step_count += static_cast<unsigned>(n);
+
+        if (m_step_count == m_samples_per_step)
+        {
+            m_step_power.push_back(m_step_sum / m_samples_per_step);
+            m_step_sum = 0.0;
+            m_step_count = 0;
+        }
+
+        samples += n;
+        count -= n;
+    }
+}
+
+void LoudnessMeter::GetState(State &state, size_t first_step) const
+{
+    state.m_filter[0] = m_shelf.z1;
+    state.m_filter[1] = m_shelf.z2;
+    state.m_filter[2] = m_highpass.z1;
+    state.m_filter[3] = m_highpass.z2;
+    state.m_step_sum = m_step_sum;
+    state.m_step_count = m_step_count;
+    state.m_first_step = std::min(first_step, m_step_power.size());
+    state.m_step_power.assign(m_step_power.begin() + state.m_first_step, m_step_power.end());
+}
+
+bool LoudnessMeter::SetState(const State &state)
+{
+    if (state.m_first_step != m_step_power.size() || state.m_step_count >= m_samples_per_step)
+        return false;
+
+    m_shelf.z1 = state.m_filter[0];
+    m_shelf.z2 = state.m_filter[1];
+    m_highpass.z1 = state.m_filter[2];
+    m_highpass.z2 = state.m_filter[3];
+    m_step_sum = state.m_step_sum;
+    m_step_count = state.m_step_count;
+    m_step_power.insert(m_step_power.end(), state.m_step_power.begin(), state.m_step_power.end());
+    return true;
+}
+
+float LoudnessMeter::IntegratedLoudness(size_t start_sample, size_t num_samples) const
+{
+    // Figure out which of the completed steps we're measuring.
+    size_t first_step = start_sample / m_samples_per_step;
+    size_t end_step = m_step_power.size();
+    if (num_samples)
+        end_step = (start_sample + num_samples) / m_samples_per_step;
+    if (end_step > m_step_power.size())
+        end_step = m_step_power.size();
+    if (first_step >= end_step)
+        return -HUGE_VALF;
+
+    // Calculate the power of each gating block.  The blocks overlap
+    // by 75%, so each one is the average of four consecutive steps.
+    std::vector<double> block_power;
+    if (end_step - first_step < k_steps_per_block)
+    {
+        double sum = 0.0;
+        for (size_t istep = first_step; istep < end_step; istep++)
+            sum += m_step_power[istep];
+        block_power.push_back(sum / (end_step - first_step));
+    }
+    else
+    {
+        for (size_t istep = first_step; istep + k_steps_per_block <= end_step; istep++)
+        {
+            double sum = 0.0;
+            for (unsigned j = 0; j < k_steps_per_block; j++)
+                sum += m_step_power[istep + j];
+            block_power.push_back(sum / k_steps_per_block);
+        }
+    }
+
+    // Apply the absolute gate.
+    const double absolute_threshold = lufs_to_power(k_absolute_gate);
+    double sum = 0.0;
+    size_t count = 0;
+    for (double power : block_power)
+    {
+        if (power > absolute_threshold)
+        {
+            sum += power;
+            ++count;
+        }
+    }
+    if (!count)
+        return -HUGE_VALF;
+
+    // Apply the relative gate, which is based on the loudness of
+    // the blocks that passed the absolute gate.
+    const double relative_threshold = sum / count * pow(10.0, k_relative_gate / 10.0);
+    sum = 0.0;
+    count = 0;
+    for (double power : block_power)
+    {
+        if (power > absolute_threshold && power > relative_threshold)
+        {
+            sum += power;
+            ++count;
+        }
+    }
+    if (!count)
+        return -HUGE_VALF;
+
+    return static_cast<float>(power_to_lufs(sum / count));
+}
+
+std::vector<float> LoudnessMeter::ShortTermLoudness() const
+{
+    std::vector<float> loudness(m_step_power.size());
+
+    // Keep a running sum of the steps within the sliding window.
+    double window_sum = 0.0;
+    for (size_t istep = 0; istep < m_step_power.size(); istep++)
+    {
+        window_sum += m_step_power[istep];
+        if (istep >= k_steps_per_short_term)
+            window_sum -= m_step_power[istep - k_steps_per_short_term];
+
+        size_t window_steps = (istep + 1 < k_steps_per_short_term) ? istep + 1 : k_steps_per_short_term;
+        loudness[istep] = static_cast<float>(power_to_lufs(window_sum / window_steps));
+    }
+
+    return loudness;
+}
+
+// Returns the gain multiplier that will change audio measured at
+// 'measured_lufs' to the 'target_lufs' loudness level.
+float LoudnessGain(float measured_lufs, float target_lufs)
+{
+    if (!isfinite(measured_lufs))
+        return 1.0f;
+    return powf(10.0f, (target_lufs - measured_lufs) / 20.0f);
+}
+
+// Calculates the gain that NormalizeAudioLoudness would apply to
+// part of an audio waveform, without modifying the waveform.
+template <typename SampleT>
+float CalculateLoudnessNormalizationGain(const BasicWaveform<SampleT> &wav, float target_lufs, float measured_lufs,
+    size_t start_sample, size_t num_samples)
+{
+    if (start_sample >= wav.m_data.size())
+        return 1.0f;
+    if (!num_samples || start_sample + num_samples > wav.m_data.size())
+        num_samples = wav.m_data.size() - start_sample;
+
+    // Find the peak level so we can keep the gain from clipping.
+    const SampleT *data = &wav.m_data[start_sample];
+    float peak = 0.0f;
+    for (size_t isample = 0; isample < num_samples; isample++)
+    {
+        float vol = fabsf(SampleToFloat(data[isample]));
+        if (vol > peak)
+            peak = vol;
+    }
+
+    float gain = LoudnessGain(measured_lufs, target_lufs);
+    const float max_peak = 32767.0f / 32768.0f;
+    if (peak * gain > max_peak)
+        gain = max_peak / peak;
+
+    return gain;
+}
+
+// Normalizes part of an audio waveform, which is known to have the
+// loudness 'measured_lufs', to the 'target_lufs' loudness level.
+// The gain is limited so that the audio doesn't clip.  The waveform
+// data is modified in place.
+template <typename SampleT>
+void NormalizeAudioLoudness(BasicWaveform<SampleT> &wav, float target_lufs, float measured_lufs,
+    size_t start_sample, size_t num_samples)
+{
+    if (start_sample >= wav.m_data.size())
+        return;
+    if (!num_samples || start_sample + num_samples > wav.m_data.size())
+        num_samples = wav.m_data.size() - start_sample;
+
+    float gain = CalculateLoudnessNormalizationGain(wav, target_lufs, measured_lufs, start_sample, num_samples);
+    SampleT *data = &wav.m_data[start_sample];
+    for (size_t isample = 0; isample < num_samples; isample++)
+        SampleFromFloat(SampleToFloat(data[isample]) * gain, data[isample]);
+}
+
+// The sample types that waveforms can be stored as.
+template float CalculateLoudnessNormalizationGain(const Waveform &wav, float target_lufs, float measured_lufs,
+    size_t start_sample, size_t num_samples);
+template float CalculateLoudnessNormalizationGain(const Waveform16 &wav, float target_lufs, float measured_lufs,
+    size_t start_sample, size_t num_samples);
+template float CalculateLoudnessNormalizationGain(const WaveformHalf &wav, float target_lufs, float measured_lufs,
+    size_t start_sample, size_t num_samples);
+template void NormalizeAudioLoudness(Waveform &wav, float target_lufs, float measured_lufs,
+    size_t start_sample, size_t num_samples);
+template void NormalizeAudioLoudness(Waveform16 &wav, float target_lufs, float measured_lufs,
+    size_t start_sample, size_t num_samples);
+template void NormalizeAudioLoudness(WaveformHalf &wav, float target_lufs, float measured_lufs,
+    size_t start_sample, size_t num_samples);
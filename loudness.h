@@ -0,0 +1,146 @@
+//-------------------------------------------------------------------
+//
+// loudness.h
+//
+// Header of C++ module for measuring the perceived loudness of an
+// audio waveform, as described by ITU-R BS.1770 and EBU R128, and
+// for normalizing audio to a target loudness in LUFS.
+//
+//-------------------------------------------------------------------
+//
+// (C) Copyright 2024 Ammon R. Campbell.
+//
+// I wrote this code for use in my own educational and experimental
+// programs, but you may also freely use it in yours as long as you
+// abide by the following terms and conditions:
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following
+//     disclaimer in the documentation and/or other materials
+//     provided with the distribution.
+//   * The name(s) of the author(s) and contributors (if any) may not
+//     be used to endorse or promote products derived from this
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+// CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+// OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.  IN OTHER WORDS, USE AT YOUR OWN RISK, NOT OURS.  
+//--------------------------------------------------------------------
+
+#pragma once
+#include "waveform.h"
+
+// Measures the loudness of a monophonic audio signal.  Samples are
+// fed to the meter in blocks of any size with Process(); the meter
+// runs them through the K-weighting filter and keeps the mean
+// square power of each 100 millisecond step of the signal.  The
+// integrated (gated) and short-term loudness of the whole signal,
+// or of any part of it, can then be calculated from those steps
+// without looking at the samples again.
+//
+// Loudness values are in LUFS (Loudness Units relative to Full
+// Scale), where a full-scale 1 KHz sine wave measures about -3 LUFS.
+class LoudnessMeter
+{
+public:
+    explicit LoudnessMeter(unsigned frequency = 48000);
+    ~LoudnessMeter() = default;
+
+    // Discards any measurements and prepares the meter for a new
+    // signal with the given sample frequency.
+    void Reset(unsigned frequency);
+
+    // Feeds the next block of samples into the meter.
+    void Process(const float *samples, size_t count);
+
+    // Returns the integrated loudness of the signal, using the
+    // 400 millisecond gated blocks described by BS.1770.  A
+    // specific part of the signal can be measured by using the
+    // 'start_sample' and 'num_samples' parameters.  Parts shorter
+    // than one gating block are measured as a single block.
+    // Returns -infinity if the signal is silent.
+    float IntegratedLoudness(size_t start_sample = 0, size_t num_samples = 0) const;
+
+    // Returns the short-term loudness (3 second window) of the
+    // signal at the end of each 100 millisecond step.
+    std::vector<float> ShortTermLoudness() const;
+
+    // Returns the number of samples in each 100 millisecond step.
+    unsigned SamplesPerStep() const { return m_samples_per_step; }
+
+    // The meter's running state, which can be saved part way through
+    // a long signal so the meter can carry on from the same place
+    // later (see Checkpoint in journal.h).  The step powers can be
+    // saved a few at a time:  'm_first_step' is the number of the
+    // first step in 'm_step_power'.
+    struct State
+    {
+        double m_filter[4] = {};            // z1 and z2 of each filter stage.
+        double m_step_sum = 0;              // Sum of squares for the current step.
+        unsigned m_step_count = 0;          // Samples so far in the current step.
+        size_t m_first_step = 0;            // Number of the first step below.
+        std::vector<double> m_step_power;   // Mean square power of the completed steps.
+    };
+
+    // Gets the meter's state, with the step powers from 'first_step'
+    // on.
+    void GetState(State &state, size_t first_step = 0) const;
+
+    // Restores a state from GetState, after the meter has been Reset
+    // for the same sample frequency.  The state's steps are added to
+    // the meter's, so a state that was saved a few steps at a time
+    // can be restored a few steps at a time, in the same order.
+    // Returns false if the state's first step isn't the next one the
+    // meter needs.
+    bool SetState(const State &state);
+
+private:
+    // One second-order section of the K-weighting filter, using the
+    // transposed direct form II structure.
+    struct Biquad
+    {
+        double b0 = 1, b1 = 0, b2 = 0;  // Feed-forward coefficients.
+        double a1 = 0, a2 = 0;          // Feedback coefficients.
+        double z1 = 0, z2 = 0;          // Filter state.
+    };
+
+    unsigned m_samples_per_step = 4800;
+    Biquad m_shelf;                     // Stage 1: high frequency shelf.
+    Biquad m_highpass;                  // Stage 2: low frequency cut.
+    double m_step_sum = 0;              // Sum of squares for current step.
+    unsigned m_step_count = 0;          // Samples so far in current step.
+    std::vector<double> m_step_power;   // Mean square power of each completed step.
+};
+
+// Returns the gain multiplier that will change audio measured at
+// 'measured_lufs' to the 'target_lufs' loudness level.
+float LoudnessGain(float measured_lufs, float target_lufs);
+
+// Calculates the gain that NormalizeAudioLoudness would apply to
+// part of an audio waveform, without modifying the waveform.
+template <typename SampleT>
+float CalculateLoudnessNormalizationGain(const BasicWaveform<SampleT> &wav, float target_lufs, float measured_lufs,
+    size_t start_sample = 0, size_t num_samples = 0);
+
+// Normalizes part of an audio waveform, which is known to have the
+// loudness 'measured_lufs', to the 'target_lufs' loudness level.
+// The gain is limited so that the audio doesn't clip.  The waveform
+// data is modified in place.
+template <typename SampleT>
+void NormalizeAudioLoudness(BasicWaveform<SampleT> &wav, float target_lufs, float measured_lufs,
+    size_t start_sample = 0, size_t num_samples = 0);
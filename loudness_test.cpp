@@ -0,0 +1,136 @@
+//-------------------------------------------------------------------
+//
+// loudness_test.cpp
+//
+// Simple test of the loudness.cpp module.  Generates sine wave test
+// tones of known levels, then confirms the loudness meter measures
+// them as expected, both for the whole waveform and for the
+// individual segments found by the segmentation function.
+//
+//-------------------------------------------------------------------
+//
+// (C) Copyright 2024 Ammon R. Campbell.
+//
+// I wrote this code for use in my own educational and experimental
+// programs, but you may also freely use it in yours as long as you
+// abide by the following terms and conditions:
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following
+//     disclaimer in the documentation and/or other materials
+//     provided with the distribution.
+//   * The name(s) of the author(s) and contributors (if any) may not
+//     be used to endorse or promote products derived from this
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+// CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+// OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.  IN OTHER WORDS, USE AT YOUR OWN RISK, NOT OURS.  
+//--------------------------------------------------------------------
+
+#include "waveform.h"
+#include "loudness.h"
+#include "segment.h"
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <math.h>
+#include <vector>
+
+// Adds a 1 KHz sine wave tone with the given peak amplitude to the
+// waveform.
+static void add_tone(Waveform &wav, size_t offset, size_t count, float amplitude)
+{
+    for (size_t i = 0; i < count; i++)
+        wav.m_data[offset + i] = amplitude * sinf(2.0f * 3.14159265f * 1000.0f * i / wav.m_frequency);
+}
+
+// Checks that a loudness measurement is close to what we expected.
+static bool check_loudness(const char *what, float measured, float expected, float tolerance = 0.1f)
+{
+    if (fabsf(measured - expected) > tolerance)
+    {
+        printf("Loudness of %s doesn't match!\n", what);
+        printf("  Expected:  %.2f LUFS\n", expected);
+        printf("  Measured:  %.2f LUFS\n", measured);
+        return false;
+    }
+
+    return true;
+}
+
+bool test_loudness()
+{
+    printf("Starting loudness measurement test\n");
+
+    // A full-scale 1 KHz sine wave measures -3.01 LUFS, so a sine
+    // wave with a peak of 0.1 (-20 dB) should measure -23.01 LUFS.
+    // Try it at a few different sample rates.
+    const unsigned rates[] = { 16000, 44100, 48000 };
+    for (unsigned rate : rates)
+    {
+        Waveform wav;
+        wav.m_frequency = rate;
+        wav.m_data.resize(rate * 5);
+        add_tone(wav, 0, wav.m_data.size(), 0.1f);
+
+        LoudnessMeter meter(rate);
+        meter.Process(wav.m_data.data(), wav.m_data.size());
+        if (!check_loudness("sine tone", meter.IntegratedLoudness(), -23.01f))
+            return false;
+    }
+
+    // The gating should ignore silence, so a tone with long silent
+    // gaps around it should still measure the same as the tone.
+    Waveform wav;
+    wav.m_frequency = 48000;
+    wav.m_data.resize(wav.m_frequency * 20);
+    add_tone(wav, wav.m_frequency * 2, wav.m_frequency * 4, 0.1f);
+    add_tone(wav, wav.m_frequency * 12, wav.m_frequency * 6, 0.5f);
+
+    LoudnessMeter meter(wav.m_frequency);
+    auto segments = FindSegmentsInAudioWaveform(wav, &meter);
+    if (segments.size() != 2)
+    {
+        printf("Expected 2 segments, found %zu!\n", segments.size());
+        return false;
+    }
+
+    // Each segment should have its own loudness.  The gating blocks
+    // at the edges of a segment are only partly filled by the tone,
+    // so allow a little more tolerance here.
+    if (!check_loudness("first segment", segments[0].m_loudness, -23.01f, 0.3f) ||
+        !check_loudness("second segment", segments[1].m_loudness, -9.03f, 0.3f))
+        return false;
+
+    // The quieter tone falls below the relative gate, so the
+    // integrated loudness of the whole waveform should be about the
+    // same as the louder tone.
+    if (!check_loudness("gated waveform", meter.IntegratedLoudness(), -9.03f, 0.3f))
+        return false;
+
+    // Normalizing the first segment should bring it to the target.
+    NormalizeAudioLoudness(wav, -16.0f, segments[0].m_loudness, segments[0].m_start, segments[0].m_count);
+    LoudnessMeter meter2(wav.m_frequency);
+    meter2.Process(&wav.m_data[segments[0].m_start], segments[0].m_count);
+    if (!check_loudness("normalized segment", meter2.IntegratedLoudness(), -16.0f, 0.3f))
+        return false;
+
+    printf("Loudness test OK.\n");
+    return true;
+}
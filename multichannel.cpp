@@ -0,0 +1,245 @@
+//-------------------------------------------------------------------
+//
+// multichannel.cpp
+//
+// C++ module for a multichannel audio waveform, which keeps each
+// channel of a WAV file in its own buffer so channels can be
+// selected or mixed down to mono in any proportion.
+//
+//-------------------------------------------------------------------
+//
+// (C) Copyright 2024 Ammon R. Campbell.
+//
+// I wrote this code for use in my own educational and experimental
+// programs, but you may also freely use it in yours as long as you
+// abide by the following terms and conditions:
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following
+//     disclaimer in the documentation and/or other materials
+//     provided with the distribution.
+//   * The name(s) of the author(s) and contributors (if any) may not
+//     be used to endorse or promote products derived from this
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+// CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+// OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.  IN OTHER WORDS, USE AT YOUR OWN RISK, NOT OURS.  
+//--------------------------------------------------------------------
+
+#include "multichannel.h"
+#include <algorithm>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define USE_SSE2
+#endif
+
+// Splits the first frames of interleaved stereo samples into left
+// and right buffers, for the formats that have a vectorized version.
+// Returns the number of frames that were done; the caller does the
+// rest one at a time.
+template <typename T, typename SampleT>
+static size_t deinterleave_stereo(const T *, size_t, SampleT *, SampleT *)
+{
+    return 0;
+}
+
+#ifdef USE_SSE2
+
+// 16-bit integer samples to floating-point.  Each pair of samples is
+// treated as a 32-bit value; shifting it left and then right
+// (keeping the sign) gives the left sample, and shifting it right
+// gives the right sample.  Multiplying by 1/32768 is exact, so this
+// gives the same values as dividing by 32768.
+static size_t deinterleave_stereo(const int16_t *in, size_t frames, float *left, float *right)
+{
+    const __m128 scale = _mm_set1_ps(1.0f / 32768);
+    size_t iframe = 0;
+    for (; iframe + 4 <= frames; iframe += 4)
+    {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + iframe * 2));
+        __m128i l = _mm_srai_epi32(_mm_slli_epi32(x, 16), 16);
+        __m128i r = _mm_srai_epi32(x, 16);
+        _mm_storeu_ps(left + iframe, _mm_mul_ps(_mm_cvtepi32_ps(l), scale));
+        _mm_storeu_ps(right + iframe, _mm_mul_ps(_mm_cvtepi32_ps(r), scale));
+    }
+    return iframe;
+}
+
+// 16-bit integer samples to 16-bit integer samples.  Same as above,
+// but two vectors of 32-bit values are packed back into 16 bits.
+static size_t deinterleave_stereo(const int16_t *in, size_t frames, int16_t *left, int16_t *right)
+{
+    size_t iframe = 0;
+    for (; iframe + 8 <= frames; iframe += 8)
+    {
+        __m128i x0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + iframe * 2));
+        __m128i x1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + iframe * 2 + 8));
+        __m128i l = _mm_packs_epi32(_mm_srai_epi32(_mm_slli_epi32(x0, 16), 16), _mm_srai_epi32(_mm_slli_epi32(x1, 16), 16));
+        __m128i r = _mm_packs_epi32(_mm_srai_epi32(x0, 16), _mm_srai_epi32(x1, 16));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(left + iframe), l);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(right + iframe), r);
+    }
+    return iframe;
+}
+
+// Floating-point samples to floating-point.  Just a shuffle.
+static size_t deinterleave_stereo(const float *in, size_t frames, float *left, float *right)
+{
+    size_t iframe = 0;
+    for (; iframe + 4 <= frames; iframe += 4)
+    {
+        __m128 x0 = _mm_loadu_ps(in + iframe * 2);
+        __m128 x1 = _mm_loadu_ps(in + iframe * 2 + 4);
+        _mm_storeu_ps(left + iframe, _mm_shuffle_ps(x0, x1, _MM_SHUFFLE(2, 0, 2, 0)));
+        _mm_storeu_ps(right + iframe, _mm_shuffle_ps(x0, x1, _MM_SHUFFLE(3, 1, 3, 1)));
+    }
+    return iframe;
+}
+
+#endif
+
+// Splits interleaved multichannel samples from a WAV file into a
+// separate buffer for each channel, converting them to our internal
+// sample format.  The 'to_float' function converts one sample value
+// from the file.
+template <typename T, typename ToFloat, typename SampleT>
+static void deinterleave(const T *in, size_t frames, ToFloat to_float, std::vector<BasicWaveform<SampleT>> &out)
+{
+    const unsigned channels = static_cast<unsigned>(out.size());
+    size_t iframe = 0;
+    if (channels == 2)
+        iframe = deinterleave_stereo(in, frames, out[0].m_data.data(), out[1].m_data.data());
+
+    for (; iframe < frames; iframe++)
+    {
+        for (unsigned channel = 0; channel < channels; channel++)
+            SampleFromFloat(to_float(in[iframe * channels + channel]), out[channel].m_data[iframe]);
+    }
+}
+
+template <typename SampleT>
+bool BasicMultichannelWaveform<SampleT>::LoadFromWAVFile(const wchar_t *filename)
+{
+    WAVInfo header;
+    if (!WAVFileReadHeader(filename, header))
+        return false;
+
+    std::vector<char> raw(header.CalculateBufferSize());
+    if (!raw.empty() && !WAVFileReadSamples(filename, raw.data(), raw.size()))
+        return false;
+
+    LoadFromWAVData(raw.data(), header);
+    return true;
+}
+
+template <typename SampleT>
+void BasicMultichannelWaveform<SampleT>::LoadFromWAVData(const void *samples, const WAVInfo &header)
+{
+    m_frequency = header.m_rate;
+    m_channels.assign(header.m_channels, BasicWaveform<SampleT>());
+    for (BasicWaveform<SampleT> &channel : m_channels)
+    {
+        channel.m_frequency = header.m_rate;
+        channel.m_data.resize(header.m_sample_count);
+    }
+
+    // Convert data from the file's format to our internal format,
+    // one channel per buffer.
+    if (header.m_is_float && header.m_bits == 32)
+    {
+        // cppcheck-suppress invalidPointerCast
+        const float *in = reinterpret_cast<const float *>(samples);
+        deinterleave(in, header.m_sample_count, [](float sample) { return sample; }, m_channels);
+    }
+    else if (header.m_bits == 16)
+    {
+        const int16_t *in = reinterpret_cast<const int16_t *>(samples);
+        deinterleave(in, header.m_sample_count, [](int16_t sample) { return sample / 32768.f; }, m_channels);
+    }
+    else if (header.m_bits == 8)
+    {
+        const uint8_t *in = reinterpret_cast<const uint8_t *>(samples);
+        deinterleave(in, header.m_sample_count, [](uint8_t sample) { return (sample - 128.f) / 128.f; }, m_channels);
+    }
+}
+
+template <typename SampleT>
+bool BasicMultichannelWaveform<SampleT>::MixToMono(const std::vector<float> &weights, BasicWaveform<SampleT> &out) const
+{
+    if (weights.size() != m_channels.size() || m_channels.empty())
+        return false;
+
+    out.m_frequency = m_frequency;
+
+    // If we're just selecting one channel, copy it as it is.
+    unsigned selected = 0, num_selected = 0, num_zero = 0;
+    for (unsigned channel = 0; channel < weights.size(); channel++)
+    {
+        if (weights[channel] == 1.0f)
+        {
+            selected = channel;
+            num_selected++;
+        }
+        else if (weights[channel] == 0.0f)
+        {
+            num_zero++;
+        }
+    }
+    if (num_selected == 1 && num_selected + num_zero == weights.size())
+    {
+        out.m_data = m_channels[selected].m_data;
+        return true;
+    }
+
+    // Mix the channels a block at a time, so the sums stay in the
+    // cache.
+    const size_t num_samples = m_channels[0].m_data.size();
+    const size_t block_size = 4096;
+    std::vector<float> sum(block_size), buffer;
+    out.m_data.resize(num_samples);
+    for (size_t first = 0; first < num_samples; first += block_size)
+    {
+        size_t count = num_samples - first;
+        if (count > block_size)
+            count = block_size;
+
+        std::fill(sum.begin(), sum.begin() + count, 0.0f);
+        for (unsigned channel = 0; channel < m_channels.size(); channel++)
+        {
+            const float weight = weights[channel];
+            if (weight == 0.0f)
+                continue;
+
+            const float *in = SamplesAsFloat(&m_channels[channel].m_data[first], count, buffer);
+            for (size_t isample = 0; isample < count; isample++)
+                sum[isample] += in[isample] * weight;
+        }
+
+        for (size_t isample = 0; isample < count; isample++)
+            SampleFromFloat(sum[isample], out.m_data[first + isample]);
+    }
+
+    return true;
+}
+
+// The sample types that waveforms can be stored as.
+template class BasicMultichannelWaveform<float>;
+template class BasicMultichannelWaveform<int16_t>;
+template class BasicMultichannelWaveform<Half>;
@@ -0,0 +1,87 @@
+//-------------------------------------------------------------------
+//
+// multichannel.h
+//
+// Header of C++ module for a multichannel audio waveform, which
+// keeps each channel of a WAV file in its own buffer so channels
+// can be selected or mixed down to mono in any proportion.
+//
+//-------------------------------------------------------------------
+//
+// (C) Copyright 2024 Ammon R. Campbell.
+//
+// I wrote this code for use in my own educational and experimental
+// programs, but you may also freely use it in yours as long as you
+// abide by the following terms and conditions:
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following
+//     disclaimer in the documentation and/or other materials
+//     provided with the distribution.
+//   * The name(s) of the author(s) and contributors (if any) may not
+//     be used to endorse or promote products derived from this
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+// CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+// OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.  IN OTHER WORDS, USE AT YOUR OWN RISK, NOT OURS.  
+//--------------------------------------------------------------------
+
+#pragma once
+#include "waveform.h"
+#include <vector>
+
+// Container class for a multichannel PCM audio waveform.  The
+// samples are stored 'planar', with a separate single-channel
+// waveform for each channel, rather than interleaved the way they
+// are in a WAV file.  So any channel can be used directly with the
+// code that works on single-channel waveforms.
+template <typename SampleT>
+class BasicMultichannelWaveform
+{
+public:
+    BasicMultichannelWaveform() = default;
+    ~BasicMultichannelWaveform() = default;
+
+    // Loads this waveform object with the PCM audio from a WAV file,
+    // splitting the file's interleaved samples into one waveform per
+    // channel.
+    // Returns true if successful.
+    bool LoadFromWAVFile(const wchar_t *filename);
+
+    // Loads this waveform object with PCM audio that has already
+    // been read from a WAV file into memory, the same way as
+    // LoadFromWAVFile.
+    void LoadFromWAVData(const void *samples, const WAVInfo &header);
+
+    // Mixes the channels down to a single-channel waveform.  The
+    // 'weights' give the gain multiplier for each channel, and there
+    // must be one for each channel.  For example, { 0.5, 0.5 } is
+    // the average of two channels, and { 0, 1 } selects the right
+    // channel.
+    // Returns false if the number of weights is wrong.
+    bool MixToMono(const std::vector<float> &weights, BasicWaveform<SampleT> &out) const;
+
+    // Returns the number of channels.
+    unsigned ChannelCount() const { return static_cast<unsigned>(m_channels.size()); }
+
+    unsigned m_frequency = 48000;                   // Sample frequency in Hertz.
+    std::vector<BasicWaveform<SampleT>> m_channels; // Audio for each channel.
+};
+
+typedef BasicMultichannelWaveform<float> MultichannelWaveform;
@@ -0,0 +1,213 @@
+//-------------------------------------------------------------------
+//
+// multichannel_test.cpp
+//
+// Simple test of the multichannel.cpp module.  Writes WAV files with
+// a known pattern of samples in several formats and channel counts,
+// loads them back into planar buffers, and confirms that each sample
+// ended up in the right channel.  Also checks that mixing the
+// channels of a WAV file gives the same mono waveform as the usual
+// WAV file loader.
+//
+//-------------------------------------------------------------------
+//
+// (C) Copyright 2024 Ammon R. Campbell.
+//
+// I wrote this code for use in my own educational and experimental
+// programs, but you may also freely use it in yours as long as you
+// abide by the following terms and conditions:
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following
+//     disclaimer in the documentation and/or other materials
+//     provided with the distribution.
+//   * The name(s) of the author(s) and contributors (if any) may not
+//     be used to endorse or promote products derived from this
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+// CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+// OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.  IN OTHER WORDS, USE AT YOUR OWN RISK, NOT OURS.  
+//--------------------------------------------------------------------
+
+#include "waveform.h"
+#include "multichannel.h"
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <math.h>
+#include <vector>
+
+// Returns a different 16-bit sample value for each frame and channel.
+static int16_t pattern_sample(size_t iframe, unsigned channel)
+{
+    return static_cast<int16_t>((iframe * 37 + channel * 1000) % 65536 - 32768);
+}
+
+// Writes a WAV file with the test pattern, loads it into planar
+// buffers, and checks the samples.
+template <typename SampleT>
+static bool check_format(unsigned channels, size_t frames, bool is_float)
+{
+    WAVInfo header;
+    header.m_rate = 16000;
+    header.m_channels = channels;
+    header.m_bits = is_float ? 32 : 16;
+    header.m_is_float = is_float;
+    header.m_sample_count = static_cast<unsigned>(frames);
+
+    std::vector<int16_t> pcm(frames * channels);
+    std::vector<float> floats(frames * channels);
+    for (size_t iframe = 0; iframe < frames; iframe++)
+    {
+        for (unsigned channel = 0; channel < channels; channel++)
+        {
+            pcm[iframe * channels + channel] = pattern_sample(iframe, channel);
+            floats[iframe * channels + channel] = pattern_sample(iframe, channel) / 32768.f;
+        }
+    }
+
+    const wchar_t *filename = L"temp.wav";
+    if (!WAVFileWrite(filename, header, is_float ? static_cast<const void *>(floats.data()) : pcm.data()))
+    {
+        printf("WAVFileWrite failed writing '%S'\n", filename);
+        return false;
+    }
+
+    BasicMultichannelWaveform<SampleT> wav;
+    bool loaded = wav.LoadFromWAVFile(filename);
+    _wunlink(filename);
+    if (!loaded)
+    {
+        printf("LoadFromWAVFile failed reading %u channel file\n", channels);
+        return false;
+    }
+
+    if (wav.m_frequency != header.m_rate || wav.ChannelCount() != channels)
+    {
+        printf("Multichannel waveform has the wrong format!\n");
+        return false;
+    }
+
+    for (unsigned channel = 0; channel < channels; channel++)
+    {
+        const BasicWaveform<SampleT> &plane = wav.m_channels[channel];
+        if (plane.m_data.size() != frames)
+        {
+            printf("Channel %u has the wrong number of samples!\n", channel + 1);
+            return false;
+        }
+        for (size_t iframe = 0; iframe < frames; iframe++)
+        {
+            // Compare with the pattern stored as the same sample type,
+            // since half-precision samples can't hold it exactly.
+            SampleT expected;
+            SampleFromFloat(pattern_sample(iframe, channel) / 32768.f, expected);
+            if (SampleToFloat(plane.m_data[iframe]) != SampleToFloat(expected))
+            {
+                printf("Channel %u of %u doesn't match at sample %zu!\n", channel + 1, channels, iframe);
+                return false;
+            }
+        }
+    }
+
+    // Selecting a channel should give exactly that channel.
+    std::vector<float> weights(channels, 0.0f);
+    weights[channels - 1] = 1.0f;
+    BasicWaveform<SampleT> mono;
+    if (!wav.MixToMono(weights, mono) || mono.m_data.size() != frames)
+    {
+        printf("Selecting channel %u of %u failed!\n", channels, channels);
+        return false;
+    }
+    for (size_t iframe = 0; iframe < frames; iframe++)
+    {
+        if (SampleToFloat(mono.m_data[iframe]) != SampleToFloat(wav.m_channels[channels - 1].m_data[iframe]))
+        {
+            printf("Selecting channel %u of %u doesn't match!\n", channels, channels);
+            return false;
+        }
+    }
+
+    // The wrong number of weights should be refused.
+    weights.push_back(0.0f);
+    if (wav.MixToMono(weights, mono))
+    {
+        printf("MixToMono accepted the wrong number of weights!\n");
+        return false;
+    }
+
+    return true;
+}
+
+bool test_multichannel()
+{
+    printf("Starting multichannel waveform test\n");
+
+    // Odd numbers of frames leave some samples for the non-vectorized
+    // code to do.
+    if (!check_format<float>(2, 1001, false) ||
+        !check_format<int16_t>(2, 1003, false) ||
+        !check_format<float>(2, 999, true) ||
+        !check_format<float>(3, 500, false) ||
+        !check_format<int16_t>(8, 321, false) ||
+        !check_format<Half>(2, 100, false))
+        return false;
+
+    printf("Multichannel waveform test OK.\n");
+    return true;
+}
+
+bool test_multichannel_mix(wchar_t *filename)
+{
+    printf("Starting multichannel mix test with '%S'\n", filename);
+
+    Waveform mono;
+    if (!mono.LoadFromWAVFile(filename))
+    {
+        printf("LoadFromWAVFile failed reading '%S'\n", filename);
+        return false;
+    }
+
+    MultichannelWaveform wav;
+    if (!wav.LoadFromWAVFile(filename))
+    {
+        printf("LoadFromWAVFile failed reading '%S' as multichannel\n", filename);
+        return false;
+    }
+
+    // Mixing equal parts of each channel should give the same
+    // waveform as the usual loader, apart from rounding.
+    std::vector<float> weights(wav.ChannelCount(), 1.0f / wav.ChannelCount());
+    Waveform mixed;
+    if (!wav.MixToMono(weights, mixed) || mixed.m_data.size() != mono.m_data.size())
+    {
+        printf("Mixing '%S' to mono failed!\n", filename);
+        return false;
+    }
+    for (size_t isample = 0; isample < mono.m_data.size(); isample++)
+    {
+        if (fabsf(mixed.m_data[isample] - mono.m_data[isample]) > 1e-6f)
+        {
+            printf("Mixed sample %zu doesn't match!\n", isample);
+            return false;
+        }
+    }
+
+    return true;
+}
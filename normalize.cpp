@@ -41,7 +41,42 @@
 //--------------------------------------------------------------------
 
 #include "normalize.h"
+#include "analysis.h"
 #include <math.h>
+#include <deque>
+#include <utility>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define USE_SSE2
+#endif
+
+// The 4x oversampling interpolation filter from ITU-R BS.1770, which
+// has four phases of 12 taps each.  The table is stored tap by tap,
+// with the coefficients of the four phases for each tap side by
+// side, so that all four phases can be calculated at once as one
+// 4-wide vector.
+static const unsigned k_oversample = 4;
+static const unsigned k_taps_per_phase = 12;
+alignas(16) static const float k_true_peak_fir[k_taps_per_phase][k_oversample] =
+{
+    {  0.0017089843750f, -0.0291748046875f, -0.0189208984375f, -0.0083007812500f },
+    {  0.0109863281250f,  0.0292968750000f,  0.0330810546875f,  0.0148925781250f },
+    { -0.0196533203125f, -0.0517578125000f, -0.0582275390625f, -0.0266113281250f },
+    {  0.0332031250000f,  0.0891113281250f,  0.1015625000000f,  0.0476074218750f },
+    { -0.0594482421875f, -0.1665039062500f, -0.2003173828125f, -0.1022949218750f },
+    {  0.1373291015625f,  0.4650878906250f,  0.7797851562500f,  0.9721679687500f },
+    {  0.9721679687500f,  0.7797851562500f,  0.4650878906250f,  0.1373291015625f },
+    { -0.1022949218750f, -0.2003173828125f, -0.1665039062500f, -0.0594482421875f },
+    {  0.0476074218750f,  0.1015625000000f,  0.0891113281250f,  0.0332031250000f },
+    { -0.0266113281250f, -0.0582275390625f, -0.0517578125000f, -0.0196533203125f },
+    {  0.0148925781250f,  0.0330810546875f,  0.0292968750000f,  0.0109863281250f },
+    { -0.0083007812500f, -0.0189208984375f, -0.0291748046875f,  0.0017089843750f },
+};
+
+// The filter's output for a given input sample is centered this
+// many samples later, so we look this far ahead to line them up.
+static const unsigned k_true_peak_delay = 6;
 
 // From an attenuation level between 0 dB (loudest) and -infinity
 // dB (quietest), returns the corresponding linear gain multiplier
@@ -54,14 +89,34 @@ static float db_to_linear(float db)
 // Normalizes an audio waveform such that the level doesn't exceed
 // the specified dB level (where 0dB=loudest, -infinity=quietest).
 // The waveform data is modified in place.
-void NormalizeAudioWaveform(Waveform &wav, float db_level)
+template <typename SampleT>
+void NormalizeAudioWaveform(BasicWaveform<SampleT> &wav, float db_level)
 {
-    if (wav.m_data.empty())
-        return;
+    GainEnvelope envelope;
+    CalculateNormalizationGain(wav, db_level, envelope);
+    wav.ApplyGainEnvelope(envelope);
+}
+
+// Calculates the gain envelope that NormalizeAudioWaveform would
+// apply to an audio waveform, without modifying the waveform.
+template <typename SampleT>
+void CalculateNormalizationGain(const BasicWaveform<SampleT> &wav, float db_level, GainEnvelope &envelope)
+{
+    AnalysisTable table;
+    AnalyzeAudioWaveform(wav, table);
+    CalculateNormalizationGain(table, db_level, envelope);
+}
+
+// Calculates the normalization gain envelope from the table of
+// statistics for each frame of an audio waveform.
+void CalculateNormalizationGain(const AnalysisTable &table, float db_level, GainEnvelope &envelope)
+{
+    envelope.m_spans.clear();
 
     //
-    // Examine the waveform in chunks of about 50 milliseconds
-    // each, finding the peak volume level of each chunk as we go.
+    // Examine the waveform in chunks of about 10 milliseconds
+    // each (one frame of the analysis table), looking at the peak
+    // volume level of each chunk as we go.
     //
     // If the current chunk's audio peak is lower than the target
     // maximum, we increase the gain slightly.  If the peak is
@@ -71,21 +126,15 @@ void NormalizeAudioWaveform(Waveform &wav, float db_level)
     //
 
     const float max_vol = db_to_linear(db_level);
-    const unsigned samples_per_chunk = static_cast<unsigned>(wav.m_frequency * 0.01f);
-    const unsigned num_chunks = static_cast<unsigned>(wav.m_data.size() / samples_per_chunk);
+    const unsigned samples_per_chunk = table.m_samples_per_frame;
+    const size_t num_chunks = table.m_frames.size();
     float gain = 1.0f;
 
-    for (unsigned chunk = 0; chunk < num_chunks; chunk++)
+    envelope.m_spans.reserve(num_chunks);
+    for (size_t chunk = 0; chunk < num_chunks; chunk++)
     {
-        // Determine the peak volume of the samples in this chunk.
-        unsigned isample = static_cast<unsigned>(chunk * samples_per_chunk);
-        float local_peak = 0.0f;
-        for (unsigned subsample = 0; subsample < samples_per_chunk; subsample++)
-        {
-            float vol = fabsf(wav.m_data[isample + subsample]);
-            if (vol > local_peak)
-                local_peak = vol;
-        }
+        // The peak volume of the samples in this chunk.
+        float local_peak = table.m_frames[chunk].m_peak;
 
         // If this chunks's peak volume is less than the target max,
         // gradually increase the gain.
@@ -102,15 +151,213 @@ void NormalizeAudioWaveform(Waveform &wav, float db_level)
                 gain = max_vol / local_peak;
         }
 
-        // Apply the gain multiplier to the samples in this chunk.
-        // If this is the last full chunk, also apply the gain to
-        // any remaining partial chunk at the very end of the
-        // waveform.
-        size_t count = samples_per_chunk;
-        if (chunk == num_chunks - 1)
-            count = wav.m_data.size() - isample;
-        for (size_t subsample = 0; subsample < count; subsample++)
-            wav.m_data[isample + subsample] *= gain;
+        // The gain multiplier applies to the samples in this chunk.
+        // Since the last span runs to the end of the waveform, the
+        // last full chunk's gain also applies to any remaining
+        // partial chunk at the very end of the waveform.
+        envelope.Add(chunk * samples_per_chunk, gain);
+    }
+}
+
+// Calculates the true peak level of each sample in part of a
+// waveform:  The largest absolute value among the sample itself and
+// the four oversampled points that lie between it and the next
+// sample.  The results are written to the 'peaks' array, which must
+// have room for 'num_samples' values.
+template <typename SampleT>
+static void true_peak_per_sample(const BasicWaveform<SampleT> &wav, size_t start_sample, size_t num_samples, float *peaks)
+{
+    //
+    // The waveform is processed in blocks.  Each block is copied to
+    // a local buffer along with the neighboring samples the filter
+    // needs on either side (or zeros at the ends of the waveform),
+    // so the inner loop doesn't need any bounds checks.
+    //
+
+    const size_t block_size = 4096;
+    const size_t before = k_taps_per_phase - 1 - k_true_peak_delay;
+    alignas(16) float buffer[block_size + k_taps_per_phase - 1];
+
+    for (size_t block_start = 0; block_start < num_samples; block_start += block_size)
+    {
+        size_t count = num_samples - block_start;
+        if (count > block_size)
+            count = block_size;
+
+        // Fill the local buffer.
+        const size_t first = start_sample + block_start;
+        for (size_t j = 0; j < count + k_taps_per_phase - 1; j++)
+        {
+            size_t isample = first + j - before;
+            buffer[j] = (first + j >= before && isample < wav.m_data.size()) ? SampleToFloat(wav.m_data[isample]) : 0.0f;
+        }
+
+        // Run the interpolation filter and find the peaks.
+        for (size_t i = 0; i < count; i++)
+        {
+            const float *x = &buffer[i + k_taps_per_phase - 1];
+#ifdef USE_SSE2
+            __m128 acc = _mm_setzero_ps();
+            for (unsigned k = 0; k < k_taps_per_phase; k++)
+                acc = _mm_add_ps(acc, _mm_mul_ps(_mm_load_ps(k_true_peak_fir[k]), _mm_set1_ps(*(x - k))));
+            acc = _mm_andnot_ps(_mm_set1_ps(-0.0f), acc);
+            acc = _mm_max_ps(acc, _mm_shuffle_ps(acc, acc, _MM_SHUFFLE(2, 3, 0, 1)));
+            acc = _mm_max_ps(acc, _mm_shuffle_ps(acc, acc, _MM_SHUFFLE(1, 0, 3, 2)));
+            float peak = _mm_cvtss_f32(acc);
+#else
+            float acc[k_oversample] = { 0.0f };
+            for (unsigned k = 0; k < k_taps_per_phase; k++)
+            {
+                for (unsigned phase = 0; phase < k_oversample; phase++)
+                    acc[phase] += k_true_peak_fir[k][phase] * *(x - k);
+            }
+            float peak = 0.0f;
+            for (unsigned phase = 0; phase < k_oversample; phase++)
+            {
+                if (fabsf(acc[phase]) > peak)
+                    peak = fabsf(acc[phase]);
+            }
+#endif
+            float vol = fabsf(buffer[i + before]);
+            peaks[block_start + i] = (vol > peak) ? vol : peak;
+        }
+    }
+}
+
+// Returns the true peak level of an audio waveform, which includes
+// the peaks that occur between samples when the waveform is played
+// back or resampled.
+template <typename SampleT>
+float FindTruePeak(const BasicWaveform<SampleT> &wav, size_t start_sample, size_t num_samples)
+{
+    if (start_sample >= wav.m_data.size())
+        return 0.0f;
+    if (!num_samples || start_sample + num_samples > wav.m_data.size())
+        num_samples = wav.m_data.size() - start_sample;
+
+    std::vector<float> peaks(num_samples);
+    true_peak_per_sample(wav, start_sample, num_samples, peaks.data());
+
+    float true_peak = 0.0f;
+    for (float peak : peaks)
+    {
+        if (peak > true_peak)
+            true_peak = peak;
+    }
+
+    return true_peak;
+}
+
+// Limits an audio waveform such that its true peak level doesn't
+// exceed the specified dB level (where 0dB=loudest).  The waveform
+// data is modified in place.
+template <typename SampleT>
+void LimitTruePeakAudioWaveform(BasicWaveform<SampleT> &wav, float db_level)
+{
+    if (wav.m_data.empty())
+        return;
+
+    //
+    // First we find the gain each sample would need to keep its
+    // true peak under the limit.  Then we build a gain envelope from
+    // those:  The envelope starts dropping a short 'look-ahead' time
+    // before each peak so that it has fully reached the needed gain
+    // by the time the peak arrives, and after the peak it recovers
+    // gradually over the 'release' time.  The envelope is smoothed
+    // with a moving average the length of the look-ahead time, so
+    // the gain never changes abruptly enough to be audible as a
+    // click.
+    //
+
+    const float max_vol = db_to_linear(db_level);
+    const size_t num_samples = wav.m_data.size();
+    std::vector<float> gain(num_samples);
+    true_peak_per_sample(wav, 0, num_samples, gain.data());
+
+    // Turn the peaks into the gain needed for each sample.  If no
+    // sample exceeds the limit, there's nothing to do.
+    bool any_over = false;
+    for (float &g : gain)
+    {
+        if (g > max_vol)
+        {
+            g = max_vol / g;
+            any_over = true;
+        }
+        else
+        {
+            g = 1.0f;
+        }
+    }
+    if (!any_over)
+        return;
+
+    size_t lookahead = static_cast<size_t>(wav.m_frequency * 0.0015);
+    if (lookahead < 1)
+        lookahead = 1;
+    const float release = 1.0f - expf(-1.0f / (wav.m_frequency * 0.05f));
+
+    // Find the lowest gain within the look-ahead window that starts
+    // at each sample.  We keep a queue of the window's candidate
+    // minimums, in increasing order of both position and gain, so
+    // that each sample is only examined a couple of times.
+    std::deque<std::pair<size_t, float>> window;
+    for (size_t isample = 0; isample < num_samples + lookahead - 1; isample++)
+    {
+        if (isample < num_samples)
+        {
+            while (!window.empty() && window.back().second >= gain[isample])
+                window.pop_back();
+            window.push_back(std::make_pair(isample, gain[isample]));
+        }
+
+        if (isample + 1 >= lookahead)
+        {
+            size_t iout = isample + 1 - lookahead;
+            while (window.front().first < iout)
+                window.pop_front();
+            gain[iout] = window.front().second;
+        }
+    }
+
+    // Let the gain recover gradually after each peak.
+    float recovering = 1.0f;
+    for (float &g : gain)
+    {
+        recovering += (1.0f - recovering) * release;
+        if (g < recovering)
+            recovering = g;
+        g = recovering;
+    }
+
+    // Smooth the envelope with a moving average, and apply it to
+    // the samples.  Since the envelope already dropped a full
+    // look-ahead time before each peak, the average has reached
+    // the needed gain by the time the peak arrives.
+    // The average starts out as if the first sample's gain had been
+    // in effect before the start of the waveform.
+    std::vector<float> history(lookahead, gain[0]);
+    double sum = static_cast<double>(gain[0]) * lookahead;
+    for (size_t isample = 0; isample < num_samples; isample++)
+    {
+        float &oldest = history[isample % lookahead];
+        sum += gain[isample] - oldest;
+        oldest = gain[isample];
+        SampleT &sample = wav.m_data[isample];
+        SampleFromFloat(SampleToFloat(sample) * static_cast<float>(sum / lookahead), sample);
     }
 }
 
+// The sample types that waveforms can be stored as.
+template void NormalizeAudioWaveform(Waveform &wav, float db_level);
+template void NormalizeAudioWaveform(Waveform16 &wav, float db_level);
+template void NormalizeAudioWaveform(WaveformHalf &wav, float db_level);
+template void CalculateNormalizationGain(const Waveform &wav, float db_level, GainEnvelope &envelope);
+template void CalculateNormalizationGain(const Waveform16 &wav, float db_level, GainEnvelope &envelope);
+template void CalculateNormalizationGain(const WaveformHalf &wav, float db_level, GainEnvelope &envelope);
+template float FindTruePeak(const Waveform &wav, size_t start_sample, size_t num_samples);
+template float FindTruePeak(const Waveform16 &wav, size_t start_sample, size_t num_samples);
+template float FindTruePeak(const WaveformHalf &wav, size_t start_sample, size_t num_samples);
+template void LimitTruePeakAudioWaveform(Waveform &wav, float db_level);
+template void LimitTruePeakAudioWaveform(Waveform16 &wav, float db_level);
+template void LimitTruePeakAudioWaveform(WaveformHalf &wav, float db_level);
@@ -44,8 +44,41 @@
 #pragma once
 #include "waveform.h"
 
+struct AnalysisTable;
+
 // Normalizes an audio waveform such that the level doesn't exceed
 // the specified dB attenuation level (where 0dB=loudest,
 // -infinity=quietest).  The waveform data is modified in place.
-void NormalizeAudioWaveform(Waveform &wav, float db_level);
+template <typename SampleT>
+void NormalizeAudioWaveform(BasicWaveform<SampleT> &wav, float db_level);
+
+// Calculates the gain envelope that NormalizeAudioWaveform would
+// apply to an audio waveform, without modifying the waveform.  The
+// envelope can be applied later, for example while writing the
+// waveform to a WAV file.
+template <typename SampleT>
+void CalculateNormalizationGain(const BasicWaveform<SampleT> &wav, float db_level, GainEnvelope &envelope);
+
+// Calculates the normalization gain envelope from the table of
+// statistics for each frame of an audio waveform, so the waveform's
+// samples don't need to be examined again.
+void CalculateNormalizationGain(const AnalysisTable &table, float db_level, GainEnvelope &envelope);
+
+// Returns the true peak level of an audio waveform, which includes
+// the peaks that occur between samples when the waveform is played
+// back or resampled.  The true peak is estimated by oversampling
+// the waveform 4x as described by ITU-R BS.1770.  A specific part
+// of the waveform can be measured by using the 'start_sample' and
+// 'num_samples' parameters.  Returns a linear level (1.0=full scale).
+template <typename SampleT>
+float FindTruePeak(const BasicWaveform<SampleT> &wav, size_t start_sample = 0, size_t num_samples = 0);
+
+// Limits an audio waveform such that its true peak level doesn't
+// exceed the specified dB level (where 0dB=loudest).  This catches
+// the inter-sample peaks that can still clip after normalizing and
+// quantizing to 16-bit.  A look-ahead gain envelope smoothly lowers
+// the gain ahead of each peak and then lets it recover.  The
+// waveform data is modified in place.
+template <typename SampleT>
+void LimitTruePeakAudioWaveform(BasicWaveform<SampleT> &wav, float db_level);
 
@@ -4,7 +4,10 @@
 //
 // Simple test of the normalize.cpp module.  Given the name of a
 // WAV file, reads the waveform, normalizes it, then checks the
-// audio data to confirm that it was normalized.
+// audio data to confirm that it was normalized.  Also checks that
+// the true peak limiter keeps the inter-sample peaks under the
+// normalization level, and that applying the normalization gain
+// while writing gives the same result as normalizing in place.
 //
 //-------------------------------------------------------------------
 //
@@ -47,6 +50,7 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <math.h>
 #include <vector>
 
 // From an attenuation level between 0 dB (loudest) and -infinity
@@ -96,3 +100,101 @@ bool test_normalize(wchar_t *filename)
     return true;
 }
 
+
+bool test_true_peak_limit(wchar_t *filename)
+{
+    printf("Starting true peak limiter test with '%S'\n", filename);
+
+    // Read the WAV file.
+    Waveform wav;
+    if (!wav.LoadFromWAVFile(filename))
+    {
+        printf("WAVFileReadHeader failed reading '%S'\n", filename);
+        return false;
+    }
+
+    // Append a sine wave at 1/4 of the sample rate, whose samples
+    // fall halfway between the true peaks of the wave.  Its sample
+    // peak is about 3 dB lower than its true peak, so it will
+    // always have inter-sample overs after normalization.
+    const float phase_step = 3.14159265f / 2.0f;
+    const size_t tone_len = wav.m_frequency / 2;
+    for (size_t i = 0; i < tone_len; i++)
+        wav.m_data.push_back(0.5f * sinf(phase_step * i + phase_step / 2.0f));
+
+    // Normalize the waveform and limit its true peak level.
+    float db_level = -1.0f;
+    float linear_level = db_to_linear(db_level);
+    NormalizeAudioWaveform(wav, db_level);
+    if (FindTruePeak(wav) <= linear_level * 1.01f)
+    {
+        printf("Expected the test waveform to have inter-sample overs!\n");
+        return false;
+    }
+    LimitTruePeakAudioWaveform(wav, db_level);
+
+    // See if the true peak level is within the limit.
+    float true_peak = FindTruePeak(wav);
+    if (true_peak > linear_level * 1.01f)
+    {
+        printf("True peak level higher than expected after limiting!\n");
+        printf("  Target:  %.4f\n", linear_level);
+        printf("  Actual:  %.4f\n", true_peak);
+        return false;
+    }
+
+    return true;
+}
+
+bool test_gain_envelope(wchar_t *filename)
+{
+    printf("Starting gain envelope test with '%S'\n", filename);
+
+    // Read the WAV file.
+    Waveform wav;
+    if (!wav.LoadFromWAVFile(filename))
+    {
+        printf("WAVFileReadHeader failed reading '%S'\n", filename);
+        return false;
+    }
+
+    // Write the waveform with the normalization gain applied while
+    // writing.  This shouldn't modify the waveform.
+    Waveform original = wav;
+    GainEnvelope envelope;
+    CalculateNormalizationGain(wav, -1.0f, envelope);
+    if (!wav.WriteToWAVFile(L"temp.wav", 0, 0, &envelope))
+    {
+        printf("WriteToWAVFile failed writing 'temp.wav'\n");
+        return false;
+    }
+    if (wav.m_data != original.m_data)
+    {
+        printf("Waveform was modified while writing with a gain envelope!\n");
+        _wunlink(L"temp.wav");
+        return false;
+    }
+
+    // Read it back, then normalize the original in place and write
+    // it the old way.  The results should be the same.
+    Waveform fused;
+    bool loaded = fused.LoadFromWAVFile(L"temp.wav");
+    _wunlink(L"temp.wav");
+    NormalizeAudioWaveform(wav, -1.0f);
+    if (!loaded || !wav.WriteToWAVFile(L"temp.wav"))
+    {
+        printf("Failed writing or reading 'temp.wav'\n");
+        _wunlink(L"temp.wav");
+        return false;
+    }
+    Waveform separate;
+    loaded = separate.LoadFromWAVFile(L"temp.wav");
+    _wunlink(L"temp.wav");
+    if (!loaded || fused.m_data != separate.m_data)
+    {
+        printf("Audio written with a gain envelope doesn't match normalized audio!\n");
+        return false;
+    }
+
+    return true;
+}
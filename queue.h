@@ -0,0 +1,214 @@
+//-------------------------------------------------------------------
+//
+// queue.h
+//
+// Header of C++ module for a bounded lock-free queue, for passing
+// work from one stage of processing to the next when the stages
+// run on different threads.
+//
+//-------------------------------------------------------------------
+//
+// (C) Copyright 2024 Ammon R. Campbell.
+//
+// I wrote this code for use in my own educational and experimental
+// programs, but you may also freely use it in yours as long as you
+// abide by the following terms and conditions:
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following
+//     disclaimer in the documentation and/or other materials
+//     provided with the distribution.
+//   * The name(s) of the author(s) and contributors (if any) may not
+//     be used to endorse or promote products derived from this
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+// CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+// OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.  IN OTHER WORDS, USE AT YOUR OWN RISK, NOT OURS.  
+//--------------------------------------------------------------------
+
+#pragma once
+#include <stddef.h>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+
+// A first-in, first-out queue of items of type T that holds up to
+// a fixed number of items, and can be used by any number of
+// threads at once without locks.  Each slot in the queue has a
+// sequence number that says whether it's ready to be filled or
+// emptied, so a thread only has to claim a position with an atomic
+// compare-and-swap.
+//
+// Push waits while the queue is full, so a stage that gets ahead of
+// the next one stops until there's room, and the number of items
+// in flight (and the memory they use) never grows past the
+// capacity.  Pop waits while it's empty.  A thread that has to wait
+// blocks on a condition variable, which is only locked when some
+// thread is waiting, so while items keep flowing no lock is taken.
+template <typename T>
+class BoundedQueue
+{
+public:
+    // Makes a queue that can hold up to 'capacity' items (at least
+    // 2).
+    explicit BoundedQueue(size_t capacity) :
+        m_capacity(capacity < 2 ? 2 : capacity),
+        m_cells(new Cell[m_capacity])
+    {
+        for (size_t icell = 0; icell < m_capacity; icell++)
+            m_cells[icell].m_sequence.store(icell, std::memory_order_relaxed);
+    }
+
+    BoundedQueue(const BoundedQueue &) = delete;
+    BoundedQueue &operator=(const BoundedQueue &) = delete;
+
+    // Adds an item to the back of the queue, moving it out of
+    // 'item', unless the queue is full.
+    // Returns false if the queue was full.
+    bool TryPush(T &item)
+    {
+        size_t position = m_push_position.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            Cell &cell = m_cells[position % m_capacity];
+            size_t sequence = cell.m_sequence.load(std::memory_order_acquire);
+            if (sequence == position)
+            {
+                // The slot is empty; try to claim it.
+                if (m_push_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                {
+                    cell.m_item = std::move(item);
+                    cell.m_sequence.store(position + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (sequence < position)
+            {
+                // The slot still holds the item from one lap ago.
+                return false;
+            }
+            else
+            {
+                // Another thread pushed here first; try again.
+                position = m_push_position.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Removes the item at the front of the queue into 'item',
+    // unless the queue is empty.
+    // Returns false if the queue was empty.
+    bool TryPop(T &item)
+    {
+        size_t position = m_pop_position.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            Cell &cell = m_cells[position % m_capacity];
+            size_t sequence = cell.m_sequence.load(std::memory_order_acquire);
+            if (sequence == position + 1)
+            {
+                // The slot is full; try to claim it.
+                if (m_pop_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                {
+                    item = std::move(cell.m_item);
+                    cell.m_sequence.store(position + m_capacity, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (sequence < position + 1)
+            {
+                // Nothing has been pushed here yet.
+                return false;
+            }
+            else
+            {
+                // Another thread popped here first; try again.
+                position = m_pop_position.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Adds an item to the back of the queue, waiting until there's
+    // room for it.
+    void Push(T item)
+    {
+        if (!TryPush(item))
+            wait([this, &item]() { return TryPush(item); });
+        wake();
+    }
+
+    // Removes the item at the front of the queue, waiting until
+    // there is one.
+    T Pop()
+    {
+        T item;
+        if (!TryPop(item))
+            wait([this, &item]() { return TryPop(item); });
+        wake();
+        return item;
+    }
+
+private:
+    // Blocks until 'done' returns true, trying it again each time
+    // another thread pushes or pops an item.
+    template <typename Func>
+    void wait(Func done)
+    {
+        std::unique_lock<std::mutex> lock(m_wait_mutex);
+        m_waiting++;
+        // Pairs with the fence in wake, so either this sees the
+        // other thread's item (or room), or that thread sees this
+        // one waiting.
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        m_changed.wait(lock, done);
+        m_waiting--;
+    }
+
+    // Wakes up any threads that are waiting, after an item has been
+    // pushed or popped.
+    void wake()
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!m_waiting.load(std::memory_order_relaxed))
+            return;
+
+        // Locking the mutex makes sure a thread that's about to wait
+        // either sees the change or gets the notification.
+        {
+            std::lock_guard<std::mutex> lock(m_wait_mutex);
+        }
+        m_changed.notify_all();
+    }
+
+    // One slot in the queue.
+    struct Cell
+    {
+        std::atomic<size_t> m_sequence;     // Position this slot is ready for.
+        T m_item;                           // The item, while the slot is full.
+    };
+
+    const size_t m_capacity;                // Maximum number of items.
+    std::unique_ptr<Cell[]> m_cells;        // The slots, used in a ring.
+    std::atomic<size_t> m_push_position{0}; // Position of the next item pushed.
+    std::atomic<size_t> m_pop_position{0};  // Position of the next item popped.
+    std::atomic<unsigned> m_waiting{0};     // Number of threads waiting in Push or Pop.
+    std::mutex m_wait_mutex;                // Goes with m_changed.
+    std::condition_variable m_changed;      // Signalled when an item is pushed or popped.
+};
@@ -0,0 +1,134 @@
+//-------------------------------------------------------------------
+//
+// queue_test.cpp
+//
+// Simple test of the BoundedQueue class in queue.h.  Checks that a
+// full queue refuses more items and an empty one gives none, then
+// passes numbered items through a small queue from several threads
+// to several others, and confirms that every item came out exactly
+// once.
+//
+//-------------------------------------------------------------------
+//
+// (C) Copyright 2024 Ammon R. Campbell.
+//
+// I wrote this code for use in my own educational and experimental
+// programs, but you may also freely use it in yours as long as you
+// abide by the following terms and conditions:
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following
+//     disclaimer in the documentation and/or other materials
+//     provided with the distribution.
+//   * The name(s) of the author(s) and contributors (if any) may not
+//     be used to endorse or promote products derived from this
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+// CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+// OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.  IN OTHER WORDS, USE AT YOUR OWN RISK, NOT OURS.  
+//--------------------------------------------------------------------
+
+#include "queue.h"
+#include <stdio.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+// Number of threads putting items in the queue, and taking them out.
+static const unsigned k_producers = 4;
+static const unsigned k_consumers = 3;
+
+// Number of items each producer puts in the queue.
+static const size_t k_items_per_producer = 20000;
+
+bool test_queue()
+{
+    printf("Starting queue test\n");
+
+    // One thread: items come out in order, and the capacity holds.
+    BoundedQueue<int> fifo(4);
+    for (int item = 0; item < 4; item++)
+    {
+        if (!fifo.TryPush(item))
+        {
+            printf("Queue refused item %d before it was full!\n", item);
+            return false;
+        }
+    }
+    int extra = 4;
+    if (fifo.TryPush(extra))
+    {
+        printf("Queue took an item when it was full!\n");
+        return false;
+    }
+    for (int expected = 0; expected < 4; expected++)
+    {
+        int item = -1;
+        if (!fifo.TryPop(item) || item != expected)
+        {
+            printf("Queue gave item %d instead of %d!\n", item, expected);
+            return false;
+        }
+    }
+    int item = -1;
+    if (fifo.TryPop(item))
+    {
+        printf("Queue gave an item when it was empty!\n");
+        return false;
+    }
+
+    // Several threads at once, through a queue that's often full.
+    const size_t total = k_producers * k_items_per_producer;
+    BoundedQueue<size_t> queue(8);
+    std::vector<std::atomic<unsigned>> seen(total);
+    for (auto &count : seen)
+        count = 0;
+
+    std::vector<std::thread> threads;
+    for (unsigned iproducer = 0; iproducer < k_producers; iproducer++)
+    {
+        threads.emplace_back([&queue, iproducer]()
+        {
+            for (size_t iitem = 0; iitem < k_items_per_producer; iitem++)
+                queue.Push(iproducer * k_items_per_producer + iitem);
+        });
+    }
+    std::atomic<size_t> popped(0);
+    for (unsigned iconsumer = 0; iconsumer < k_consumers; iconsumer++)
+    {
+        threads.emplace_back([&queue, &seen, &popped, total]()
+        {
+            while (popped++ < total)
+                seen[queue.Pop()]++;
+        });
+    }
+    for (std::thread &thread : threads)
+        thread.join();
+
+    for (size_t iitem = 0; iitem < total; iitem++)
+    {
+        if (seen[iitem] != 1)
+        {
+            printf("Item %zu came out of the queue %u times!\n", iitem, seen[iitem].load());
+            return false;
+        }
+    }
+
+    return true;
+}
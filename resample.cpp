@@ -0,0 +1,308 @@
+//-------------------------------------------------------------------
+//
+// resample.cpp
+//
+// C++ module for changing the sample rate of an audio waveform,
+// using a band-limited polyphase filter.
+//
+//-------------------------------------------------------------------
+//
+// (C) Copyright 2024 Ammon R. Campbell.
+//
+// I wrote this code for use in my own educational and experimental
+// programs, but you may also freely use it in yours as long as you
+// abide by the following terms and conditions:
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following
+//     disclaimer in the documentation and/or other materials
+//     provided with the distribution.
+//   * The name(s) of the author(s) and contributors (if any) may not
+//     be used to endorse or promote products derived from this
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+// CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+// OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.  IN OTHER WORDS, USE AT YOUR OWN RISK, NOT OURS.  
+//--------------------------------------------------------------------
+
+#include "resample.h"
+#include <math.h>
+#include <map>
+#include <mutex>
+#include <utility>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define USE_SSE2
+#endif
+
+// Number of input samples on each side of an output sample that
+// the filter looks at, when the output rate is at least as high as
+// the input rate.  When the output rate is lower, the filter is
+// stretched out to cover proportionally more input samples.
+static const unsigned k_half_taps = 24;
+
+// Where the filter's cutoff frequency is placed, as a fraction of
+// the lower of the two Nyquist frequencies.  This leaves room for
+// the filter to roll off before the Nyquist frequency.
+static const double k_cutoff = 0.9;
+
+// Shape of the filter's Kaiser window.  Higher values give more
+// attenuation above the cutoff but a wider roll-off.
+static const double k_kaiser_beta = 8.0;
+
+// The filter taps for one rate ratio.  The taps for each phase are
+// stored together, in reverse order so they line up with the input
+// samples in the order the samples are stored.  The number of taps
+// per phase is padded with zeros to a multiple of 8 so the dot
+// product doesn't need to deal with leftover taps.
+struct Resampler::FilterBank
+{
+    unsigned m_up = 1;              // Upsampling factor (L).
+    unsigned m_down = 1;            // Downsampling factor (M).
+    unsigned m_taps = 0;            // Taps per phase (padded).
+    size_t m_center = 0;            // Center of the filter, in upsampled samples.
+    std::vector<float> m_coefs;     // m_up phases of m_taps taps each.
+};
+
+// Returns the greatest common divisor of two numbers.
+static unsigned gcd(unsigned a, unsigned b)
+{
+    while (b)
+    {
+        unsigned t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+// The zeroth order modified Bessel function of the first kind,
+// which is used to calculate the Kaiser window.
+static double bessel_i0(double x)
+{
+    double sum = 1.0, term = 1.0;
+    for (int k = 1; k < 50 && term > sum * 1e-12; k++)
+    {
+        term *= (x / (2 * k)) * (x / (2 * k));
+        sum += term;
+    }
+    return sum;
+}
+
+// Calculates the filter taps for upsampling by 'up' and then
+// downsampling by 'down'.
+static std::shared_ptr<const Resampler::FilterBank> design_filter_bank(unsigned up, unsigned down)
+{
+    auto bank = std::make_shared<Resampler::FilterBank>();
+    bank->m_up = up;
+    bank->m_down = down;
+
+    // The filter runs at the upsampled rate, and has to cut off at
+    // the lower of the two Nyquist frequencies.
+    const unsigned ratio = (up > down) ? up : down;
+    unsigned taps = (2 * k_half_taps * ratio + up - 1) / up;
+    const size_t length = static_cast<size_t>(taps) * up;
+    const double center = length / 2.0;
+    const double cutoff = k_cutoff * 0.5 / ratio;
+    const double pi = 3.14159265358979323846;
+
+    std::vector<double> h(length);
+    for (size_t j = 0; j < length; j++)
+    {
+        double x = j - center;
+        double sinc = (x == 0.0) ? 1.0 : sin(2 * pi * cutoff * x) / (2 * pi * cutoff * x);
+        double r = x / center;
+        double window = (r * r < 1.0) ? bessel_i0(k_kaiser_beta * sqrt(1.0 - r * r)) / bessel_i0(k_kaiser_beta) : 0.0;
+        h[j] = sinc * window;
+    }
+
+    // Rearrange the taps into phases, scaling each phase so it has a
+    // gain of exactly 1 at 0 Hz.
+    bank->m_taps = (taps + 7) & ~7u;
+    bank->m_center = length / 2;
+    bank->m_coefs.assign(static_cast<size_t>(up) * bank->m_taps, 0.0f);
+    for (unsigned phase = 0; phase < up; phase++)
+    {
+        double sum = 0.0;
+        for (unsigned k = 0; k < taps; k++)
+            sum += h[phase + static_cast<size_t>(k) * up];
+
+        float *coefs = &bank->m_coefs[static_cast<size_t>(phase) * bank->m_taps];
+        for (unsigned k = 0; k < taps; k++)
+            coefs[bank->m_taps - 1 - k] = static_cast<float>(h[phase + static_cast<size_t>(k) * up] / sum);
+    }
+
+    return bank;
+}
+
+// Returns the filter taps for converting between two sample rates.
+// The taps for each ratio are only calculated the first time
+// they're needed.
+static std::shared_ptr<const Resampler::FilterBank> get_filter_bank(unsigned in_frequency, unsigned out_frequency)
+{
+    if (!in_frequency || !out_frequency)
+        in_frequency = out_frequency = 1;
+
+    unsigned divisor = gcd(in_frequency, out_frequency);
+    unsigned up = out_frequency / divisor;
+    unsigned down = in_frequency / divisor;
+
+    static std::mutex mutex;
+    static std::map<std::pair<unsigned, unsigned>, std::shared_ptr<const Resampler::FilterBank>> banks;
+    std::lock_guard<std::mutex> lock(mutex);
+    auto &bank = banks[std::make_pair(up, down)];
+    if (!bank)
+        bank = design_filter_bank(up, down);
+    return bank;
+}
+
+// Returns the sum of the products of two arrays of floats.  The
+// count must be a multiple of 8.
+static float dot_product(const float *a, const float *b, size_t count)
+{
+#if defined(USE_SSE2)
+    __m128 acc0 = _mm_setzero_ps();
+    __m128 acc1 = _mm_setzero_ps();
+    for (size_t i = 0; i < count; i += 8)
+    {
+        acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+        acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+    }
+    __m128 sum4 = _mm_add_ps(acc0, acc1);
+    sum4 = _mm_add_ps(sum4, _mm_shuffle_ps(sum4, sum4, _MM_SHUFFLE(2, 3, 0, 1)));
+    sum4 = _mm_add_ps(sum4, _mm_shuffle_ps(sum4, sum4, _MM_SHUFFLE(1, 0, 3, 2)));
+    return _mm_cvtss_f32(sum4);
+#else
+    float sum = 0.0f;
+    for (size_t i = 0; i < count; i++)
+        sum += a[i] * b[i];
+    return sum;
+#endif
+}
+
+Resampler::Resampler(unsigned in_frequency, unsigned out_frequency)
+{
+    m_bank = get_filter_bank(in_frequency, out_frequency);
+    Reset();
+}
+
+void Resampler::Reset()
+{
+    // The history starts out with a filter's worth of zeros before
+    // the first input sample.  Input sample N is stored at position
+    // N + m_taps.
+    m_history.assign(m_bank->m_taps, 0.0f);
+    m_history_start = 0;
+    m_in_count = 0;
+    m_out_count = 0;
+}
+
+void Resampler::make_output(std::vector<float> &out, size_t max_count)
+{
+    const FilterBank &bank = *m_bank;
+    const size_t available = m_history_start + m_history.size();
+
+    while (m_out_count < max_count)
+    {
+        // Find the newest input sample and the filter phase for the
+        // next output sample, and see if we have that sample yet.
+        const size_t t = m_out_count * bank.m_down + bank.m_center;
+        const size_t newest = t / bank.m_up + bank.m_taps;
+        if (newest >= available)
+            break;
+
+        const float *coefs = &bank.m_coefs[(t % bank.m_up) * bank.m_taps];
+        const float *x = &m_history[newest + 1 - bank.m_taps - m_history_start];
+        out.push_back(dot_product(coefs, x, bank.m_taps));
+        m_out_count++;
+    }
+
+    // Drop the input samples that won't be needed again, once there
+    // are enough of them to be worth moving the rest.
+    const size_t t = m_out_count * bank.m_down + bank.m_center;
+    const size_t oldest = t / bank.m_up + 1;
+    if (oldest > m_history_start + 4096)
+    {
+        const size_t drop = oldest - m_history_start;
+        m_history.erase(m_history.begin(), m_history.begin() + (drop < m_history.size() ? drop : m_history.size()));
+        m_history_start += drop;
+    }
+}
+
+void Resampler::Process(const float *samples, size_t num_samples, std::vector<float> &out)
+{
+    m_history.insert(m_history.end(), samples, samples + num_samples);
+    m_in_count += num_samples;
+    make_output(out, SIZE_MAX);
+}
+
+void Resampler::Flush(std::vector<float> &out)
+{
+    const FilterBank &bank = *m_bank;
+    const size_t total = (m_in_count * bank.m_up + bank.m_down - 1) / bank.m_down;
+    if (m_out_count >= total)
+        return;
+
+    // Pretend the input continues with silence for long enough to
+    // make the last output sample.
+    const size_t t = (total - 1) * bank.m_down + bank.m_center;
+    const size_t needed = t / bank.m_up + bank.m_taps + 1;
+    const size_t available = m_history_start + m_history.size();
+    if (needed > available)
+        m_history.resize(m_history.size() + (needed - available), 0.0f);
+
+    make_output(out, total);
+}
+
+// Changes the sample rate of an audio waveform to 'frequency'.  The
+// waveform data is replaced with the resampled data.
+template <typename SampleT>
+void ResampleAudioWaveform(BasicWaveform<SampleT> &wav, unsigned frequency)
+{
+    if (!frequency || frequency == wav.m_frequency)
+        return;
+
+    Resampler resampler(wav.m_frequency, frequency);
+    std::vector<float> out, buffer;
+    out.reserve(static_cast<size_t>(static_cast<double>(wav.m_data.size()) * frequency / wav.m_frequency) + 1);
+
+    // Feed the samples to the resampler a block at a time, so that
+    // samples that aren't floating-point only need to be converted
+    // one block at a time.
+    const size_t block_size = 4096;
+    for (size_t first = 0; first < wav.m_data.size(); first += block_size)
+    {
+        size_t count = wav.m_data.size() - first;
+        if (count > block_size)
+            count = block_size;
+        resampler.Process(SamplesAsFloat(&wav.m_data[first], count, buffer), count, out);
+    }
+    resampler.Flush(out);
+
+    wav.m_frequency = frequency;
+    wav.m_data.resize(out.size());
+    for (size_t isample = 0; isample < out.size(); isample++)
+        SampleFromFloat(out[isample], wav.m_data[isample]);
+}
+
+// The sample types that waveforms can be stored as.
+template void ResampleAudioWaveform(Waveform &wav, unsigned frequency);
+template void ResampleAudioWaveform(Waveform16 &wav, unsigned frequency);
+template void ResampleAudioWaveform(WaveformHalf &wav, unsigned frequency);
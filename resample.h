@@ -0,0 +1,99 @@
+//-------------------------------------------------------------------
+//
+// resample.h
+//
+// Header of C++ module for changing the sample rate of an audio
+// waveform, using a band-limited polyphase filter.
+//
+//-------------------------------------------------------------------
+//
+// (C) Copyright 2024 Ammon R. Campbell.
+//
+// I wrote this code for use in my own educational and experimental
+// programs, but you may also freely use it in yours as long as you
+// abide by the following terms and conditions:
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following
+//     disclaimer in the documentation and/or other materials
+//     provided with the distribution.
+//   * The name(s) of the author(s) and contributors (if any) may not
+//     be used to endorse or promote products derived from this
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+// CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+// OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.  IN OTHER WORDS, USE AT YOUR OWN RISK, NOT OURS.  
+//--------------------------------------------------------------------
+
+#pragma once
+#include "waveform.h"
+#include <memory>
+#include <vector>
+
+// Converts a stream of audio samples from one sample rate to
+// another.  The samples can be given in blocks of any size, and the
+// output is the same as if they had all been given at once.
+//
+// The rates are reduced to a ratio of small integers L/M.  The
+// input is (in effect) upsampled by L, low-pass filtered to remove
+// anything above the lower of the two Nyquist frequencies, and then
+// downsampled by M.  Only the filter taps that land on real input
+// samples are used, so each output sample is one short dot product
+// with one of L sets ('phases') of filter taps.  The filter taps for
+// each ratio are calculated once and shared.
+//
+// The output is lined up with the input, so that output sample N
+// is at the same time as input sample N * in_rate / out_rate.
+class Resampler
+{
+public:
+    Resampler(unsigned in_frequency, unsigned out_frequency);
+    ~Resampler() = default;
+
+    // Starts over with a new stream of samples.
+    void Reset();
+
+    // Resamples a block of samples, appending any output samples
+    // that are ready to the 'out' vector.
+    void Process(const float *samples, size_t num_samples, std::vector<float> &out);
+
+    // Finishes the stream, appending the rest of the output samples
+    // to the 'out' vector.  The total number of output samples is
+    // the number of input samples times out_rate / in_rate (rounded
+    // up).  Call Reset before resampling another stream.
+    void Flush(std::vector<float> &out);
+
+    struct FilterBank;
+
+private:
+    // Makes any output samples that can be made from the samples in
+    // the history buffer, up to 'max_count' samples.
+    void make_output(std::vector<float> &out, size_t max_count);
+
+    std::shared_ptr<const FilterBank> m_bank;
+    std::vector<float> m_history;   // Recent input samples.
+    size_t m_history_start = 0;     // Input sample number of m_history[0].
+    size_t m_in_count = 0;          // Number of input samples so far.
+    size_t m_out_count = 0;         // Number of output samples so far.
+};
+
+// Changes the sample rate of an audio waveform to 'frequency'.  The
+// waveform data is replaced with the resampled data.
+template <typename SampleT>
+void ResampleAudioWaveform(BasicWaveform<SampleT> &wav, unsigned frequency);
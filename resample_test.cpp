@@ -0,0 +1,177 @@
+//-------------------------------------------------------------------
+//
+// resample_test.cpp
+//
+// Simple test of the resample.cpp module.  Generates sine wave
+// tones, resamples them between several common sample rates, and
+// confirms that tones below the new Nyquist frequency come through
+// unchanged while tones above it are removed.  Also checks that
+// resampling a stream in blocks gives the same samples as
+// resampling it all at once.
+//
+//-------------------------------------------------------------------
+//
+// (C) Copyright 2024 Ammon R. Campbell.
+//
+// I wrote this code for use in my own educational and experimental
+// programs, but you may also freely use it in yours as long as you
+// abide by the following terms and conditions:
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following
+//     disclaimer in the documentation and/or other materials
+//     provided with the distribution.
+//   * The name(s) of the author(s) and contributors (if any) may not
+//     be used to endorse or promote products derived from this
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+// CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+// OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.  IN OTHER WORDS, USE AT YOUR OWN RISK, NOT OURS.  
+//--------------------------------------------------------------------
+
+#include "waveform.h"
+#include "resample.h"
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <math.h>
+#include <vector>
+
+static const double k_pi = 3.14159265358979323846;
+
+// Makes a waveform with a sine wave tone of the given frequency.
+static Waveform make_tone(unsigned rate, float tone_frequency, float seconds)
+{
+    Waveform wav;
+    wav.m_frequency = rate;
+    wav.m_data.resize(static_cast<size_t>(rate * seconds));
+    for (size_t isample = 0; isample < wav.m_data.size(); isample++)
+        wav.m_data[isample] = static_cast<float>(0.5 * sin(2 * k_pi * tone_frequency * isample / rate));
+    return wav;
+}
+
+// Resamples a tone and checks that the result is the same tone at
+// the new rate.  The first and last 10 milliseconds are skipped,
+// since the tone starts and stops abruptly there.
+static bool check_tone(unsigned in_rate, unsigned out_rate, float tone_frequency)
+{
+    Waveform wav = make_tone(in_rate, tone_frequency, 2.0f);
+    const size_t expected_size = (wav.m_data.size() * out_rate + in_rate - 1) / in_rate;
+    ResampleAudioWaveform(wav, out_rate);
+    if (wav.m_frequency != out_rate || wav.m_data.size() != expected_size)
+    {
+        printf("Resampling %u Hz to %u Hz gave the wrong number of samples!\n", in_rate, out_rate);
+        return false;
+    }
+
+    const size_t skip = out_rate / 100;
+    for (size_t isample = skip; isample + skip < wav.m_data.size(); isample++)
+    {
+        double expected = 0.5 * sin(2 * k_pi * tone_frequency * isample / out_rate);
+        if (fabs(wav.m_data[isample] - expected) > 0.002)
+        {
+            printf("Resampling %.0f Hz tone from %u Hz to %u Hz doesn't match at sample %zu!\n",
+                tone_frequency, in_rate, out_rate, isample);
+            printf("  Expected:  %f\n", expected);
+            printf("  Actual:    %f\n", wav.m_data[isample]);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Resamples a tone that is above the new Nyquist frequency, and
+// checks that it's removed.
+static bool check_alias(unsigned in_rate, unsigned out_rate, float tone_frequency)
+{
+    Waveform wav = make_tone(in_rate, tone_frequency, 2.0f);
+    ResampleAudioWaveform(wav, out_rate);
+
+    const size_t skip = out_rate / 100;
+    for (size_t isample = skip; isample + skip < wav.m_data.size(); isample++)
+    {
+        if (fabsf(wav.m_data[isample]) > 0.0005f)
+        {
+            printf("Resampling %.0f Hz tone from %u Hz to %u Hz wasn't filtered out at sample %zu!\n",
+                tone_frequency, in_rate, out_rate, isample);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Resamples noise in blocks of assorted sizes, and checks that the
+// result is the same as resampling it all at once.
+static bool check_blocks(unsigned in_rate, unsigned out_rate)
+{
+    std::vector<float> noise(in_rate);
+    for (float &sample : noise)
+        sample = (rand() % 20001 - 10000) / 10000.0f;
+
+    std::vector<float> whole;
+    Resampler resampler(in_rate, out_rate);
+    resampler.Process(noise.data(), noise.size(), whole);
+    resampler.Flush(whole);
+
+    std::vector<float> blocks;
+    resampler.Reset();
+    for (size_t first = 0; first < noise.size(); )
+    {
+        size_t count = 1 + rand() % 3000;
+        if (count > noise.size() - first)
+            count = noise.size() - first;
+        resampler.Process(&noise[first], count, blocks);
+        first += count;
+    }
+    resampler.Flush(blocks);
+
+    if (whole != blocks)
+    {
+        printf("Resampling %u Hz to %u Hz in blocks doesn't match!\n", in_rate, out_rate);
+        return false;
+    }
+
+    return true;
+}
+
+bool test_resample()
+{
+    printf("Starting resampling test\n");
+
+    if (!check_tone(48000, 16000, 1000.0f) ||
+        !check_tone(44100, 16000, 1000.0f) ||
+        !check_tone(44100, 16000, 6000.0f) ||
+        !check_tone(16000, 48000, 1000.0f) ||
+        !check_tone(22050, 44100, 3000.0f))
+        return false;
+
+    if (!check_alias(48000, 16000, 12000.0f) ||
+        !check_alias(44100, 16000, 10000.0f))
+        return false;
+
+    if (!check_blocks(48000, 16000) ||
+        !check_blocks(44100, 16000) ||
+        !check_blocks(16000, 44100))
+        return false;
+
+    printf("Resampling test OK.\n");
+    return true;
+}
@@ -42,31 +42,48 @@
 //--------------------------------------------------------------------
 
 #include "segment.h"
+#include "analysis.h"
+#include "loudness.h"
 #include <math.h>
 
-// Returns the standard deviation of an array of data values.
-static float standard_deviation(const float *data, size_t count)
+// Returns the standard deviation of the data values that were
+// summed up in the given frame statistics.
+static float standard_deviation(const FrameStats &stats, size_t count)
 {
     if (count < 1)
         return 0.0f;
 
-    float sum = 0.0f;
-    for (size_t i = 0; i < count; i++)
-        sum += data[i];
+    double mean = stats.m_sum / count;
+    double v = stats.m_sum_squares / count - mean * mean;
+    if (v < 0.0)
+        v = 0.0;
 
-    float mean = sum / count;
-    float v = 0;
-    for (size_t i = 0; i < count; i++)
-        v += powf(data[i] - mean, 2);
-
-    return sqrtf(v / count);
+    return static_cast<float>(sqrt(v));
 }
 
 // Determines where the segments are in the given waveform by
 // detecting where the waveform is silent (or near silent).
 // A list of the non-silent segments is returned.  An empty
 // list is returned if the entire waveform is silent.
-std::vector<Segment> FindSegmentsInAudioWaveform(const Waveform &wav)
+//
+// If a loudness meter is given, the waveform is also fed through
+// it while it is being examined, and the integrated loudness of
+// each segment is stored in the segment list.
+template <typename SampleT>
+std::vector<Segment> FindSegmentsInAudioWaveform(const BasicWaveform<SampleT> &wav, LoudnessMeter *meter)
+{
+    AnalysisTable table;
+    AnalyzeAudioWaveform(wav, table, meter);
+    return FindSegmentsInAudioWaveform(table, meter);
+}
+
+template std::vector<Segment> FindSegmentsInAudioWaveform(const Waveform &wav, LoudnessMeter *meter);
+template std::vector<Segment> FindSegmentsInAudioWaveform(const Waveform16 &wav, LoudnessMeter *meter);
+template std::vector<Segment> FindSegmentsInAudioWaveform(const WaveformHalf &wav, LoudnessMeter *meter);
+
+// Determines where the segments are in an audio waveform from the
+// table of statistics for each of its frames.
+std::vector<Segment> FindSegmentsInAudioWaveform(const AnalysisTable &table, const LoudnessMeter *meter)
 {
     //
     // Algorithm:
@@ -85,20 +102,23 @@ std::vector<Segment> FindSegmentsInAudioWaveform(const Waveform &wav)
     // beginning of the next segment; and so on.
     //
 
-    const unsigned samples_per_chunk = static_cast<unsigned>(wav.m_frequency * 0.05);
-    const unsigned num_chunks = static_cast<unsigned>(wav.m_data.size() / samples_per_chunk);
+    // Each chunk is made of several of the analysis table's frames,
+    // for about 50 milliseconds per chunk.
+    const unsigned frames_per_chunk = 5;
+    const unsigned samples_per_chunk = table.m_samples_per_frame * frames_per_chunk;
+    const unsigned num_chunks = static_cast<unsigned>(table.m_frames.size() / frames_per_chunk);
 
     // Calculate the standard deviation for each chunk in the waveform.
     std::vector<float> stddev_per_chunk(num_chunks);
     for (unsigned ichunk = 0; ichunk < num_chunks; ichunk++)
     {
-        unsigned isample = static_cast<unsigned>(ichunk * samples_per_chunk);
-        stddev_per_chunk[ichunk] = standard_deviation(&wav.m_data[isample], samples_per_chunk);
+        FrameStats stats = table.CombineFrames(ichunk * frames_per_chunk, frames_per_chunk);
+        stddev_per_chunk[ichunk] = standard_deviation(stats, samples_per_chunk);
     }
 
     // Calculate the threshold we'll use to separate "loud" from "quiet".
     float sample_min = 0.0f, sample_max = 0.0f;
-    wav.FindMinMaxSamples(sample_min, sample_max);
+    table.FindMinMaxSamples(sample_min, sample_max);
     float sample_peak = (sample_max - sample_min) / 2.0f;
     float stddev_threshold = sample_peak * 0.05f;
 
@@ -145,6 +165,13 @@ std::vector<Segment> FindSegmentsInAudioWaveform(const Waveform &wav)
         }
     }
 
+    // Measure the loudness of each segment.
+    if (meter)
+    {
+        for (Segment &seg : list)
+            seg.m_loudness = meter->IntegratedLoudness(seg.m_start, seg.m_count);
+    }
+
     return list;
 }
 
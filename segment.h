@@ -44,16 +44,34 @@
 #pragma once
 #include "waveform.h"
 
+class LoudnessMeter;
+struct AnalysisTable;
+
 // Container to describe one segment within an audio waveform.
 struct Segment
 {
-    size_t m_start = 0;  // Which sample does this segment start on.
-    size_t m_count = 0;  // How many samples does this segment run for.
+    size_t m_start = 0;     // Which sample does this segment start on.
+    size_t m_count = 0;     // How many samples does this segment run for.
+    float m_loudness = 0;   // Integrated loudness in LUFS (if measured).
+    unsigned m_channel = 0; // Which channel it came from (1=first; 0=all channels mixed).
 };
 
 // Determines where the segments are in the given waveform by
 // detecting where the waveform is silent (or near silent).
 // A list of the non-silent segments is returned.  An empty
 // list is returned if the entire waveform is silent.
-std::vector<Segment> FindSegmentsInAudioWaveform(const Waveform &wav);
+//
+// If a loudness meter is given, the waveform is also fed through
+// it while it is being examined, and the integrated loudness of
+// each segment is stored in the segment list.
+template <typename SampleT>
+std::vector<Segment> FindSegmentsInAudioWaveform(const BasicWaveform<SampleT> &wav, LoudnessMeter *meter = nullptr);
+
+// Determines where the segments are in an audio waveform from the
+// table of statistics for each of its frames, so the waveform's
+// samples don't need to be examined again.  If a loudness meter is
+// given, it must have already been fed the whole waveform (see
+// AnalyzeAudioWaveform), and the integrated loudness of each
+// segment is stored in the segment list.
+std::vector<Segment> FindSegmentsInAudioWaveform(const AnalysisTable &table, const LoudnessMeter *meter = nullptr);
 
@@ -6,6 +6,10 @@
 // containing several 'beep' tones, then runs the waveform through
 // the segmentation function and comfirms the number of segments
 // found matches the number of test tones that were generated.
+// Also checks that segmenting 16-bit audio directly from its integer
+// samples finds the same segments as segmenting it as floating-point,
+// and that waveforms stored as 16-bit samples are segmented the same
+// as waveforms stored as floating-point.
 //
 //-------------------------------------------------------------------
 //
@@ -45,9 +49,11 @@
 
 #include "waveform.h"
 #include "segment.h"
+#include "analysis.h"
 #include <stdlib.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <math.h>
 #include <vector>
 
 bool test_segmentation()
@@ -96,3 +102,107 @@ bool test_segmentation()
     return true;
 }
 
+
+bool test_segmentation_pcm16(wchar_t *filename)
+{
+    printf("Starting 16-bit segmentation test with '%S'\n", filename);
+
+    // Segment the file as floating-point.
+    Waveform wav;
+    AnalysisTable float_table;
+    if (!wav.LoadFromWAVFile(filename, &float_table))
+    {
+        printf("LoadFromWAVFile failed reading '%S'\n", filename);
+        return false;
+    }
+    auto float_segments = FindSegmentsInAudioWaveform(float_table);
+
+    // Segment the file from its integer samples.  This only works on
+    // 16-bit mono audio, but for other formats it should still get
+    // the same results the usual way.
+    WAVInfo header;
+    AnalysisTable int_table;
+    if (!AnalyzeWAVFile(filename, int_table, header))
+    {
+        printf("AnalyzeWAVFile failed reading '%S'\n", filename);
+        return false;
+    }
+    auto int_segments = FindSegmentsInAudioWaveform(int_table);
+
+    if (float_segments.size() != int_segments.size())
+    {
+        printf("Expected %zu segments, found %zu!\n", float_segments.size(), int_segments.size());
+        return false;
+    }
+    for (size_t iseg = 0; iseg < float_segments.size(); iseg++)
+    {
+        if (float_segments[iseg].m_start != int_segments[iseg].m_start ||
+            float_segments[iseg].m_count != int_segments[iseg].m_count)
+        {
+            printf("Segment %zu doesn't match!\n", iseg + 1);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Loads a WAV file into a waveform with the given type of samples,
+// checks that the samples are within 'tolerance' of the floating-
+// point samples (relative to each sample's size), and checks that
+// the same segments are found in it.
+template <typename SampleT>
+static bool check_storage(const wchar_t *filename, const char *name, const Waveform &original,
+    const std::vector<Segment> &original_segments, float tolerance)
+{
+    BasicWaveform<SampleT> wav;
+    if (!wav.LoadFromWAVFile(filename))
+    {
+        printf("LoadFromWAVFile failed reading '%S' as %s\n", filename, name);
+        return false;
+    }
+    if (wav.m_frequency != original.m_frequency || wav.m_data.size() != original.m_data.size())
+    {
+        printf("Waveform stored as %s has the wrong size!\n", name);
+        return false;
+    }
+
+    for (size_t isample = 0; isample < wav.m_data.size(); isample++)
+    {
+        float expected = original.m_data[isample];
+        float actual = SampleToFloat(wav.m_data[isample]);
+        if (fabsf(actual - expected) > tolerance * fabsf(expected) + 1.0f / 32768)
+        {
+            printf("Sample %zu stored as %s doesn't match!\n", isample, name);
+            printf("  Expected:  %f\n", expected);
+            printf("  Stored:    %f\n", actual);
+            return false;
+        }
+    }
+
+    auto segments = FindSegmentsInAudioWaveform(wav);
+    if (segments.size() != original_segments.size())
+    {
+        printf("Expected %zu segments stored as %s, found %zu!\n", original_segments.size(), name, segments.size());
+        return false;
+    }
+
+    return true;
+}
+
+bool test_segmentation_storage(wchar_t *filename)
+{
+    printf("Starting sample storage test with '%S'\n", filename);
+
+    Waveform wav;
+    if (!wav.LoadFromWAVFile(filename))
+    {
+        printf("LoadFromWAVFile failed reading '%S'\n", filename);
+        return false;
+    }
+    auto segments = FindSegmentsInAudioWaveform(wav);
+
+    // Half precision samples have an 11 bit mantissa.
+    return check_storage<int16_t>(filename, "int16", wav, segments, 0.0f) &&
+        check_storage<Half>(filename, "half", wav, segments, 1.0f / 2048);
+}
@@ -10,7 +10,8 @@
 //      The starting and ending position of each segment is printed
 //      to the console.
 //   3. Normalizes the audio level to a specific decibel level
-//      (default level is -1 dB below clipping).
+//      (default level is -1 dB below clipping), or normalizes each
+//      segment to a specific integrated loudness in LUFS.
 //
 // After all audio processing, the audio segments are written to
 // WAV files whose names are similar to the original WAV file, but
@@ -71,17 +72,118 @@
 //--------------------------------------------------------------------
 
 #include "waveform.h"
+#include "analysis.h"
 #include "normalize.h"
+#include "loudness.h"
 #include "segment.h"
+#include "multichannel.h"
+#include "timeline.h"
+#include "jobs.h"
+#include "queue.h"
+#include "inputs.h"
+#include "journal.h"
+#include "cache.h"
+#include "dedup.h"
 #include <stdlib.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdarg.h>
 #include <math.h>
 #include <wchar.h>
 #include <vector>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <functional>
+#include <algorithm>
+#include <memory>
+#include <future>
+#include <deque>
 
 #define MAX_PATH 512
 
+// Types of samples that a waveform can be stored in memory as.
+enum class SampleStorage
+{
+    Float,      // 32-bit floating-point.
+    Int16,      // 16-bit integer.
+    Half,       // 16-bit floating-point.
+};
+
+struct WrittenFiles;
+
+// Settings from the command line that control how each WAV file
+// gets processed.
+struct ProcessingOptions
+{
+    float m_db_level = -1.0f;       // Peak normalization level in dB.
+    bool m_use_loudness = false;    // Normalize each segment by loudness instead of peak level?
+    float m_target_lufs = -23.0f;   // Loudness normalization level in LUFS.
+    bool m_limit_true_peak = false; // Limit inter-sample peaks to m_db_level?
+    bool m_analyze_only = false;    // Only print the segments, don't write them?
+    SampleStorage m_storage = SampleStorage::Float; // How to store the waveform in memory.
+    unsigned m_out_frequency = 0;   // Sample rate to write the segments at (0=same as input).
+    unsigned m_channel = 0;         // Which channel to use (1=first; 0=mix all channels).
+    std::vector<float> m_mix_weights; // Gain for each channel when mixing to mono (if not empty).
+    bool m_split_channels = false;  // Segment each channel separately?
+    bool m_concat = false;          // Treat the WAV files as parts of one recording?
+    bool m_multitrack = false;      // Treat the WAV files as aligned tracks of one recording?
+    unsigned m_shards = 1;          // Number of shards to split each recording into.
+    std::wstring m_checkpoint_prefix; // Start of the names of checkpoint files (empty=no checkpoints).
+    SegmentIndex *m_segment_index = nullptr; // Segments already written, to leave out duplicates (null=write them all).
+    WrittenFiles *m_written = nullptr; // Where to list the segment files that get written (null=don't list them).
+};
+
+// Where the current thread's output goes.  If it's null, the
+// output is printed straight to the console; otherwise it's added
+// to the string, to be printed later (see OutputCapture).
+static thread_local std::string *t_output = nullptr;
+
+// Prints to the console like printf, or to the current thread's
+// output string if it has one.
+static void print(const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    if (!t_output)
+    {
+        vprintf(format, args);
+    }
+    else
+    {
+        va_list args_copy;
+        va_copy(args_copy, args);
+        int length = vsnprintf(nullptr, 0, format, args_copy);
+        va_end(args_copy);
+        if (length > 0)
+        {
+            const size_t old_size = t_output->size();
+            t_output->resize(old_size + length + 1);
+            vsnprintf(&(*t_output)[old_size], length + 1, format, args);
+            t_output->resize(old_size + length);
+        }
+    }
+    va_end(args);
+}
+
+// While an object of this class exists, everything the current
+// thread prints is added to the given string instead of going to
+// the console.  This lets threads that run at the same time print
+// without their output getting mixed together; whoever started the
+// threads prints the strings afterward, in order.
+class OutputCapture
+{
+public:
+    explicit OutputCapture(std::string *output) : m_previous(t_output) { t_output = output; }
+    ~OutputCapture() { t_output = m_previous; }
+
+    OutputCapture(const OutputCapture &) = delete;
+    OutputCapture &operator=(const OutputCapture &) = delete;
+
+private:
+    std::string *m_previous;    // Where output went before this object.
+};
+
 // Prints a time duration to the console in a consistent format,
 // showing the elapsed hours, minutes, and seconds.
 void print_duration(float seconds)
@@ -91,120 +193,2268 @@ void print_duration(float seconds)
     int mmin = static_cast<int>(seconds / 60);
     seconds -= mmin * 60;
 
-    if (mhour)
-        printf("%dh:", mhour);
+    if (mhour)
+        print("%dh:", mhour);
+
+    if (mmin)
+        print(mhour ? "%02dm:" : "%dm:", mmin);
+
+    print((mhour || mmin) ? "%05.2fds" : "%.2fs", seconds);
+}
+
+// Makes the name of the WAV file that a segment gets written to.
+// The filename passed here is used as a template, by inserting
+// "_seg" and a number at the end of the filename.  So, for
+// example, the first two segments from "myfile.wav" would be
+// written to files named "myfile_seg1.wav" and "myfile_seg2.wav"
+// in the current working directory.  If the segment came from
+// just one channel, "_ch" and the channel number are inserted
+// too, as in "myfile_ch2_seg1.wav".  Only the file's base name is
+// used (see SegmentBaseName), so files with the same name in
+// different directories get the same segment files; see
+// skip_clashing_files.
+static void make_segment_filename(const wchar_t *filename, const Segment &segment, unsigned seg_num, wchar_t (&new_filename)[MAX_PATH])
+{
+    const std::wstring basename = SegmentBaseName(filename);
+    if (segment.m_channel)
+        _snwprintf_s(new_filename, MAX_PATH, L"%s_ch%u_seg%u.wav", basename.c_str(), segment.m_channel, seg_num);
+    else
+        _snwprintf_s(new_filename, MAX_PATH, L"%s_seg%u.wav", basename.c_str(), seg_num);
+}
+
+// The segment files that have been written for a WAV file, for its
+// journal record.  Files can be added from any thread.
+struct WrittenFiles
+{
+    // Adds a file to the list, if there is a list.
+    static void Add(WrittenFiles *written, const std::wstring &filename)
+    {
+        if (!written)
+            return;
+        std::lock_guard<std::mutex> lock(written->m_mutex);
+        written->m_files.push_back(filename);
+    }
+
+    std::mutex m_mutex;                 // Guards m_files.
+    std::vector<std::wstring> m_files;  // Names of the files.
+};
+
+// Number of WAV files that are read ahead of the files being
+// processed.
+static const size_t k_files_read_ahead = 2;
+
+// Number of segments that can be waiting for the writer thread.
+static const size_t k_segments_queued = 64;
+
+struct PipelineFile;
+
+// A WAV file that has been read into memory.
+struct FileData
+{
+    PipelineFile *m_file = nullptr; // Which of the files it is.
+    WAVInfo m_header;               // Format of the file.
+    std::vector<char> m_samples;    // The samples, as they are in the file.
+    bool m_ok = false;              // Was the file read successfully?
+    bool m_stream = false;          // Too big to read at once, so stream it instead?
+};
+
+class SegmentWriter;
+
+// Keeps track of the segments of one WAV file that are being
+// written by a SegmentWriter.  The count starts at 1, which is held
+// by the code that's processing the file until it has queued all of
+// the segments, and whoever brings the count to zero calls
+// m_finish.
+struct FileWrites
+{
+    // Drops one from the count, and finishes the file if that was
+    // the last one.  The finish function is moved out before it's
+    // called, since it can free the file that this belongs to.
+    void Release()
+    {
+        if (--m_count == 0)
+        {
+            std::function<void()> finish;
+            finish.swap(m_finish);
+            finish();
+        }
+    }
+
+    SegmentWriter *m_writer = nullptr;  // Thread that writes the segments.
+    std::atomic<size_t> m_count{1};     // Number of holds on the file.
+    std::function<void()> m_finish;     // Called when the file's segments are all written.
+    std::vector<std::pair<unsigned, std::wstring>> m_failed; // Segments that couldn't be written.
+};
+
+// One segment's samples, ready to be written to its WAV file.
+struct SegmentData
+{
+    FileWrites *m_file = nullptr;   // The WAV file the segment came from.
+    unsigned m_seg_num = 0;         // Segment number (1=first).
+    std::wstring m_filename;        // Name of the file to write.
+    WAVInfo m_header;               // Format of the file to write.
+    std::vector<int16_t> m_samples; // The samples to write.
+    SegmentIndex *m_index = nullptr; // Index to add the segment to once it's written (if any).
+    uint64_t m_hash = 0;            // Hash of the segment (see HashSegment), for the index.
+    bool m_sync = false;            // Sync the file to the disk once it's written?
+    WrittenFiles *m_written = nullptr; // Where to list the file once it's written (if anywhere).
+};
+
+// Writes segment files on a thread of its own, so the writing
+// overlaps with processing the next WAV files.  Segments wait in a
+// bounded queue, so if the disk can't keep up, the threads that
+// make the segments wait too, instead of holding more and more of
+// them in memory.
+class SegmentWriter
+{
+public:
+    SegmentWriter() : m_queue(k_segments_queued), m_thread(&SegmentWriter::write_segments, this) {}
+    ~SegmentWriter() { Finish(); }
+
+    SegmentWriter(const SegmentWriter &) = delete;
+    SegmentWriter &operator=(const SegmentWriter &) = delete;
+
+    // Queues a segment to be written, waiting if the queue is full.
+    void Write(std::unique_ptr<SegmentData> segment)
+    {
+        segment->m_file->m_count++;
+        m_queue.Push(std::move(segment));
+    }
+
+    // Writes the segments that are still queued, and stops the
+    // thread.
+    void Finish()
+    {
+        if (!m_thread.joinable())
+            return;
+        m_queue.Push(nullptr);
+        m_thread.join();
+    }
+
+private:
+    // Writes each queued segment until it gets a null segment.
+    void write_segments()
+    {
+        for (std::unique_ptr<SegmentData> segment = m_queue.Pop(); segment; segment = m_queue.Pop())
+        {
+            FileWrites &file = *segment->m_file;
+            if (!WAVFileWrite(segment->m_filename.c_str(), segment->m_header, segment->m_samples.data(), segment->m_sync))
+            {
+                file.m_failed.emplace_back(segment->m_seg_num, segment->m_filename);
+                if (segment->m_index)
+                    segment->m_index->Release(segment->m_hash, segment->m_filename);
+            }
+            else
+            {
+                if (segment->m_index)
+                    segment->m_index->Commit(segment->m_hash, segment->m_header.CalculateBufferSize(), segment->m_filename);
+                WrittenFiles::Add(segment->m_written, segment->m_filename);
+            }
+            segment.reset();
+            file.Release();
+        }
+    }
+
+    BoundedQueue<std::unique_ptr<SegmentData>> m_queue;  // Segments waiting to be written.
+    std::thread m_thread;                               // Thread that writes them.
+};
+
+// Hashes a segment that's been converted to be written to the given
+// file, and checks whether the same audio has already been written
+// to another file (see SegmentIndex).  If it has, that file's name
+// is put in 'canonical', and the segment shouldn't be written.
+// Otherwise, once the segment has been written, it should be added
+// to the index with the hash that's put in 'hash' (or released from
+// it, if it couldn't be written).
+// Returns true if the segment is a duplicate.
+static bool claim_segment(SegmentIndex *index, const wchar_t *filename, const WAVInfo &header,
+    const std::vector<int16_t> &samples, uint64_t &hash, std::wstring &canonical)
+{
+    if (!index)
+        return false;
+    hash = HashSegment(header, samples.data());
+    return index->Claim(hash, header.CalculateBufferSize(), filename, canonical);
+}
+
+// What happened when one segment was written to its WAV file.
+struct SegmentWrite
+{
+    std::string m_output;   // What was printed while writing it.
+    bool m_ok = false;      // Was it written successfully?
+};
+
+// Writes the waveform's audio segments to individual WAV files,
+// named as described for make_segment_filename.
+// If a gain envelope is given, the gain is applied to the audio as
+// it is written.  If an output frequency is given, the audio is
+// resampled to that frequency as it is written.  If 'print_progress'
+// is false, the names of the files aren't printed as they're
+// written (so the caller can print them later).
+// Each segment is converted and written by its own task, so the
+// segments of a long recording can be written by all of the threads
+// at once.  What the tasks print is printed afterward in segment
+// order, up to the first segment that failed.
+// If 'writes' is given, the segments are converted but handed to
+// the writer thread to write, and any that can't be written are
+// added to 'writes' instead of making this fail.
+// If 'index' is given, each segment is hashed as soon as it's
+// converted, and a segment that's the same as one that was already
+// written isn't written (see SegmentIndex).  If 'duplicate_of' is
+// given too, it gets the name of the file that each segment is the
+// same as (or an empty name for the segments that were written).
+// If 'sync' is true, each file is synced to the disk once it's
+// written (see WAVFileWrite).  If 'written' is given, each file is
+// added to it once it's written.
+// Returns true if successful.
+template <typename SampleT>
+static bool write_audio_segments_to_wav_files(
+    const BasicWaveform<SampleT> &wav,
+    const wchar_t *filename,
+    const std::vector<Segment> &segments,
+    const GainEnvelope *envelope,
+    unsigned out_frequency,
+    bool print_progress = true,
+    FileWrites *writes = nullptr,
+    SegmentIndex *index = nullptr,
+    std::vector<std::wstring> *duplicate_of = nullptr,
+    bool sync = false,
+    WrittenFiles *written = nullptr)
+{
+    if (wav.m_data.empty() || segments.empty())
+    {
+        print("ERROR: No audio data to output.\n");
+        return false;
+    }
+    if (!filename || !*filename)
+    {
+        print("ERROR: Missing filename.\n");
+        return false;
+    }
+
+    // Write the processed audio to new WAV file(s).
+    std::vector<SegmentWrite> results(segments.size());
+    if (duplicate_of)
+        duplicate_of->assign(segments.size(), std::wstring());
+    TaskGroup group;
+    for (size_t iseg = 0; iseg < segments.size(); iseg++)
+    {
+        group.Run([&, iseg]()
+        {
+            SegmentWrite &result = results[iseg];
+            OutputCapture capture(&result.m_output);
+            const Segment &segment = segments[iseg];
+            wchar_t new_filename[MAX_PATH] = {0};
+            make_segment_filename(filename, segment, static_cast<unsigned>(iseg + 1), new_filename);
+
+            try
+            {
+                std::unique_ptr<SegmentData> data(new SegmentData);
+                data->m_file = writes;
+                data->m_seg_num = static_cast<unsigned>(iseg + 1);
+                data->m_filename = new_filename;
+                data->m_index = index;
+                data->m_sync = sync;
+                data->m_written = written;
+                result.m_ok = wav.ConvertToPCM16(data->m_samples, data->m_header,
+                    static_cast<unsigned>(segment.m_start), static_cast<unsigned>(segment.m_count),
+                    envelope, out_frequency);
+
+                std::wstring canonical;
+                if (result.m_ok && claim_segment(index, new_filename, data->m_header, data->m_samples, data->m_hash, canonical))
+                {
+                    if (print_progress)
+                        print("Skipped '%S', the same as '%S'\n", new_filename, canonical.c_str());
+                    if (duplicate_of)
+                        (*duplicate_of)[iseg] = canonical;
+                }
+                else if (result.m_ok)
+                {
+                    if (print_progress)
+                        print("Writing '%S' starting at %zu for %zu samples\n", new_filename, segment.m_start, segment.m_count);
+                    if (writes)
+                    {
+                        writes->m_writer->Write(std::move(data));
+                    }
+                    else
+                    {
+                        result.m_ok = WAVFileWrite(new_filename, data->m_header, data->m_samples.data(), sync);
+                        if (result.m_ok && index)
+                            index->Commit(data->m_hash, data->m_header.CalculateBufferSize(), new_filename);
+                        else if (index)
+                            index->Release(data->m_hash, new_filename);
+                        if (result.m_ok)
+                            WrittenFiles::Add(written, new_filename);
+                    }
+                }
+            }
+            catch(...)
+            {
+                result.m_ok = false;
+            }
+            if (!result.m_ok)
+                print("ERROR: Attempted write of '%S' was not successful.\n", new_filename);
+        });
+    }
+    group.Wait();
+
+    for (const SegmentWrite &result : results)
+    {
+        print("%s", result.m_output.c_str());
+        if (!result.m_ok)
+            return false;
+    }
+
+    return true;
+}
+
+// Number of analysis frames in each tile of a waveform that
+// analyze_waveform analyzes at a time (10 seconds).
+static const size_t k_frames_per_tile = 1000;
+
+// Fills in the table of statistics for each frame of the waveform
+// (see AnalyzeAudioWaveform).  The frames don't depend on each
+// other, so the waveform is cut into tiles that are analyzed by
+// separate tasks.  A loudness meter has to be fed the audio in
+// order, though, so if one is given the waveform is analyzed in one
+// piece.
+template <typename SampleT>
+static void analyze_waveform(const BasicWaveform<SampleT> &wav, AnalysisTable &table, LoudnessMeter *meter)
+{
+    const size_t total = wav.m_data.size();
+    table.Reset(wav.m_frequency, total);
+    const size_t tile_size = table.m_samples_per_frame * k_frames_per_tile;
+    if (meter || total <= tile_size)
+    {
+        AnalyzeAudioWaveform(wav, table, meter);
+        return;
+    }
+
+    TaskGroup group;
+    for (size_t first = 0; first < total; first += tile_size)
+    {
+        group.Run([&wav, &table, total, tile_size, first]()
+        {
+            AnalysisTable tile_table;
+            AnalyzeSamples(wav.m_data.data() + first, std::min(tile_size, total - first), wav.m_frequency, tile_table);
+            std::copy(tile_table.m_frames.begin(), tile_table.m_frames.end(),
+                table.m_frames.begin() + first / table.m_samples_per_frame);
+            if (tile_table.m_remainder_count)
+                table.m_remainder = tile_table.m_remainder;
+        });
+    }
+    group.Wait();
+}
+
+// Loads the channels of a WAV file that has been read into memory,
+// and selects one channel or mixes the channels to mono as the
+// options say.  The mono waveform is then analyzed the usual way.
+// Returns true if successful.
+template <typename SampleT>
+static bool load_channels(const wchar_t *filename, const FileData &data, const ProcessingOptions &options,
+    BasicWaveform<SampleT> &wav, AnalysisTable &table, LoudnessMeter *meter)
+{
+    BasicMultichannelWaveform<SampleT> channels;
+    channels.LoadFromWAVData(data.m_samples.data(), data.m_header);
+
+    std::vector<float> weights = options.m_mix_weights;
+    if (options.m_channel)
+    {
+        weights.assign(channels.ChannelCount(), 0.0f);
+        if (options.m_channel <= weights.size())
+            weights[options.m_channel - 1] = 1.0f;
+        else
+            weights.clear();
+    }
+    if (!channels.MixToMono(weights, wav))
+    {
+        print("ERROR: '%S' has %u channel(s), which doesn't match the --channel or --mix option.\n",
+            filename, channels.ChannelCount());
+        return false;
+    }
+
+    if (meter)
+        meter->Reset(wav.m_frequency);
+    analyze_waveform(wav, table, meter);
+    return true;
+}
+
+// Prints the sample rate and duration of a WAV file.
+static void print_file_info(const wchar_t *filename, unsigned frequency, size_t sample_count)
+{
+    print("File %S:\n", filename);
+    print("  Sample rate:  %.2f KHz\n", frequency / 1000.0);
+    print("  Duration:     ");
+    print_duration(sample_count / static_cast<float>(frequency));
+    print("\n");
+}
+
+// Prints info about the audio segments to the console.  If the
+// segments are from a timeline of several WAV files, the file that
+// each segment starts in is printed too.
+static void print_segments(const std::vector<Segment> &segments, unsigned frequency, bool print_loudness,
+    const WAVTimeline *timeline = nullptr)
+{
+    int seg_num = 0;
+    for (const Segment &segment : segments)
+    {
+        print("Segment %d:\n", ++seg_num);
+        print("  Starts at sample %zu, runs for %zu samples\n", segment.m_start, segment.m_count);
+        print("  Start time:  ");
+        print_duration(segment.m_start / static_cast<float>(frequency));
+        print("\n");
+        print("  Length:      ");
+        print_duration(segment.m_count / static_cast<float>(frequency));
+        print("\n");
+        print("  End time:    ");
+        print_duration((segment.m_start + segment.m_count) / static_cast<float>(frequency));
+        print("\n");
+        if (print_loudness)
+            print("  Loudness:    %.1f LUFS\n", segment.m_loudness);
+
+        size_t part = 0, sample = 0;
+        if (timeline && timeline->Locate(segment.m_start, part, sample))
+            print("  Starts in:   %S at sample %zu\n", timeline->m_parts[part].m_filename.c_str(), sample);
+    }
+}
+
+// Normalizes the audio level of the waveform's segments, and writes
+// them to WAV files.  The table must hold the waveform's statistics.
+// If 'print_progress' is false, the names of the files aren't
+// printed as they're written.  If 'writes' is given, the writer
+// thread writes the files (see write_audio_segments_to_wav_files).
+// If the options have a segment index, the segments that are the
+// same as ones already written are left out, and if 'duplicate_of'
+// is given, it gets the name of the file each one is the same as.
+// If the file is to be recorded in a journal (the options have a
+// list of written files), the segment files are synced to the disk
+// first, so the journal never says a file is done when its segments
+// could still be lost, and each file is added to the list.
+// Returns true if successful.
+template <typename SampleT>
+static bool normalize_and_write_segments(BasicWaveform<SampleT> &wav, const AnalysisTable &table,
+    const std::vector<Segment> &segments, const wchar_t *filename,
+    const ProcessingOptions &options, bool print_progress, FileWrites *writes = nullptr,
+    std::vector<std::wstring> *duplicate_of = nullptr)
+{
+    // Calculate the gain needed to normalize the audio to a uniform
+    // level.
+    GainEnvelope envelope;
+    if (options.m_use_loudness)
+    {
+        for (const Segment &segment : segments)
+        {
+            envelope.Add(segment.m_start, CalculateLoudnessNormalizationGain(
+                wav, options.m_target_lufs, segment.m_loudness, segment.m_start, segment.m_count));
+            envelope.Add(segment.m_start + segment.m_count, 1.0f);
+        }
+    }
+    else
+    {
+        CalculateNormalizationGain(table, options.m_db_level, envelope);
+    }
+
+    const bool sync = options.m_written != nullptr;
+
+    // Normally the gain is applied as the segments are written, so
+    // the samples only get touched once.  But the true peak limiter
+    // needs to see the normalized audio, so in that case we apply
+    // the gain first.
+    if (options.m_limit_true_peak)
+    {
+        wav.ApplyGainEnvelope(envelope);
+        LimitTruePeakAudioWaveform(wav, options.m_db_level);
+        return write_audio_segments_to_wav_files(wav, filename, segments, nullptr, options.m_out_frequency,
+            print_progress, writes, options.m_segment_index, duplicate_of, sync, options.m_written);
+    }
+
+    // Save the processed audio segments.
+    return write_audio_segments_to_wav_files(wav, filename, segments, &envelope, options.m_out_frequency,
+        print_progress, writes, options.m_segment_index, duplicate_of, sync, options.m_written);
+}
+
+// Performs audio processing tasks on a WAV file that has been read
+// into memory, storing the waveform in memory as samples of type
+// SampleT.  The file's samples are freed once they're converted.
+// If 'writes' is given, the segments are written by the writer
+// thread, which might not have finished when this returns.  If
+// 'cache_entry' is given, the segments are put in it, to be stored
+// in the result cache once they're written.
+// Returns true if successful.
+template <typename SampleT>
+static bool process_wav_file(const wchar_t *filename, FileData &data, const ProcessingOptions &options,
+    FileWrites *writes, CacheEntry *cache_entry)
+{
+    // Load PCM audio from the WAV file.  The audio is analyzed as
+    // it is loaded, so the segmentation and normalization both
+    // work from the same table of statistics and the samples don't
+    // need to be examined again.  If we're normalizing by loudness,
+    // the loudness gets measured at the same time.
+    //
+    // If we're only analyzing the audio, we don't need to keep the
+    // waveform in memory at all, so we just fill in the table.
+    // If we're selecting or mixing channels, they get loaded
+    // separately first.
+    BasicWaveform<SampleT> wav;
+    AnalysisTable table;
+    LoudnessMeter meter;
+    LoudnessMeter *use_meter = options.m_use_loudness ? &meter : nullptr;
+    bool loaded = data.m_ok;
+    if (loaded && (options.m_channel || !options.m_mix_weights.empty()))
+        loaded = load_channels(filename, data, options, wav, table, use_meter);
+    else if (loaded && options.m_analyze_only)
+        AnalyzeWAVData(data.m_samples.data(), data.m_header, table, use_meter);
+    else if (loaded)
+        wav.LoadFromWAVData(data.m_samples.data(), data.m_header, &table, use_meter);
+    std::vector<char>().swap(data.m_samples);
+    if (!loaded)
+    {
+        print("ERROR: Attempted load of '%S' was not successful.\n", filename);
+        return false;
+    }
+    const unsigned frequency = table.m_frequency;
+
+    // Print info about the WAV file.
+    print_file_info(filename, frequency, table.SampleCount());
+
+    // Segment the audio.
+    auto segments = FindSegmentsInAudioWaveform(table, use_meter);
+    if (segments.empty())
+    {
+        print("ERROR: Failed segmenting '%S'.  Is the entire waveform silent?\n", filename);
+        return false;
+    }
+
+    print_segments(segments, frequency, options.m_use_loudness);
+    if (cache_entry)
+    {
+        cache_entry->m_frequency = frequency;
+        cache_entry->m_sample_count = table.SampleCount();
+        cache_entry->m_segments = segments;
+    }
+
+    if (options.m_analyze_only)
+        return true;
+
+    return normalize_and_write_segments(wav, table, segments, filename, options, true, writes);
+}
+
+// The results of processing one channel of a WAV file, or one
+// track of a multitrack recording.
+struct TrackResult
+{
+    std::vector<Segment> m_segments;    // Segments found in the channel or track.
+    std::vector<std::wstring> m_duplicate_of; // File each segment is the same as (empty=it was written).
+    bool m_ok = false;                  // Was it processed successfully?
+    std::string m_output;               // What was printed while processing it.
+};
+
+// Prints the names of the files that the segments were written to,
+// for when they were written without printing them.  If
+// 'duplicate_of' has a name for a segment, the segment wasn't
+// written because it's the same as that file.
+static void print_written_segments(const wchar_t *filename, const std::vector<Segment> &segments,
+    const std::vector<std::wstring> &duplicate_of)
+{
+    unsigned seg_num = 0;
+    for (const Segment &segment : segments)
+    {
+        wchar_t new_filename[MAX_PATH] = {0};
+        make_segment_filename(filename, segment, ++seg_num, new_filename);
+        if (seg_num <= duplicate_of.size() && !duplicate_of[seg_num - 1].empty())
+            print("Skipped '%S', the same as '%S'\n", new_filename, duplicate_of[seg_num - 1].c_str());
+        else
+            print("Wrote '%S' starting at %zu for %zu samples\n", new_filename, segment.m_start, segment.m_count);
+    }
+}
+
+// Segments, normalizes and writes one channel of a multichannel
+// WAV file.  This runs as its own task, so anything it prints is
+// held in the result, and the caller prints the results once all
+// of the channels are done.
+template <typename SampleT>
+static void process_channel(BasicWaveform<SampleT> &wav, unsigned channel,
+    const wchar_t *filename, const ProcessingOptions &options, TrackResult &result)
+{
+    OutputCapture capture(&result.m_output);
+    try
+    {
+        AnalysisTable table;
+        LoudnessMeter meter;
+        LoudnessMeter *use_meter = options.m_use_loudness ? &meter : nullptr;
+        if (use_meter)
+            meter.Reset(wav.m_frequency);
+        analyze_waveform(wav, table, use_meter);
+
+        result.m_segments = FindSegmentsInAudioWaveform(table, use_meter);
+        for (Segment &segment : result.m_segments)
+            segment.m_channel = channel;
+        if (result.m_segments.empty())
+            return;
+
+        result.m_ok = options.m_analyze_only ||
+            normalize_and_write_segments(wav, table, result.m_segments, filename, options, false, nullptr,
+                &result.m_duplicate_of);
+    }
+    catch(...)
+    {
+        print("ERROR: Unexpected exception processing channel %u!\n", channel);
+        result.m_ok = false;
+    }
+}
+
+// Performs audio processing tasks on each channel of the given WAV
+// file separately, storing the waveform in memory as samples of
+// type SampleT.  The file is only read once, and then each channel
+// is segmented and written by its own task.
+// Returns true if successful.
+template <typename SampleT>
+static bool process_wav_file_channels(const wchar_t *filename, FileData &data, const ProcessingOptions &options)
+{
+    if (!data.m_ok)
+    {
+        print("ERROR: Attempted load of '%S' was not successful.\n", filename);
+        return false;
+    }
+    BasicMultichannelWaveform<SampleT> wav;
+    wav.LoadFromWAVData(data.m_samples.data(), data.m_header);
+    std::vector<char>().swap(data.m_samples);
+    const unsigned frequency = wav.m_frequency;
+    const unsigned num_channels = wav.ChannelCount();
+
+    // Print info about the WAV file.
+    print("File %S:\n", filename);
+    print("  Sample rate:  %.2f KHz\n", frequency / 1000.0);
+    print("  Channels:     %u\n", num_channels);
+    print("  Duration:     ");
+    print_duration(wav.m_channels.empty() ? 0.0f : wav.m_channels[0].m_data.size() / static_cast<float>(frequency));
+    print("\n");
+
+    // Process the channels in parallel.
+    std::vector<TrackResult> results(num_channels);
+    TaskGroup group;
+    for (unsigned channel = 0; channel < num_channels; channel++)
+    {
+        group.Run([&, channel]()
+        {
+            process_channel(wav.m_channels[channel], channel + 1, filename, options, results[channel]);
+        });
+    }
+    group.Wait();
+
+    // Print what happened to each channel, in order.
+    bool ok = true;
+    for (unsigned channel = 0; channel < num_channels; channel++)
+    {
+        const TrackResult &result = results[channel];
+        print("Channel %u:\n", channel + 1);
+        print("%s", result.m_output.c_str());
+        if (result.m_segments.empty())
+        {
+            print("ERROR: Failed segmenting channel %u of '%S'.  Is the entire channel silent?\n", channel + 1, filename);
+            ok = false;
+            continue;
+        }
+
+        print_segments(result.m_segments, frequency, options.m_use_loudness);
+        if (options.m_analyze_only)
+            continue;
+
+        if (!result.m_ok)
+        {
+            ok = false;
+            continue;
+        }
+
+        print_written_segments(filename, result.m_segments, result.m_duplicate_of);
+    }
+
+    return ok;
+}
+
+// Loads one track of a multitrack recording, analyzing it as it's
+// loaded.  This runs on its own thread.
+template <typename SampleT>
+static void load_track(const std::wstring &filename, BasicWaveform<SampleT> &wav, AnalysisTable &table,
+    LoudnessMeter *meter, TrackResult &result)
+{
+    try
+    {
+        result.m_ok = wav.LoadFromWAVFile(filename.c_str(), &table, meter);
+    }
+    catch(...)
+    {
+        result.m_ok = false;
+    }
+}
+
+// Normalizes and writes the segments of one track of a multitrack
+// recording.  The segments are the same for every track, but the
+// gain is calculated from each track's own audio.  This runs on its
+// own thread, so it doesn't print anything unless there's an error,
+// and that is held in the result for the caller to print.
+template <typename SampleT>
+static void write_track(BasicWaveform<SampleT> &wav, const AnalysisTable &table, const LoudnessMeter *meter,
+    const std::wstring &filename, const ProcessingOptions &options, TrackResult &result)
+{
+    OutputCapture capture(&result.m_output);
+    try
+    {
+        if (meter)
+        {
+            for (Segment &segment : result.m_segments)
+                segment.m_loudness = meter->IntegratedLoudness(segment.m_start, segment.m_count);
+        }
+        result.m_ok = normalize_and_write_segments(wav, table, result.m_segments, filename.c_str(), options, false,
+            nullptr, &result.m_duplicate_of);
+    }
+    catch(...)
+    {
+        print("ERROR: Unexpected exception writing '%S'!\n", filename.c_str());
+        result.m_ok = false;
+    }
+}
+
+// Performs audio processing tasks on a recording with one WAV file
+// per track (such as one per microphone), where the tracks are all
+// sample-aligned.  The tracks are loaded in parallel and segmented
+// together, so every track gets the same segments, and then each
+// track's segments are normalized and written in parallel.  The
+// audio is stored in memory as samples of type SampleT.
+// Returns true if successful.
+template <typename SampleT>
+static bool process_tracks(const std::vector<std::wstring> &filenames, const ProcessingOptions &options)
+{
+    // Load and analyze the tracks.
+    const size_t num_tracks = filenames.size();
+    std::vector<BasicWaveform<SampleT>> tracks(num_tracks);
+    std::vector<AnalysisTable> tables(num_tracks);
+    std::vector<LoudnessMeter> meters(num_tracks);
+    std::vector<TrackResult> results(num_tracks);
+    std::vector<std::thread> threads;
+    for (size_t itrack = 0; itrack < num_tracks; itrack++)
+    {
+        threads.emplace_back(load_track<SampleT>, std::cref(filenames[itrack]), std::ref(tracks[itrack]),
+            std::ref(tables[itrack]), options.m_use_loudness ? &meters[itrack] : nullptr, std::ref(results[itrack]));
+    }
+    for (std::thread &thread : threads)
+        thread.join();
+    threads.clear();
+
+    for (size_t itrack = 0; itrack < num_tracks; itrack++)
+    {
+        if (!results[itrack].m_ok)
+        {
+            print("ERROR: Attempted load of '%S' was not successful.\n", filenames[itrack].c_str());
+            return false;
+        }
+    }
+
+    AnalysisTable table;
+    if (!CombineTrackAnalysis(tables, table))
+    {
+        print("ERROR: The tracks starting with '%S' don't all have the same sample rate.\n", filenames[0].c_str());
+        return false;
+    }
+    const unsigned frequency = table.m_frequency;
+
+    // Print info about the WAV files.
+    print("Tracks %S to %S:\n", filenames.front().c_str(), filenames.back().c_str());
+    print("  Tracks:       %zu\n", num_tracks);
+    print("  Sample rate:  %.2f KHz\n", frequency / 1000.0);
+    print("  Duration:     ");
+    print_duration(table.SampleCount() / static_cast<float>(frequency));
+    print("\n");
+
+    // Segment all of the tracks together.
+    auto segments = FindSegmentsInAudioWaveform(table);
+    if (segments.empty())
+    {
+        print("ERROR: Failed segmenting '%S'.  Are all of the tracks silent?\n", filenames[0].c_str());
+        return false;
+    }
+
+    print_segments(segments, frequency, false);
+
+    if (options.m_analyze_only)
+        return true;
+
+    // Write the segments of each track.
+    for (size_t itrack = 0; itrack < num_tracks; itrack++)
+    {
+        results[itrack].m_segments = segments;
+        threads.emplace_back(write_track<SampleT>, std::ref(tracks[itrack]), std::cref(tables[itrack]),
+            options.m_use_loudness ? &meters[itrack] : nullptr, std::cref(filenames[itrack]),
+            std::cref(options), std::ref(results[itrack]));
+    }
+    for (std::thread &thread : threads)
+        thread.join();
+
+    bool ok = true;
+    for (size_t itrack = 0; itrack < num_tracks; itrack++)
+    {
+        print("%s", results[itrack].m_output.c_str());
+        if (results[itrack].m_ok)
+            print_written_segments(filenames[itrack].c_str(), results[itrack].m_segments, results[itrack].m_duplicate_of);
+        else
+            ok = false;
+    }
+
+    return ok;
+}
+
+// Makes a copy of the part of a gain envelope that starts at
+// 'start_sample', with the positions moved so that sample is at the
+// start.
+static GainEnvelope slice_gain_envelope(const GainEnvelope &envelope, size_t start_sample)
+{
+    GainEnvelope slice;
+    float gain = 1.0f;
+    for (const GainEnvelope::Span &span : envelope.m_spans)
+    {
+        if (span.m_start <= start_sample)
+            gain = span.m_gain;
+        else
+            slice.Add(span.m_start - start_sample, span.m_gain);
+    }
+    slice.m_spans.insert(slice.m_spans.begin(), GainEnvelope::Span{0, gain});
+    return slice;
+}
+
+// Splits a timeline into 'num_shards' shards of about the same
+// length, with each shard starting at the start of an analysis
+// frame.  Returns the position where each shard starts, followed
+// by the end of the timeline.
+static std::vector<size_t> shard_timeline(const WAVTimeline &timeline, unsigned num_shards)
+{
+    const size_t total = timeline.SampleCount();
+    const size_t samples_per_frame = SamplesPerFrame(timeline.Frequency());
+    const size_t num_frames = total / samples_per_frame;
+    if (num_shards < 1)
+        num_shards = 1;
+
+    std::vector<size_t> shards(1, 0);
+    for (unsigned ishard = 1; ishard < num_shards; ishard++)
+    {
+        size_t start = num_frames * ishard / num_shards * samples_per_frame;
+        if (start > shards.back())
+            shards.push_back(start);
+    }
+    if (total > shards.back() || shards.size() == 1)
+        shards.push_back(total);
+    return shards;
+}
+
+// Describes the options that change the segments that are written
+// for a WAV file, for its journal record.  Options that only change
+// how the work gets done (like --shards or --jobs) are left out.
+// The storage is kept, since storing the samples as int16 or half
+// rounds them.
+static std::string describe_options(const ProcessingOptions &options)
+{
+    const char *storage = "float";
+    if (options.m_storage == SampleStorage::Int16)
+        storage = "int16";
+    else if (options.m_storage == SampleStorage::Half)
+        storage = "half";
+
+    char text[256];
+    snprintf(text, sizeof(text), "level=%g truepeak=%d analyze=%d storage=%s rate=%u channel=%u split-channels=%d",
+        options.m_db_level, options.m_limit_true_peak ? 1 : 0, options.m_analyze_only ? 1 : 0, storage,
+        options.m_out_frequency, options.m_channel, options.m_split_channels ? 1 : 0);
+    std::string result = text;
+    if (options.m_use_loudness)
+    {
+        snprintf(text, sizeof(text), " loudness=%g", options.m_target_lufs);
+        result += text;
+    }
+    for (size_t iweight = 0; iweight < options.m_mix_weights.size(); iweight++)
+    {
+        snprintf(text, sizeof(text), "%s%g", iweight ? "," : " mix=", options.m_mix_weights[iweight]);
+        result += text;
+    }
+    return result;
+}
+
+// Number of the timeline's blocks of audio (see WAVTimeline) that
+// are analyzed between checkpoints of a recording (one minute).
+static const size_t k_blocks_per_checkpoint = 6;
+
+// Opens the checkpoint for a recording (see Checkpoint), restoring
+// whatever an earlier run got done into the table and meter.  The
+// checkpoint's key has the options, and the name, size and time of
+// each of the files, and the checkpoint file is named with the
+// prefix from the options and a hash of the key, so a recording
+// that's changed, or processed with other options, doesn't pick up
+// the wrong checkpoint.
+// Returns true if successful.
+static bool open_checkpoint(const std::vector<std::wstring> &filenames, const ProcessingOptions &options,
+    AnalysisTable &table, LoudnessMeter *meter, Checkpoint &checkpoint)
+{
+    char text[256];
+    snprintf(text, sizeof(text), "splitspeech checkpoint 1\n%s storage=%d\n", describe_options(options).c_str(),
+        static_cast<int>(options.m_storage));
+    std::string key = text;
+    for (const std::wstring &filename : filenames)
+    {
+        uint64_t size = 0;
+        int64_t mtime = 0;
+        if (!GetFileStamp(filename.c_str(), size, mtime))
+            return false;
+        snprintf(text, sizeof(text), "%llu %lld ", static_cast<unsigned long long>(size), static_cast<long long>(mtime));
+        key += text;
+        key += ToUTF8(filename) + "\n";
+    }
+
+    snprintf(text, sizeof(text), ".%016llx.checkpoint", static_cast<unsigned long long>(HashBytes(key.data(), key.size())));
+    std::wstring checkpoint_name = options.m_checkpoint_prefix;
+    for (const char *p = text; *p; p++)
+        checkpoint_name += static_cast<wchar_t>(*p);
+    if (!checkpoint.Open(checkpoint_name.c_str(), key, table, meter))
+    {
+        print("ERROR: Attempted open of checkpoint '%S' was not successful.\n", checkpoint_name.c_str());
+        return false;
+    }
+    return true;
+}
+
+// Fills in part of the table of statistics for a timeline, like
+// WAVTimeline::AnalyzeRange.  With a checkpoint, the range is
+// analyzed a piece at a time, on a grid of pieces that's the same
+// for every run (and for any number of shards), skipping the pieces
+// that an earlier run already did, and recording each piece in the
+// checkpoint as it's done.
+// Returns true if successful.
+template <typename SampleT>
+static bool analyze_timeline_range(WAVTimeline &timeline, size_t first_sample, size_t num_samples,
+    AnalysisTable &table, LoudnessMeter *meter, Checkpoint *checkpoint)
+{
+    if (!checkpoint)
+        return timeline.AnalyzeRange<SampleT>(first_sample, num_samples, table, meter);
+
+    const size_t piece_size = table.m_samples_per_frame * WAVTimeline::FramesPerBlock() * k_blocks_per_checkpoint;
+    const size_t end = first_sample + num_samples;
+    for (size_t start = first_sample; start < end; )
+    {
+        const size_t piece_end = std::min(end, (start / piece_size + 1) * piece_size);
+        if (!checkpoint->IsAnalyzed(start, piece_end - start))
+        {
+            if (!timeline.AnalyzeRange<SampleT>(start, piece_end - start, table, meter) ||
+                !checkpoint->AddAnalyzed(table, start, piece_end - start, meter))
+            {
+                return false;
+            }
+        }
+        start = piece_end;
+    }
+    return true;
+}
+
+// Fills in the table of statistics for a timeline, analyzing each
+// of the shards (see shard_timeline) as its own task, each reading
+// the files with its own WAVTimeline.  The table must already be
+// Reset for the whole timeline, and comes out the same as from
+// WAVTimeline::Analyze.  If a checkpoint is given, each shard is
+// analyzed as analyze_timeline_range describes.
+// Returns true if successful.
+template <typename SampleT>
+static bool analyze_timeline_shards(const WAVTimeline &timeline, const std::vector<size_t> &shards,
+    AnalysisTable &table, Checkpoint *checkpoint)
+{
+    std::vector<char> ok(shards.size() - 1, 0);
+    TaskGroup group;
+    for (size_t ishard = 0; ishard + 1 < shards.size(); ishard++)
+    {
+        group.Run([&, ishard]()
+        {
+            WAVTimeline shard;
+            shard.m_parts = timeline.m_parts;
+            ok[ishard] = analyze_timeline_range<SampleT>(shard, shards[ishard], shards[ishard + 1] - shards[ishard],
+                table, nullptr, checkpoint);
+        });
+    }
+    group.Wait();
+
+    return std::find(ok.begin(), ok.end(), 0) == ok.end();
+}
+
+// Reads one segment of a timeline back from the files, normalizes
+// it with the given gain envelope (for the whole timeline), and
+// writes it.  If a checkpoint is given, a segment that it says was
+// already written is skipped, and the segment is recorded in it
+// once it's written and synced to the disk.  If the options have a
+// segment index, a segment that's the same as one that was already
+// written isn't written, but is still recorded in the checkpoint as
+// done.  This can run as a task, so what it prints is held in the
+// result.
+template <typename SampleT>
+static void write_timeline_segment(WAVTimeline &timeline, const wchar_t *filename, const Segment &segment,
+    unsigned seg_num, const GainEnvelope &envelope, const ProcessingOptions &options, Checkpoint *checkpoint,
+    SegmentWrite &result)
+{
+    OutputCapture capture(&result.m_output);
+    try
+    {
+        if (checkpoint && checkpoint->IsWritten(seg_num))
+        {
+            wchar_t new_filename[MAX_PATH] = {0};
+            make_segment_filename(filename, segment, seg_num, new_filename);
+            print("Already wrote '%S' starting at %zu for %zu samples\n", new_filename, segment.m_start, segment.m_count);
+            WrittenFiles::Add(options.m_written, new_filename);
+            result.m_ok = true;
+            return;
+        }
+
+        BasicWaveform<SampleT> wav;
+        if (!timeline.Read(segment.m_start, segment.m_count, wav))
+        {
+            print("ERROR: Attempted read of segment %u was not successful.\n", seg_num);
+            return;
+        }
+
+        GainEnvelope segment_envelope;
+        if (options.m_use_loudness)
+            segment_envelope.Add(0, CalculateLoudnessNormalizationGain(wav, options.m_target_lufs, segment.m_loudness));
+        else
+            segment_envelope = slice_gain_envelope(envelope, segment.m_start);
+
+        wchar_t new_filename[MAX_PATH] = {0};
+        make_segment_filename(filename, segment, seg_num, new_filename);
+
+        std::vector<int16_t> samples;
+        WAVInfo header;
+        bool converted = false;
+        if (options.m_limit_true_peak)
+        {
+            wav.ApplyGainEnvelope(segment_envelope);
+            LimitTruePeakAudioWaveform(wav, options.m_db_level);
+            converted = wav.ConvertToPCM16(samples, header, 0, 0, nullptr, options.m_out_frequency);
+        }
+        else
+        {
+            converted = wav.ConvertToPCM16(samples, header, 0, 0, &segment_envelope, options.m_out_frequency);
+        }
+
+        uint64_t hash = 0;
+        std::wstring canonical;
+        if (converted && claim_segment(options.m_segment_index, new_filename, header, samples, hash, canonical))
+        {
+            print("Skipped '%S', the same as '%S'\n", new_filename, canonical.c_str());
+        }
+        else
+        {
+            print("Writing '%S' starting at %zu for %zu samples\n", new_filename, segment.m_start, segment.m_count);
+            if (!converted || !WAVFileWrite(new_filename, header, samples.data(), checkpoint != nullptr))
+            {
+                print("ERROR: Attempted write of '%S' was not successful.\n", new_filename);
+                if (converted && options.m_segment_index)
+                    options.m_segment_index->Release(hash, new_filename);
+                return;
+            }
+            if (options.m_segment_index)
+                options.m_segment_index->Commit(hash, header.CalculateBufferSize(), new_filename);
+            WrittenFiles::Add(options.m_written, new_filename);
+        }
+        if (checkpoint && !checkpoint->AddWritten(seg_num))
+        {
+            print("ERROR: Attempted write of checkpoint was not successful.\n");
+            return;
+        }
+
+        result.m_ok = true;
+    }
+    catch(...)
+    {
+        print("ERROR: Unexpected exception writing segment %u!\n", seg_num);
+    }
+}
+
+// Performs audio processing tasks on a recording that is split
+// across several WAV files, treating the files as one continuous
+// timeline so segments can run from one file into the next.  Only
+// the table of statistics is kept for the whole recording; the
+// audio for each segment is read back from the files as it's
+// written, storing the samples in memory as type SampleT.  The
+// segments are named after the first file.
+//
+// This also works for a single WAV file that's too big to read
+// into memory at once (see --memory-budget), since only the table
+// and one segment are ever held in memory.
+//
+// If the options ask for shards, the timeline is cut into that
+// many pieces, and the pieces are analyzed and their segments are
+// written in parallel.  The segments are still found from the
+// table for the whole timeline, so they're the same as when it's
+// done all at once.  The loudness meter has to see all of the
+// audio in order, so with --loudness only the writing is split.
+//
+// If the options give a prefix for checkpoints, the progress is
+// kept in a checkpoint (see open_checkpoint), so if the program is
+// killed, running it again carries on from the last checkpoint, and
+// gives the same segments.  The checkpoint is deleted once the
+// recording is done.
+// Returns true if successful.
+template <typename SampleT>
+static bool process_timeline(const std::vector<std::wstring> &filenames, const ProcessingOptions &options)
+{
+    const bool one_file = filenames.size() == 1;
+    WAVTimeline timeline;
+    if (!timeline.Open(filenames))
+    {
+        if (one_file)
+        {
+            print("ERROR: Attempted load of '%S' was not successful.\n", filenames[0].c_str());
+            return false;
+        }
+        print("ERROR: Attempted load of '%S' and the files after it was not successful.\n", filenames[0].c_str());
+        print("       All of the files must exist and have the same format.\n");
+        return false;
+    }
+
+    AnalysisTable table;
+    table.Reset(timeline.Frequency(), timeline.SampleCount());
+    LoudnessMeter meter(timeline.Frequency());
+    LoudnessMeter *use_meter = options.m_use_loudness ? &meter : nullptr;
+    std::unique_ptr<Checkpoint> checkpoint;
+    if (!options.m_checkpoint_prefix.empty())
+    {
+        checkpoint.reset(new Checkpoint);
+        if (!open_checkpoint(filenames, options, table, use_meter, *checkpoint))
+            return false;
+    }
+
+    const std::vector<size_t> shards = shard_timeline(timeline, options.m_shards);
+    bool analyzed = false;
+    if (use_meter || shards.size() < 3)
+        analyzed = analyze_timeline_range<SampleT>(timeline, 0, timeline.SampleCount(), table, use_meter, checkpoint.get());
+    else
+        analyzed = analyze_timeline_shards<SampleT>(timeline, shards, table, checkpoint.get());
+    if (!analyzed)
+    {
+        print("ERROR: Attempted read of '%S'%s was not successful.\n", filenames[0].c_str(),
+            one_file ? "" : " and the files after it");
+        return false;
+    }
+    const unsigned frequency = table.m_frequency;
+
+    // Print info about the WAV files, the same way as for a file
+    // that's read into memory if there's only one.
+    if (one_file)
+    {
+        print("File %S:\n", filenames[0].c_str());
+    }
+    else
+    {
+        print("Files %S to %S:\n", filenames.front().c_str(), filenames.back().c_str());
+        print("  Parts:        %zu\n", filenames.size());
+    }
+    print("  Sample rate:  %.2f KHz\n", frequency / 1000.0);
+    print("  Duration:     ");
+    print_duration(table.SampleCount() / static_cast<float>(frequency));
+    print("\n");
+    if (checkpoint && (checkpoint->AnalyzedCount() || checkpoint->WrittenCount()))
+    {
+        print("  Resumed:      %.1f%% analyzed, %zu segment(s) written\n",
+            100.0 * static_cast<double>(checkpoint->AnalyzedCount()) / static_cast<double>(std::max<size_t>(table.SampleCount(), 1)),
+            checkpoint->WrittenCount());
+    }
+
+    // Segment the audio.
+    auto segments = FindSegmentsInAudioWaveform(table, use_meter);
+    if (segments.empty())
+    {
+        print("ERROR: Failed segmenting '%S'.  Is the entire waveform silent?\n", filenames[0].c_str());
+        return false;
+    }
+
+    print_segments(segments, frequency, options.m_use_loudness, one_file ? nullptr : &timeline);
+
+    if (options.m_analyze_only)
+    {
+        if (checkpoint)
+            checkpoint->Remove();
+        return true;
+    }
+
+    // The peak normalization gain comes from the statistics for the
+    // whole timeline.
+    GainEnvelope envelope;
+    if (!options.m_use_loudness)
+        CalculateNormalizationGain(table, options.m_db_level, envelope);
+
+    // Each shard reads back and writes the segments that start in
+    // it (reading on past its end if a segment runs into the next
+    // shard), so the segments are the same however many shards
+    // there are.  What's printed for each segment is printed
+    // afterward in order, up to the first segment that failed.
+    std::vector<SegmentWrite> results(segments.size());
+    TaskGroup group;
+    size_t first_segment = 0;
+    for (size_t ishard = 0; ishard + 1 < shards.size(); ishard++)
+    {
+        size_t end_segment = first_segment;
+        while (end_segment < segments.size() && segments[end_segment].m_start < shards[ishard + 1])
+            end_segment++;
+        if (end_segment == first_segment)
+            continue;
+
+        group.Run([&, first_segment, end_segment]()
+        {
+            WAVTimeline shard;
+            shard.m_parts = timeline.m_parts;
+            for (size_t iseg = first_segment; iseg < end_segment; iseg++)
+            {
+                write_timeline_segment<SampleT>(shard, filenames[0].c_str(), segments[iseg], static_cast<unsigned>(iseg + 1),
+                    envelope, options, checkpoint.get(), results[iseg]);
+                if (!results[iseg].m_ok)
+                    break;
+            }
+        });
+        first_segment = end_segment;
+    }
+    group.Wait();
+
+    for (const SegmentWrite &result : results)
+    {
+        print("%s", result.m_output.c_str());
+        if (!result.m_ok)
+            return false;
+    }
+
+    if (checkpoint)
+        checkpoint->Remove();
+    return true;
+}
+
+// Performs audio processing tasks on a WAV file that has been read
+// into memory, with the waveform stored in memory the way the
+// options say.  If 'writes' is given, the writer thread writes
+// the segments (except with --split-channels).  If 'cache_entry'
+// is given, the segments are put in it (except with
+// --split-channels).
+// Returns true if successful.
+static bool process_wav_file(const wchar_t *filename, FileData &data, const ProcessingOptions &options,
+    FileWrites *writes, CacheEntry *cache_entry)
+{
+    if (options.m_split_channels)
+    {
+        switch (options.m_storage)
+        {
+        case SampleStorage::Int16:
+            return process_wav_file_channels<int16_t>(filename, data, options);
+        case SampleStorage::Half:
+            return process_wav_file_channels<Half>(filename, data, options);
+        default:
+            return process_wav_file_channels<float>(filename, data, options);
+        }
+    }
+
+    switch (options.m_storage)
+    {
+    case SampleStorage::Int16:
+        return process_wav_file<int16_t>(filename, data, options, writes, cache_entry);
+    case SampleStorage::Half:
+        return process_wav_file<Half>(filename, data, options, writes, cache_entry);
+    default:
+        return process_wav_file<float>(filename, data, options, writes, cache_entry);
+    }
+}
+
+// Reads a WAV file's header and samples into memory.
+static std::unique_ptr<FileData> read_wav_file(const std::wstring &filename, PipelineFile *file)
+{
+    std::unique_ptr<FileData> data(new FileData);
+    data->m_file = file;
+    try
+    {
+        if (WAVFileReadHeader(filename.c_str(), data->m_header))
+        {
+            data->m_samples.resize(data->m_header.CalculateBufferSize());
+            data->m_ok = data->m_samples.empty() ||
+                WAVFileReadSamples(filename.c_str(), data->m_samples.data(), data->m_samples.size());
+        }
+    }
+    catch(...)
+    {
+        data->m_ok = false;
+    }
+    if (!data->m_ok)
+        std::vector<char>().swap(data->m_samples);
+
+    return data;
+}
+
+// Performs audio processing tasks on a recording that is split
+// across several WAV files (or a multitrack recording, if the
+// options say so), with the audio stored in memory the way the
+// options say.
+// Returns true if successful.
+static bool process_timeline(const std::vector<std::wstring> &filenames, const ProcessingOptions &options)
+{
+    if (options.m_multitrack)
+    {
+        switch (options.m_storage)
+        {
+        case SampleStorage::Int16:
+            return process_tracks<int16_t>(filenames, options);
+        case SampleStorage::Half:
+            return process_tracks<Half>(filenames, options);
+        default:
+            return process_tracks<float>(filenames, options);
+        }
+    }
+
+    switch (options.m_storage)
+    {
+    case SampleStorage::Int16:
+        return process_timeline<int16_t>(filenames, options);
+    case SampleStorage::Half:
+        return process_timeline<Half>(filenames, options);
+    default:
+        return process_timeline<float>(filenames, options);
+    }
+}
+
+// A WAV file from the command line, with the options that were in
+// effect for it, and what happened when it was processed.
+struct FileJob
+{
+    std::wstring m_filename;        // Name of the WAV file.
+    ProcessingOptions m_options;    // Options given before the file.
+    std::string m_output;           // What was printed while processing it.
+    bool m_ok = false;              // Was it processed successfully?
+    bool m_done = false;            // Has it been processed yet?
+    bool m_stamped = false;         // Were the file's size and time read, for the journal?
+    uint64_t m_size = 0;            // Size of the file.
+    int64_t m_mtime = 0;            // When the file was last changed.
+    std::vector<std::wstring> m_old_outputs; // Segment files the journal says it had before.
+    std::string m_cache_key;        // Key of its entry in the result cache (empty=none to store).
+    CacheEntry m_cache_entry;       // Entry to store once its segments are written.
+};
+
+// A batch of WAV files to process, and what was printed while
+// finding them.
+struct FileBatch
+{
+    std::vector<FileJob> m_files;   // The files.
+    std::string m_output;           // Errors found while finding them.
+    unsigned m_error_count = 0;     // Number of errors.
+};
+
+// A WAV file in the pipeline (see process_wav_files), from when
+// its batch is scheduled until what it printed has been printed.
+// An entry with no file name just holds something to print between
+// the files, such as the errors found while finding them.
+struct PipelineFile
+{
+    FileJob m_job;                  // The file, and what happened to it.
+    size_t m_reserved = 0;          // Bytes of the memory budget it holds.
+    FileWrites m_writes;            // Its segments that are being written.
+    WrittenFiles m_written;         // Its segment files that have been written, for the journal.
+};
+
+// Reads the header of each of the WAV files, on 'num_threads'
+// threads.  Each takes just one small read.  A file whose header
+// can't be read gets a header with no audio and a sample rate of 0
+// (it fails quickly when it's processed).
+static std::vector<WAVInfo> probe_wav_files(const std::vector<FileJob> &files, unsigned num_threads)
+{
+    std::vector<WAVInfo> headers(files.size());
+    RunJobs(files.size(), num_threads, [&files, &headers](size_t ifile)
+    {
+        if (!WAVFileReadHeader(files[ifile].m_filename.c_str(), headers[ifile]))
+        {
+            headers[ifile] = WAVInfo();
+            headers[ifile].m_rate = 0;
+        }
+    });
+
+    return headers;
+}
+
+// Returns the order to process the WAV files in, as a list of
+// indexes into their headers.  For longest or shortest first, the
+// files are ordered by duration.
+static std::vector<size_t> schedule_wav_files(const std::vector<WAVInfo> &headers, JobOrder order)
+{
+    std::vector<double> durations(headers.size(), 0.0);
+    for (size_t ifile = 0; ifile < headers.size(); ifile++)
+    {
+        if (headers[ifile].m_rate)
+            durations[ifile] = static_cast<double>(headers[ifile].m_sample_count) / headers[ifile].m_rate;
+    }
+
+    return OrderJobs(durations, order);
+}
+
+// Estimates the memory used by the table of statistics for one
+// channel of a WAV file with the given header, in bytes.
+static double estimate_table_memory(const WAVInfo &header)
+{
+    const double frames = static_cast<double>(header.m_sample_count / SamplesPerFrame(header.m_rate));
+    return (frames + 1) * static_cast<double>(sizeof(FrameStats));
+}
+
+// Estimates the most memory that processing a WAV file with the
+// given header will use at once, in bytes.  That's the larger of
+// the file's samples plus the waveform they're converted to (while
+// it's loaded), and the waveform plus the segments converted from
+// it (while they're written), and the table of statistics.
+static size_t estimate_file_memory(const WAVInfo &header, const ProcessingOptions &options)
+{
+    const double frames = header.m_sample_count;
+    const double file_bytes = frames * header.m_channels * (header.m_bits / 8);
+    const double sample_size = static_cast<double>(
+        options.m_storage == SampleStorage::Float ? sizeof(float) : sizeof(int16_t));
+    const double all_channels = frames * header.m_channels * sample_size;
+    const bool select_channels = options.m_channel || !options.m_mix_weights.empty();
+
+    // The waveforms that get kept, and the table for each.
+    const unsigned tracks = options.m_split_channels ? header.m_channels : 1;
+    double waveform = options.m_split_channels ? all_channels : frames * sample_size;
+    if (options.m_analyze_only && !options.m_split_channels && !select_channels)
+        waveform = 0;
+    const double table = tracks * estimate_table_memory(header);
+
+    // Selecting or mixing channels loads all of them first.
+    double loading = file_bytes + waveform;
+    if (select_channels)
+        loading += all_channels;
+
+    // The segments are written as 16-bit samples, at the output
+    // sample rate.
+    double writing = 0;
+    if (!options.m_analyze_only)
+    {
+        double rate_ratio = options.m_out_frequency && header.m_rate ?
+            static_cast<double>(options.m_out_frequency) / header.m_rate : 1.0;
+        writing = waveform + tracks * frames * rate_ratio * static_cast<double>(sizeof(int16_t));
+    }
+
+    return static_cast<size_t>(std::max(loading, writing) + table);
+}
+
+// Returns true if a WAV file can be streamed (see process_timeline)
+// with these options, when it's too big for the memory budget or
+// it's to be split into shards.  The channels have to be mixed to
+// mono with equal gains for that.
+static bool can_stream(const ProcessingOptions &options)
+{
+    return !options.m_split_channels && !options.m_channel && options.m_mix_weights.empty();
+}
+
+// Returns true if the options give a prefix for checkpoints, and a
+// WAV file with the given header is long enough to reach at least
+// one checkpoint, so it should be streamed (see process_timeline)
+// to keep its progress.  A shorter file is quick to do again from
+// the start.
+static bool wants_checkpoint(const WAVInfo &header, const ProcessingOptions &options)
+{
+    if (options.m_checkpoint_prefix.empty() || !header.m_rate)
+        return false;
+    const size_t piece_size = SamplesPerFrame(header.m_rate) * WAVTimeline::FramesPerBlock() * k_blocks_per_checkpoint;
+    return header.m_sample_count > piece_size;
+}
+
+// Processes a WAV file by streaming it from the file, instead of
+// reading it into memory all at once.
+// Returns true if successful.
+static bool stream_wav_file(const wchar_t *filename, const ProcessingOptions &options)
+{
+    const std::vector<std::wstring> filenames(1, filename);
+    switch (options.m_storage)
+    {
+    case SampleStorage::Int16:
+        return process_timeline<int16_t>(filenames, options);
+    case SampleStorage::Half:
+        return process_timeline<Half>(filenames, options);
+    default:
+        return process_timeline<float>(filenames, options);
+    }
+}
+
+// Returns the names of the files that a WAV file's segments are
+// written to.
+static std::vector<std::wstring> segment_filenames(const wchar_t *filename, const std::vector<Segment> &segments)
+{
+    std::vector<std::wstring> filenames;
+    for (const Segment &segment : segments)
+    {
+        wchar_t new_filename[MAX_PATH] = {0};
+        make_segment_filename(filename, segment, static_cast<unsigned>(filenames.size() + 1), new_filename);
+        filenames.push_back(new_filename);
+    }
+    return filenames;
+}
+
+// Returns true if a WAV file's segments can be kept in the result
+// cache with these options.  Each channel's segments are written
+// separately with --split-channels, and with --dedup some of the
+// segment files might not be written, so they aren't cached.
+static bool can_cache(const ProcessingOptions &options)
+{
+    return !options.m_split_channels && !options.m_segment_index;
+}
+
+// Makes the key of a WAV file's entry in the result cache (see
+// ResultCache), from a hash of the samples that were read from it,
+// their format, and the options that change the segments that are
+// written.
+static std::string make_cache_key(const FileData &data, const ProcessingOptions &options)
+{
+    char text[256];
+    snprintf(text, sizeof(text), "audio=%016llx bytes=%zu rate=%u channels=%u bits=%u float=%d storage=%d ",
+        static_cast<unsigned long long>(HashContent(data.m_samples.data(), data.m_samples.size())),
+        data.m_samples.size(), data.m_header.m_rate, data.m_header.m_channels, data.m_header.m_bits,
+        data.m_header.m_is_float ? 1 : 0, static_cast<int>(options.m_storage));
+    return text + describe_options(options);
+}
+
+// Processes a WAV file whose audio and options match an entry in
+// the result cache, by printing the segments that the entry has and
+// linking its segment files to the names this file's segments get.
+// Returns false (without printing anything) if there's no such
+// entry, or its files can't be linked, so the file has to be
+// processed after all.
+static bool restore_cached_file(const wchar_t *filename, const std::string &key, const ProcessingOptions &options,
+    const ResultCache &cache)
+{
+    CacheEntry entry;
+    if (!cache.Find(key, entry) || entry.m_segments.empty())
+        return false;
+    if (!options.m_analyze_only && !cache.Restore(key, segment_filenames(filename, entry.m_segments)))
+        return false;
+
+    print_file_info(filename, entry.m_frequency, entry.m_sample_count);
+    print_segments(entry.m_segments, entry.m_frequency, options.m_use_loudness);
+    if (!options.m_analyze_only)
+    {
+        unsigned seg_num = 0;
+        for (const Segment &segment : entry.m_segments)
+        {
+            wchar_t new_filename[MAX_PATH] = {0};
+            make_segment_filename(filename, segment, ++seg_num, new_filename);
+            print("Linked '%S' from the cache starting at %zu for %zu samples\n", new_filename,
+                segment.m_start, segment.m_count);
+            WrittenFiles::Add(options.m_written, new_filename);
+        }
+    }
+    return true;
+}
+
+// Removes the segment files that the journal says a WAV file had
+// the last time it was done, but that it didn't write this time (as
+// when it has fewer segments now), so they aren't left behind as
+// if they were still its segments.  'outputs' must be sorted.
+static void remove_old_outputs(const FileJob &file, const std::vector<std::wstring> &outputs)
+{
+    for (const std::wstring &old_output : file.m_old_outputs)
+    {
+        uint64_t size = 0;
+        int64_t mtime = 0;
+        if (std::binary_search(outputs.begin(), outputs.end(), old_output) ||
+            !GetFileStamp(old_output.c_str(), size, mtime))
+            continue;
+        if (_wunlink(old_output.c_str()) == 0)
+            print("Removed '%S', which %S no longer has.\n", old_output.c_str(), file.m_filename.c_str());
+        else
+            print("WARNING: Attempted removal of '%S' was not successful.\n", old_output.c_str());
+    }
+}
+
+// Processes WAV files as a pipeline, with the calling thread
+// reading the files, a pool of 'num_threads' threads processing
+// them, and a thread that writes the segments.  The stages are
+// linked by bounded queues, so while one file is being processed,
+// the next files are being read and the segments of the files
+// before it are being written, but only a few files and segments
+// are held in memory at a time.  Each file that's read is added to
+// the pool as a job, so a thread that's waiting for the next file
+// can run other files' tasks in the meantime.
+//
+// The reader gets the files a batch at a time from 'next_batch',
+// as it needs them, until it gets an empty batch.
+// The pipeline keeps running from one batch to the next, so the
+// first files of a batch are read and processed while the last
+// files of the batch before it are still being finished.  The files
+// of each batch are read and started in the order that 'order' says
+// (see schedule_wav_files).  Several files are processed at a time,
+// and the tasks within each file (such as converting its segments)
+// are spread across any threads that are idle.
+//
+// If 'memory_budget' isn't 0, the reader waits before reading each
+// file until there's enough of the budget free for the file's
+// estimated memory use, which stays taken until the file's segments
+// are written.  A file that wouldn't fit in the whole budget is
+// streamed instead of being read into memory, if the options allow
+// it; otherwise it waits until it can have the whole budget to
+// itself.  A file that's to be split into shards is streamed too,
+// so its shards can be read in parallel, and so is a file that's to
+// be checkpointed (see wants_checkpoint), so it can pick up where it
+// left off if the program is killed.
+//
+// If 'journal' isn't null, each file that's processed successfully
+// is added to it once its segments are all written.
+//
+// If 'cache' isn't null, a file that's read into memory is looked
+// up in it by a hash of its samples, and if it's there, its segment
+// files are linked from the cache instead of the file being
+// processed.  Otherwise it's added to the cache once its segments
+// are all written.
+//
+// What each file prints is held until the files before it have
+// been printed, so the console shows the files one after another in
+// command line order, just like when they're processed one at a
+// time.  What was printed while finding each batch is printed
+// before its files.
+// Returns the number of errors.
+static unsigned process_wav_files(const std::function<FileBatch()> &next_batch, unsigned num_threads,
+    JobOrder order, size_t memory_budget, Journal *journal, ResultCache *cache)
+{
+    MemoryBudget budget(memory_budget);
+
+    // The files that haven't been printed yet, in command line
+    // order.  A file is freed once it's been printed.
+    std::mutex print_mutex;
+    std::deque<std::unique_ptr<PipelineFile>> unprinted;
+    unsigned error_count = 0;
+
+    // Prints the files at the front of the list that are done.  The
+    // print mutex must be locked.
+    auto print_done = [&]()
+    {
+        for (; !unprinted.empty() && unprinted.front()->m_job.m_done; unprinted.pop_front())
+        {
+            const FileJob &file = unprinted.front()->m_job;
+            fputs(file.m_output.c_str(), stdout);
+            if (!file.m_ok)
+                ++error_count;
+        }
+    };
+
+    // Once a file's segments are all written, print its output, and
+    // any later files' output that was waiting for it.
+    auto finish = [&](PipelineFile &entry)
+    {
+        FileJob &file = entry.m_job;
+        FileWrites &file_writes = entry.m_writes;
+        {
+            OutputCapture capture(&file.m_output);
+            std::sort(file_writes.m_failed.begin(), file_writes.m_failed.end());
+            for (const auto &failed : file_writes.m_failed)
+            {
+                print("ERROR: Attempted write of '%S' was not successful.\n", failed.second.c_str());
+                file.m_ok = false;
+            }
+            if (file.m_ok && cache && !file.m_cache_key.empty())
+            {
+                // With --analyze, there are no segment files to link.
+                const CacheEntry &entry = file.m_cache_entry;
+                std::vector<std::wstring> filenames;
+                if (!file.m_options.m_analyze_only)
+                    filenames = segment_filenames(file.m_filename.c_str(), entry.m_segments);
+                // The file's segments are all written, so it's only
+                // a warning if they can't be cached.
+                if (!cache->Store(file.m_cache_key, entry, filenames))
+                    print("WARNING: Attempted write of '%S' to the cache was not successful.\n", file.m_filename.c_str());
+                file.m_cache_entry = CacheEntry();
+            }
+            if (!file.m_ok)
+            {
+                print("ERROR: One or more error(s) processing %S\n", file.m_filename.c_str());
+            }
+            else if (journal && file.m_stamped)
+            {
+                JournalRecord record;
+                record.m_filename = file.m_filename;
+                record.m_size = file.m_size;
+                record.m_mtime = file.m_mtime;
+                record.m_options = describe_options(file.m_options);
+                record.m_outputs.swap(entry.m_written.m_files);
+                std::sort(record.m_outputs.begin(), record.m_outputs.end());
+                remove_old_outputs(file, record.m_outputs);
+                if (!journal->Add(record))
+                {
+                    print("ERROR: Attempted write of journal was not successful.\n");
+                    file.m_ok = false;
+                }
+            }
+        }
+
+        budget.Release(entry.m_reserved);
+
+        std::lock_guard<std::mutex> lock(print_mutex);
+        file.m_done = true;
+        print_done();
+    };
+
+    // Each job processes the file at the front of the read queue.
+    // A job is added for each file once it's been put in the queue,
+    // so there's always one there for it.
+    SegmentWriter writer;
+    BoundedQueue<std::unique_ptr<FileData>> read_queue(k_files_read_ahead);
+    auto process_next = [&]()
+    {
+        std::unique_ptr<FileData> data = read_queue.Pop();
+        PipelineFile &entry = *data->m_file;
+        FileJob &file = entry.m_job;
+        {
+            OutputCapture capture(&file.m_output);
+            try
+            {
+                bool cached = false;
+                if (!data->m_stream && data->m_ok && cache && can_cache(file.m_options))
+                {
+                    file.m_cache_key = make_cache_key(*data, file.m_options);
+                    cached = restore_cached_file(file.m_filename.c_str(), file.m_cache_key, file.m_options, *cache);
+                    if (cached)
+                        file.m_cache_key.clear();
+                }
+
+                if (cached)
+                    file.m_ok = true;
+                else if (data->m_stream)
+                    file.m_ok = stream_wav_file(file.m_filename.c_str(), file.m_options);
+                else
+                    file.m_ok = process_wav_file(file.m_filename.c_str(), *data, file.m_options, &entry.m_writes,
+                        file.m_cache_key.empty() ? nullptr : &file.m_cache_entry);
+            }
+            catch(...)
+            {
+                print("ERROR: Unexpected exception processing %S!\n", file.m_filename.c_str());
+                file.m_ok = false;
+            }
+        }
+        data.reset();
+        entry.m_writes.Release();
+    };
+
+    // Read the files a batch at a time, each batch in the scheduled
+    // order, staying a few files ahead, and within the memory
+    // budget, and start a job for each one.
+    JobPool pool(num_threads);
+    try
+    {
+        for (;;)
+        {
+            FileBatch batch = next_batch();
+            std::vector<WAVInfo> headers(batch.m_files.size());
+            const bool checkpoints = std::any_of(batch.m_files.begin(), batch.m_files.end(),
+                [](const FileJob &job) { return !job.m_options.m_checkpoint_prefix.empty(); });
+            if (order != JobOrder::Input || budget.Total() || checkpoints)
+                headers = probe_wav_files(batch.m_files, num_threads);
+            const std::vector<size_t> schedule = schedule_wav_files(headers, order);
+
+            // The batch's files are printed in command line order,
+            // after what was printed while finding them.
+            std::vector<PipelineFile *> files;
+            {
+                std::lock_guard<std::mutex> lock(print_mutex);
+                std::unique_ptr<PipelineFile> note(new PipelineFile);
+                note->m_job.m_output = std::move(batch.m_output);
+                note->m_job.m_ok = true;
+                note->m_job.m_done = true;
+                error_count += batch.m_error_count;
+                unprinted.push_back(std::move(note));
+                for (FileJob &job : batch.m_files)
+                {
+                    std::unique_ptr<PipelineFile> entry(new PipelineFile);
+                    PipelineFile *file = entry.get();
+                    file->m_job = std::move(job);
+                    file->m_writes.m_writer = &writer;
+                    file->m_writes.m_finish = [&finish, file]() { finish(*file); };
+                    if (journal && file->m_job.m_stamped)
+                        file->m_job.m_options.m_written = &file->m_written;
+                    files.push_back(file);
+                    unprinted.push_back(std::move(entry));
+                }
+                print_done();
+            }
+            if (files.empty())
+                break;
 
-    if (mmin)
-        printf(mhour ? "%02dm:" : "%dm:", mmin);
+            for (size_t ifile : schedule)
+            {
+                PipelineFile *file = files[ifile];
+                const ProcessingOptions &options = file->m_job.m_options;
+                size_t bytes = estimate_file_memory(headers[ifile], options);
+                if (can_stream(options) &&
+                    (options.m_shards > 1 || !budget.Fits(bytes) || wants_checkpoint(headers[ifile], options)))
+                {
+                    // Streaming only keeps the table (and one segment).
+                    file->m_reserved = budget.Acquire(static_cast<size_t>(estimate_table_memory(headers[ifile])));
+                    std::unique_ptr<FileData> data(new FileData);
+                    data->m_file = file;
+                    data->m_stream = true;
+                    read_queue.Push(std::move(data));
+                    pool.Add(process_next);
+                    continue;
+                }
+
+                file->m_reserved = budget.Acquire(bytes);
+                read_queue.Push(read_wav_file(file->m_job.m_filename, file));
+                pool.Add(process_next);
+            }
+        }
+    }
+    catch(...)
+    {
+        std::lock_guard<std::mutex> lock(print_mutex);
+        printf("ERROR: Unexpected exception finding the WAV files!\n");
+        ++error_count;
+    }
 
-    printf((mhour || mmin) ? "%05.2fds" : "%.2fs", seconds);
+    pool.Finish();
+    writer.Finish();
+    return error_count;
 }
 
-// Writes the waveform's audio segments to individual WAV files.
-// The filename passed here is used as a template for creating
-// the segment WAV files, by inserting "_seg" and a number at
-// the end of the filename.  So, for example, the first two
-// segments from "myfile.wav" would be written to files named
-// "myfile_seg1.wav" and "myfile_seg2.wav" in the current working
-// directory.
-// Returns true if successful.
-static bool write_audio_segments_to_wav_files(
-    const Waveform &wav,
-    const wchar_t *filename,
-    const std::vector<Segment> &segments)
+// Reads one of the options that control how each WAV file gets
+// processed (such as "--level=-3") into 'options'.  If the option's
+// value is out of range, an error is printed and 'valid' is set to
+// false.
+// Returns false if it isn't one of those options.
+static bool parse_file_option(const wchar_t *arg, ProcessingOptions &options, bool &valid)
 {
-    if (wav.m_data.empty() || segments.empty())
+    const wchar_t *level_option = L"--level=";
+    const size_t level_option_len = wcslen(level_option);
+    const wchar_t *loudness_option = L"--loudness=";
+    const size_t loudness_option_len = wcslen(loudness_option);
+    const wchar_t *rate_option = L"--rate=";
+    const size_t rate_option_len = wcslen(rate_option);
+    const wchar_t *channel_option = L"--channel=";
+    const size_t channel_option_len = wcslen(channel_option);
+    const wchar_t *mix_option = L"--mix=";
+    const size_t mix_option_len = wcslen(mix_option);
+    const wchar_t *shards_option = L"--shards=";
+    const size_t shards_option_len = wcslen(shards_option);
+
+    valid = true;
+    if (wcsncmp(arg, level_option, level_option_len) == 0)
     {
-        printf("ERROR: No audio data to output.\n");
-        return false;
+        options.m_db_level = static_cast<float>(_wtof(&arg[level_option_len]));
+        if (options.m_db_level > 0.0f || options.m_db_level < -100.0f)
+        {
+            print("ERROR: Level value %S out of range (expected value -100 to 0).\n", arg);
+            valid = false;
+        }
     }
-    if (!filename || !*filename)
+    else if (wcsncmp(arg, loudness_option, loudness_option_len) == 0)
+    {
+        options.m_target_lufs = static_cast<float>(_wtof(&arg[loudness_option_len]));
+        if (options.m_target_lufs > 0.0f || options.m_target_lufs < -70.0f)
+        {
+            print("ERROR: Loudness value %S out of range (expected value -70 to 0).\n", arg);
+            valid = false;
+        }
+        options.m_use_loudness = true;
+    }
+    else if (wcsncmp(arg, rate_option, rate_option_len) == 0)
+    {
+        int rate = _wtoi(&arg[rate_option_len]);
+        if (rate < 1000 || rate > 192000)
+        {
+            print("ERROR: Rate value %S out of range (expected value 1000 to 192000).\n", arg);
+            valid = false;
+        }
+        options.m_out_frequency = static_cast<unsigned>(rate);
+    }
+    else if (wcsncmp(arg, channel_option, channel_option_len) == 0)
+    {
+        int channel = _wtoi(&arg[channel_option_len]);
+        if (channel < 1 || channel > 8)
+        {
+            print("ERROR: Channel value %S out of range (expected value 1 to 8).\n", arg);
+            valid = false;
+        }
+        options.m_channel = static_cast<unsigned>(channel);
+        options.m_mix_weights.clear();
+    }
+    else if (wcsncmp(arg, mix_option, mix_option_len) == 0)
+    {
+        // Parse the comma-separated list of gains.
+        options.m_mix_weights.clear();
+        options.m_channel = 0;
+        const wchar_t *weight = &arg[mix_option_len];
+        while (*weight)
+        {
+            options.m_mix_weights.push_back(static_cast<float>(_wtof(weight)));
+            weight = wcschr(weight, ',');
+            if (!weight)
+                break;
+            weight++;
+        }
+        if (options.m_mix_weights.empty() || options.m_mix_weights.size() > 8)
+        {
+            print("ERROR: Mix value %S should have 1 to 8 gains.\n", arg);
+            valid = false;
+        }
+    }
+    else if (wcsncmp(arg, shards_option, shards_option_len) == 0)
+    {
+        int shards = _wtoi(&arg[shards_option_len]);
+        if (shards < 1 || shards > 1024)
+        {
+            print("ERROR: Shards value %S out of range (expected value 1 to 1024).\n", arg);
+            valid = false;
+        }
+        options.m_shards = static_cast<unsigned>(shards);
+    }
+    else if (wcscmp(arg, L"--truepeak") == 0)
+    {
+        options.m_limit_true_peak = true;
+    }
+    else if (wcscmp(arg, L"--split-channels") == 0)
+    {
+        options.m_split_channels = true;
+    }
+    else if (wcscmp(arg, L"--analyze") == 0)
+    {
+        options.m_analyze_only = true;
+    }
+    else if (wcscmp(arg, L"--storage=float") == 0)
+    {
+        options.m_storage = SampleStorage::Float;
+    }
+    else if (wcscmp(arg, L"--storage=int16") == 0)
+    {
+        options.m_storage = SampleStorage::Int16;
+    }
+    else if (wcscmp(arg, L"--storage=half") == 0)
+    {
+        options.m_storage = SampleStorage::Half;
+    }
+    else
     {
-        printf("ERROR: Missing filename.\n");
         return false;
     }
 
-    // Extract the basename portion of the filename.
-    wchar_t basename[MAX_PATH] = {0};
-    const wchar_t *base_start = wcsrchr(filename, '\\');
-    if (!base_start)
-        base_start = filename;
-    else
-        base_start++;
-    const wchar_t *base_end = wcsrchr(filename, '.');
-    if (!base_end)
-        base_end = filename + wcslen(filename);
-    wcsncpy_s(basename, MAX_PATH, base_start, base_end - base_start);
+    return true;
+}
 
-    // Write the processed audio to new WAV file(s).
-    unsigned seg_num = 0;
-    for (const Segment &segment : segments)
+// Checks that the options for a WAV file (or --concat recording)
+// can be used together.  If they can't, an error is printed.
+// Returns false if they can't.
+static bool check_file_options(const ProcessingOptions &options)
+{
+    // Each shard is streamed, and the streamed path limits the true
+    // peak of each segment separately, so the audio wouldn't be the
+    // same as with one piece.
+    if (options.m_shards > 1 && options.m_limit_true_peak)
     {
-        wchar_t new_filename[MAX_PATH] = {0};
-        _snwprintf_s(
-            new_filename, MAX_PATH, L"%s_seg%u.wav", basename, ++seg_num);
+        print("ERROR: The --shards option can't be used with --truepeak.\n");
+        return false;
+    }
+
+    return true;
+}
+
+// Where some of the WAV files to process come from.
+enum class InputKind
+{
+    File,       // One WAV file.
+    Manifest,   // A manifest that lists WAV files (see ManifestReader).
+    Directory,  // A directory to find WAV files in (with --recursive).
+};
+
+// A WAV file, manifest or directory from the command line, with
+// the options that were in effect for it.
+struct Input
+{
+    InputKind m_kind = InputKind::File; // What it is.
+    std::wstring m_path;                // Name of the file or directory.
+    ProcessingOptions m_options;        // Options given before it.
+};
+
+// Goes through the inputs from the command line in order, giving
+// the WAV files one at a time.  The manifests are read and the
+// directories are walked as the files are needed, so there can be
+// any number of them.  The files from manifests and directories
+// are always processed one by one, even with --concat.
+class InputFiles
+{
+public:
+    explicit InputFiles(std::vector<Input> inputs) : m_inputs(std::move(inputs)) {}
+
+    InputFiles(const InputFiles &) = delete;
+    InputFiles &operator=(const InputFiles &) = delete;
 
-        printf("Writing '%S' starting at %zu for %zu samples\n", new_filename, segment.m_start, segment.m_count);
+    // Gets the next WAV file, with the options for it.  For each
+    // line of a manifest that can't be used, and each manifest or
+    // directory that can't be read, an error is printed and added
+    // to 'error_count'.
+    // Returns false if there are no more files.
+    bool Next(FileJob &file, unsigned &error_count);
+
+private:
+    // Makes a file from a line of a manifest, applying the line's
+    // options on top of the manifest's.
+    // Returns false (after printing why) if the line can't be used.
+    bool use_manifest_entry(const ManifestEntry &entry, const Input &manifest, FileJob &file);
+
+    std::vector<Input> m_inputs;                // The inputs, in command line order.
+    size_t m_next = 0;                          // Which input the next file comes from.
+    ManifestReader m_manifest;                  // Reader for the current manifest.
+    bool m_manifest_open = false;               // Has the current manifest been opened?
+    std::unique_ptr<DirectoryWalker> m_walker;  // Walker for the current directory.
+};
+
+bool InputFiles::use_manifest_entry(const ManifestEntry &entry, const Input &manifest, FileJob &file)
+{
+    if (!entry.m_error.empty())
+    {
+        print("ERROR: Couldn't read line %u of manifest '%S' (%s).\n", entry.m_line, manifest.m_path.c_str(),
+            entry.m_error.c_str());
+        return false;
+    }
 
-        if (!wav.WriteToWAVFile(new_filename, static_cast<unsigned>(segment.m_start), static_cast<unsigned>(segment.m_count)))
+    file = FileJob();
+    file.m_filename = entry.m_filename;
+    file.m_options = manifest.m_options;
+    for (const std::wstring &option : entry.m_options)
+    {
+        bool valid = true;
+        if (!parse_file_option(option.c_str(), file.m_options, valid))
         {
-            printf("ERROR: Attempted write of '%S' was not successful.\n", new_filename);
+            print("ERROR: Unrecognized option %S in line %u of manifest '%S'\n", option.c_str(), entry.m_line,
+                manifest.m_path.c_str());
+            return false;
+        }
+        if (!valid)
+        {
+            print("       (in line %u of manifest '%S')\n", entry.m_line, manifest.m_path.c_str());
             return false;
         }
     }
-
+    if (!check_file_options(file.m_options))
+    {
+        print("       (in line %u of manifest '%S')\n", entry.m_line, manifest.m_path.c_str());
+        return false;
+    }
     return true;
 }
 
-// Performs audio processing tasks on the given WAV file.
-// Returns true if successful.
-static bool process_wav_file(wchar_t *filename, float db_level)
+bool InputFiles::Next(FileJob &file, unsigned &error_count)
 {
-    // Load PCM audio from the WAV file.
-    Waveform wav;
-    if (!wav.LoadFromWAVFile(filename))
+    while (m_next < m_inputs.size())
     {
-        printf("ERROR: Attempted load of '%S' was not successful.\n", filename);
-        return false;
+        const Input &input = m_inputs[m_next];
+        if (input.m_kind == InputKind::File)
+        {
+            file = FileJob();
+            file.m_filename = input.m_path;
+            file.m_options = input.m_options;
+            m_next++;
+            return true;
+        }
+
+        if (input.m_kind == InputKind::Manifest)
+        {
+            if (!m_manifest_open)
+            {
+                m_manifest_open = m_manifest.Open(input.m_path.c_str());
+                if (!m_manifest_open)
+                {
+                    print("ERROR: Attempted read of manifest '%S' was not successful.\n", input.m_path.c_str());
+                    ++error_count;
+                    m_next++;
+                    continue;
+                }
+            }
+
+            ManifestEntry entry;
+            while (m_manifest.Next(entry))
+            {
+                if (use_manifest_entry(entry, input, file))
+                    return true;
+                ++error_count;
+            }
+            m_manifest.Close();
+            m_manifest_open = false;
+            m_next++;
+            continue;
+        }
+
+        if (!m_walker)
+            m_walker.reset(new DirectoryWalker(input.m_path));
+        std::wstring filename;
+        if (m_walker->Next(filename))
+        {
+            file = FileJob();
+            file.m_filename = filename;
+            file.m_options = input.m_options;
+            return true;
+        }
+        for (const std::wstring &directory : m_walker->UnreadableDirectories())
+        {
+            print("ERROR: Attempted read of directory '%S' was not successful.\n", directory.c_str());
+            ++error_count;
+        }
+        m_walker.reset();
+        m_next++;
     }
 
-    // Print info about the WAV file.
-    printf("File %S:\n", filename);
-    printf("  Sample rate:  %.2f KHz\n", wav.m_frequency / 1000.0);
-    printf("  Duration:     ");
-    print_duration(wav.m_data.size() / static_cast<float>(wav.m_frequency));
-    printf("\n");
+    return false;
+}
 
-    // Segment the audio.
-    auto segments = FindSegmentsInAudioWaveform(wav);
-    if (segments.empty())
+// Number of WAV files in each batch that process_wav_files
+// schedules together.
+static const size_t k_files_per_batch = 500;
+
+// Gets the next batch of WAV files from the inputs.  The batch is
+// empty if there are no more files.
+static FileBatch read_batch(InputFiles &inputs)
+{
+    FileBatch batch;
+    OutputCapture capture(&batch.m_output);
+    FileJob file;
+    while (batch.m_files.size() < k_files_per_batch && inputs.Next(file, batch.m_error_count))
+        batch.m_files.push_back(std::move(file));
+    return batch;
+}
+
+// Which share of the WAV files this machine processes, when a big
+// batch is split between several machines (see --shard).  Every
+// machine runs the same command line, and each one works out the
+// same shares by itself, so they don't have to talk to each other.
+struct NodeShard
+{
+    unsigned m_index = 0;           // The share this machine processes (0=first).
+    unsigned m_count = 1;           // Number of shares.
+    bool m_balance = false;         // Balance the shares by duration?
+    std::vector<double> m_loads;    // Duration (seconds) given to each share so far.
+};
+
+// Returns true if the WAV file (or --concat or --multitrack
+// recording) with the given name is in this machine's share, going
+// by a hash of its name.
+static bool in_node_shard(const std::wstring &filename, const NodeShard &shard)
+{
+    return PathHash(filename) % shard.m_count == shard.m_index;
+}
+
+// Removes the files that are in other machines' shares from a
+// batch.  Each file goes to a share picked by a hash of its name,
+// or, when balancing, the files are given out longest first (from
+// their headers) to the share with the least audio so far.
+//
+// Balancing only gives every machine the same shares if every
+// machine reads the same headers, since each file's duration adds
+// to the share it's given, and that changes where the files after
+// it go.  A file whose header can't be read is left out of the
+// balancing altogether, and goes by its name instead, so it never
+// counts towards a share; a warning is printed for it, since if it
+// can be read on another machine, the machines' shares won't
+// agree from then on.
+static void take_node_shard(std::vector<FileJob> &files, NodeShard &shard, unsigned num_threads)
+{
+    if (shard.m_count < 2)
+        return;
+
+    std::vector<unsigned> shards(files.size(), 0);
+    if (shard.m_balance)
     {
-        printf("ERROR: Failed segmenting '%S'.  Is the entire waveform silent?\n", filename);
-        return false;
+        const std::vector<WAVInfo> headers = probe_wav_files(files, num_threads);
+        std::vector<size_t> balanced;
+        std::vector<double> durations;
+        for (size_t ifile = 0; ifile < files.size(); ifile++)
+        {
+            if (headers[ifile].m_rate)
+            {
+                balanced.push_back(ifile);
+                durations.push_back(static_cast<double>(headers[ifile].m_sample_count) / headers[ifile].m_rate);
+            }
+            else
+            {
+                print("WARNING: Couldn't read the header of '%S' to balance it, so it's shared out by its name.\n",
+                    files[ifile].m_filename.c_str());
+                shards[ifile] = static_cast<unsigned>(PathHash(files[ifile].m_filename) % shard.m_count);
+            }
+        }
+        if (shard.m_loads.empty())
+            shard.m_loads.resize(shard.m_count, 0.0);
+        const std::vector<unsigned> balanced_shards = BalanceShards(durations, shard.m_loads);
+        for (size_t ibalanced = 0; ibalanced < balanced.size(); ibalanced++)
+            shards[balanced[ibalanced]] = balanced_shards[ibalanced];
+    }
+    else
+    {
+        for (size_t ifile = 0; ifile < files.size(); ifile++)
+            shards[ifile] = static_cast<unsigned>(PathHash(files[ifile].m_filename) % shard.m_count);
     }
 
-    // Print info about the audio segments to the console.
-    int seg_num = 0;
-    for (const Segment &segment : segments)
+    std::vector<FileJob> kept;
+    for (size_t ifile = 0; ifile < files.size(); ifile++)
+    {
+        if (shards[ifile] == shard.m_index)
+            kept.push_back(std::move(files[ifile]));
+    }
+    files.swap(kept);
+}
+
+// Removes the files from a batch that would write the same segment
+// files as a file before them (such as "a\take1.wav" and
+// "b\take1.wav"), printing an error for each, so one file's
+// segments aren't written over another's.
+// Returns the number of files that were removed.
+static unsigned skip_clashing_files(std::vector<FileJob> &files, OutputNames &names)
+{
+    unsigned skipped = 0;
+    std::vector<FileJob> kept;
+    for (FileJob &file : files)
     {
-        printf("Segment %d:\n", ++seg_num);
-        printf("  Starts at sample %zu, runs for %zu samples\n", segment.m_start, segment.m_count);
-        printf("  Start time:  ");
-        print_duration(segment.m_start / static_cast<float>(wav.m_frequency));
-        printf("\n");
-        printf("  Length:      ");
-        print_duration(segment.m_count / static_cast<float>(wav.m_frequency));
-        printf("\n");
-        printf("  End time:    ");
-        print_duration((segment.m_start + segment.m_count) / static_cast<float>(wav.m_frequency));
-        printf("\n");
+        std::wstring earlier;
+        if (names.Add(file.m_filename, earlier))
+        {
+            kept.push_back(std::move(file));
+            continue;
+        }
+        print("ERROR: '%S' would write the same segment files as '%S', so it was skipped.\n",
+            file.m_filename.c_str(), earlier.c_str());
+        ++skipped;
     }
+    files.swap(kept);
+    return skipped;
+}
 
-    // Normalize the audio to a uniform level.
-    NormalizeAudioWaveform(wav, db_level);
+// Removes the files that the journal says are already done from a
+// batch, and gets the size and time of the rest, for their journal
+// records, along with the segment files that the journal says they
+// had before (see remove_old_outputs).
+static void skip_journaled_files(std::vector<FileJob> &files, const Journal &journal)
+{
+    std::vector<FileJob> remaining;
+    size_t skipped = 0;
+    for (FileJob &file : files)
+    {
+        JournalRecord record;
+        record.m_filename = file.m_filename;
+        record.m_options = describe_options(file.m_options);
+        file.m_stamped = GetFileStamp(file.m_filename.c_str(), file.m_size, file.m_mtime);
+        record.m_size = file.m_size;
+        record.m_mtime = file.m_mtime;
+        if (file.m_stamped && journal.IsDone(record))
+        {
+            skipped++;
+            continue;
+        }
 
-    // Save the processed audio segments.
-    return write_audio_segments_to_wav_files(wav, filename, segments);
+        JournalRecord old_record;
+        if (journal.Find(file.m_filename, old_record))
+        {
+            if (file.m_stamped && old_record.m_size == record.m_size && old_record.m_mtime == record.m_mtime &&
+                old_record.m_options == record.m_options)
+            {
+                print("Processing '%S' again, since some of its segment files were changed or removed.\n",
+                    file.m_filename.c_str());
+            }
+            file.m_old_outputs.swap(old_record.m_outputs);
+        }
+        remaining.push_back(std::move(file));
+    }
+    files.swap(remaining);
+
+    if (skipped)
+        print("Skipped %zu file(s) that the journal says are already done.\n", skipped);
 }
 
 // The entry point is wmain instead of main so we get Unicode
@@ -217,46 +2467,442 @@ int wmain(int argc, wchar_t **argv)
     if (argc < 2)
     {
         printf(
-            "Usage:  splitspeech [--level=X] file1.wav [file2.wav ...]\n"
+            "Usage:  splitspeech [options] file1.wav [file2.wav ...]\n"
             "\n"
             "Options:\n"
-            "  --level=X  Normalize audio waveforms to X decibels,\n"
-            "             where X is between -100 and 0 inclusive.\n"
-            "             The default is -1.0 dB.\n"
+            "  --level=X     Normalize audio waveforms to X decibels,\n"
+            "                where X is between -100 and 0 inclusive.\n"
+            "                The default is -1.0 dB.\n"
+            "  --loudness=X  Normalize each segment to an integrated\n"
+            "                loudness of X LUFS, where X is between\n"
+            "                -70 and 0 inclusive (e.g. -23 for EBU R128).\n"
+            "                This replaces the --level normalization.\n"
+            "  --truepeak    Limit the true (inter-sample) peak level\n"
+            "                of the normalized audio to the --level value.\n"
+            "  --analyze     Only print the segments; don't normalize\n"
+            "                or write them.  Uses less memory.\n"
+            "  --storage=X   Store the audio in memory as X, which is\n"
+            "                float (the default), int16 or half.  int16\n"
+            "                and half use half as much memory as float.\n"
+            "  --rate=N      Write the segments at a sample rate of N Hz,\n"
+            "                where N is between 1000 and 192000.\n"
+            "  --channel=N   Use only channel N of the audio (1=left,\n"
+            "                2=right) instead of mixing the channels.\n"
+            "  --mix=A,B,... Mix the channels to mono with gain A for\n"
+            "                the first channel, B for the second, etc.\n"
+            "  --split-channels\n"
+            "                Segment each channel separately, in\n"
+            "                parallel, writing files named like\n"
+            "                file_ch1_seg1.wav.\n"
+            "  --concat      Treat the WAV files as consecutive parts of\n"
+            "                one recording (e.g. rec_001.wav rec_002.wav),\n"
+            "                so segments can cross from one file to the\n"
+            "                next.  The segments are named after the\n"
+            "                first file.  Can't be used with --channel,\n"
+            "                --mix or --split-channels.\n"
+            "  --multitrack  Treat the WAV files as sample-aligned tracks\n"
+            "                of one recording (e.g. one per microphone),\n"
+            "                and segment them together, so each track\n"
+            "                gets the same segments.\n"
+            "  --jobs=N      Use N threads to process the WAV files, and\n"
+            "                the segments within them.  The default is\n"
+            "                the number of CPUs this process is allowed\n"
+            "                to use.\n"
+            "  --order=X     Process the WAV files in the order X, which\n"
+            "                is lpt (longest first, the default; the\n"
+            "                batch finishes soonest), spt (shortest\n"
+            "                first) or input (command line order).  The\n"
+            "                output is printed in command line order\n"
+            "                either way.\n"
+            "  --memory-budget=N\n"
+            "                Limit the memory used by the WAV files\n"
+            "                being processed at once to about N\n"
+            "                megabytes (or N gigabytes with a G suffix,\n"
+            "                e.g. 4G).  A file too big for the whole\n"
+            "                budget is read a piece at a time instead.\n"
+            "  --shards=N    Cut each WAV file (or --concat recording)\n"
+            "                into N pieces of time, and analyze them and\n"
+            "                write their segments in parallel.  The\n"
+            "                segments are the same as with one piece.\n"
+            "                Can't be used with --truepeak.\n"
+            "  --manifest=FILE\n"
+            "                Process the WAV files listed in FILE, one\n"
+            "                per line.  A line can also be a JSON object\n"
+            "                with the file's \"path\" and options for it,\n"
+            "                e.g. {\"path\": \"a.wav\", \"level\": -3}.\n"
+            "  --recursive   Process all of the WAV files in each\n"
+            "                directory given after this, and in the\n"
+            "                directories under it.\n"
+            "  --shard=I/N   Split the WAV files into N shares by a hash\n"
+            "                of their names, and process only share I\n"
+            "                (0 to N-1).  Run the same command line with\n"
+            "                each I on N machines to split a batch\n"
+            "                between them.\n"
+            "  --balance-shards\n"
+            "                Split the --shard shares so each gets about\n"
+            "                the same amount of audio, from the WAV\n"
+            "                file headers, instead of by name.\n"
+            "  --journal=FILE\n"
+            "                Record each WAV file in FILE once its\n"
+            "                segments are written, and skip the files\n"
+            "                that FILE says are done (with the same\n"
+            "                size, time and options, and the segment\n"
+            "                files it lists unchanged), so a batch that\n"
+            "                was interrupted can be run again to finish.\n"
+            "                Long files are checkpointed next to FILE\n"
+            "                unless --checkpoint is given.\n"
+            "  --checkpoint=FILE\n"
+            "                Keep a checkpoint of each recording that's\n"
+            "                over a minute long in a file whose name\n"
+            "                starts with FILE, after each minute of\n"
+            "                audio is analyzed and each segment is\n"
+            "                written, so running it again after it was\n"
+            "                interrupted picks up where it left off.\n"
+            "  --cache=DIR   Keep the segments found in each WAV file in\n"
+            "                the directory DIR, by a hash of its audio\n"
+            "                and the options, and link the segment files\n"
+            "                of a file that's the same as one that was\n"
+            "                done before instead of processing it again.\n"
+            "  --dedup       Hash each segment as it's converted, and\n"
+            "                don't write a segment that's exactly the\n"
+            "                same as one already written in this run.\n"
+            "  --dedup-index=FILE\n"
+            "                Like --dedup, but also keep the hash of each\n"
+            "                segment that's written in FILE, so segments\n"
+            "                written by earlier runs count too.\n"
+            "  --dedup-manifest=FILE\n"
+            "                Like --dedup, and list each segment that\n"
+            "                isn't written in FILE, with the name of the\n"
+            "                file it's the same as.\n"
             );
 
         return EXIT_FAILURE;
     }
 
-    float db_level = -1.0f;
+    ProcessingOptions options;
+    std::vector<std::wstring> parts;
+    std::vector<Input> inputs;
+    bool recursive = false;
+    unsigned num_jobs = 0;
+    JobOrder order = JobOrder::LongestFirst;
+    size_t memory_budget = 0;
+    NodeShard node_shard;
+    const wchar_t *journal_filename = nullptr;
+    const wchar_t *checkpoint_prefix = nullptr;
+    Journal journal;
+    const wchar_t *cache_directory = nullptr;
+    ResultCache cache;
+    bool dedup = false;
+    const wchar_t *dedup_index_filename = nullptr;
+    const wchar_t *dedup_manifest_filename = nullptr;
+    SegmentIndex segment_index;
     unsigned error_count = 0;
     try
     {
-        // Process each WAV file that was given on the command line.
+        // Gather the WAV files (and manifests and directories of
+        // them) that were given on the command line, each with the
+        // options that come before it.
         for (int iarg = 1; iarg < argc; iarg++)
         {
-            const wchar_t *level_option = L"--level=";
-            const size_t level_option_len = wcslen(level_option);
+            const wchar_t *jobs_option = L"--jobs=";
+            const size_t jobs_option_len = wcslen(jobs_option);
+            const wchar_t *memory_option = L"--memory-budget=";
+            const size_t memory_option_len = wcslen(memory_option);
+            const wchar_t *manifest_option = L"--manifest=";
+            const size_t manifest_option_len = wcslen(manifest_option);
+            const wchar_t *shard_option = L"--shard=";
+            const size_t shard_option_len = wcslen(shard_option);
+            const wchar_t *journal_option = L"--journal=";
+            const size_t journal_option_len = wcslen(journal_option);
+            const wchar_t *checkpoint_option = L"--checkpoint=";
+            const size_t checkpoint_option_len = wcslen(checkpoint_option);
+            const wchar_t *cache_option = L"--cache=";
+            const size_t cache_option_len = wcslen(cache_option);
+            const wchar_t *dedup_index_option = L"--dedup-index=";
+            const size_t dedup_index_option_len = wcslen(dedup_index_option);
+            const wchar_t *dedup_manifest_option = L"--dedup-manifest=";
+            const size_t dedup_manifest_option_len = wcslen(dedup_manifest_option);
 
-            if (wcsncmp(argv[iarg], level_option, level_option_len) == 0)
+            bool valid = true;
+            if (parse_file_option(argv[iarg], options, valid))
+            {
+                if (!valid)
+                    return EXIT_FAILURE;
+            }
+            else if (wcsncmp(argv[iarg], jobs_option, jobs_option_len) == 0)
+            {
+                int jobs = _wtoi(&argv[iarg][jobs_option_len]);
+                if (jobs < 1 || jobs > 1024)
+                {
+                    printf("ERROR: Jobs value %S out of range (expected value 1 to 1024).\n", argv[iarg]);
+                    return EXIT_FAILURE;
+                }
+                num_jobs = static_cast<unsigned>(jobs);
+            }
+            else if (wcsncmp(argv[iarg], memory_option, memory_option_len) == 0)
+            {
+                // The size is in megabytes, or gigabytes with a G.
+                const wchar_t *size = &argv[iarg][memory_option_len];
+                double megabytes = _wtof(size);
+                const size_t size_len = wcslen(size);
+                if (size_len && (size[size_len - 1] == 'G' || size[size_len - 1] == 'g'))
+                    megabytes *= 1024.0;
+                if (megabytes < 1.0 || megabytes > 1024.0 * 1024.0)
+                {
+                    printf("ERROR: Memory budget %S out of range (expected value 1 to 1048576 megabytes).\n", argv[iarg]);
+                    return EXIT_FAILURE;
+                }
+                memory_budget = static_cast<size_t>(megabytes * 1024.0 * 1024.0);
+            }
+            else if (wcsncmp(argv[iarg], shard_option, shard_option_len) == 0)
+            {
+                const wchar_t *value = &argv[iarg][shard_option_len];
+                const wchar_t *slash = wcschr(value, L'/');
+                int index = _wtoi(value);
+                int count = slash ? _wtoi(slash + 1) : 0;
+                if (!slash || count < 1 || count > 65536 || index < 0 || index >= count)
+                {
+                    printf("ERROR: Shard %S out of range (expected I/N, with N from 1 to 65536 and I from 0 to N-1).\n", argv[iarg]);
+                    return EXIT_FAILURE;
+                }
+                node_shard.m_index = static_cast<unsigned>(index);
+                node_shard.m_count = static_cast<unsigned>(count);
+            }
+            else if (wcscmp(argv[iarg], L"--balance-shards") == 0)
             {
-                db_level = static_cast<float>(_wtof(&argv[iarg][level_option_len]));
-                if (db_level > 0.0f || db_level < -100.0f)
+                node_shard.m_balance = true;
+            }
+            else if (wcsncmp(argv[iarg], journal_option, journal_option_len) == 0)
+            {
+                journal_filename = &argv[iarg][journal_option_len];
+            }
+            else if (wcsncmp(argv[iarg], checkpoint_option, checkpoint_option_len) == 0)
+            {
+                checkpoint_prefix = &argv[iarg][checkpoint_option_len];
+                if (!*checkpoint_prefix)
                 {
-                    printf("ERROR: Level value %S out of range (expected value -100 to 0).\n", argv[iarg]);
+                    printf("ERROR: The --checkpoint option needs the start of the checkpoint files' names.\n");
                     return EXIT_FAILURE;
                 }
             }
+            else if (wcsncmp(argv[iarg], cache_option, cache_option_len) == 0)
+            {
+                cache_directory = &argv[iarg][cache_option_len];
+            }
+            else if (wcscmp(argv[iarg], L"--dedup") == 0)
+            {
+                dedup = true;
+            }
+            else if (wcsncmp(argv[iarg], dedup_index_option, dedup_index_option_len) == 0)
+            {
+                dedup = true;
+                dedup_index_filename = &argv[iarg][dedup_index_option_len];
+            }
+            else if (wcsncmp(argv[iarg], dedup_manifest_option, dedup_manifest_option_len) == 0)
+            {
+                dedup = true;
+                dedup_manifest_filename = &argv[iarg][dedup_manifest_option_len];
+            }
+            else if (wcsncmp(argv[iarg], manifest_option, manifest_option_len) == 0)
+            {
+                if (!check_file_options(options))
+                    return EXIT_FAILURE;
+                Input input;
+                input.m_kind = InputKind::Manifest;
+                input.m_path = &argv[iarg][manifest_option_len];
+                input.m_options = options;
+                inputs.push_back(input);
+            }
+            else if (wcscmp(argv[iarg], L"--recursive") == 0)
+            {
+                recursive = true;
+            }
+            else if (wcscmp(argv[iarg], L"--concat") == 0)
+            {
+                options.m_concat = true;
+                options.m_multitrack = false;
+            }
+            else if (wcscmp(argv[iarg], L"--multitrack") == 0)
+            {
+                options.m_multitrack = true;
+                options.m_concat = false;
+            }
+            else if (wcscmp(argv[iarg], L"--order=lpt") == 0)
+            {
+                order = JobOrder::LongestFirst;
+            }
+            else if (wcscmp(argv[iarg], L"--order=spt") == 0)
+            {
+                order = JobOrder::ShortestFirst;
+            }
+            else if (wcscmp(argv[iarg], L"--order=input") == 0)
+            {
+                order = JobOrder::Input;
+            }
             else if (wcsncmp(argv[iarg], L"--", 2) == 0)
             {
                 printf("ERROR: Unrecognized option switch: %S\n", argv[iarg]);
                 return EXIT_FAILURE;
             }
-            else if (!process_wav_file(argv[iarg], db_level))
+            else if (recursive && IsDirectory(argv[iarg]))
+            {
+                if (!check_file_options(options))
+                    return EXIT_FAILURE;
+                Input input;
+                input.m_kind = InputKind::Directory;
+                input.m_path = argv[iarg];
+                input.m_options = options;
+                inputs.push_back(input);
+            }
+            else if (options.m_concat || options.m_multitrack)
+            {
+                // The parts or tracks are processed together once
+                // we have all of them.
+                parts.push_back(argv[iarg]);
+            }
+            else
+            {
+                if (!check_file_options(options))
+                    return EXIT_FAILURE;
+                Input input;
+                input.m_path = argv[iarg];
+                input.m_options = options;
+                inputs.push_back(input);
+            }
+        }
+
+        // The parts (or tracks) of a recording all use the options
+        // that are in effect at the end.
+        if (!parts.empty() && !check_file_options(options))
+            return EXIT_FAILURE;
+
+        // A --concat recording is streamed, which mixes all of the
+        // channels to mono.
+        if (!parts.empty() && options.m_concat && !can_stream(options))
+        {
+            printf("ERROR: The --concat option can't be used with --channel, --mix or --split-channels.\n");
+            return EXIT_FAILURE;
+        }
+
+        // Process the WAV files in parallel, in one pipeline that's
+        // fed a batch at a time.  While each batch is processed, the
+        // files for the next one are found.
+        if (!num_jobs)
+            num_jobs = AvailableCPUCount();
+        // Without --checkpoint, the checkpoints go next to the journal.
+        if (journal_filename && !checkpoint_prefix)
+            checkpoint_prefix = journal_filename;
+        if (journal_filename && !journal.Open(journal_filename))
+        {
+            printf("ERROR: Attempted open of journal '%S' was not successful.\n", journal_filename);
+            return EXIT_FAILURE;
+        }
+        if (cache_directory && !cache.Open(cache_directory))
+        {
+            printf("ERROR: Attempted open of cache '%S' was not successful.\n", cache_directory);
+            return EXIT_FAILURE;
+        }
+        if (dedup_index_filename && !segment_index.OpenIndex(dedup_index_filename))
+        {
+            printf("ERROR: Attempted open of segment index '%S' was not successful.\n", dedup_index_filename);
+            return EXIT_FAILURE;
+        }
+        if (dedup_manifest_filename && !segment_index.OpenManifest(dedup_manifest_filename))
+        {
+            printf("ERROR: Attempted open of duplicate manifest '%S' was not successful.\n", dedup_manifest_filename);
+            return EXIT_FAILURE;
+        }
+        // A --concat recording is named after its first file, and a
+        // --multitrack recording after each track.  Their segment
+        // files are claimed first, so a file in the batch that would
+        // write over them is skipped.
+        OutputNames output_names;
+        if (!parts.empty() && !in_node_shard(parts[0], node_shard))
+            parts.clear();
+        for (size_t ipart = 0; ipart < parts.size() && (ipart == 0 || options.m_multitrack); ipart++)
+        {
+            std::wstring earlier;
+            if (!output_names.Add(parts[ipart], earlier))
             {
-                printf("ERROR: One or more error(s) processing %S\n", argv[iarg]);
+                printf("ERROR: '%S' would write the same segment files as '%S', so the recording was skipped.\n",
+                    parts[ipart].c_str(), earlier.c_str());
                 ++error_count;
+                parts.clear();
+            }
+        }
+
+        InputFiles input_files(std::move(inputs));
+        std::future<FileBatch> found = std::async(std::launch::async, read_batch, std::ref(input_files));
+        auto next_batch = [&]()
+        {
+            // Skip over the batches whose files all go to other
+            // machines or are already done, so only the last batch
+            // is empty.
+            FileBatch batch;
+            while (batch.m_files.empty())
+            {
+                FileBatch next = found.get();
+                batch.m_output += next.m_output;
+                batch.m_error_count += next.m_error_count;
+                if (next.m_files.empty())
+                    break;
+
+                found = std::async(std::launch::async, read_batch, std::ref(input_files));
+                batch.m_files = std::move(next.m_files);
+                OutputCapture capture(&batch.m_output);
+                take_node_shard(batch.m_files, node_shard, num_jobs);
+                batch.m_error_count += skip_clashing_files(batch.m_files, output_names);
+                if (journal.IsOpen())
+                    skip_journaled_files(batch.m_files, journal);
+                if (checkpoint_prefix)
+                {
+                    for (FileJob &file : batch.m_files)
+                        file.m_options.m_checkpoint_prefix = checkpoint_prefix;
+                }
+                if (dedup)
+                {
+                    for (FileJob &file : batch.m_files)
+                        file.m_options.m_segment_index = &segment_index;
+                }
             }
+            return batch;
+        };
+        error_count += process_wav_files(next_batch, num_jobs, order, memory_budget,
+            journal.IsOpen() ? &journal : nullptr, cache.IsOpen() ? &cache : nullptr);
+
+        // A --concat recording's shards run on the pool too.  The
+        // recording is one of the files split between machines.
+        bool parts_ok = true;
+        if (checkpoint_prefix)
+            options.m_checkpoint_prefix = checkpoint_prefix;
+        if (dedup)
+            options.m_segment_index = &segment_index;
+        if (!parts.empty())
+        {
+            RunJobs(1, num_jobs, [&](size_t)
+            {
+                try
+                {
+                    parts_ok = process_timeline(parts, options);
+                }
+                catch(...)
+                {
+                    printf("ERROR: Unexpected exception processing %S!\n", parts[0].c_str());
+                    parts_ok = false;
+                }
+            });
+        }
+        if (!parts_ok)
+        {
+            printf("ERROR: One or more error(s) processing %S and the files after it\n", parts[0].c_str());
+            ++error_count;
+        }
+
+        segment_index.Close();
+        if (segment_index.HadError())
+        {
+            printf("ERROR: Attempted write of the segment index or duplicate manifest was not successful.\n");
+            ++error_count;
         }
     }
     catch(...)
@@ -0,0 +1,210 @@
+//-------------------------------------------------------------------
+//
+// timeline.cpp
+//
+// C++ module for treating a recording that is split across several
+// WAV files (such as the part files written by a field recorder) as
+// one continuous timeline of audio.
+//
+//-------------------------------------------------------------------
+//
+// (C) Copyright 2024 Ammon R. Campbell.
+//
+// I wrote this code for use in my own educational and experimental
+// programs, but you may also freely use it in yours as long as you
+// abide by the following terms and conditions:
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following
+//     disclaimer in the documentation and/or other materials
+//     provided with the distribution.
+//   * The name(s) of the author(s) and contributors (if any) may not
+//     be used to endorse or promote products derived from this
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+// CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+// OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.  IN OTHER WORDS, USE AT YOUR OWN RISK, NOT OURS.  
+//--------------------------------------------------------------------
+
+#include "timeline.h"
+#include "analysis.h"
+#include "loudness.h"
+#include <algorithm>
+#include <future>
+
+// Number of analysis frames in each block of audio that Analyze
+// reads at a time (10 seconds).
+static const size_t k_frames_per_block = 1000;
+
+bool WAVTimeline::Open(const std::vector<std::wstring> &filenames)
+{
+    m_parts.clear();
+    m_reader.Close();
+    m_reader_open = false;
+
+    size_t position = 0;
+    for (const std::wstring &filename : filenames)
+    {
+        TimelinePart part;
+        part.m_filename = filename;
+        part.m_start = position;
+        if (!WAVFileReadHeader(filename.c_str(), part.m_header))
+            return false;
+
+        // The files have to match, or they can't be one recording.
+        if (!m_parts.empty())
+        {
+            const WAVInfo &first = m_parts[0].m_header;
+            if (part.m_header.m_rate != first.m_rate ||
+                part.m_header.m_channels != first.m_channels ||
+                part.m_header.m_bits != first.m_bits ||
+                part.m_header.m_is_float != first.m_is_float)
+                return false;
+        }
+
+        position += part.m_header.m_sample_count;
+        m_parts.push_back(part);
+    }
+
+    return !m_parts.empty();
+}
+
+size_t WAVTimeline::SampleCount() const
+{
+    if (m_parts.empty())
+        return 0;
+
+    return m_parts.back().m_start + m_parts.back().m_header.m_sample_count;
+}
+
+bool WAVTimeline::Locate(size_t position, size_t &part, size_t &sample) const
+{
+    if (position >= SampleCount())
+        return false;
+
+    // Find the last file that starts at or before the position.
+    auto found = std::upper_bound(m_parts.begin(), m_parts.end(), position,
+        [](size_t pos, const TimelinePart &p) { return pos < p.m_start; });
+    part = static_cast<size_t>(found - m_parts.begin()) - 1;
+    sample = position - m_parts[part].m_start;
+    return true;
+}
+
+template <typename SampleT>
+bool WAVTimeline::Read(size_t start_sample, size_t num_samples, BasicWaveform<SampleT> &out)
+{
+    out.m_frequency = Frequency();
+    out.m_data.clear();
+    out.m_data.reserve(num_samples);
+
+    std::vector<char> raw;
+    while (num_samples)
+    {
+        size_t part = 0, sample = 0;
+        if (!Locate(start_sample, part, sample))
+            return false;
+
+        // Keep the current file open, since the reads are usually
+        // sequential.
+        if (!m_reader_open || m_reader_part != part)
+        {
+            m_reader_open = m_reader.Open(m_parts[part].m_filename.c_str());
+            m_reader_part = part;
+            if (!m_reader_open)
+                return false;
+        }
+
+        const WAVInfo &header = m_reader.Header();
+        const size_t count = std::min(num_samples, header.m_sample_count - sample);
+        raw.resize(count * header.m_channels * header.m_bits / 8);
+        if (!m_reader.Seek(sample) || !m_reader.Read(raw.data(), count))
+            return false;
+        out.AppendWAVSamples(raw.data(), header, count);
+
+        start_sample += count;
+        num_samples -= count;
+    }
+
+    return true;
+}
+
+size_t WAVTimeline::FramesPerBlock()
+{
+    return k_frames_per_block;
+}
+
+template <typename SampleT>
+bool WAVTimeline::Analyze(AnalysisTable &table, LoudnessMeter *meter)
+{
+    table.Reset(Frequency(), SampleCount());
+    if (meter)
+        meter->Reset(Frequency());
+
+    return AnalyzeRange<SampleT>(0, SampleCount(), table, meter);
+}
+
+template <typename SampleT>
+bool WAVTimeline::AnalyzeRange(size_t first_sample, size_t num_samples, AnalysisTable &table,
+    LoudnessMeter *meter)
+{
+    // The blocks are a whole number of frames long, so each block's
+    // frames go straight into the table.  Only the last block of
+    // the timeline can have a partial frame.
+    const size_t end = first_sample + num_samples;
+    const size_t block_size = table.m_samples_per_frame * k_frames_per_block;
+    auto read_block = [this, end, block_size](size_t first, BasicWaveform<SampleT> *block)
+    {
+        return Read(first, std::min(block_size, end - first), *block);
+    };
+
+    BasicWaveform<SampleT> block, next;
+    std::future<bool> reading;
+    if (num_samples)
+        reading = std::async(std::launch::async, read_block, first_sample, &next);
+    for (size_t first = first_sample; first < end; first += block_size)
+    {
+        if (!reading.get())
+            return false;
+        std::swap(block, next);
+
+        // Start reading the next block while we analyze this one.
+        if (first + block_size < end)
+            reading = std::async(std::launch::async, read_block, first + block_size, &next);
+
+        AnalysisTable block_table;
+        AnalyzeAudioWaveform(block, block_table, meter);
+        std::copy(block_table.m_frames.begin(), block_table.m_frames.end(),
+            table.m_frames.begin() + first / table.m_samples_per_frame);
+        if (block_table.m_remainder_count)
+            table.m_remainder = block_table.m_remainder;
+    }
+
+    return true;
+}
+
+// The sample types that waveforms can be stored as.
+template bool WAVTimeline::Read(size_t, size_t, BasicWaveform<float> &);
+template bool WAVTimeline::Read(size_t, size_t, BasicWaveform<int16_t> &);
+template bool WAVTimeline::Read(size_t, size_t, BasicWaveform<Half> &);
+template bool WAVTimeline::Analyze<float>(AnalysisTable &, LoudnessMeter *);
+template bool WAVTimeline::Analyze<int16_t>(AnalysisTable &, LoudnessMeter *);
+template bool WAVTimeline::Analyze<Half>(AnalysisTable &, LoudnessMeter *);
+template bool WAVTimeline::AnalyzeRange<float>(size_t, size_t, AnalysisTable &, LoudnessMeter *);
+template bool WAVTimeline::AnalyzeRange<int16_t>(size_t, size_t, AnalysisTable &, LoudnessMeter *);
+template bool WAVTimeline::AnalyzeRange<Half>(size_t, size_t, AnalysisTable &, LoudnessMeter *);
@@ -0,0 +1,134 @@
+//-------------------------------------------------------------------
+//
+// timeline.h
+//
+// Header of C++ module for treating a recording that is split
+// across several WAV files (such as the part files written by a
+// field recorder) as one continuous timeline of audio.
+//
+//-------------------------------------------------------------------
+//
+// (C) Copyright 2024 Ammon R. Campbell.
+//
+// I wrote this code for use in my own educational and experimental
+// programs, but you may also freely use it in yours as long as you
+// abide by the following terms and conditions:
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following
+//     disclaimer in the documentation and/or other materials
+//     provided with the distribution.
+//   * The name(s) of the author(s) and contributors (if any) may not
+//     be used to endorse or promote products derived from this
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+// CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+// OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.  IN OTHER WORDS, USE AT YOUR OWN RISK, NOT OURS.  
+//--------------------------------------------------------------------
+
+#pragma once
+#include "waveform.h"
+#include "wavfile.h"
+#include <string>
+#include <vector>
+
+class LoudnessMeter;
+struct AnalysisTable;
+
+// One of the WAV files that make up a timeline.
+struct TimelinePart
+{
+    std::wstring m_filename;    // Name of the WAV file.
+    WAVInfo m_header;           // Format of the WAV file.
+    size_t m_start = 0;         // Position of the file's first sample on the timeline.
+};
+
+// Presents an ordered list of WAV files as a single timeline, with
+// each file's audio following straight on from the file before it.
+// Positions on the timeline are sample numbers counted from the
+// start of the first file, and can be mapped back to a file and a
+// sample within that file.
+//
+// The audio is read from the files a piece at a time as it's
+// needed, so the files never need to be joined together on disk or
+// held in memory all at once.
+class WAVTimeline
+{
+public:
+    // Reads the headers of the given WAV files, in order.  All of
+    // the files must have the same sample rate, number of channels
+    // and sample format.
+    // Returns true if successful.
+    bool Open(const std::vector<std::wstring> &filenames);
+
+    // Returns the total number of samples in all of the files.
+    size_t SampleCount() const;
+
+    // Returns the sample frequency of the files in Hertz.
+    unsigned Frequency() const { return m_parts.empty() ? 0 : m_parts[0].m_header.m_rate; }
+
+    // Finds which file a position on the timeline is in, and which
+    // sample of that file it is.
+    // Returns false if the position is past the end of the timeline.
+    bool Locate(size_t position, size_t &part, size_t &sample) const;
+
+    // Reads part of the timeline into a waveform, continuing from
+    // one file into the next as needed.  The channels are merged to
+    // mono.
+    // Returns true if successful.
+    template <typename SampleT>
+    bool Read(size_t start_sample, size_t num_samples, BasicWaveform<SampleT> &out);
+
+    // Fills in the table of statistics for each frame of the whole
+    // timeline (see AnalyzeAudioWaveform), reading and analyzing a
+    // block of audio at a time.  The next block is read on another
+    // thread while each block is analyzed, so the reading (including
+    // opening the next file) overlaps with the analysis.  If a
+    // loudness meter is given, it is reset and fed the audio too.
+    // Returns true if successful.
+    template <typename SampleT>
+    bool Analyze(AnalysisTable &table, LoudnessMeter *meter = nullptr);
+
+    // Fills in the part of the table of statistics for the
+    // 'num_samples' samples starting at 'first_sample', which must
+    // be at the start of a frame.  The table must already be Reset
+    // for the whole timeline.  Each frame's statistics only depend
+    // on its own samples, so a long timeline can be split into
+    // shards that are analyzed in parallel, each by its own
+    // WAVTimeline (with the same parts), and the table comes out
+    // the same as from Analyze.  If a loudness meter is given, it
+    // is fed the audio too, so it has to be fed every range in
+    // order; if the ranges start at multiples of FramesPerBlock
+    // frames, it's fed exactly the same way as by Analyze.
+    // Returns true if successful.
+    template <typename SampleT>
+    bool AnalyzeRange(size_t first_sample, size_t num_samples, AnalysisTable &table,
+        LoudnessMeter *meter = nullptr);
+
+    // Returns the number of frames that Analyze reads and analyzes
+    // at a time.
+    static size_t FramesPerBlock();
+
+    std::vector<TimelinePart> m_parts;  // The files, in order.
+
+private:
+    WAVFileReader m_reader;             // Reader for the file being read.
+    size_t m_reader_part = 0;           // Which file m_reader has open.
+    bool m_reader_open = false;         // Does m_reader have a file open?
+};
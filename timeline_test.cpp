@@ -0,0 +1,228 @@
+//-------------------------------------------------------------------
+//
+// timeline_test.cpp
+//
+// Simple test of the timeline.cpp module.  Splits a WAV file into
+// several part files, makes a timeline from the parts repeated a
+// few times, and confirms that the timeline gives the same samples,
+// analysis and segments as the same audio held in one waveform,
+// including when it's analyzed in separate shards.
+//
+//-------------------------------------------------------------------
+//
+// (C) Copyright 2024 Ammon R. Campbell.
+//
+// I wrote this code for use in my own educational and experimental
+// programs, but you may also freely use it in yours as long as you
+// abide by the following terms and conditions:
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above
+//     copyright notice, this list of conditions and the following
+//     disclaimer in the documentation and/or other materials
+//     provided with the distribution.
+//   * The name(s) of the author(s) and contributors (if any) may not
+//     be used to endorse or promote products derived from this
+//     software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+// CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+// OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+// BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+// USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.  IN OTHER WORDS, USE AT YOUR OWN RISK, NOT OURS.  
+//--------------------------------------------------------------------
+
+#include "waveform.h"
+#include "analysis.h"
+#include "loudness.h"
+#include "segment.h"
+#include "timeline.h"
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <math.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+// Number of times the parts are repeated in the timeline, so the
+// timeline is long enough to be analyzed in several blocks.
+static const unsigned k_repeats = 4;
+
+// Number of shards to analyze the timeline in.
+static const size_t k_shards = 3;
+
+// Returns the first frame (with the partial frame at the end
+// counting as the last) where two tables of statistics differ, or
+// the number of frames plus one if they're the same.
+static size_t first_different_frame(const AnalysisTable &a, const AnalysisTable &b)
+{
+    for (size_t iframe = 0; iframe <= b.m_frames.size(); iframe++)
+    {
+        bool remainder = (iframe == b.m_frames.size());
+        if (!remainder && iframe >= a.m_frames.size())
+            return iframe;
+        const FrameStats &x = remainder ? a.m_remainder : a.m_frames[iframe];
+        const FrameStats &y = remainder ? b.m_remainder : b.m_frames[iframe];
+        if (x.m_sum != y.m_sum || x.m_sum_squares != y.m_sum_squares ||
+            x.m_min != y.m_min || x.m_max != y.m_max || x.m_peak != y.m_peak)
+            return iframe;
+    }
+
+    return b.m_frames.size() + 1;
+}
+
+bool test_timeline(wchar_t *filename)
+{
+    printf("Starting timeline test with '%S'\n", filename);
+
+    WAVInfo header;
+    if (!WAVFileReadHeader(filename, header))
+    {
+        printf("WAVFileReadHeader failed reading '%S'\n", filename);
+        return false;
+    }
+    std::vector<char> raw(header.CalculateBufferSize());
+    if (!WAVFileReadSamples(filename, raw.data(), raw.size()))
+    {
+        printf("WAVFileReadSamples failed reading '%S'\n", filename);
+        return false;
+    }
+
+    // Split the file into three parts, at places that aren't on a
+    // frame boundary.
+    const size_t bytes_per_sample = header.m_channels * header.m_bits / 8;
+    const size_t splits[4] = { 0, header.m_sample_count / 3 + 17, header.m_sample_count * 2 / 3 + 5, header.m_sample_count };
+    const wchar_t *part_names[3] = { L"temp_part1.wav", L"temp_part2.wav", L"temp_part3.wav" };
+    std::vector<std::wstring> filenames;
+    bool ok = true;
+    for (unsigned ipart = 0; ipart < 3; ipart++)
+    {
+        WAVInfo part_header = header;
+        part_header.m_sample_count = static_cast<unsigned>(splits[ipart + 1] - splits[ipart]);
+        if (!WAVFileWrite(part_names[ipart], part_header, &raw[splits[ipart] * bytes_per_sample]))
+        {
+            printf("WAVFileWrite failed writing '%S'\n", part_names[ipart]);
+            ok = false;
+        }
+    }
+    for (unsigned irepeat = 0; irepeat < k_repeats; irepeat++)
+        filenames.insert(filenames.end(), part_names, part_names + 3);
+
+    // Make the same audio as one waveform.
+    Waveform whole, wav;
+    if (ok && !wav.LoadFromWAVFile(filename))
+    {
+        printf("LoadFromWAVFile failed reading '%S'\n", filename);
+        ok = false;
+    }
+    whole.m_frequency = wav.m_frequency;
+    for (unsigned irepeat = 0; irepeat < k_repeats; irepeat++)
+        whole.m_data.insert(whole.m_data.end(), wav.m_data.begin(), wav.m_data.end());
+
+    WAVTimeline timeline;
+    if (ok && (!timeline.Open(filenames) || timeline.SampleCount() != whole.m_data.size() ||
+        timeline.Frequency() != whole.m_frequency))
+    {
+        printf("Timeline has the wrong format!\n");
+        ok = false;
+    }
+
+    // Positions should map back to the right file and sample.
+    size_t part = 0, sample = 0;
+    if (ok && (!timeline.Locate(splits[1] - 1, part, sample) || part != 0 || sample != splits[1] - 1 ||
+        !timeline.Locate(header.m_sample_count + splits[2], part, sample) || part != 5 || sample != 0 ||
+        timeline.Locate(timeline.SampleCount(), part, sample)))
+    {
+        printf("Timeline positions don't map to the right files!\n");
+        ok = false;
+    }
+
+    // Reading across the boundaries between files should give the
+    // same samples as the whole waveform.
+    Waveform piece;
+    const size_t piece_start = splits[2] - 1000;
+    const size_t piece_count = header.m_sample_count + 2000;
+    if (ok && (!timeline.Read(piece_start, piece_count, piece) || piece.m_data.size() != piece_count ||
+        !std::equal(piece.m_data.begin(), piece.m_data.end(), whole.m_data.begin() + piece_start)))
+    {
+        printf("Samples read from the timeline don't match!\n");
+        ok = false;
+    }
+
+    // The analysis and segments should be the same too.
+    AnalysisTable timeline_table, whole_table;
+    LoudnessMeter timeline_meter, whole_meter;
+    if (ok && !timeline.Analyze<float>(timeline_table, &timeline_meter))
+    {
+        printf("Analyzing the timeline failed!\n");
+        ok = false;
+    }
+    whole_meter.Reset(whole.m_frequency);
+    AnalyzeAudioWaveform(whole, whole_table, &whole_meter);
+    size_t iframe = first_different_frame(timeline_table, whole_table);
+    if (ok && iframe <= whole_table.m_frames.size())
+    {
+        printf("Timeline analysis doesn't match at frame %zu!\n", iframe);
+        ok = false;
+    }
+
+    // Analyzing the timeline in shards, each with its own timeline
+    // of the same files, should give the same table.
+    AnalysisTable shard_table;
+    shard_table.Reset(timeline.Frequency(), timeline.SampleCount());
+    const size_t num_frames = shard_table.m_frames.size();
+    for (size_t ishard = 0; ok && ishard < k_shards; ishard++)
+    {
+        const size_t first = (num_frames * ishard / k_shards) * shard_table.m_samples_per_frame;
+        const size_t end = (ishard + 1 == k_shards) ? timeline.SampleCount() :
+            (num_frames * (ishard + 1) / k_shards) * shard_table.m_samples_per_frame;
+        WAVTimeline shard;
+        shard.m_parts = timeline.m_parts;
+        if (!shard.AnalyzeRange<float>(first, end - first, shard_table))
+        {
+            printf("Analyzing shard %zu of the timeline failed!\n", ishard + 1);
+            ok = false;
+        }
+    }
+    iframe = first_different_frame(shard_table, whole_table);
+    if (ok && iframe <= whole_table.m_frames.size())
+    {
+        printf("Sharded timeline analysis doesn't match at frame %zu!\n", iframe);
+        ok = false;
+    }
+
+    auto timeline_segments = FindSegmentsInAudioWaveform(timeline_table, &timeline_meter);
+    auto whole_segments = FindSegmentsInAudioWaveform(whole_table, &whole_meter);
+    if (ok && timeline_segments.size() != whole_segments.size())
+    {
+        printf("Timeline has a different number of segments!\n");
+        ok = false;
+    }
+    for (size_t iseg = 0; ok && iseg < whole_segments.size(); iseg++)
+    {
+        if (timeline_segments[iseg].m_start != whole_segments[iseg].m_start ||
+            timeline_segments[iseg].m_count != whole_segments[iseg].m_count ||
+            fabsf(timeline_segments[iseg].m_loudness - whole_segments[iseg].m_loudness) > 0.01f)
+        {
+            printf("Timeline segment %zu doesn't match!\n", iseg + 1);
+            ok = false;
+        }
+    }
+
+    for (const wchar_t *part_name : part_names)
+        _wunlink(part_name);
+    return ok;
+}
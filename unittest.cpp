@@ -53,7 +53,25 @@
 // Declare any test functions we will be calling from other test modules.
 extern bool test_wavfile_read_write(wchar_t *filename);
 extern bool test_normalize(wchar_t *filename);
+extern bool test_true_peak_limit(wchar_t *filename);
+extern bool test_gain_envelope(wchar_t *filename);
+extern bool test_analysis_during_load(wchar_t *filename);
+extern bool test_segmentation_pcm16(wchar_t *filename);
+extern bool test_segmentation_storage(wchar_t *filename);
+extern bool test_multichannel_mix(wchar_t *filename);
+extern bool test_timeline(wchar_t *filename);
 extern bool test_segmentation();
+extern bool test_loudness();
+extern bool test_analysis();
+extern bool test_track_analysis();
+extern bool test_resample();
+extern bool test_multichannel();
+extern bool test_jobs();
+extern bool test_queue();
+extern bool test_inputs();
+extern bool test_journal();
+extern bool test_cache();
+extern bool test_dedup();
 
 // Performs tests using the specified WAV file.
 static bool process_wav_file(wchar_t *filename)
@@ -68,6 +86,27 @@ static bool process_wav_file(wchar_t *filename)
     if (!test_normalize(filename))
         error_count++;
 
+    if (!test_true_peak_limit(filename))
+        error_count++;
+
+    if (!test_gain_envelope(filename))
+        error_count++;
+
+    if (!test_analysis_during_load(filename))
+        error_count++;
+
+    if (!test_segmentation_pcm16(filename))
+        error_count++;
+
+    if (!test_segmentation_storage(filename))
+        error_count++;
+
+    if (!test_multichannel_mix(filename))
+        error_count++;
+
+    if (!test_timeline(filename))
+        error_count++;
+
     printf("Done testing with '%S'\n", filename);
 
     return (error_count == 0);
@@ -95,6 +134,28 @@ int wmain(int argc, wchar_t **argv)
         // Run any tests that don't use the WAV files.
         if (!test_segmentation())
             error_count++;
+        if (!test_loudness())
+            error_count++;
+        if (!test_analysis())
+            error_count++;
+        if (!test_track_analysis())
+            error_count++;
+        if (!test_resample())
+            error_count++;
+        if (!test_multichannel())
+            error_count++;
+        if (!test_jobs())
+            error_count++;
+        if (!test_queue())
+            error_count++;
+        if (!test_inputs())
+            error_count++;
+        if (!test_journal())
+            error_count++;
+        if (!test_cache())
+            error_count++;
+        if (!test_dedup())
+            error_count++;
     }
     catch(...)
     {
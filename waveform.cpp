@@ -3,7 +3,9 @@
 // waveform.cpp
 //
 // Waveform container class.  Stores and manipulates a monophonic
-// floating-point PCM audio signal.
+// PCM audio signal, with the samples stored as 32-bit floating-
+// point, 16-bit integer, or 16-bit (half precision) floating-point
+// values.
 //
 //-------------------------------------------------------------------
 //
@@ -42,8 +44,44 @@
 //--------------------------------------------------------------------
 
 #include "waveform.h"
+#include "analysis.h"
+#include "loudness.h"
+#include "resample.h"
+#include <algorithm>
 
-double Waveform::DurationInSeconds() const
+void GainEnvelope::Add(size_t start_sample, float gain)
+{
+    Span span;
+    span.m_start = start_sample;
+    span.m_gain = gain;
+    m_spans.push_back(span);
+}
+
+// Calls 'func(gain, start, count)' for each run of samples in the
+// range 'start_sample' to 'end_sample' that has a constant gain in
+// the given envelope.
+template <typename Func>
+static void for_each_gain_span(const GainEnvelope &envelope, size_t start_sample, size_t end_sample, Func func)
+{
+    // Find the span that contains the first sample.
+    auto span = std::upper_bound(envelope.m_spans.begin(), envelope.m_spans.end(), start_sample,
+        [](size_t isample, const GainEnvelope::Span &s) { return isample < s.m_start; });
+
+    size_t isample = start_sample;
+    float gain = (span == envelope.m_spans.begin()) ? 1.0f : (span - 1)->m_gain;
+    while (isample < end_sample)
+    {
+        size_t span_end = (span == envelope.m_spans.end()) ? end_sample : std::min(span->m_start, end_sample);
+        if (span_end > isample)
+            func(gain, isample, span_end - isample);
+        isample = span_end;
+        if (span != envelope.m_spans.end())
+            gain = (span++)->m_gain;
+    }
+}
+
+template <typename SampleT>
+double BasicWaveform<SampleT>::DurationInSeconds() const
 {
     if (!m_frequency || m_data.empty())
         return 0.;
@@ -51,7 +89,8 @@ double Waveform::DurationInSeconds() const
     return static_cast<double>(m_data.size()) / m_frequency;
 }
 
-void Waveform::FindMinMaxSamples(float &smin, float &smax) const
+template <typename SampleT>
+void BasicWaveform<SampleT>::FindMinMaxSamples(float &smin, float &smax) const
 {
     if (m_data.empty())
     {
@@ -63,85 +102,215 @@ void Waveform::FindMinMaxSamples(float &smin, float &smax) const
     smax = -FLT_MAX;
     for (unsigned isample = 0; isample < m_data.size(); isample++)
     {
-        if (m_data[isample] < smin)
-            smin = m_data[isample];
-        if (m_data[isample] > smax)
-            smax = m_data[isample];
+        float sample = SampleToFloat(m_data[isample]);
+        if (sample < smin)
+            smin = sample;
+        if (sample > smax)
+            smax = sample;
     }
 }
 
-bool Waveform::LoadFromWAVFile(const wchar_t *filename)
+template <typename SampleT>
+void BasicWaveform<SampleT>::ApplyGainEnvelope(const GainEnvelope &envelope)
 {
-    WAVInfo header;
-    if (!WAVFileReadHeader(filename, header))
-        return false;
+    for_each_gain_span(envelope, 0, m_data.size(), [this](float gain, size_t start, size_t count)
+    {
+        SampleT *data = &m_data[start];
+        for (size_t isample = 0; isample < count; isample++)
+            SampleFromFloat(SampleToFloat(data[isample]) * gain, data[isample]);
+    });
+}
 
-    std::vector<char> raw(header.CalculateBufferSize());
-    if (!WAVFileReadSamples(filename, raw.data(), raw.size()))
-        return false;
+// Stand-in for a FrameAccumulator when we aren't analyzing the
+// samples while loading them, so the compiler can drop the work.
+struct NullAccumulator
+{
+    void Add(float) { }
+};
 
-    m_frequency = header.m_rate;
-    m_data.resize(header.m_sample_count);
+// Stores the statistics for a frame in the analysis table.
+static void store_frame_stats(const FrameAccumulator &acc, AnalysisTable *table, size_t iframe, bool partial)
+{
+    if (partial)
+        table->m_remainder = acc.Stats();
+    else
+        table->m_frames[iframe] = acc.Stats();
+}
+
+static void store_frame_stats(const NullAccumulator &, AnalysisTable *, size_t, bool)
+{
+}
 
-    // Convert data from the file's format to our internal format.
-    // If the data is stereo/multichannel it will also be flattened
-    // to mono.
+// Converts one frame of interleaved multichannel samples from a
+// WAV file to our internal sample format, merging the channels to
+// mono, and adds the stored samples to the accumulator.  Returns
+// the position of the next frame in the input.
+template <typename Accumulator, typename T, typename ToFloat, typename SampleT, typename Count>
+static const T *convert_frame(const T *in, unsigned channels, Count count, SampleT *out,
+    ToFloat to_float, Accumulator &acc)
+{
+    for (size_t isample = 0; isample < count; isample++)
+    {
+        float sample = 0.0;
+
+        for (unsigned channel = 0; channel < channels; ++channel)
+            sample += to_float(*in++);
+        sample /= channels;
+
+        SampleFromFloat(sample, out[isample]);
+        acc.Add(SampleToFloat(out[isample]));
+    }
+    return in;
+}
+
+// Converts interleaved multichannel samples from a WAV file to our
+// internal sample format, merging the channels to mono.
+// The 'to_float' function converts one sample value from the file.
+// If we're analyzing the samples (Accumulator is FrameAccumulator),
+// the statistics for each frame of the analysis table are
+// accumulated in the same loop as each sample is converted.  Each
+// frame is fed to the loudness meter (if any) while it's still in
+// the cache.  The statistics and the loudness are taken from the
+// stored samples, so they match the waveform exactly.  The full
+// frames are converted with the frame size given as a FixedFrameSize
+// where possible, the same as the analysis code does.
+template <typename Accumulator, typename T, typename ToFloat, typename SampleT, typename FrameSize>
+static void convert_to_mono(const T *in, unsigned channels, size_t num_samples, SampleT *out,
+    ToFloat to_float, FrameSize frame_size, AnalysisTable *table, LoudnessMeter *meter)
+{
+    const size_t num_frames = num_samples / frame_size;
+    std::vector<float> buffer;
+    for (size_t iframe = 0; iframe < num_frames; iframe++)
+    {
+        SampleT *frame = &out[iframe * frame_size];
+        Accumulator acc;
+        in = convert_frame(in, channels, frame_size, frame, to_float, acc);
+        store_frame_stats(acc, table, iframe, false);
+        if (meter)
+            meter->Process(SamplesAsFloat(frame, frame_size, buffer), frame_size);
+    }
+
+    // Convert the partial frame at the end, if any.
+    const size_t count = num_samples - num_frames * frame_size;
+    if (count)
+    {
+        SampleT *frame = &out[num_frames * frame_size];
+        Accumulator acc;
+        convert_frame(in, channels, count, frame, to_float, acc);
+        store_frame_stats(acc, table, num_frames, true);
+        if (meter)
+            meter->Process(SamplesAsFloat(frame, count, buffer), count);
+    }
+}
+
+// Converts the samples with or without analyzing them, depending
+// on whether an analysis table was given.
+template <typename T, typename ToFloat, typename SampleT>
+static void convert_to_mono(const T *in, unsigned channels, size_t num_samples, SampleT *out,
+    ToFloat to_float, AnalysisTable *table, LoudnessMeter *meter)
+{
+    if (table)
+    {
+        WithFrameSize(table->m_samples_per_frame, [&](auto frame_size)
+        {
+            convert_to_mono<FrameAccumulator>(in, channels, num_samples, out, to_float, frame_size, table, meter);
+        });
+    }
+    else
+    {
+        const size_t frame_size = 4096;
+        convert_to_mono<NullAccumulator>(in, channels, num_samples, out, to_float, frame_size, table, meter);
+    }
+}
+
+// Converts samples from a WAV file's format to our internal
+// format.  If the data is stereo/multichannel it will also be
+// flattened to mono.
+template <typename SampleT>
+static void convert_wav_samples(const void *raw, const WAVInfo &header, size_t num_samples, SampleT *out,
+    AnalysisTable *table, LoudnessMeter *meter)
+{
     if (header.m_is_float && header.m_bits == 32)
     {
         // Data is already floating-point, just merge the channels to mono.
         // cppcheck-suppress invalidPointerCast
-        const float *in = reinterpret_cast<const float *>(raw.data());
-        float *out = reinterpret_cast<float *>(m_data.data());
-        for (size_t isample = 0; isample < header.m_sample_count; isample++)
-        {
-            float sample = 0.0;
-
-            for (unsigned channel = 0; channel < header.m_channels; ++channel)
-                sample += *in++;
-            sample /= header.m_channels;
-
-            *out++ = sample;
-        }
+        const float *in = reinterpret_cast<const float *>(raw);
+        convert_to_mono(in, header.m_channels, num_samples, out,
+            [](float sample) { return sample; }, table, meter);
     }
     else if (header.m_bits == 16)
     {
         // Convert 16-bit integer PCM to floating-point, and merge to mono.
-        const int16_t *in = reinterpret_cast<const int16_t *>(raw.data());
-        float *out = reinterpret_cast<float *>(m_data.data());
-        for (size_t isample = 0; isample < header.m_sample_count; isample++)
-        {
-            float sample = 0.0;
-
-            for (unsigned channel = 0; channel < header.m_channels; ++channel)
-                sample += (*in++) / 32768.f;
-
-            sample /= header.m_channels;
-            *out++ = sample;
-        }
+        const int16_t *in = reinterpret_cast<const int16_t *>(raw);
+        convert_to_mono(in, header.m_channels, num_samples, out,
+            [](int16_t sample) { return sample / 32768.f; }, table, meter);
     }
     else if (header.m_bits == 8)
     {
         // Convert 8-bit unsigned integer PCM to floating-point, and merge to mono.
-        const uint8_t *in = reinterpret_cast<const uint8_t *>(raw.data());
-        float *out = reinterpret_cast<float *>(m_data.data());
-        for (size_t isample = 0; isample < header.m_sample_count; isample++)
-        {
-            float sample = 0.0;
+        const uint8_t *in = reinterpret_cast<const uint8_t *>(raw);
+        convert_to_mono(in, header.m_channels, num_samples, out,
+            [](uint8_t sample) { return (sample - 128.f) / 128.f; }, table, meter);
+    }
+}
 
-            for (unsigned channel = 0; channel < header.m_channels; ++channel)
-                sample += ((*in++) - 128.f) / 128.f;
+template <typename SampleT>
+bool BasicWaveform<SampleT>::LoadFromWAVFile(const wchar_t *filename, AnalysisTable *table, LoudnessMeter *meter)
+{
+    WAVInfo header;
+    if (!WAVFileReadHeader(filename, header))
+        return false;
 
-            sample /= header.m_channels;
-            *out++ = sample;
-        }
-    }
+    std::vector<char> raw(header.CalculateBufferSize());
+    if (!WAVFileReadSamples(filename, raw.data(), raw.size()))
+        return false;
 
+    LoadFromWAVData(raw.data(), header, table, meter);
     return true;
 }
 
-bool Waveform::WriteToWAVFile(const wchar_t *filename, unsigned start_sample, unsigned num_samples) const
+template <typename SampleT>
+void BasicWaveform<SampleT>::LoadFromWAVData(const void *samples, const WAVInfo &header,
+    AnalysisTable *table, LoudnessMeter *meter)
+{
+    m_frequency = header.m_rate;
+    m_data.resize(header.m_sample_count);
+    if (table)
+        table->Reset(header.m_rate, header.m_sample_count);
+    if (meter)
+        meter->Reset(header.m_rate);
+
+    convert_wav_samples(samples, header, header.m_sample_count, m_data.data(), table, meter);
+}
+
+template <typename SampleT>
+void BasicWaveform<SampleT>::AppendWAVSamples(const void *samples, const WAVInfo &header, size_t num_samples)
 {
-    if (!filename || m_data.empty())
+    const size_t first = m_data.size();
+    m_data.resize(first + num_samples);
+    convert_wav_samples(samples, header, num_samples, m_data.data() + first, nullptr, nullptr);
+}
+
+template <typename SampleT>
+bool BasicWaveform<SampleT>::WriteToWAVFile(const wchar_t *filename, unsigned start_sample, unsigned num_samples,
+    const GainEnvelope *envelope, unsigned frequency) const
+{
+    if (!filename)
+        return false;
+
+    std::vector<int16_t> samples;
+    WAVInfo header;
+    if (!ConvertToPCM16(samples, header, start_sample, num_samples, envelope, frequency))
+        return false;
+
+    return WAVFileWrite(filename, header, samples.data());
+}
+
+template <typename SampleT>
+bool BasicWaveform<SampleT>::ConvertToPCM16(std::vector<int16_t> &samples, WAVInfo &header, unsigned start_sample,
+    unsigned num_samples, const GainEnvelope *envelope, unsigned frequency) const
+{
+    if (m_data.empty())
         return false;
     if (start_sample >= m_data.size())
         return false;
@@ -150,18 +319,62 @@ bool Waveform::WriteToWAVFile(const wchar_t *filename, unsigned start_sample, un
     if (start_sample + num_samples > m_data.size())
         return false;
 
-    // Convert the samples from floating-point to 16-bit PCM.
-    std::vector<int16_t> samples(num_samples);
-    for (size_t isample = 0; isample < num_samples; isample++)
-        samples[isample] = static_cast<int16_t>(m_data[start_sample + isample] * 32768);
+    // Convert the samples from our internal format to 16-bit PCM,
+    // applying the gain envelope (if any) along the way.
+    samples.assign(num_samples, 0);
+    if (frequency && frequency != m_frequency)
+    {
+        // Apply the gain, resample, then convert the resampled
+        // samples.  The resampler's filter can overshoot a little,
+        // so the samples are clipped as they're converted.
+        std::vector<float> buffer(num_samples);
+        GainEnvelope no_gain;
+        for_each_gain_span(envelope ? *envelope : no_gain, start_sample, start_sample + num_samples,
+            [&](float gain, size_t start, size_t count)
+        {
+            const SampleT *in = &m_data[start];
+            float *out = &buffer[start - start_sample];
+            for (size_t isample = 0; isample < count; isample++)
+                out[isample] = SampleToFloat(in[isample]) * gain;
+        });
+
+        std::vector<float> resampled;
+        Resampler resampler(m_frequency, frequency);
+        resampler.Process(buffer.data(), buffer.size(), resampled);
+        resampler.Flush(resampled);
 
-    // Fill in the header and write the file.
-    WAVInfo header;
-    header.m_rate = m_frequency;
+        num_samples = static_cast<unsigned>(resampled.size());
+        samples.resize(num_samples);
+        for (size_t isample = 0; isample < num_samples; isample++)
+            SampleFromFloat(resampled[isample], samples[isample]);
+    }
+    else if (envelope)
+    {
+        for_each_gain_span(*envelope, start_sample, start_sample + num_samples,
+            [&](float gain, size_t start, size_t count)
+        {
+            const SampleT *in = &m_data[start];
+            int16_t *out = &samples[start - start_sample];
+            for (size_t isample = 0; isample < count; isample++)
+                out[isample] = static_cast<int16_t>(SampleToFloat(in[isample]) * gain * 32768);
+        });
+    }
+    else
+    {
+        for (size_t isample = 0; isample < num_samples; isample++)
+            samples[isample] = static_cast<int16_t>(SampleToFloat(m_data[start_sample + isample]) * 32768);
+    }
+
+    // Fill in the header for the file.
+    header.m_rate = frequency ? frequency : m_frequency;
     header.m_channels = 1;
     header.m_bits = 16;
     header.m_is_float = false;
     header.m_sample_count = num_samples;
-    return WAVFileWrite(filename, header, samples.data());
+    return true;
 }
 
+// The sample types that waveforms can be stored as.
+template class BasicWaveform<float>;
+template class BasicWaveform<int16_t>;
+template class BasicWaveform<Half>;
@@ -3,7 +3,9 @@
 // waveform.h
 //
 // Waveform container class.  Stores and manipulates a monophonic
-// floating-point PCM audio signal.
+// PCM audio signal, with the samples stored as 32-bit floating-
+// point, 16-bit integer, or 16-bit (half precision) floating-point
+// values.
 //
 //-------------------------------------------------------------------
 //
@@ -43,17 +45,171 @@
 
 #pragma once
 #include "wavfile.h"
+#include <stdint.h>
+#include <string.h>
 #include <vector>
 
+struct AnalysisTable;
+class LoudnessMeter;
+
+// A compact description of the gain to apply to each part of a
+// waveform, such as the gain calculated by normalization.  The
+// gain is constant over each span of samples, from the span's
+// starting sample to the start of the next span.  Spans are stored
+// in order of their starting sample.  Samples before the first span
+// have a gain of 1.0.
+struct GainEnvelope
+{
+    struct Span
+    {
+        size_t m_start = 0;     // Which sample does this span start on.
+        float m_gain = 1.0f;    // Gain multiplier for this span.
+    };
+
+    // Adds a new span to the end of the envelope.
+    void Add(size_t start_sample, float gain);
+
+    std::vector<Span> m_spans;
+};
+
+// A 16-bit (half precision) IEEE floating-point sample value.  It
+// has about 11 bits of precision, which is plenty for speech, and
+// takes half the memory of a 32-bit float.  There's no arithmetic
+// on it; it's only converted to and from float.
+struct Half
+{
+    uint16_t m_bits = 0;
+};
+
+// Functions to convert each type of sample value to and from a
+// floating-point value between -1.0 and +1.0.  These are inline so
+// that the code working on each type of waveform gets the right
+// conversion built into its inner loops.
+
+inline float SampleToFloat(float sample)
+{
+    return sample;
+}
+
+inline float SampleToFloat(int16_t sample)
+{
+    return sample / 32768.f;
+}
+
+inline float SampleToFloat(Half sample)
+{
+    // Move the exponent and mantissa into place, then fix up the
+    // exponent for infinities and denormals.
+    const uint32_t shifted_exp = 0x7c00 << 13;
+    uint32_t bits = (sample.m_bits & 0x7fff) << 13;
+    uint32_t exp = bits & shifted_exp;
+    bits += (127 - 15) << 23;
+    float value;
+    if (exp == shifted_exp)
+    {
+        bits += (128 - 16) << 23;
+        memcpy(&value, &bits, sizeof(value));
+    }
+    else if (exp == 0)
+    {
+        bits += 1 << 23;
+        memcpy(&value, &bits, sizeof(value));
+        value -= 6.10351563e-05f; // 2^-14
+    }
+    else
+    {
+        memcpy(&value, &bits, sizeof(value));
+    }
+    return (sample.m_bits & 0x8000) ? -value : value;
+}
+
+inline void SampleFromFloat(float value, float &sample)
+{
+    sample = value;
+}
+
+inline void SampleFromFloat(float value, int16_t &sample)
+{
+    // Values are truncated the same way they are when writing a
+    // floating-point waveform to a 16-bit WAV file.
+    float scaled = value * 32768;
+    if (scaled >= 32767.f)
+        sample = 32767;
+    else if (scaled <= -32768.f)
+        sample = -32768;
+    else
+        sample = static_cast<int16_t>(scaled);
+}
+
+inline void SampleFromFloat(float value, Half &sample)
+{
+    // Rounds to the nearest half precision value, with ties going
+    // to the even value.
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    const uint16_t sign = static_cast<uint16_t>((bits >> 16) & 0x8000);
+    bits &= 0x7fffffff;
+
+    uint16_t result;
+    if (bits >= 0x47800000)
+    {
+        // Too big (or infinity or NaN).
+        result = (bits > 0x7f800000) ? 0x7e00 : 0x7c00;
+    }
+    else if (bits < 0x38800000)
+    {
+        // Denormal or zero.  Adding 0.5 lines the bits up so the
+        // floating-point unit does the rounding for us.
+        float magnitude;
+        memcpy(&magnitude, &bits, sizeof(magnitude));
+        magnitude += 0.5f;
+        memcpy(&bits, &magnitude, sizeof(bits));
+        result = static_cast<uint16_t>(bits - 0x3f000000);
+    }
+    else
+    {
+        // Normal number.  Rebias the exponent and round.
+        uint32_t mant_odd = (bits >> 13) & 1;
+        bits += (static_cast<uint32_t>(15 - 127) << 23) + 0xfff + mant_odd;
+        result = static_cast<uint16_t>(bits >> 13);
+    }
+    sample.m_bits = sign | result;
+}
+
+// Returns a pointer to 'count' samples as floating-point values.
+// Floating-point samples are used as they are; other types are
+// converted into the given buffer.
+inline const float *SamplesAsFloat(const float *samples, size_t, std::vector<float> &)
+{
+    return samples;
+}
+
+template <typename SampleT>
+inline const float *SamplesAsFloat(const SampleT *samples, size_t count, std::vector<float> &buffer)
+{
+    if (buffer.size() < count)
+        buffer.resize(count);
+    for (size_t isample = 0; isample < count; isample++)
+        buffer[isample] = SampleToFloat(samples[isample]);
+    return buffer.data();
+}
+
 // Container class for a single-channel PCM audio waveform.
-// Internally we store the audio as an array of floating-point
-// sample values between -1.0 and +1.0.  The caller may access
-// these data values directly through the m_data member.
-class Waveform
+// Internally we store the audio as an array of samples of type
+// SampleT, which represent values between -1.0 and +1.0.  The
+// caller may access these data values directly through the m_data
+// member (see SampleToFloat and SampleFromFloat).
+//
+// Storing the samples as int16_t or Half instead of float takes
+// half as much memory, which matters for long recordings.  The
+// code that works on waveforms is compiled separately for each
+// type, so there's no extra work in the inner loops.
+template <typename SampleT>
+class BasicWaveform
 {
 public:
-    Waveform() = default;
-    ~Waveform() = default;
+    BasicWaveform() = default;
+    ~BasicWaveform() = default;
 
     // Returns the duration of the waveform in seconds.
     double DurationInSeconds() const;
@@ -61,18 +217,57 @@ public:
     // Finds the lowest and highest sample values in the waveform.
     void FindMinMaxSamples(float &smin, float &smax) const;
 
+    // Multiplies the samples by the gain from a gain envelope.
+    void ApplyGainEnvelope(const GainEnvelope &envelope);
+
     // Loads this waveform object with the PCM audio from a WAV file.
+    // The samples are converted from the file's format to SampleT.
+    // If an analysis table is given, it is filled in as the samples
+    // are converted (the same as calling AnalyzeAudioWaveform, but
+    // without another pass over the samples).  If a loudness meter
+    // is given, it is reset and fed the samples the same way.
     // Returns true if successful.
-    bool LoadFromWAVFile(const wchar_t *filename);
+    bool LoadFromWAVFile(const wchar_t *filename, AnalysisTable *table = nullptr, LoudnessMeter *meter = nullptr);
+
+    // Loads this waveform object with PCM audio that has already
+    // been read from a WAV file into memory (with WAVFileReadHeader
+    // and WAVFileReadSamples), the same way as LoadFromWAVFile.
+    void LoadFromWAVData(const void *samples, const WAVInfo &header,
+        AnalysisTable *table = nullptr, LoudnessMeter *meter = nullptr);
+
+    // Appends samples that were read from a WAV file (for example,
+    // with WAVFileReader) to the end of this waveform.  The samples
+    // are converted from the format given by 'header' to SampleT,
+    // and the channels are merged to mono.
+    void AppendWAVSamples(const void *samples, const WAVInfo &header, size_t num_samples);
 
     // Writes the PCM audio waveform to a WAV file on disk.
     // A specific subset of the waveform can be written to the
     // file by using the 'start_sample' and 'num_samples'
     // parameters.
+    // If a gain envelope is given, the gain is applied to the
+    // samples as they are converted to the file's format, so the
+    // waveform itself is left as it is.
+    // If a frequency is given, the samples are resampled to that
+    // frequency as they are written (see resample.cpp).
     // Returns false if the file could not be written.
-    bool WriteToWAVFile(const wchar_t *filename, unsigned start_sample = 0, unsigned num_samples = 0) const;
+    bool WriteToWAVFile(const wchar_t *filename, unsigned start_sample = 0, unsigned num_samples = 0,
+        const GainEnvelope *envelope = nullptr, unsigned frequency = 0) const;
+
+    // Converts part of the waveform to the 16-bit PCM samples and
+    // header that WriteToWAVFile would write, without writing them,
+    // so the file can be written later (for example, by another
+    // thread with WAVFileWrite).  The parameters are the same as
+    // for WriteToWAVFile.
+    // Returns false if the part of the waveform isn't valid.
+    bool ConvertToPCM16(std::vector<int16_t> &samples, WAVInfo &header, unsigned start_sample = 0,
+        unsigned num_samples = 0, const GainEnvelope *envelope = nullptr, unsigned frequency = 0) const;
 
     unsigned m_frequency = 48000;   // Sample frequency in Hertz.
-    std::vector<float> m_data;      // Buffer of audio samples.
+    std::vector<SampleT> m_data;    // Buffer of audio samples.
 };
 
+typedef BasicWaveform<float> Waveform;          // 32-bit floating-point samples.
+typedef BasicWaveform<int16_t> Waveform16;      // 16-bit integer samples.
+typedef BasicWaveform<Half> WaveformHalf;       // 16-bit floating-point samples.
+
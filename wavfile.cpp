@@ -48,6 +48,13 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdint.h>
+#include <wchar.h>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
 
 // Handy class to auto-close a stdio FILE when it goes out of scope.
 class ScopedFile
@@ -66,7 +73,8 @@ private:
 // The file format header found within a WAV file.
 typedef struct
 {
-    // Encoding: 1 = integer PCM data; 3 = floating-point PCM data.
+    // Encoding: 1 = integer PCM data; 3 = floating-point PCM data;
+    // 0xFFFE = extended format header.
     unsigned short int    wFmtTag;
 
     // Number of channels: 1 = mono; 2 = stereo.
@@ -129,12 +137,27 @@ static bool read_and_confirm_format_header(FILE *fp, WAVFHDR &hdr)
     if (fread(&hdr, 1, sizeof(hdr), fp) != sizeof(hdr))
         return false; // Read error.
 
+    // Files with more than two channels usually have an extended
+    // format header, which gives the real encoding in the first two
+    // bytes of its 'sub-format' field.  The sub-format follows the
+    // extension size (2 bytes), valid bits (2 bytes), and channel
+    // mask (4 bytes).
+    if (hdr.wFmtTag == 0xFFFE)
+    {
+        unsigned short int ext[5] = {0};
+        if (hdr_size < sizeof(WAVFHDR) + sizeof(ext))
+            return false; // Invalid header size.
+        if (fread(ext, 1, sizeof(ext), fp) != sizeof(ext))
+            return false; // Read error.
+        hdr.wFmtTag = ext[4];
+    }
+
     // Check that the contents of the header are acceptable.
     if (hdr.nBits != 8 && hdr.nBits != 16 && hdr.nBits != 32)
         return false; // Unsupported format.
     if (hdr.wFmtTag != 1 && hdr.wFmtTag != 3)
         return false; // Unsupported format.
-    if (hdr.nChannels < 1 || hdr.nChannels > 5)
+    if (hdr.nChannels < 1 || hdr.nChannels > 8)
         return false; // Unsupported format.
 
     // Seek past the header to the next chunk.
@@ -178,6 +201,17 @@ static bool read_and_confirm_data_header(FILE *fp, uint32_t &datasize)
     return true;
 }
 
+// Saves the few pieces of info we'll need about the audio format
+// from the WAV file's format header.
+static void fill_in_header(const WAVFHDR &hdr, uint32_t datasize, WAVInfo &header)
+{
+    header.m_rate         = hdr.Rate;
+    header.m_channels     = hdr.nChannels;
+    header.m_bits         = hdr.nBits;
+    header.m_is_float     = (hdr.wFmtTag == 3);
+    header.m_sample_count = datasize / hdr.nChannels / (hdr.nBits / 8);
+}
+
 // Reads the header portion of a WAV file.  Among other things, the
 // information from the header can be used to determine how large
 // of a sample buffer will be needed to read the audio data from the
@@ -207,13 +241,7 @@ bool WAVFileReadHeader(const wchar_t *filename, WAVInfo &header)
     if (!read_and_confirm_data_header(fp, datasize))
         return false; // Data chunk not found or unreadable.
 
-    // Save a few pieces of info we'll need about the audio format.
-    header.m_rate         = hdr.Rate;
-    header.m_channels     = hdr.nChannels;
-    header.m_bits         = hdr.nBits;
-    header.m_is_float     = (hdr.wFmtTag == 3);
-    header.m_sample_count = datasize / hdr.nChannels / (hdr.nBits / 8);
-
+    fill_in_header(hdr, datasize, header);
     return true;
 }
 
@@ -256,14 +284,18 @@ bool WAVFileReadSamples(const wchar_t *filename, void *sample_buffer, size_t buf
 // The given header specifies the format of the data in the buffer.
 //
 // Returns true if successful.
-bool WAVFileWrite(const wchar_t *filename, const WAVInfo &header, const void *samples)
+bool WAVFileWrite(const wchar_t *filename, const WAVInfo &header, const void *samples, bool sync)
 {
     if (!filename || !*filename || !samples || !header.m_sample_count)
         return false; // Bad parameter.
     if (header.m_bits != 8 && header.m_bits != 16 && header.m_bits != 32)
         return false;
 
-    // Open the WAV file for writing.
+    // Open the WAV file for writing.  An existing file is deleted
+    // first instead of being written over, in case it's a hard link
+    // to a file in the result cache (see cache.h), which has to keep
+    // its old contents.
+    _wunlink(filename);
     FILE *fp = nullptr;
     if (_wfopen_s(&fp, filename, L"w+b") || !fp)
         return false;
@@ -305,6 +337,75 @@ bool WAVFileWrite(const wchar_t *filename, const WAVInfo &header, const void *sa
     if (fwrite(samples, 1, data_size, fp) != data_size)
         return false;
 
+    if (sync)
+    {
+        if (fflush(fp) != 0)
+            return false;
+#ifdef _WIN32
+        if (_commit(_fileno(fp)) != 0)
+            return false;
+#else
+        if (fsync(fileno(fp)) != 0)
+            return false;
+#endif
+    }
+
     return true;
 }
 
+bool WAVFileReader::Open(const wchar_t *filename)
+{
+    Close();
+
+    if (!filename || !*filename)
+        return false; // Empty filename.
+
+    // Open the WAV file for reading.
+    if (_wfopen_s(&m_fp, filename, L"rb") || !m_fp)
+    {
+        m_fp = nullptr;
+        return false; // Can't open the file.
+    }
+
+    // Read and check the various headers in the WAV file.
+    WAVFHDR hdr = {0};
+    uint32_t datasize = 0;
+    if (!read_and_confirm_wav_signature(m_fp) ||
+        !read_and_confirm_format_header(m_fp, hdr) ||
+        !read_and_confirm_data_header(m_fp, datasize))
+    {
+        Close();
+        return false; // Not a WAV file we can read.
+    }
+
+    fill_in_header(hdr, datasize, m_header);
+    m_data_start = _ftelli64(m_fp);
+    return true;
+}
+
+void WAVFileReader::Close()
+{
+    if (m_fp)
+        fclose(m_fp);
+    m_fp = nullptr;
+    m_header = WAVInfo();
+}
+
+bool WAVFileReader::Seek(size_t sample)
+{
+    if (!m_fp || sample > m_header.m_sample_count)
+        return false;
+
+    // Part files can be 2 GB or more, so we need a 64-bit seek.
+    const long long bytes_per_sample = m_header.m_channels * m_header.m_bits / 8;
+    return _fseeki64(m_fp, m_data_start + static_cast<long long>(sample) * bytes_per_sample, SEEK_SET) == 0;
+}
+
+bool WAVFileReader::Read(void *sample_buffer, size_t num_samples)
+{
+    if (!m_fp || !sample_buffer)
+        return false; // Bad parameter.
+
+    const size_t num_bytes = num_samples * m_header.m_channels * m_header.m_bits / 8;
+    return fread(sample_buffer, 1, num_bytes, m_fp) == num_bytes;
+}
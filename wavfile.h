@@ -58,6 +58,7 @@
 
 #pragma once
 #include <stddef.h>
+#include <stdio.h>
 
 // Describes the format of the audio data from a Microsoft WAV file.
 struct WAVInfo
@@ -89,7 +90,49 @@ bool WAVFileReadSamples(const wchar_t *filename, void *sample_buffer, size_t buf
 
 // Writes a buffer of audio samples to a WAV file.
 // The given header specifies the format of the data in the buffer.
+// A file that's already there is replaced with a new file, so any
+// other names that are hard linked to it keep the old contents.
+// If 'sync' is true, the file is flushed all the way to the disk
+// before this returns, so it's kept even if the machine goes down.
 //
 // Returns true if successful.
-bool WAVFileWrite(const wchar_t *filename, const WAVInfo &header, const void *samples);
+bool WAVFileWrite(const wchar_t *filename, const WAVInfo &header, const void *samples, bool sync = false);
 
+// Reads the audio samples from a WAV file a piece at a time, so a
+// long recording doesn't need to be held in memory all at once.
+// The file is kept open until the reader is closed or destroyed.
+class WAVFileReader
+{
+public:
+    WAVFileReader() = default;
+    ~WAVFileReader() { Close(); }
+    WAVFileReader(const WAVFileReader &) = delete;
+    WAVFileReader &operator=(const WAVFileReader &) = delete;
+
+    // Opens a WAV file and reads its header.  The reader is left at
+    // the first sample.
+    // Returns true if successful.
+    bool Open(const wchar_t *filename);
+
+    // Closes the WAV file (if it's open).
+    void Close();
+
+    // Returns the format of the open WAV file.
+    const WAVInfo &Header() const { return m_header; }
+
+    // Moves the reader to the given sample (counting each sample of
+    // a multichannel file once for all of its channels).
+    // Returns true if successful.
+    bool Seek(size_t sample);
+
+    // Reads the next 'num_samples' samples (again counting all of
+    // the channels together) into the provided buffer, in the file's
+    // format.  The buffer must be big enough to hold them.
+    // Returns true if successful.
+    bool Read(void *sample_buffer, size_t num_samples);
+
+private:
+    FILE *m_fp = nullptr;           // The open WAV file.
+    long long m_data_start = 0;     // File offset of the first sample.
+    WAVInfo m_header;               // Format of the WAV file.
+};